@@ -0,0 +1,76 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "esp_err.h"
+
+// each channel reads the voltage the simulated plant puts on its pin; see simplant.h
+typedef enum
+{
+    ADC_UNIT_1 = 1,
+    ADC_UNIT_2 = 2,
+} adc_unit_t;
+typedef enum
+{
+    ADC1_CHANNEL_0 = 0,
+    ADC1_CHANNEL_1,
+    ADC1_CHANNEL_2,
+    ADC1_CHANNEL_3,
+    ADC1_CHANNEL_4,
+    ADC1_CHANNEL_5,
+    ADC1_CHANNEL_6,
+    ADC1_CHANNEL_7,
+    ADC1_CHANNEL_MAX,
+} adc1_channel_t;
+typedef enum
+{
+    ADC2_CHANNEL_0 = 0,
+    ADC2_CHANNEL_1,
+    ADC2_CHANNEL_2,
+    ADC2_CHANNEL_3,
+    ADC2_CHANNEL_4,
+    ADC2_CHANNEL_5,
+    ADC2_CHANNEL_6,
+    ADC2_CHANNEL_7,
+    ADC2_CHANNEL_8,
+    ADC2_CHANNEL_9,
+    ADC2_CHANNEL_MAX,
+} adc2_channel_t;
+typedef enum
+{
+    ADC_ATTEN_DB_0 = 0,
+    ADC_ATTEN_DB_2_5,
+    ADC_ATTEN_DB_6,
+    ADC_ATTEN_DB_11,
+    ADC_ATTEN_MAX,
+} adc_atten_t;
+typedef enum
+{
+    ADC_WIDTH_BIT_9 = 0,
+    ADC_WIDTH_BIT_10,
+    ADC_WIDTH_BIT_11,
+    ADC_WIDTH_BIT_12,
+    ADC_WIDTH_MAX,
+} adc_bits_width_t;
+#define ADC_ATTEN_11db ADC_ATTEN_DB_11
+#define ADC_WIDTH_12Bit ADC_WIDTH_BIT_12
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+int adc1_get_raw(adc1_channel_t channel);
+esp_err_t adc2_config_channel_atten(adc2_channel_t channel, adc_atten_t atten);
+esp_err_t adc2_get_raw(adc2_channel_t channel, adc_bits_width_t width_bit, int *raw_out);
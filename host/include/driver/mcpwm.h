@@ -0,0 +1,72 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+// the servo is not modelled; calls only succeed
+typedef enum
+{
+    MCPWM_UNIT_0 = 0,
+    MCPWM_UNIT_1,
+    MCPWM_UNIT_MAX,
+} mcpwm_unit_t;
+typedef enum
+{
+    MCPWM_TIMER_0 = 0,
+    MCPWM_TIMER_1,
+    MCPWM_TIMER_2,
+    MCPWM_TIMER_MAX,
+} mcpwm_timer_t;
+typedef enum
+{
+    MCPWM_OPR_A = 0,
+    MCPWM_OPR_B,
+    MCPWM_OPR_MAX,
+} mcpwm_generator_t;
+typedef mcpwm_generator_t mcpwm_operator_t;
+typedef enum
+{
+    MCPWM0A = 0,
+    MCPWM0B,
+} mcpwm_io_signals_t;
+typedef enum
+{
+    MCPWM_FREQ_COUNTER = 0,
+    MCPWM_UP_COUNTER,
+} mcpwm_counter_type_t;
+typedef enum
+{
+    MCPWM_DUTY_MODE_0 = 0,
+    MCPWM_DUTY_MODE_1,
+} mcpwm_duty_type_t;
+
+typedef struct
+{
+    uint32_t frequency;
+    float cmpr_a;
+    float cmpr_b;
+    mcpwm_duty_type_t duty_mode;
+    mcpwm_counter_type_t counter_mode;
+} mcpwm_config_t;
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t mcpwm_num, mcpwm_io_signals_t io_signal, int gpio_num);
+esp_err_t mcpwm_init(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, const mcpwm_config_t *mcpwm_conf);
+esp_err_t mcpwm_set_duty_in_us(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_generator_t gen, uint32_t duty_in_us);
+esp_err_t mcpwm_start(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num);
+esp_err_t mcpwm_stop(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num);
@@ -0,0 +1,82 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// timer group alarms fire in ISR context at the virtual time the counter would reach them
+#define APB_CLK_FREQ (80 * 1000000)
+
+typedef enum
+{
+    TIMER_GROUP_0 = 0,
+    TIMER_GROUP_1 = 1,
+    TIMER_GROUP_MAX,
+} timer_group_t;
+typedef enum
+{
+    TIMER_0 = 0,
+    TIMER_1 = 1,
+    TIMER_MAX,
+} timer_idx_t;
+typedef enum
+{
+    TIMER_PAUSE = 0,
+    TIMER_START = 1,
+} timer_start_t;
+typedef enum
+{
+    TIMER_ALARM_DIS = 0,
+    TIMER_ALARM_EN = 1,
+} timer_alarm_t;
+typedef enum
+{
+    TIMER_INTR_LEVEL = 0,
+} timer_intr_mode_t;
+typedef enum
+{
+    TIMER_COUNT_DOWN = 0,
+    TIMER_COUNT_UP = 1,
+} timer_count_dir_t;
+typedef enum
+{
+    TIMER_AUTORELOAD_DIS = 0,
+    TIMER_AUTORELOAD_EN = 1,
+} timer_autoreload_t;
+
+typedef struct
+{
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    timer_autoreload_t auto_reload;
+    uint32_t divider;
+} timer_config_t;
+
+typedef bool (*timer_isr_t)(void *arg);
+
+esp_err_t timer_init(timer_group_t group_num, timer_idx_t timer_num, const timer_config_t *config);
+esp_err_t timer_set_counter_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t load_val);
+esp_err_t timer_set_alarm_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t alarm_value);
+esp_err_t timer_set_alarm(timer_group_t group_num, timer_idx_t timer_num, timer_alarm_t alarm_en);
+esp_err_t timer_enable_intr(timer_group_t group_num, timer_idx_t timer_num);
+esp_err_t timer_isr_callback_add(timer_group_t group_num, timer_idx_t timer_num, timer_isr_t isr_handler, void *arg, int intr_alloc_flags);
+esp_err_t timer_start(timer_group_t group_num, timer_idx_t timer_num);
+esp_err_t timer_pause(timer_group_t group_num, timer_idx_t timer_num);
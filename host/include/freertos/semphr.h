@@ -0,0 +1,32 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "freertos/queue.h"
+
+// as in FreeRTOS, a semaphore is a queue of zero-size items; mutexes do not inherit priority here
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+#define xSemaphoreTake(semaphore, ticks_to_wait) xQueueReceive((semaphore), NULL, (ticks_to_wait))
+#define xSemaphoreTakeFromISR(semaphore, woken) xQueueReceiveFromISR((semaphore), NULL, (woken))
+#define xSemaphoreGive(semaphore) xQueueSendToBack((semaphore), NULL, 0)
+#define xSemaphoreGiveFromISR(semaphore, woken) xQueueSendToBackFromISR((semaphore), NULL, (woken))
+#define uxSemaphoreGetCount(semaphore) uxQueueMessagesWaiting(semaphore)
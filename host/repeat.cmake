@@ -0,0 +1,14 @@
+# Runs a simulator twice and fails unless both runs print the same thing.
+#   cmake -DSIM=<executable> -DARGS=<args> -P repeat.cmake
+# Lines starting "host:" report wall-clock time, so they are left out of the comparison.
+separate_arguments(ARGS)
+foreach(run first second)
+    execute_process(COMMAND ${SIM} ${ARGS} OUTPUT_VARIABLE ${run} RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${SIM} exited with ${result}")
+    endif()
+    string(REGEX REPLACE "host:[^\n]*\n" "" ${run} "${${run}}")
+endforeach()
+if(NOT first STREQUAL second)
+    message(FATAL_ERROR "two runs of ${SIM} ${ARGS} printed different output")
+endif()
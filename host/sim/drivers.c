@@ -0,0 +1,617 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "kernel.h"
+#include "driver/adc.h"
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "driver/ledc.h"
+#include "driver/mcpwm.h"
+#include "driver/timer.h"
+#include "esp_adc_cal.h"
+#include "bootloader_random.h"
+#include "simplant.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t _ls_host_gpio_levels;
+static uint64_t _ls_host_gpio_written;
+// inputs the plant drives, and their levels
+static uint64_t _ls_host_gpio_driven;
+static uint64_t _ls_host_gpio_driven_levels;
+
+/**
+ * Each pin's interrupt is an alarm set for the moment its input changes, so the handler runs
+ * as an ISR once whatever changed it (often the stepper ISR moving the arm) has returned.
+ */
+typedef struct
+{
+    ls_host_alarm_t alarm; // first, so the alarm callback can find its pin
+    bool registered;
+    gpio_int_type_t intr_type;
+    gpio_isr_t handler;
+    void *args;
+} _ls_host_gpio_interrupt_t;
+
+static _ls_host_gpio_interrupt_t _ls_host_gpio_interrupts[GPIO_NUM_MAX];
+
+static void _ls_host_gpio_alarm(ls_host_alarm_t *alarm)
+{
+    _ls_host_gpio_interrupt_t *interrupt = (_ls_host_gpio_interrupt_t *)alarm;
+    ls_host_lock();
+    gpio_isr_t handler = interrupt->handler;
+    void *args = interrupt->args;
+    ls_host_unlock();
+    if (NULL != handler)
+    {
+        handler(args);
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    for (gpio_num_t gpio_num = 0; gpio_num < GPIO_NUM_MAX; gpio_num++)
+    {
+        if (config->pin_bit_mask & (1ULL << gpio_num))
+        {
+            _ls_host_gpio_interrupts[gpio_num].intr_type = config->intr_type;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint64_t mask = 1ULL << gpio_num;
+    bool changed = !(_ls_host_gpio_written & mask) || !!(_ls_host_gpio_levels & mask) != !!level;
+    _ls_host_gpio_written |= mask;
+    _ls_host_gpio_levels = level ? _ls_host_gpio_levels | mask : _ls_host_gpio_levels & ~mask;
+    if (changed)
+    {
+        ls_simplant_gpio_output(gpio_num, level);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return 0;
+    }
+    uint64_t mask = 1ULL << gpio_num;
+    if (_ls_host_gpio_driven & mask)
+    {
+        return !!(_ls_host_gpio_driven_levels & mask);
+    }
+    return (_ls_host_gpio_written & mask) ? !!(_ls_host_gpio_levels & mask) : 1;
+}
+
+void ls_host_gpio_drive(gpio_num_t gpio_num, int level)
+{
+    uint64_t mask = 1ULL << gpio_num;
+    int was = gpio_get_level(gpio_num);
+    _ls_host_gpio_driven |= mask;
+    _ls_host_gpio_driven_levels = level ? _ls_host_gpio_driven_levels | mask : _ls_host_gpio_driven_levels & ~mask;
+    level = !!level;
+    _ls_host_gpio_interrupt_t *interrupt = &_ls_host_gpio_interrupts[gpio_num];
+    bool fires = false;
+    switch (interrupt->intr_type)
+    {
+    case GPIO_INTR_POSEDGE:
+        fires = level && !was;
+        break;
+    case GPIO_INTR_NEGEDGE:
+        fires = !level && was;
+        break;
+    case GPIO_INTR_ANYEDGE:
+        fires = level != was;
+        break;
+    case GPIO_INTR_HIGH_LEVEL:
+        fires = level;
+        break;
+    case GPIO_INTR_LOW_LEVEL:
+        fires = !level;
+        break;
+    default:
+        break;
+    }
+    if (!fires || NULL == interrupt->handler)
+    {
+        return;
+    }
+    ls_host_lock();
+    if (!interrupt->registered)
+    {
+        ls_host_alarm_register(&interrupt->alarm, _ls_host_gpio_alarm);
+        interrupt->registered = true;
+    }
+    ls_host_alarm_arm(&interrupt->alarm, ls_host_now_us());
+    ls_host_unlock();
+}
+
+uint32_t ls_host_gpio_reg_read(uint32_t reg)
+{
+    uint64_t outputs = _ls_host_gpio_levels & _ls_host_gpio_written;
+    return GPIO_OUT1_REG == reg ? (uint32_t)(outputs >> 32) : (uint32_t)outputs;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _ls_host_gpio_interrupts[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ls_host_lock();
+    _ls_host_gpio_interrupts[gpio_num].handler = isr_handler;
+    _ls_host_gpio_interrupts[gpio_num].args = args;
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    return gpio_isr_handler_add(gpio_num, NULL, NULL);
+}
+
+/**
+ * A timer group counter runs at APB_CLK_FREQ / divider. It is not stored; it is worked out
+ * from the nanosecond it last had a known value, so alarms land where the counter would
+ * reach them even when the ISR moves the alarm every period, as the stepper's does.
+ */
+typedef struct
+{
+    ls_host_alarm_t alarm; // first, so the alarm callback can find its timer
+    bool registered;
+    uint32_t divider;
+    bool auto_reload;
+    bool alarm_enabled;
+    bool running;
+    uint64_t alarm_value;
+    uint64_t base_counter;
+    int64_t base_ns;
+    int64_t due_ns;
+    timer_isr_t isr;
+    void *arg;
+} _ls_host_timer_t;
+
+static _ls_host_timer_t _ls_host_timers[TIMER_GROUP_MAX][TIMER_MAX];
+
+// twice the count period in ns, so the 12.5 ns per count at divider 1 stays an integer
+static int64_t _ls_host_timer_ns_per_count_x2(const _ls_host_timer_t *timer)
+{
+    return (int64_t)timer->divider * 2000000000LL / APB_CLK_FREQ;
+}
+
+static void _ls_host_timer_schedule(_ls_host_timer_t *timer)
+{
+    if (!timer->running || !timer->alarm_enabled || NULL == timer->isr || timer->alarm_value < timer->base_counter)
+    {
+        ls_host_alarm_disarm(&timer->alarm);
+        return;
+    }
+    int64_t now_ns = ls_host_now_us() * 1000;
+    timer->due_ns = timer->base_ns + (int64_t)(timer->alarm_value - timer->base_counter) * _ls_host_timer_ns_per_count_x2(timer) / 2;
+    if (timer->due_ns < now_ns)
+    {
+        timer->due_ns = now_ns;
+    }
+    ls_host_alarm_arm(&timer->alarm, (timer->due_ns + 999) / 1000);
+}
+
+static uint64_t _ls_host_timer_counter(const _ls_host_timer_t *timer)
+{
+    if (!timer->running)
+    {
+        return timer->base_counter;
+    }
+    int64_t elapsed_ns = ls_host_now_us() * 1000 - timer->base_ns;
+    return timer->base_counter + (uint64_t)(elapsed_ns * 2 / _ls_host_timer_ns_per_count_x2(timer));
+}
+
+static void _ls_host_timer_alarm(ls_host_alarm_t *alarm)
+{
+    _ls_host_timer_t *timer = (_ls_host_timer_t *)alarm;
+    ls_host_lock();
+    timer->base_ns = timer->due_ns;
+    timer->base_counter = timer->auto_reload ? 0 : timer->alarm_value;
+    if (timer->auto_reload)
+    {
+        _ls_host_timer_schedule(timer);
+    }
+    else
+    {
+        timer->alarm_enabled = false; // as on the chip, the alarm must be re-enabled
+    }
+    timer_isr_t isr = timer->isr;
+    void *arg = timer->arg;
+    ls_host_unlock();
+    isr(arg);
+}
+
+esp_err_t timer_init(timer_group_t group_num, timer_idx_t timer_num, const timer_config_t *config)
+{
+    if (group_num >= TIMER_GROUP_MAX || timer_num >= TIMER_MAX || config->divider < 2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    if (!timer->registered)
+    {
+        ls_host_alarm_register(&timer->alarm, _ls_host_timer_alarm);
+        timer->registered = true;
+    }
+    timer->divider = config->divider;
+    timer->auto_reload = TIMER_AUTORELOAD_EN == config->auto_reload;
+    timer->alarm_enabled = TIMER_ALARM_EN == config->alarm_en;
+    timer->running = TIMER_START == config->counter_en;
+    timer->base_counter = 0;
+    timer->base_ns = ls_host_now_us() * 1000;
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t load_val)
+{
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    timer->base_counter = load_val;
+    timer->base_ns = ls_host_now_us() * 1000;
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t alarm_value)
+{
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    timer->alarm_value = alarm_value;
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm(timer_group_t group_num, timer_idx_t timer_num, timer_alarm_t alarm_en)
+{
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    timer->alarm_enabled = TIMER_ALARM_EN == alarm_en;
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t timer_enable_intr(timer_group_t group_num, timer_idx_t timer_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t timer_isr_callback_add(timer_group_t group_num, timer_idx_t timer_num, timer_isr_t isr_handler, void *arg, int intr_alloc_flags)
+{
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    timer->isr = isr_handler;
+    timer->arg = arg;
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t timer_start(timer_group_t group_num, timer_idx_t timer_num)
+{
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    if (!timer->running)
+    {
+        timer->running = true;
+        timer->base_ns = ls_host_now_us() * 1000;
+    }
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t timer_pause(timer_group_t group_num, timer_idx_t timer_num)
+{
+    _ls_host_timer_t *timer = &_ls_host_timers[group_num][timer_num];
+    ls_host_lock();
+    timer->base_counter = _ls_host_timer_counter(timer);
+    timer->running = false;
+    _ls_host_timer_schedule(timer);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten)
+{
+    return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel)
+{
+    return ls_simplant_adc1_raw(channel);
+}
+
+esp_err_t adc2_config_channel_atten(adc2_channel_t channel, adc_atten_t atten)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc2_get_raw(adc2_channel_t channel, adc_bits_width_t width_bit, int *raw_out)
+{
+    *raw_out = ls_simplant_adc2_raw(channel);
+    return ESP_OK;
+}
+
+esp_err_t esp_adc_cal_check_efuse(esp_adc_cal_value_t value_type)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width, uint32_t default_vref, esp_adc_cal_characteristics_t *chars)
+{
+    chars->adc_num = adc_num;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    // ESP-IDF's linear fit for the default vref at 11 dB; the small lookup-table correction is left out
+    chars->coeff_a = default_vref * 196602 / 4095;
+    chars->coeff_b = 142;
+    chars->low_curve = NULL;
+    chars->high_curve = NULL;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t *chars)
+{
+    return (uint32_t)(((uint64_t)chars->coeff_a * adc_reading + 32768) / 65536) + chars->coeff_b;
+}
+
+void bootloader_random_enable(void)
+{
+}
+
+void bootloader_random_disable(void)
+{
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t speed_mode, ledc_timer_t timer_num, uint32_t freq_hz)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t mcpwm_num, mcpwm_io_signals_t io_signal, int gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_init(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, const mcpwm_config_t *mcpwm_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_set_duty_in_us(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_generator_t gen, uint32_t duty_in_us)
+{
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_start(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_stop(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num)
+{
+    return ESP_OK;
+}
+
+/**
+ * A command link records one transaction for the plant: the address byte after the first
+ * start, the bytes written after it, and where a read after a repeated start lands. Only
+ * the I2C service task builds links, one at a time, so a single link will do.
+ */
+typedef struct
+{
+    bool expect_address;
+    bool addressed;
+    uint8_t address;
+    uint8_t written[32];
+    size_t written_length;
+    uint8_t *read;
+    size_t read_length;
+} _ls_host_i2c_link_t;
+
+static _ls_host_i2c_link_t _ls_host_i2c_link;
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    memset(&_ls_host_i2c_link, 0, sizeof(_ls_host_i2c_link));
+    return &_ls_host_i2c_link;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    return i2c_cmd_link_create();
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle)
+{
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    _ls_host_i2c_link_t *link = cmd_handle;
+    link->expect_address = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    _ls_host_i2c_link_t *link = cmd_handle;
+    if (link->expect_address)
+    {
+        // the repeated start before a read names the same device
+        link->expect_address = false;
+        link->addressed = true;
+        link->address = data >> 1;
+        return ESP_OK;
+    }
+    if (link->written_length >= sizeof(link->written))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    link->written[link->written_length++] = data;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    for (size_t i = 0; i < data_len; i++)
+    {
+        esp_err_t result = i2c_master_write_byte(cmd_handle, data[i], ack_en);
+        if (ESP_OK != result)
+        {
+            return result;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    return i2c_master_read(cmd_handle, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack)
+{
+    _ls_host_i2c_link_t *link = cmd_handle;
+    link->read = data;
+    link->read_length = data_len;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    _ls_host_i2c_link_t *link = cmd_handle;
+    if (!link->addressed)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // a NACK on the address byte comes back as ESP_FAIL
+    return ls_simplant_i2c_transfer(link->address, link->written, link->written_length, link->read, link->read_length);
+}
@@ -0,0 +1,166 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "kernel.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+
+// the alarm comes first so the alarm callback can find its timer
+struct esp_timer
+{
+    ls_host_alarm_t alarm;
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t period_us; // 0 for one-shot
+    bool pending;       // alarm fired, callback not yet dispatched
+    uint64_t pending_order;
+    struct esp_timer *next;
+};
+
+static struct esp_timer *_ls_host_esp_timers; // also what the dispatch task blocks on
+static uint64_t _ls_host_esp_timer_order;
+static TaskHandle_t _ls_host_esp_timer_task;
+
+int64_t esp_timer_get_time(void)
+{
+    return ls_host_now_us();
+}
+
+static void _ls_host_esp_timer_alarm(ls_host_alarm_t *alarm)
+{
+    struct esp_timer *timer = (struct esp_timer *)alarm;
+    ls_host_lock();
+    timer->pending = true;
+    timer->pending_order = ++_ls_host_esp_timer_order;
+    if (timer->period_us)
+    {
+        ls_host_alarm_arm(&timer->alarm, timer->alarm.due_us + timer->period_us);
+    }
+    ls_host_wake(&_ls_host_esp_timers);
+    ls_host_unlock();
+}
+
+/**
+ * @brief stands in for ESP-IDF's esp_timer task: callbacks run one at a time, in the order their alarms fired
+ */
+static void _ls_host_esp_timer_dispatch(void *parameter)
+{
+    ls_host_lock();
+    while (1)
+    {
+        struct esp_timer *next = NULL;
+        for (struct esp_timer *timer = _ls_host_esp_timers; timer; timer = timer->next)
+        {
+            if (timer->pending && (NULL == next || timer->pending_order < next->pending_order))
+            {
+                next = timer;
+            }
+        }
+        if (NULL == next)
+        {
+            ls_host_block(&_ls_host_esp_timers, LS_HOST_FOREVER);
+            continue;
+        }
+        next->pending = false;
+        ls_host_unlock();
+        next->callback(next->arg);
+        ls_host_lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (NULL == create_args || NULL == create_args->callback || NULL == out_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    ls_host_lock();
+    ls_host_alarm_register(&timer->alarm, _ls_host_esp_timer_alarm);
+    timer->next = _ls_host_esp_timers;
+    _ls_host_esp_timers = timer;
+    if (NULL == _ls_host_esp_timer_task)
+    {
+        _ls_host_esp_timer_task = ls_host_task_create(_ls_host_esp_timer_dispatch, "esp_timer", NULL, 22);
+        ls_host_preempt_check();
+    }
+    ls_host_unlock();
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t _ls_host_esp_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    ls_host_lock();
+    if (timer->alarm.armed || timer->pending)
+    {
+        ls_host_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = period_us;
+    ls_host_alarm_arm(&timer->alarm, ls_host_now_us() + timeout_us);
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return _ls_host_esp_timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (0 == period_us)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return _ls_host_esp_timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    ls_host_lock();
+    if (!timer->alarm.armed && !timer->pending)
+    {
+        ls_host_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    ls_host_alarm_disarm(&timer->alarm);
+    timer->pending = false;
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    ls_host_lock();
+    if (timer->alarm.armed || timer->pending)
+    {
+        ls_host_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    // stays registered with the kernel, disarmed; the firmware never deletes a timer
+    ls_host_unlock();
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->alarm.armed || timer->pending;
+}
@@ -0,0 +1,355 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "kernel.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include <stdlib.h>
+#include <string.h>
+
+// receivers block on the queue itself, senders on its storage
+struct ls_host_queue
+{
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct ls_host_queue *queue = calloc(1, sizeof(struct ls_host_queue));
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items = calloc(length ? length : 1, item_size ? item_size : 1);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+static void _ls_host_queue_put(QueueHandle_t queue, const void *item, bool to_front)
+{
+    UBaseType_t slot;
+    if (to_front)
+    {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    }
+    else
+    {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    if (queue->item_size && item)
+    {
+        memcpy(queue->items + slot * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+}
+
+static void _ls_host_queue_get(QueueHandle_t queue, void *item, bool remove)
+{
+    if (queue->item_size && item)
+    {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    if (remove)
+    {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+}
+
+static BaseType_t _ls_host_queue_send(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait, bool to_front)
+{
+    ls_host_lock();
+    int64_t wake_us = ls_host_ticks_from_now_us(ticks_to_wait);
+    while (queue->count >= queue->length)
+    {
+        if (!ls_host_block(queue->items, wake_us))
+        {
+            ls_host_unlock();
+            return errQUEUE_FULL;
+        }
+    }
+    _ls_host_queue_put(queue, item, to_front);
+    ls_host_wake(queue);
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return pdPASS;
+}
+
+static BaseType_t _ls_host_queue_send_from_isr(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken, bool to_front)
+{
+    ls_host_lock();
+    if (queue->count >= queue->length)
+    {
+        ls_host_unlock();
+        return errQUEUE_FULL;
+    }
+    _ls_host_queue_put(queue, item, to_front);
+    TaskHandle_t woken = ls_host_wake(queue);
+    if (higher_priority_task_woken && ls_host_woken_outranks_current(woken))
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    ls_host_unlock();
+    return pdPASS;
+}
+
+static BaseType_t _ls_host_queue_receive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait, bool remove)
+{
+    ls_host_lock();
+    int64_t wake_us = ls_host_ticks_from_now_us(ticks_to_wait);
+    while (0 == queue->count)
+    {
+        if (!ls_host_block(queue, wake_us))
+        {
+            ls_host_unlock();
+            return errQUEUE_EMPTY;
+        }
+    }
+    _ls_host_queue_get(queue, item, remove);
+    if (remove)
+    {
+        ls_host_wake(queue->items);
+    }
+    else
+    {
+        ls_host_wake(queue); // a peek leaves the item for the next waiting receiver
+    }
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    return _ls_host_queue_send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    return _ls_host_queue_send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken)
+{
+    return _ls_host_queue_send_from_isr(queue, item, higher_priority_task_woken, false);
+}
+
+BaseType_t xQueueSendToFrontFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken)
+{
+    return _ls_host_queue_send_from_isr(queue, item, higher_priority_task_woken, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    ls_host_lock();
+    queue->count = 0;
+    queue->head = 0;
+    _ls_host_queue_put(queue, item, false);
+    ls_host_wake(queue);
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    return _ls_host_queue_receive(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    return _ls_host_queue_receive(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void *item, BaseType_t *higher_priority_task_woken)
+{
+    ls_host_lock();
+    if (0 == queue->count)
+    {
+        ls_host_unlock();
+        return errQUEUE_EMPTY;
+    }
+    _ls_host_queue_get(queue, item, true);
+    TaskHandle_t woken = ls_host_wake(queue->items);
+    if (higher_priority_task_woken && ls_host_woken_outranks_current(woken))
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    ls_host_unlock();
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    ls_host_lock();
+    queue->count = 0;
+    queue->head = 0;
+    ls_host_wake(queue->items);
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t semaphore = xQueueCreate(max_count, 0);
+    semaphore->count = initial_count;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+struct ls_host_soft_timer
+{
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    int64_t expiry_us;
+    uint64_t order; // timers expiring on the same tick run in the order they were started
+    struct ls_host_soft_timer *next;
+};
+
+static struct ls_host_soft_timer *_ls_host_soft_timers; // also what the service task blocks on
+static uint64_t _ls_host_soft_timer_order;
+static TaskHandle_t _ls_host_timer_task;
+
+/**
+ * @brief the FreeRTOS timer service task, at ESP-IDF's default priority of 1
+ */
+static void _ls_host_timer_service(void *parameter)
+{
+    ls_host_lock();
+    while (1)
+    {
+        struct ls_host_soft_timer *due = NULL;
+        for (struct ls_host_soft_timer *timer = _ls_host_soft_timers; timer; timer = timer->next)
+        {
+            if (timer->active && (NULL == due || timer->expiry_us < due->expiry_us ||
+                                  (timer->expiry_us == due->expiry_us && timer->order < due->order)))
+            {
+                due = timer;
+            }
+        }
+        if (due && due->expiry_us <= ls_host_now_us())
+        {
+            if (due->auto_reload)
+            {
+                due->expiry_us += (int64_t)due->period * LS_HOST_TICK_US;
+            }
+            else
+            {
+                due->active = false;
+            }
+            ls_host_unlock();
+            due->callback(due);
+            ls_host_lock();
+            continue;
+        }
+        ls_host_block(&_ls_host_soft_timers, due ? due->expiry_us : LS_HOST_FOREVER);
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id, TimerCallbackFunction_t callback)
+{
+    struct ls_host_soft_timer *timer = calloc(1, sizeof(struct ls_host_soft_timer));
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = id;
+    timer->callback = callback;
+    ls_host_lock();
+    timer->next = _ls_host_soft_timers;
+    _ls_host_soft_timers = timer;
+    if (NULL == _ls_host_timer_task)
+    {
+        _ls_host_timer_task = ls_host_task_create(_ls_host_timer_service, "Tmr Svc", NULL, 1);
+        ls_host_preempt_check();
+    }
+    ls_host_unlock();
+    return timer;
+}
+
+static BaseType_t _ls_host_timer_command(TimerHandle_t timer, bool active)
+{
+    ls_host_lock();
+    timer->active = active;
+    timer->expiry_us = ls_host_ticks_from_now_us(timer->period);
+    timer->order = ++_ls_host_soft_timer_order;
+    ls_host_wake(&_ls_host_soft_timers);
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return pdPASS;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return _ls_host_timer_command(timer, true);
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return _ls_host_timer_command(timer, true);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return _ls_host_timer_command(timer, false);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait)
+{
+    timer->period = period;
+    return _ls_host_timer_command(timer, true);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
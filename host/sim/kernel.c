@@ -0,0 +1,596 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "kernel.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum _ls_host_task_state_t
+{
+    _LS_HOST_TASK_READY, // includes the running task
+    _LS_HOST_TASK_BLOCKED,
+    _LS_HOST_TASK_DELETED,
+};
+
+struct ls_host_task
+{
+    pthread_t thread;
+    pthread_cond_t turn; // signalled when this task is chosen to run
+    char *name;
+    UBaseType_t priority;
+    TaskFunction_t function;
+    void *parameter;
+    enum _ls_host_task_state_t state;
+    uint64_t ready_order; // equal priorities run in the order they became ready
+    const void *blocked_on;
+    uint64_t blocked_order; // equal priorities are woken in the order they blocked
+    int64_t wake_us;
+    bool woken;
+    uint32_t notify_value;
+    bool notify_pending;
+    struct ls_host_task *next;
+};
+
+static pthread_mutex_t _ls_host_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ls_host_task *_ls_host_tasks; // in creation order, so ties resolve the same way every run
+static struct ls_host_task *_ls_host_running;
+static ls_host_alarm_t *_ls_host_alarms;
+static int64_t _ls_host_now_us;
+static bool _ls_host_isr;
+static uint64_t _ls_host_order;
+static int64_t _ls_host_run_limit_us;
+static void (*_ls_host_run_limit_report)(void);
+static void (*_ls_host_app_main)(void);
+static const char _ls_host_delayed = 0; // what vTaskDelay blocks on; never woken
+
+// a task that loops without ever blocking would stop virtual time; catch it rather than hang
+#define _LS_HOST_CALLS_PER_INSTANT_MAX 20000000
+static uint32_t _ls_host_calls_at_now;
+
+void ls_host_lock(void)
+{
+    pthread_mutex_lock(&_ls_host_mutex);
+    if (++_ls_host_calls_at_now > _LS_HOST_CALLS_PER_INSTANT_MAX)
+    {
+        fprintf(stderr, "host: virtual time stuck at %lld us; task %s is spinning without blocking\n",
+                (long long)_ls_host_now_us, _ls_host_running ? _ls_host_running->name : "(none)");
+        abort();
+    }
+}
+
+void ls_host_unlock(void)
+{
+    pthread_mutex_unlock(&_ls_host_mutex);
+}
+
+int64_t ls_host_now_us(void)
+{
+    return _ls_host_now_us;
+}
+
+int64_t ls_host_ticks_from_now_us(TickType_t ticks)
+{
+    if (portMAX_DELAY == ticks)
+    {
+        return LS_HOST_FOREVER;
+    }
+    return (_ls_host_now_us / LS_HOST_TICK_US + ticks) * LS_HOST_TICK_US;
+}
+
+bool ls_host_in_isr(void)
+{
+    return _ls_host_isr;
+}
+
+void ls_host_alarm_register(ls_host_alarm_t *alarm, void (*fire)(ls_host_alarm_t *alarm))
+{
+    alarm->fire = fire;
+    alarm->armed = false;
+    alarm->next_registered = _ls_host_alarms;
+    _ls_host_alarms = alarm;
+}
+
+void ls_host_alarm_arm(ls_host_alarm_t *alarm, int64_t due_us)
+{
+    alarm->due_us = due_us < _ls_host_now_us ? _ls_host_now_us : due_us;
+    alarm->order = ++_ls_host_order;
+    alarm->armed = true;
+}
+
+void ls_host_alarm_disarm(ls_host_alarm_t *alarm)
+{
+    alarm->armed = false;
+}
+
+static void _ls_host_make_ready(struct ls_host_task *task)
+{
+    task->state = _LS_HOST_TASK_READY;
+    task->ready_order = ++_ls_host_order;
+}
+
+static struct ls_host_task *_ls_host_highest_ready(void)
+{
+    struct ls_host_task *best = NULL;
+    for (struct ls_host_task *task = _ls_host_tasks; task; task = task->next)
+    {
+        if (_LS_HOST_TASK_READY == task->state &&
+            (NULL == best || task->priority > best->priority ||
+             (task->priority == best->priority && task->ready_order < best->ready_order)))
+        {
+            best = task;
+        }
+    }
+    return best;
+}
+
+static void _ls_host_report_blocked(void)
+{
+    fprintf(stderr, "host: every task is blocked with nothing scheduled at %lld us:\n", (long long)_ls_host_now_us);
+    for (struct ls_host_task *task = _ls_host_tasks; task; task = task->next)
+    {
+        fprintf(stderr, "host:   %s (priority %u)\n", task->name, task->priority);
+    }
+}
+
+/**
+ * @brief Nothing can run: advance virtual time to the next alarm or timeout and deliver it.
+ * Interrupts go first, as the tick interrupt would be one of them.
+ */
+static void _ls_host_idle(void)
+{
+    int64_t next_us = LS_HOST_FOREVER;
+    for (struct ls_host_task *task = _ls_host_tasks; task; task = task->next)
+    {
+        if (_LS_HOST_TASK_BLOCKED == task->state && task->wake_us < next_us)
+        {
+            next_us = task->wake_us;
+        }
+    }
+    for (ls_host_alarm_t *alarm = _ls_host_alarms; alarm; alarm = alarm->next_registered)
+    {
+        if (alarm->armed && alarm->due_us < next_us)
+        {
+            next_us = alarm->due_us;
+        }
+    }
+    if (LS_HOST_FOREVER == next_us)
+    {
+        _ls_host_report_blocked();
+        exit(EXIT_FAILURE);
+    }
+    if (_ls_host_run_limit_us > 0 && next_us > _ls_host_run_limit_us)
+    {
+        _ls_host_now_us = _ls_host_run_limit_us;
+        ls_host_unlock();
+        if (_ls_host_run_limit_report)
+        {
+            _ls_host_run_limit_report();
+        }
+        exit(EXIT_SUCCESS);
+    }
+    if (next_us > _ls_host_now_us)
+    {
+        _ls_host_now_us = next_us;
+        _ls_host_calls_at_now = 0;
+    }
+    while (1)
+    {
+        ls_host_alarm_t *due = NULL;
+        for (ls_host_alarm_t *alarm = _ls_host_alarms; alarm; alarm = alarm->next_registered)
+        {
+            if (alarm->armed && alarm->due_us <= _ls_host_now_us && (NULL == due || alarm->order < due->order))
+            {
+                due = alarm;
+            }
+        }
+        if (NULL == due)
+        {
+            break;
+        }
+        due->armed = false;
+        _ls_host_isr = true;
+        ls_host_unlock();
+        due->fire(due);
+        ls_host_lock();
+        _ls_host_isr = false;
+    }
+    for (struct ls_host_task *task = _ls_host_tasks; task; task = task->next)
+    {
+        if (_LS_HOST_TASK_BLOCKED == task->state && task->wake_us <= _ls_host_now_us)
+        {
+            _ls_host_make_ready(task);
+        }
+    }
+}
+
+static void _ls_host_task_exit(struct ls_host_task *self) __attribute__((noreturn));
+static void _ls_host_task_exit(struct ls_host_task *self)
+{
+    ls_host_unlock();
+    pthread_cond_destroy(&self->turn);
+    free(self->name);
+    free(self);
+    pthread_exit(NULL);
+}
+
+static void _ls_host_wait_for_turn(struct ls_host_task *self)
+{
+    while (_ls_host_running != self)
+    {
+        pthread_cond_wait(&self->turn, &_ls_host_mutex);
+        if (_LS_HOST_TASK_DELETED == self->state)
+        {
+            _ls_host_task_exit(self);
+        }
+    }
+}
+
+/**
+ * @brief Hand the CPU to the highest-priority ready task, idling until there is one.
+ * Returns when the calling task is chosen again, or at once if it was deleted.
+ */
+static void _ls_host_reschedule(void)
+{
+    struct ls_host_task *self = _ls_host_running;
+    struct ls_host_task *next;
+    while (NULL == (next = _ls_host_highest_ready()))
+    {
+        _ls_host_idle();
+    }
+    if (next == self)
+    {
+        return;
+    }
+    _ls_host_running = next;
+    pthread_cond_signal(&next->turn);
+    if (_LS_HOST_TASK_DELETED != self->state)
+    {
+        _ls_host_wait_for_turn(self);
+    }
+}
+
+bool ls_host_block(const void *object, int64_t wake_us)
+{
+    if (wake_us <= _ls_host_now_us)
+    {
+        return false;
+    }
+    struct ls_host_task *self = _ls_host_running;
+    if (_ls_host_isr)
+    {
+        fprintf(stderr, "host: blocking call from an ISR while %s was idle\n", self->name);
+        abort();
+    }
+    self->state = _LS_HOST_TASK_BLOCKED;
+    self->blocked_on = object;
+    self->blocked_order = ++_ls_host_order;
+    self->wake_us = wake_us;
+    self->woken = false;
+    _ls_host_reschedule();
+    self->blocked_on = NULL;
+    return self->woken;
+}
+
+TaskHandle_t ls_host_wake(const void *object)
+{
+    struct ls_host_task *best = NULL;
+    for (struct ls_host_task *task = _ls_host_tasks; task; task = task->next)
+    {
+        if (_LS_HOST_TASK_BLOCKED == task->state && object == task->blocked_on &&
+            (NULL == best || task->priority > best->priority ||
+             (task->priority == best->priority && task->blocked_order < best->blocked_order)))
+        {
+            best = task;
+        }
+    }
+    if (best)
+    {
+        best->woken = true;
+        _ls_host_make_ready(best);
+    }
+    return best;
+}
+
+void ls_host_preempt_check(void)
+{
+    if (_ls_host_isr)
+    {
+        return;
+    }
+    struct ls_host_task *next = _ls_host_highest_ready();
+    if (next && next->priority > _ls_host_running->priority)
+    {
+        _ls_host_reschedule();
+    }
+}
+
+bool ls_host_woken_outranks_current(TaskHandle_t woken)
+{
+    // an ISR only ever interrupts the idle task here
+    return woken && (_ls_host_isr || woken->priority > _ls_host_running->priority);
+}
+
+static void *_ls_host_task_entry(void *arg)
+{
+    struct ls_host_task *self = arg;
+    ls_host_lock();
+    _ls_host_wait_for_turn(self);
+    ls_host_unlock();
+    self->function(self->parameter);
+    fprintf(stderr, "host: task %s returned from its function\n", self->name);
+    abort();
+}
+
+TaskHandle_t ls_host_task_create(TaskFunction_t function, const char *name, void *parameter, UBaseType_t priority)
+{
+    struct ls_host_task *task = calloc(1, sizeof(struct ls_host_task));
+    task->name = strdup(name ? name : "");
+    task->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    task->function = function;
+    task->parameter = parameter;
+    pthread_cond_init(&task->turn, NULL);
+    struct ls_host_task **tail = &_ls_host_tasks;
+    while (*tail)
+    {
+        tail = &(*tail)->next;
+    }
+    *tail = task;
+    _ls_host_make_ready(task);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 != pthread_create(&task->thread, &attr, _ls_host_task_entry, task))
+    {
+        fprintf(stderr, "host: could not start a thread for task %s\n", task->name);
+        abort();
+    }
+    pthread_attr_destroy(&attr);
+    return task;
+}
+
+static void _ls_host_main_task(void *parameter)
+{
+    _ls_host_app_main();
+    vTaskDelete(NULL);
+}
+
+void ls_host_kernel_run(void (*app_main)(void), int64_t run_limit_us)
+{
+    static pthread_cond_t never = PTHREAD_COND_INITIALIZER;
+    _ls_host_app_main = app_main;
+    _ls_host_run_limit_us = run_limit_us;
+    ls_host_lock();
+    _ls_host_running = ls_host_task_create(_ls_host_main_task, "main", NULL, 1);
+    pthread_cond_signal(&_ls_host_running->turn);
+    while (1)
+    {
+        pthread_cond_wait(&never, &_ls_host_mutex);
+    }
+}
+
+void ls_host_on_run_limit(void (*report)(void))
+{
+    _ls_host_run_limit_report = report;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameter, UBaseType_t priority, TaskHandle_t *created)
+{
+    ls_host_lock();
+    TaskHandle_t task = ls_host_task_create(function, name, parameter, priority);
+    if (created)
+    {
+        *created = task;
+    }
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameter, UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+    return xTaskCreate(function, name, stack_depth, parameter, priority, created);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    ls_host_lock();
+    struct ls_host_task *self = _ls_host_running;
+    struct ls_host_task *target = task ? task : self;
+    struct ls_host_task **link = &_ls_host_tasks;
+    while (*link && *link != target)
+    {
+        link = &(*link)->next;
+    }
+    if (NULL == *link)
+    {
+        ls_host_unlock(); // already gone
+        return;
+    }
+    *link = target->next;
+    target->state = _LS_HOST_TASK_DELETED;
+    if (target != self)
+    {
+        pthread_cond_signal(&target->turn);
+        ls_host_unlock();
+        return;
+    }
+    _ls_host_reschedule();
+    _ls_host_task_exit(self);
+}
+
+void taskYIELD(void)
+{
+    ls_host_lock();
+    _ls_host_running->ready_order = ++_ls_host_order;
+    _ls_host_reschedule();
+    ls_host_unlock();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (0 == ticks)
+    {
+        taskYIELD();
+        return;
+    }
+    ls_host_lock();
+    ls_host_block(&_ls_host_delayed, ls_host_ticks_from_now_us(ticks));
+    ls_host_unlock();
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    ls_host_lock();
+    *previous_wake += increment;
+    int32_t ahead = (int32_t)(*previous_wake - (TickType_t)(_ls_host_now_us / LS_HOST_TICK_US));
+    if (ahead > 0)
+    {
+        ls_host_block(&_ls_host_delayed, ls_host_ticks_from_now_us(ahead));
+        ls_host_unlock();
+        return;
+    }
+    ls_host_unlock();
+    taskYIELD();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(_ls_host_now_us / LS_HOST_TICK_US);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return _ls_host_running;
+}
+
+void vTaskSuspendAll(void)
+{
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    return pdFALSE;
+}
+
+static BaseType_t _ls_host_notify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    bool was_pending = task->notify_pending;
+    switch (action)
+    {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (was_pending)
+        {
+            return pdFAIL;
+        }
+        task->notify_value = value;
+        break;
+    default:
+        break;
+    }
+    task->notify_pending = true;
+    ls_host_wake(&task->notify_value);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    ls_host_lock();
+    BaseType_t result = _ls_host_notify(task, value, action);
+    ls_host_preempt_check();
+    ls_host_unlock();
+    return result;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *higher_priority_task_woken)
+{
+    ls_host_lock();
+    bool waiting = _LS_HOST_TASK_BLOCKED == task->state && &task->notify_value == task->blocked_on;
+    BaseType_t result = _ls_host_notify(task, value, action);
+    if (higher_priority_task_woken && waiting && ls_host_woken_outranks_current(task))
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    ls_host_unlock();
+    return result;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+    xTaskNotifyFromISR(task, 0, eIncrement, higher_priority_task_woken);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    ls_host_lock();
+    struct ls_host_task *self = _ls_host_running;
+    if (0 == self->notify_value)
+    {
+        ls_host_block(&self->notify_value, ls_host_ticks_from_now_us(ticks_to_wait));
+    }
+    uint32_t value = self->notify_value;
+    if (value)
+    {
+        self->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    self->notify_pending = false;
+    ls_host_unlock();
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks_to_wait)
+{
+    ls_host_lock();
+    struct ls_host_task *self = _ls_host_running;
+    if (!self->notify_pending)
+    {
+        self->notify_value &= ~clear_on_entry;
+        ls_host_block(&self->notify_value, ls_host_ticks_from_now_us(ticks_to_wait));
+    }
+    BaseType_t received = self->notify_pending ? pdTRUE : pdFALSE;
+    if (value)
+    {
+        *value = self->notify_value;
+    }
+    if (received)
+    {
+        self->notify_value &= ~clear_on_exit;
+    }
+    self->notify_pending = false;
+    ls_host_unlock();
+    return received;
+}
@@ -0,0 +1,109 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+/**
+ * Virtual-time kernel for the host build.
+ *
+ * Every FreeRTOS task is a pthread, but only one runs at a time: the highest-priority
+ * ready task, as on a single preemptive core. Running code takes no virtual time. Time
+ * only moves when every task is blocked, and then it jumps straight to the next task
+ * timeout or alarm, so an idle night passes in a few milliseconds of wall time.
+ *
+ * Alarms stand in for hardware interrupts. They fire in ISR context on whichever thread
+ * found the CPU idle, and FromISR calls from them wake tasks without switching.
+ *
+ * All functions here expect the kernel lock to be held unless noted.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LS_HOST_TICK_US (1000000LL / configTICK_RATE_HZ)
+#define LS_HOST_FOREVER INT64_MAX
+
+typedef struct ls_host_alarm
+{
+    int64_t due_us;
+    uint64_t order; // alarms due at the same time fire in the order they were set
+    bool armed;
+    void (*fire)(struct ls_host_alarm *alarm);
+    struct ls_host_alarm *next_registered;
+} ls_host_alarm_t;
+
+// taken and released by callers; never held while firmware code runs
+void ls_host_lock(void);
+void ls_host_unlock(void);
+
+int64_t ls_host_now_us(void);
+/**
+ * @brief the absolute time a FreeRTOS timeout of this many ticks ends; timeouts expire on tick boundaries
+ */
+int64_t ls_host_ticks_from_now_us(TickType_t ticks);
+bool ls_host_in_isr(void);
+
+/**
+ * @brief register an alarm once; arming and disarming it afterwards is cheap
+ */
+void ls_host_alarm_register(ls_host_alarm_t *alarm, void (*fire)(ls_host_alarm_t *alarm));
+void ls_host_alarm_arm(ls_host_alarm_t *alarm, int64_t due_us);
+void ls_host_alarm_disarm(ls_host_alarm_t *alarm);
+
+/**
+ * @brief block the running task on object until ls_host_wake() names it or wake_us passes
+ *
+ * @return true if woken, false on timeout (including wake_us already past)
+ */
+bool ls_host_block(const void *object, int64_t wake_us);
+/**
+ * @brief make the highest-priority task blocked on object ready
+ *
+ * @return the task woken, or NULL if none was waiting
+ */
+TaskHandle_t ls_host_wake(const void *object);
+/**
+ * @brief after waking a task from task context, give up the CPU if it outranks the caller
+ */
+void ls_host_preempt_check(void);
+/**
+ * @brief whether a task woken from an ISR should run before whatever it interrupted
+ */
+bool ls_host_woken_outranks_current(TaskHandle_t woken);
+
+TaskHandle_t ls_host_task_create(TaskFunction_t function, const char *name, void *parameter, UBaseType_t priority);
+
+/**
+ * @brief run app_main as the main task, as ESP-IDF does, and never return; the process ends
+ * through exit() or esp_restart()
+ *
+ * @param run_limit_us virtual time at which to stop with a summary, or 0 to run until exit()
+ */
+void ls_host_kernel_run(void (*app_main)(void), int64_t run_limit_us) __attribute__((noreturn));
+/**
+ * @brief called at the virtual time limit, before exiting with status 0; lock not held
+ */
+void ls_host_on_run_limit(void (*report)(void));
+
+/**
+ * @brief set up the parts of the chip that survive esp_restart(), from the environment the
+ * previous run left, and seed esp_random(); lock not held
+ */
+void ls_host_system_init(int argc, char **argv, uint32_t seed);
+// NVS contents as text, so esp_restart() can hand them to the next run
+char *ls_host_nvs_export(void);
+void ls_host_nvs_import(const char *text);
@@ -0,0 +1,74 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+/**
+ * Host build entry point: runs app_main() against the simulated plant in virtual time.
+ *
+ *   ls_host_sim [--run-ms N] [--seed N]
+ *
+ * --run-ms stops after N virtual milliseconds with a one-line summary (default: run until
+ * the firmware calls exit(), as the scenario suite does). --seed fixes esp_random().
+ */
+#include "kernel.h"
+#include "simplant.h"
+#include "states.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void app_main(void);
+
+static struct timespec _ls_host_wall_start;
+
+static void _ls_host_summary(void)
+{
+    struct timespec wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall_s = (wall_end.tv_sec - _ls_host_wall_start.tv_sec) + (wall_end.tv_nsec - _ls_host_wall_start.tv_nsec) / 1e9;
+    printf("host: %.3f s virtual in %.3f s wall; state %s\n",
+           ls_host_now_us() / 1e6, wall_s, ls_state_name(ls_state_current));
+}
+
+int main(int argc, char **argv)
+{
+    int64_t run_ms = 0;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--run-ms") && i + 1 < argc)
+        {
+            run_ms = strtoll(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "--seed") && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--run-ms N] [--seed N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    // the chip's console is line-buffered; keep output ordered the same way when piped
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    clock_gettime(CLOCK_MONOTONIC, &_ls_host_wall_start);
+    ls_host_system_init(argc, argv, seed);
+    ls_simplant_init();
+    ls_host_on_run_limit(_ls_host_summary);
+    ls_host_kernel_run(app_main, run_ms * 1000);
+}
@@ -0,0 +1,246 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "kernel.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _LS_HOST_NVS_NAME_MAX 16 // ESP-IDF's limit, including the terminator
+#define _LS_HOST_NVS_NAMESPACES_MAX 8
+
+typedef enum
+{
+    _LS_HOST_NVS_I32 = 'i',
+    _LS_HOST_NVS_BLOB = 'b',
+} _ls_host_nvs_type_t;
+
+typedef struct _ls_host_nvs_entry
+{
+    char name_space[_LS_HOST_NVS_NAME_MAX];
+    char key[_LS_HOST_NVS_NAME_MAX];
+    _ls_host_nvs_type_t type;
+    size_t length;
+    uint8_t *data;
+    struct _ls_host_nvs_entry *next;
+} _ls_host_nvs_entry_t;
+
+static _ls_host_nvs_entry_t *_ls_host_nvs_entries;
+static char _ls_host_nvs_namespaces[_LS_HOST_NVS_NAMESPACES_MAX][_LS_HOST_NVS_NAME_MAX];
+static bool _ls_host_nvs_initialized;
+
+esp_err_t nvs_flash_init(void)
+{
+    _ls_host_nvs_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    while (_ls_host_nvs_entries)
+    {
+        _ls_host_nvs_entry_t *entry = _ls_host_nvs_entries;
+        _ls_host_nvs_entries = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    return ESP_OK;
+}
+
+// handles are 1 + the namespace's slot, so 0 is never valid
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (!_ls_host_nvs_initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(name_space) >= _LS_HOST_NVS_NAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < _LS_HOST_NVS_NAMESPACES_MAX; i++)
+    {
+        if (0 == _ls_host_nvs_namespaces[i][0])
+        {
+            strcpy(_ls_host_nvs_namespaces[i], name_space);
+        }
+        if (0 == strcmp(_ls_host_nvs_namespaces[i], name_space))
+        {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+static _ls_host_nvs_entry_t *_ls_host_nvs_find(const char *name_space, const char *key)
+{
+    for (_ls_host_nvs_entry_t *entry = _ls_host_nvs_entries; entry; entry = entry->next)
+    {
+        if (0 == strcmp(entry->name_space, name_space) && 0 == strcmp(entry->key, key))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static const char *_ls_host_nvs_namespace(nvs_handle_t handle)
+{
+    return (handle >= 1 && handle <= _LS_HOST_NVS_NAMESPACES_MAX) ? _ls_host_nvs_namespaces[handle - 1] : NULL;
+}
+
+static esp_err_t _ls_host_nvs_set(const char *name_space, const char *key, _ls_host_nvs_type_t type, const void *value, size_t length)
+{
+    if (NULL == name_space || strlen(key) >= _LS_HOST_NVS_NAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _ls_host_nvs_entry_t *entry = _ls_host_nvs_find(name_space, key);
+    if (NULL == entry)
+    {
+        entry = calloc(1, sizeof(_ls_host_nvs_entry_t));
+        strcpy(entry->name_space, name_space);
+        strcpy(entry->key, key);
+        entry->next = _ls_host_nvs_entries;
+        _ls_host_nvs_entries = entry;
+    }
+    free(entry->data);
+    entry->type = type;
+    entry->length = length;
+    entry->data = malloc(length ? length : 1);
+    memcpy(entry->data, value, length);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value)
+{
+    const char *name_space = _ls_host_nvs_namespace(handle);
+    _ls_host_nvs_entry_t *entry = name_space ? _ls_host_nvs_find(name_space, key) : NULL;
+    if (NULL == entry || _LS_HOST_NVS_I32 != entry->type)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memcpy(out_value, entry->data, sizeof(int32_t));
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value)
+{
+    return _ls_host_nvs_set(_ls_host_nvs_namespace(handle), key, _LS_HOST_NVS_I32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    const char *name_space = _ls_host_nvs_namespace(handle);
+    _ls_host_nvs_entry_t *entry = name_space ? _ls_host_nvs_find(name_space, key) : NULL;
+    if (NULL == entry || _LS_HOST_NVS_BLOB != entry->type)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (NULL == out_value)
+    {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length)
+    {
+        *length = entry->length;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->data, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return _ls_host_nvs_set(_ls_host_nvs_namespace(handle), key, _LS_HOST_NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    const char *name_space = _ls_host_nvs_namespace(handle);
+    for (_ls_host_nvs_entry_t **link = &_ls_host_nvs_entries; *link; link = &(*link)->next)
+    {
+        _ls_host_nvs_entry_t *entry = *link;
+        if (name_space && 0 == strcmp(entry->name_space, name_space) && 0 == strcmp(entry->key, key))
+        {
+            *link = entry->next;
+            free(entry->data);
+            free(entry);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+char *ls_host_nvs_export(void)
+{
+    size_t size = 1;
+    for (_ls_host_nvs_entry_t *entry = _ls_host_nvs_entries; entry; entry = entry->next)
+    {
+        size += 2 * _LS_HOST_NVS_NAME_MAX + 2 * entry->length + 8;
+    }
+    char *text = malloc(size);
+    char *end = text;
+    *end = 0;
+    for (_ls_host_nvs_entry_t *entry = _ls_host_nvs_entries; entry; entry = entry->next)
+    {
+        end += sprintf(end, "%c %s %s ", entry->type, entry->name_space, entry->key);
+        for (size_t i = 0; i < entry->length; i++)
+        {
+            end += sprintf(end, "%02x", entry->data[i]);
+        }
+        end += sprintf(end, "-\n");
+    }
+    return text;
+}
+
+void ls_host_nvs_import(const char *text)
+{
+    char type;
+    char name_space[_LS_HOST_NVS_NAME_MAX];
+    char key[_LS_HOST_NVS_NAME_MAX];
+    int consumed;
+    while (3 == sscanf(text, " %c %15s %15s %n", &type, name_space, key, &consumed))
+    {
+        text += consumed;
+        size_t length = strspn(text, "0123456789abcdef") / 2;
+        uint8_t *data = malloc(length ? length : 1);
+        for (size_t i = 0; i < length; i++)
+        {
+            unsigned int byte;
+            sscanf(text + 2 * i, "%2x", &byte);
+            data[i] = (uint8_t)byte;
+        }
+        text += 2 * length + 1; // past the terminating '-'
+        _ls_host_nvs_set(name_space, key, (_ls_host_nvs_type_t)type, data, length);
+        free(data);
+    }
+}
@@ -0,0 +1,372 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "simplant.h"
+#include "kernel.h"
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static int32_t _ls_simplant_arm_position;
+static uint32_t _ls_simplant_skipped_steps;
+static bool _ls_simplant_inertia = true;
+static int64_t _ls_simplant_last_step_us;
+static int32_t _ls_simplant_last_rate;
+static int _ls_simplant_light_override = -1;
+static bool _ls_simplant_tilted = false;
+static bool _ls_simplant_tape_present = true;
+static bool _ls_simplant_magnet_present = true;
+static bool _ls_simplant_accel_present = true;
+static uint32_t _ls_simplant_tapemode_adc = LS_SIMPLANT_TAPEMODE_ADC;
+static bool _ls_simplant_controls_connected = false;
+// each sensor draws its noise from its own sequence, so one sensor's sampling rate cannot shift another's
+static uint32_t _ls_simplant_tape_noise_state;
+static uint32_t _ls_simplant_light_noise_state;
+// survives esp_restart() but not power loss
+static RTC_NOINIT_ATTR int32_t _ls_simplant_preserved_arm_position;
+static RTC_NOINIT_ATTR uint32_t _ls_simplant_preserved_magic;
+#define _LS_SIMPLANT_PRESERVED_MAGIC 0x51D1A4E7
+
+static const int32_t _ls_simplant_tape_spans[][2] = LS_SIMPLANT_TAPE_SPANS;
+#define _LS_SIMPLANT_TAPE_SPAN_COUNT ((int)(sizeof(_ls_simplant_tape_spans) / sizeof(_ls_simplant_tape_spans[0])))
+
+// a step slower than this is treated as starting from a standstill
+#define _LS_SIMPLANT_STANDSTILL_US 50000
+
+#define _LS_SIMPLANT_ADC_MAX 4095
+
+// the parts of the LIS2DH12 register map the firmware uses; see lis2dh12.c
+#define _LS_SIMPLANT_LIS2DH12_ADDRESS 0x18
+#define _LS_SIMPLANT_LIS2DH12_AUTO_INCREMENT 0x80
+#define _LS_SIMPLANT_LIS2DH12_CTRL_REG3 0x22
+#define _LS_SIMPLANT_LIS2DH12_CTRL_REG3_I1_IA1 0x40
+#define _LS_SIMPLANT_LIS2DH12_OUT_X_L 0x28
+#define _LS_SIMPLANT_LIS2DH12_OUT_Z_H 0x2D
+#define _LS_SIMPLANT_LIS2DH12_INT1_CFG 0x30
+#define _LS_SIMPLANT_LIS2DH12_INT1_CFG_ZLIE 0x10
+#define _LS_SIMPLANT_LIS2DH12_INT1_THS 0x32
+#define _LS_SIMPLANT_LIS2DH12_INT1_THS_MG_PER_LSB 16
+// +/- 2g full scale, left-justified in 16 bits
+#define _LS_SIMPLANT_LIS2DH12_COUNTS_PER_G 16384
+static uint8_t _ls_simplant_accel_registers[0x40];
+
+static bool _ls_simplant_in_magnet_window(int32_t position)
+{
+    return _ls_simplant_magnet_present && position < LS_SIMPLANT_MAGNET_WIDTH_STEPS;
+}
+
+static int32_t _ls_simplant_accel_z_mg(void)
+{
+    return _ls_simplant_tilted ? LS_SIMPLANT_ACCEL_Z_TILTED_MG : LS_SIMPLANT_ACCEL_Z_LEVEL_MG;
+}
+
+/**
+ * @brief INT1 with the Z-low interrupt enabled follows Z against the threshold, unlatched;
+ * the chip drives the pin low otherwise, and nothing drives it while the chip is missing
+ */
+static void _ls_simplant_accel_update_interrupt(void)
+{
+    if (!_ls_simplant_accel_present)
+    {
+        return;
+    }
+    bool enabled = (_ls_simplant_accel_registers[_LS_SIMPLANT_LIS2DH12_CTRL_REG3] & _LS_SIMPLANT_LIS2DH12_CTRL_REG3_I1_IA1) &&
+                   (_ls_simplant_accel_registers[_LS_SIMPLANT_LIS2DH12_INT1_CFG] & _LS_SIMPLANT_LIS2DH12_INT1_CFG_ZLIE);
+    int32_t threshold_mg = (_ls_simplant_accel_registers[_LS_SIMPLANT_LIS2DH12_INT1_THS] & 0x7F) * _LS_SIMPLANT_LIS2DH12_INT1_THS_MG_PER_LSB;
+    ls_host_gpio_drive(LSGPIO_TILTINTERRUPT, enabled && _ls_simplant_accel_z_mg() < threshold_mg);
+}
+
+void ls_simplant_init(void)
+{
+    _ls_simplant_arm_position = LS_SIMPLANT_ARM_START_POSITION;
+    if (esp_reset_reason() == ESP_RST_SW && _ls_simplant_preserved_magic == _LS_SIMPLANT_PRESERVED_MAGIC)
+    {
+        _ls_simplant_arm_position = _ls_simplant_preserved_arm_position;
+    }
+    _ls_simplant_preserved_magic = 0;
+    _ls_simplant_skipped_steps = 0;
+    _ls_simplant_last_step_us = 0;
+    _ls_simplant_last_rate = 0;
+    _ls_simplant_tape_noise_state = LS_SIMPLANT_SEED;
+    _ls_simplant_light_noise_state = LS_SIMPLANT_SEED ^ 0x9E3779B9;
+    memset(_ls_simplant_accel_registers, 0, sizeof(_ls_simplant_accel_registers));
+    // the sensor pulls low when triggered
+    ls_host_gpio_drive(LSGPIO_MAGNETSENSE, !_ls_simplant_in_magnet_window(_ls_simplant_arm_position));
+    _ls_simplant_accel_update_interrupt();
+    printf("Simulated plant: arm at %d steps, magnet window %d steps wide\n",
+           _ls_simplant_arm_position, LS_SIMPLANT_MAGNET_WIDTH_STEPS);
+}
+
+void ls_simplant_preserve_across_restart(void)
+{
+    _ls_simplant_preserved_arm_position = _ls_simplant_arm_position;
+    _ls_simplant_preserved_magic = _LS_SIMPLANT_PRESERVED_MAGIC;
+}
+
+/**
+ * @brief whether the arm can follow a step commanded at this moment: signed step rates
+ * are estimated from consecutive step intervals and a step that demands more than
+ * LS_SIMPLANT_ARM_MAX_ACCELERATION is skipped
+ */
+static bool _ls_simplant_arm_follows(int32_t delta)
+{
+    int64_t now = ls_host_now_us();
+    int64_t interval = now - _ls_simplant_last_step_us;
+    _ls_simplant_last_step_us = now;
+    if (interval >= _LS_SIMPLANT_STANDSTILL_US || interval <= 0)
+    {
+        _ls_simplant_last_rate = 0;
+        return true;
+    }
+    int32_t rate = delta * (int32_t)(1000000 / interval);
+    int64_t acceleration = (int64_t)(rate - _ls_simplant_last_rate) * 1000000 / interval;
+    if (acceleration < 0)
+    {
+        acceleration = -acceleration;
+    }
+    if (_ls_simplant_inertia && acceleration > LS_SIMPLANT_ARM_MAX_ACCELERATION)
+    {
+        // the rotor slips; the arm keeps its previous speed
+        return false;
+    }
+    _ls_simplant_last_rate = rate;
+    return true;
+}
+
+/**
+ * @brief the A4988 moves one step on each rising edge of STEP while awake, in the direction DIR selects
+ */
+static void _ls_simplant_step(void)
+{
+    if (!gpio_get_level(LSGPIO_STEPPERSLEEP))
+    {
+        return;
+    }
+    // the firmware makes FORWARD == DIR high
+    int32_t delta = gpio_get_level(LSGPIO_STEPPERDIRECTION) ? 1 : -1;
+    if (!_ls_simplant_arm_follows(delta))
+    {
+        _ls_simplant_skipped_steps++;
+        return;
+    }
+    int32_t position = _ls_simplant_arm_position + delta;
+    if (position < 0)
+    {
+        position += LS_STEPPER_STEPS_PER_ROTATION;
+    }
+    if (position >= LS_STEPPER_STEPS_PER_ROTATION)
+    {
+        position -= LS_STEPPER_STEPS_PER_ROTATION;
+    }
+    _ls_simplant_arm_position = position;
+    ls_host_gpio_drive(LSGPIO_MAGNETSENSE, !_ls_simplant_in_magnet_window(position));
+}
+
+void ls_simplant_gpio_output(gpio_num_t gpio_num, uint32_t level)
+{
+    if (LSGPIO_STEPPERSTEP == gpio_num && level)
+    {
+        _ls_simplant_step();
+    }
+}
+
+/**
+ * @brief xorshift32; the same seed gives the same readings on every boot, unlike esp_random()
+ */
+static int _ls_simplant_noise(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (int)(x % (2 * LS_SIMPLANT_ADC_NOISE + 1)) - LS_SIMPLANT_ADC_NOISE;
+}
+
+static int _ls_simplant_adc_clamp(int adc)
+{
+    return adc < 0 ? 0 : (adc > _LS_SIMPLANT_ADC_MAX ? _LS_SIMPLANT_ADC_MAX : adc);
+}
+
+static int _ls_simplant_tape_adc(void)
+{
+    int adc = LS_SIMPLANT_TAPE_ADC_DARK;
+    if (gpio_get_level(LSGPIO_REFLECTANCEENABLE))
+    {
+        adc = LS_SIMPLANT_TAPE_ADC_BACKGROUND;
+        for (int i = 0; _ls_simplant_tape_present && i < _LS_SIMPLANT_TAPE_SPAN_COUNT; i++)
+        {
+            if (_ls_simplant_arm_position >= _ls_simplant_tape_spans[i][0] && _ls_simplant_arm_position <= _ls_simplant_tape_spans[i][1])
+            {
+                adc = LS_SIMPLANT_TAPE_ADC_TAPE;
+            }
+        }
+    }
+    return _ls_simplant_adc_clamp(adc + _ls_simplant_noise(&_ls_simplant_tape_noise_state));
+}
+
+static int _ls_simplant_light_adc(void)
+{
+    if (_ls_simplant_light_override >= 0)
+    {
+        return _ls_simplant_light_override;
+    }
+    // the cycle starts at dawn: day for the first half, night for the second, with a linear
+    // ramp through twilight at each change so the light sensor's agreement logic gets exercised
+    int64_t cycle_ms = (ls_host_now_us() / 1000) % LS_SIMPLANT_DAY_CYCLE_MS;
+    int64_t half_ms = LS_SIMPLANT_DAY_CYCLE_MS / 2;
+    int64_t since_change_ms = cycle_ms < half_ms ? cycle_ms : cycle_ms - half_ms;
+    int from = cycle_ms < half_ms ? LS_SIMPLANT_LIGHT_ADC_NIGHT : LS_SIMPLANT_LIGHT_ADC_DAY;
+    int to = cycle_ms < half_ms ? LS_SIMPLANT_LIGHT_ADC_DAY : LS_SIMPLANT_LIGHT_ADC_NIGHT;
+    int adc = to;
+    if (since_change_ms < LS_SIMPLANT_TWILIGHT_MS)
+    {
+        adc = from + (int)((to - from) * since_change_ms / LS_SIMPLANT_TWILIGHT_MS);
+    }
+    return _ls_simplant_adc_clamp(adc + _ls_simplant_noise(&_ls_simplant_light_noise_state));
+}
+
+int ls_simplant_adc1_raw(adc1_channel_t channel)
+{
+    switch (channel)
+    {
+    case LSADC1_LIGHTSENSE:
+        return _ls_simplant_light_adc();
+    case LSADC1_REFLECTANCESENSE:
+        return _ls_simplant_tape_adc();
+    case LSADC1_TAPESETTING:
+        return (int)_ls_simplant_tapemode_adc;
+    default:
+        return 0;
+    }
+}
+
+int ls_simplant_adc2_raw(adc2_channel_t channel)
+{
+    if (!_ls_simplant_controls_connected)
+    {
+        return 0; // pulled down with nothing plugged in
+    }
+    switch (channel)
+    {
+    case LSADC2_KNOB3:
+    case LSADC2_KNOB4:
+    case LSADC2_KNOB5:
+        return LS_SIMPLANT_CONTROLS_ADC_SLIDER;
+    case LSADC2_KNOB6:
+        return LS_SIMPLANT_CONTROLS_ADC_CONNECTION;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief the output registers hold the current orientation; everything else reads back what was written
+ */
+static uint8_t _ls_simplant_accel_read_register(uint8_t reg)
+{
+    if (reg >= _LS_SIMPLANT_LIS2DH12_OUT_X_L && reg <= _LS_SIMPLANT_LIS2DH12_OUT_Z_H)
+    {
+        int32_t z_mg = _ls_simplant_accel_z_mg();
+        int32_t mg[3] = {(int32_t)lroundf(sqrtf(1e6f - (float)(z_mg * z_mg))), 0, z_mg};
+        int16_t counts = (int16_t)(mg[(reg - _LS_SIMPLANT_LIS2DH12_OUT_X_L) / 2] * _LS_SIMPLANT_LIS2DH12_COUNTS_PER_G / 1000);
+        return (reg - _LS_SIMPLANT_LIS2DH12_OUT_X_L) % 2 ? (uint8_t)(counts >> 8) : (uint8_t)counts;
+    }
+    return _ls_simplant_accel_registers[reg % sizeof(_ls_simplant_accel_registers)];
+}
+
+esp_err_t ls_simplant_i2c_transfer(uint8_t address, const uint8_t *write, size_t write_length, uint8_t *read, size_t read_length)
+{
+    if (!_ls_simplant_accel_present || _LS_SIMPLANT_LIS2DH12_ADDRESS != address)
+    {
+        return ESP_FAIL;
+    }
+    if (0 == write_length)
+    {
+        return ESP_OK; // a probe
+    }
+    bool increment = write[0] & _LS_SIMPLANT_LIS2DH12_AUTO_INCREMENT;
+    uint8_t reg = write[0] & ~_LS_SIMPLANT_LIS2DH12_AUTO_INCREMENT;
+    for (size_t i = 1; i < write_length; i++)
+    {
+        _ls_simplant_accel_registers[reg % sizeof(_ls_simplant_accel_registers)] = write[i];
+        reg += increment ? 1 : 0;
+    }
+    for (size_t i = 0; NULL != read && i < read_length; i++)
+    {
+        read[i] = _ls_simplant_accel_read_register(reg);
+        reg += increment ? 1 : 0;
+    }
+    _ls_simplant_accel_update_interrupt();
+    return ESP_OK;
+}
+
+int32_t ls_simplant_get_arm_position(void)
+{
+    return _ls_simplant_arm_position;
+}
+
+uint32_t ls_simplant_get_skipped_steps(void)
+{
+    return _ls_simplant_skipped_steps;
+}
+
+void ls_simplant_set_light_adc(int adc)
+{
+    _ls_simplant_light_override = adc;
+}
+
+void ls_simplant_set_tilted(bool tilted)
+{
+    _ls_simplant_tilted = tilted;
+    _ls_simplant_accel_update_interrupt();
+}
+
+void ls_simplant_set_tape_present(bool present)
+{
+    _ls_simplant_tape_present = present;
+}
+
+void ls_simplant_set_magnet_present(bool present)
+{
+    _ls_simplant_magnet_present = present;
+    ls_host_gpio_drive(LSGPIO_MAGNETSENSE, !_ls_simplant_in_magnet_window(_ls_simplant_arm_position));
+}
+
+void ls_simplant_set_accel_present(bool present)
+{
+    _ls_simplant_accel_present = present;
+    _ls_simplant_accel_update_interrupt();
+}
+
+void ls_simplant_set_tapemode_adc(uint32_t adc)
+{
+    _ls_simplant_tapemode_adc = adc;
+}
+
+void ls_simplant_set_controls_connected(bool connected)
+{
+    _ls_simplant_controls_connected = connected;
+}
+
+void ls_simplant_set_inertia(bool enabled)
+{
+    _ls_simplant_inertia = enabled;
+}
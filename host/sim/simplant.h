@@ -0,0 +1,119 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/adc.h"
+#include "driver/gpio.h"
+
+/**
+ * Simulated plant for the host build: a rotating arm that skips steps when driven harder
+ * than its inertia allows, a magnet window, a tape reflectance profile, a compressed
+ * night/day light cycle, a LIS2DH12 accelerometer that can be tipped over, and the external
+ * controls. It sits behind the driver stubs in drivers.c, so the firmware reads it through
+ * the same ADC, GPIO and I2C calls it makes on the chip.
+ */
+
+// physical arm position (steps) at power-on, relative to the start of the magnet window
+#define LS_SIMPLANT_ARM_START_POSITION (LS_STEPPER_STEPS_PER_ROTATION / 3)
+#define LS_SIMPLANT_MAGNET_WIDTH_STEPS (LS_STEPPER_STEPS_PER_ROTATION / 40)
+// step-rate change (steps/s per second) beyond which the arm's inertia makes the motor skip the step
+#define LS_SIMPLANT_ARM_MAX_ACCELERATION 40000
+// black tape spans as {first step, last step} measured from the start of the magnet window
+#define LS_SIMPLANT_TAPE_SPANS {{400, 900}, {2200, 2600}}
+#define LS_SIMPLANT_TAPE_ADC_TAPE 3200
+#define LS_SIMPLANT_TAPE_ADC_BACKGROUND 1200
+// what the reflectance sensor sees with its emitter off: no light comes back
+#define LS_SIMPLANT_TAPE_ADC_DARK 4095
+#define LS_SIMPLANT_ADC_NOISE 40
+// seeds the plant's sensor noise; nonzero
+#define LS_SIMPLANT_SEED 0x2022u
+// a full compressed night/day cycle; the first half is day, the second half night
+#define LS_SIMPLANT_DAY_CYCLE_MS 600000
+#define LS_SIMPLANT_TWILIGHT_MS 30000
+#define LS_SIMPLANT_LIGHT_ADC_DAY 2500
+#define LS_SIMPLANT_LIGHT_ADC_NIGHT 100
+// Z in mg; the simulated unit only tips forward, so X makes up the rest of 1g
+#define LS_SIMPLANT_ACCEL_Z_LEVEL_MG 1000
+#define LS_SIMPLANT_ACCEL_Z_TILTED_MG 700
+// tape setting switch position as an ADC reading; about 1100 mV, which selects LS_TAPEMODE_BLACK
+#define LS_SIMPLANT_TAPEMODE_ADC 1200
+// about 590 mV selects LS_TAPEMODE_BLACK_SAFE; about 220 mV selects LS_TAPEMODE_SELFTEST
+#define LS_SIMPLANT_TAPEMODE_ADC_SAFE 560
+#define LS_SIMPLANT_TAPEMODE_ADC_SELFTEST 100
+// external controls while connected: the connection divider, and the sliders held at mid-travel
+#define LS_SIMPLANT_CONTROLS_ADC_CONNECTION 1750
+#define LS_SIMPLANT_CONTROLS_ADC_SLIDER 2048
+
+/**
+ * @brief place the arm at its power-on position, or where it was before a software
+ * restart if ls_simplant_preserve_across_restart() was called first; lock not held
+ */
+void ls_simplant_init(void);
+/**
+ * @brief keep the arm position through the next esp_restart(), as a real arm would through a brownout
+ */
+void ls_simplant_preserve_across_restart(void);
+
+// driver side: the stubs in drivers.c hand the plant what the firmware writes and return what it senses
+
+/**
+ * @brief an output pin changed level; a rising edge on the step pin moves the arm
+ */
+void ls_simplant_gpio_output(gpio_num_t gpio_num, uint32_t level);
+int ls_simplant_adc1_raw(adc1_channel_t channel);
+int ls_simplant_adc2_raw(adc2_channel_t channel);
+/**
+ * @brief one I2C transaction: write bytes after the address byte, then read_length bytes
+ * after a repeated start if read is not NULL
+ *
+ * @return ESP_FAIL if no device answers at address
+ */
+esp_err_t ls_simplant_i2c_transfer(uint8_t address, const uint8_t *write, size_t write_length, uint8_t *read, size_t read_length);
+
+/**
+ * @brief physical arm position in steps from the start of the magnet window
+ */
+int32_t ls_simplant_get_arm_position(void);
+/**
+ * @brief number of commanded steps the arm has failed to follow since init
+ */
+uint32_t ls_simplant_get_skipped_steps(void);
+
+/**
+ * @brief force the light reading to an ADC value; a negative value resumes the day cycle
+ */
+void ls_simplant_set_light_adc(int adc);
+void ls_simplant_set_tilted(bool tilted);
+void ls_simplant_set_tape_present(bool present);
+/**
+ * @brief without the magnet, the arm never enters the magnet window and homing cannot succeed
+ */
+void ls_simplant_set_magnet_present(bool present);
+/**
+ * @brief without the accelerometer, nothing answers at its I2C address
+ */
+void ls_simplant_set_accel_present(bool present);
+void ls_simplant_set_tapemode_adc(uint32_t adc);
+void ls_simplant_set_controls_connected(bool connected);
+/**
+ * @brief enable or disable the inertia model; when disabled, the arm follows every step
+ */
+void ls_simplant_set_inertia(bool enabled);
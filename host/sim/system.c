@@ -0,0 +1,167 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "kernel.h"
+#include "esp_rom_sys.h"
+#include "esp_system.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// the linker brackets every section whose name is a C identifier; weak in case nothing uses RTC_NOINIT_ATTR
+extern char __start_rtc_noinit[] __attribute__((weak));
+extern char __stop_rtc_noinit[] __attribute__((weak));
+
+#define _LS_HOST_ENV_RTC "LS_HOST_RTC_NOINIT"
+#define _LS_HOST_ENV_NVS "LS_HOST_NVS"
+#define _LS_HOST_ENV_RANDOM "LS_HOST_RANDOM"
+
+static char **_ls_host_argv;
+static esp_reset_reason_t _ls_host_reset_reason = ESP_RST_POWERON;
+static uint32_t _ls_host_random_state;
+
+void ls_host_system_init(int argc, char **argv, uint32_t seed)
+{
+    _ls_host_argv = argv;
+    _ls_host_random_state = seed ? seed : 1; // xorshift never leaves 0
+    const char *rtc = getenv(_LS_HOST_ENV_RTC);
+    if (NULL == rtc)
+    {
+        return; // power-on: RTC memory holds whatever it holds, here zeros
+    }
+    _ls_host_reset_reason = ESP_RST_SW;
+    size_t length = __stop_rtc_noinit - __start_rtc_noinit;
+    for (size_t i = 0; i < length && 1 == sscanf(rtc + 2 * i, "%2hhx", (unsigned char *)&__start_rtc_noinit[i]); i++)
+    {
+    }
+    const char *nvs = getenv(_LS_HOST_ENV_NVS);
+    if (nvs)
+    {
+        ls_host_nvs_import(nvs);
+    }
+    const char *random = getenv(_LS_HOST_ENV_RANDOM);
+    if (random)
+    {
+        _ls_host_random_state = (uint32_t)strtoul(random, NULL, 10);
+    }
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return _ls_host_reset_reason;
+}
+
+void esp_restart(void)
+{
+    ls_host_lock(); // nothing else runs from here on
+    size_t length = __stop_rtc_noinit - __start_rtc_noinit;
+    char *rtc = malloc(2 * length + 1);
+    rtc[0] = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        sprintf(rtc + 2 * i, "%02x", (unsigned char)__start_rtc_noinit[i]);
+    }
+    setenv(_LS_HOST_ENV_RTC, rtc, 1);
+    char *nvs = ls_host_nvs_export();
+    setenv(_LS_HOST_ENV_NVS, nvs, 1);
+    char random[16];
+    snprintf(random, sizeof(random), "%u", _ls_host_random_state);
+    setenv(_LS_HOST_ENV_RANDOM, random, 1);
+    fprintf(stderr, "host: esp_restart() at %lld us\n", (long long)ls_host_now_us());
+    fflush(stdout);
+    fflush(stderr);
+    execv("/proc/self/exe", _ls_host_argv);
+    perror("host: esp_restart() could not re-execute");
+    abort();
+}
+
+uint32_t esp_random(void)
+{
+    // xorshift32: the same sequence for the same --seed on every machine
+    uint32_t x = _ls_host_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    _ls_host_random_state = x;
+    return x;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *bytes = buf;
+    for (size_t i = 0; i < len; i++)
+    {
+        bytes[i] = (uint8_t)esp_random();
+    }
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    if (ls_host_in_isr())
+    {
+        return;
+    }
+    static const char delaying = 0;
+    ls_host_lock();
+    ls_host_block(&delaying, ls_host_now_us() + us);
+    ls_host_unlock();
+}
+
+int ls_host_gettimeofday(struct timeval *tv, void *tz)
+{
+    int64_t now_us = ls_host_now_us();
+    tv->tv_sec = now_us / 1000000;
+    tv->tv_usec = now_us % 1000000;
+    return 0;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+        return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES:
+        return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_NEW_VERSION_FOUND:
+        return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/**
+ * Interface each supported accelerometer chip implements; see kxtj3.c, lis2dh12.c and
+ * mpu6050.c. i2c.c probes the drivers in turn and uses the first that answers.
+ */
+
+// acceleration in g along each of the chip's axes
+typedef struct ls_accel_xyz_t {
+    float x;
+    float y;
+    float z;
+} ls_accel_xyz_t;
+
+// one buffered sample in milli-g; integer so streams can be analysed without floating point
+typedef struct ls_accel_mg_t {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} ls_accel_mg_t;
+
+typedef struct ls_accel_driver_t {
+    const char *name;
+    int device; // enum ls_i2c_accelerometer_device_t
+    /**
+     * @brief whether the chip answers on the bus; may reset it to get an answer
+     */
+    bool (*probe)(void);
+    esp_err_t (*init)(void);
+    /**
+     * @brief all three axes in one auto-increment burst read
+     */
+    esp_err_t (*read_xyz)(ls_accel_xyz_t *xyz);
+    /**
+     * @brief set the output data rate to the lowest the chip supports at or above hz
+     */
+    esp_err_t (*configure_odr)(uint32_t hz);
+    /**
+     * @brief drive the chip's interrupt pin (active high) for at least duration samples;
+     * threshold_mg 0 disables. Chips with interrupt_follows_z hold the pin high while Z reads
+     * below threshold_mg; the others only detect motion, pulsing the pin whenever acceleration
+     * changes by more than threshold_mg.
+     */
+    esp_err_t (*configure_interrupt)(uint16_t threshold_mg, uint8_t duration);
+    bool interrupt_follows_z;
+    /**
+     * @brief stream samples into the chip's FIFO at (at least) hz, also setting the output data
+     * rate; hz 0 stops streaming. NULL if the chip has no FIFO.
+     */
+    esp_err_t (*configure_fifo)(uint32_t hz);
+    /**
+     * @brief drain up to max samples from the FIFO in one burst read, oldest first
+     */
+    esp_err_t (*read_fifo)(ls_accel_mg_t *samples, size_t max, size_t *count);
+} ls_accel_driver_t;
+
+extern const ls_accel_driver_t ls_accel_driver_lis2dh12;
+extern const ls_accel_driver_t ls_accel_driver_kxtj3;
+extern const ls_accel_driver_t ls_accel_driver_mpu6050;
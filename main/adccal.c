@@ -0,0 +1,39 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "adccal.h"
+#include "config.h"
+
+#define _LS_ADCCAL_RAW_COUNT 4096
+
+static uint16_t _ls_adccal_adc1_mv[_LS_ADCCAL_RAW_COUNT];
+
+esp_adc_cal_value_t ls_adccal_init(void)
+{
+    esp_adc_cal_characteristics_t characteristics;
+    esp_adc_cal_value_t val_type = esp_adc_cal_characterize(ADC_UNIT_1, LS_ADC1_ATTENUATION, ADC_WIDTH_BIT_12, LS_ADCCAL_DEFAULT_VREF_MV, &characteristics);
+    for (uint32_t raw = 0; raw < _LS_ADCCAL_RAW_COUNT; raw++)
+    {
+        _ls_adccal_adc1_mv[raw] = (uint16_t)esp_adc_cal_raw_to_voltage(raw, &characteristics);
+    }
+    return val_type;
+}
+
+uint32_t ls_adccal_raw_to_mv(uint32_t raw)
+{
+    return _ls_adccal_adc1_mv[raw < _LS_ADCCAL_RAW_COUNT ? raw : _LS_ADCCAL_RAW_COUNT - 1];
+}
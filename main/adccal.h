@@ -0,0 +1,35 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdint.h>
+#include "esp_adc_cal.h"
+
+/**
+ * Raw-to-millivolt conversion for ADC1. The eFuse (or default Vref) characterization is
+ * expanded into a lookup table once at boot, so a conversion is a single table read.
+ * All ADC1 channels use the same width and attenuation, so one table serves them all.
+ */
+
+/**
+ * @brief characterize ADC1 and build the lookup table; call before any conversion
+ *
+ * @return which calibration source the characterization used
+ */
+esp_adc_cal_value_t ls_adccal_init(void);
+
+uint32_t ls_adccal_raw_to_mv(uint32_t raw);
@@ -0,0 +1,255 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "adcstream.h"
+#include "driver/adc.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "debug.h"
+
+#define _LS_ADCSTREAM_RING_MASK (LS_ADCSTREAM_RING_LENGTH - 1)
+#if (LS_ADCSTREAM_RING_LENGTH & _LS_ADCSTREAM_RING_MASK) != 0
+#error "LS_ADCSTREAM_RING_LENGTH must be a power of two"
+#endif
+
+static const adc1_channel_t _ls_adcstream_adc1_channels[LS_ADCSTREAM_CHANNEL_COUNT] = {
+    [LS_ADCSTREAM_LIGHTSENSE] = LSADC1_LIGHTSENSE,
+    [LS_ADCSTREAM_REFLECTANCE] = LSADC1_REFLECTANCESENSE,
+    [LS_ADCSTREAM_TAPESETTING] = LSADC1_TAPESETTING,
+    [LS_ADCSTREAM_REFLECTANCE_AMBIENT] = LSADC1_REFLECTANCESENSE,
+};
+
+/**
+ * Single writer (the sampler), any number of readers. The writer fills the slot and then
+ * publishes it by advancing written; a reader that sees written move far enough to reuse
+ * a slot it copied tries again.
+ */
+static struct
+{
+    ls_adcstream_sample_t ring[LS_ADCSTREAM_RING_LENGTH];
+    volatile uint32_t written;
+} _ls_adcstream_channels[LS_ADCSTREAM_CHANNEL_COUNT];
+
+static struct
+{
+    enum ls_adcstream_channel_t channel;
+    ls_adcstream_callback_t callback;
+    void *arg;
+} _ls_adcstream_subscribers[LS_ADCSTREAM_SUBSCRIBERS_MAX];
+static volatile int _ls_adcstream_subscriber_count = 0;
+static portMUX_TYPE _ls_adcstream_subscribe_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_timer_handle_t _ls_adcstream_timer = NULL;
+
+// reflectance is only worth sampling (and at the fast rate) while the tape sensor is on
+static volatile bool _ls_adcstream_reflectance_sampling = false;
+static bool _ls_adcstream_emitter_modulating = false;
+static bool _ls_adcstream_emitter_on = false;
+static portMUX_TYPE _ls_adcstream_emitter_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief sample the ADC1 channel behind source and store the result in channel
+ */
+static void _ls_adcstream_sample(enum ls_adcstream_channel_t source, enum ls_adcstream_channel_t channel)
+{
+    ls_adcstream_sample_t sample;
+    sample.raw = (uint16_t)adc1_get_raw(_ls_adcstream_adc1_channels[source]);
+    sample.time_us = esp_timer_get_time();
+    uint32_t written = _ls_adcstream_channels[channel].written;
+    _ls_adcstream_channels[channel].ring[written & _LS_ADCSTREAM_RING_MASK] = sample;
+    __atomic_store_n(&_ls_adcstream_channels[channel].written, written + 1, __ATOMIC_RELEASE);
+    int subscriber_count = __atomic_load_n(&_ls_adcstream_subscriber_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < subscriber_count; i++)
+    {
+        if (_ls_adcstream_subscribers[i].channel == channel)
+        {
+            _ls_adcstream_subscribers[i].callback(channel, sample, _ls_adcstream_subscribers[i].arg);
+        }
+    }
+}
+
+static void _ls_adcstream_timer_callback(void *arg)
+{
+    _ls_adcstream_sample(LS_ADCSTREAM_LIGHTSENSE, LS_ADCSTREAM_LIGHTSENSE);
+    _ls_adcstream_sample(LS_ADCSTREAM_TAPESETTING, LS_ADCSTREAM_TAPESETTING);
+    if (!_ls_adcstream_reflectance_sampling)
+    {
+        return;
+    }
+    // the emitter has been in its current state since the previous period
+    bool modulating = _ls_adcstream_emitter_modulating;
+    bool emitter_on = _ls_adcstream_emitter_on;
+    _ls_adcstream_sample(LS_ADCSTREAM_REFLECTANCE,
+                         modulating && !emitter_on ? LS_ADCSTREAM_REFLECTANCE_AMBIENT : LS_ADCSTREAM_REFLECTANCE);
+    if (modulating)
+    {
+        portENTER_CRITICAL(&_ls_adcstream_emitter_spinlock);
+        // modulation may have been turned off while we sampled
+        if (_ls_adcstream_emitter_modulating)
+        {
+            _ls_adcstream_emitter_on = !_ls_adcstream_emitter_on;
+            gpio_set_level(LSGPIO_REFLECTANCEENABLE, _ls_adcstream_emitter_on);
+        }
+        portEXIT_CRITICAL(&_ls_adcstream_emitter_spinlock);
+    }
+}
+
+void ls_adcstream_init(void)
+{
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    for (int channel = 0; channel < LS_ADCSTREAM_CHANNEL_COUNT; channel++)
+    {
+        adc1_config_channel_atten(_ls_adcstream_adc1_channels[channel], LS_ADC1_ATTENUATION);
+    }
+    // readers can rely on there being at least one sample
+    for (int channel = 0; channel < LS_ADCSTREAM_CHANNEL_COUNT; channel++)
+    {
+        _ls_adcstream_sample(channel, channel);
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = &_ls_adcstream_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "adcstream"};
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &_ls_adcstream_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(_ls_adcstream_timer, _ls_adcstream_reflectance_sampling ? LS_ADCSTREAM_PERIOD_US : LS_ADCSTREAM_IDLE_PERIOD_US));
+}
+
+void ls_adcstream_set_reflectance_sampling(bool sample)
+{
+    if (sample == _ls_adcstream_reflectance_sampling)
+    {
+        return;
+    }
+    _ls_adcstream_reflectance_sampling = sample;
+    if (NULL == _ls_adcstream_timer)
+    {
+        return; // ls_adcstream_init() starts at the rate for the current setting
+    }
+    esp_timer_stop(_ls_adcstream_timer);
+    ESP_ERROR_CHECK(esp_timer_start_periodic(_ls_adcstream_timer, sample ? LS_ADCSTREAM_PERIOD_US : LS_ADCSTREAM_IDLE_PERIOD_US));
+#ifdef LSDEBUG_ADCSTREAM
+    ls_debug_printf("ADC stream %s reflectance\n", sample ? "sampling" : "no longer sampling");
+#endif
+}
+
+/**
+ * @brief copy the count most recent samples, oldest first
+ */
+static void _ls_adcstream_copy_recent(enum ls_adcstream_channel_t channel, ls_adcstream_sample_t *samples, int count)
+{
+    while (1)
+    {
+        uint32_t written = __atomic_load_n(&_ls_adcstream_channels[channel].written, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < count; i++)
+        {
+            samples[i] = _ls_adcstream_channels[channel].ring[(written - count + i) & _LS_ADCSTREAM_RING_MASK];
+        }
+        uint32_t after = __atomic_load_n(&_ls_adcstream_channels[channel].written, __ATOMIC_ACQUIRE);
+        // the writer may already be filling slot `after`, which is the oldest we copied
+        // once it has published this many more
+        if (after - written < (uint32_t)(LS_ADCSTREAM_RING_LENGTH - count))
+        {
+            return;
+        }
+#ifdef LSDEBUG_ADCSTREAM
+        ls_debug_printf("ADC stream read of channel %d overrun; retrying\n", channel);
+#endif
+    }
+}
+
+ls_adcstream_sample_t ls_adcstream_read_latest(enum ls_adcstream_channel_t channel)
+{
+    ls_adcstream_sample_t sample;
+    _ls_adcstream_copy_recent(channel, &sample, 1);
+    return sample;
+}
+
+uint32_t ls_adcstream_read_average(enum ls_adcstream_channel_t channel, int count)
+{
+    ls_adcstream_sample_t samples[LS_ADCSTREAM_RING_LENGTH];
+    uint32_t available = _ls_adcstream_channels[channel].written;
+    if (count > LS_ADCSTREAM_RING_LENGTH - 1)
+    {
+        count = LS_ADCSTREAM_RING_LENGTH - 1; // leave the slot the sampler may be writing
+    }
+    if ((uint32_t)count > available)
+    {
+        count = (int)available;
+    }
+    if (count < 1)
+    {
+        count = 1;
+    }
+    _ls_adcstream_copy_recent(channel, samples, count);
+    uint32_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += samples[i].raw;
+    }
+    return total / count;
+}
+
+int ls_adcstream_count_since(enum ls_adcstream_channel_t channel, int64_t since_us, int count)
+{
+    ls_adcstream_sample_t samples[LS_ADCSTREAM_RING_LENGTH];
+    uint32_t available = _ls_adcstream_channels[channel].written;
+    if (count > LS_ADCSTREAM_RING_LENGTH - 1)
+    {
+        count = LS_ADCSTREAM_RING_LENGTH - 1;
+    }
+    if ((uint32_t)count > available)
+    {
+        count = (int)available;
+    }
+    if (count < 1)
+    {
+        return 0;
+    }
+    _ls_adcstream_copy_recent(channel, samples, count);
+    int fresh = 0;
+    while (fresh < count && samples[count - 1 - fresh].time_us >= since_us)
+    {
+        fresh++;
+    }
+    return fresh;
+}
+
+void ls_adcstream_set_emitter_modulation(bool modulate)
+{
+    portENTER_CRITICAL(&_ls_adcstream_emitter_spinlock);
+    _ls_adcstream_emitter_on = modulate;
+    _ls_adcstream_emitter_modulating = modulate;
+    portEXIT_CRITICAL(&_ls_adcstream_emitter_spinlock);
+}
+
+bool ls_adcstream_subscribe(enum ls_adcstream_channel_t channel, ls_adcstream_callback_t callback, void *arg)
+{
+    bool subscribed = false;
+    portENTER_CRITICAL(&_ls_adcstream_subscribe_spinlock);
+    if (_ls_adcstream_subscriber_count < LS_ADCSTREAM_SUBSCRIBERS_MAX)
+    {
+        _ls_adcstream_subscribers[_ls_adcstream_subscriber_count].channel = channel;
+        _ls_adcstream_subscribers[_ls_adcstream_subscriber_count].callback = callback;
+        _ls_adcstream_subscribers[_ls_adcstream_subscriber_count].arg = arg;
+        // publish only once the entry is complete; the sampler reads the count first
+        __atomic_store_n(&_ls_adcstream_subscriber_count, _ls_adcstream_subscriber_count + 1, __ATOMIC_RELEASE);
+        subscribed = true;
+    }
+    portEXIT_CRITICAL(&_ls_adcstream_subscribe_spinlock);
+    return subscribed;
+}
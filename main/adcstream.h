@@ -0,0 +1,80 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+
+/**
+ * ADC1 sampling service: one periodic esp_timer callback owns ADC1, samples every channel
+ * below in turn and keeps the most recent samples of each in a ring buffer. Readers never
+ * block and never touch the peripheral; a read that races the sampler simply retries.
+ * The reflectance channels are sampled only while ls_adcstream_set_reflectance_sampling()
+ * has turned them on; otherwise the sampler runs at the slower LS_ADCSTREAM_IDLE_PERIOD_US.
+ */
+enum ls_adcstream_channel_t {
+    LS_ADCSTREAM_LIGHTSENSE,
+    LS_ADCSTREAM_REFLECTANCE,
+    LS_ADCSTREAM_TAPESETTING,
+    LS_ADCSTREAM_REFLECTANCE_AMBIENT, // reflectance with the emitter off; only while modulating
+    LS_ADCSTREAM_CHANNEL_COUNT
+};
+
+typedef struct ls_adcstream_sample_t {
+    uint16_t raw;
+    int64_t time_us; // esp_timer_get_time() when sampled
+} ls_adcstream_sample_t;
+
+/**
+ * @brief called from the sampler for every new sample on a subscribed channel; runs in the
+ * esp_timer task, so it must be brief and must not block
+ */
+typedef void (*ls_adcstream_callback_t)(enum ls_adcstream_channel_t channel, ls_adcstream_sample_t sample, void *arg);
+
+/**
+ * @brief configure ADC1 once, take a first sample of every channel and start sampling
+ */
+void ls_adcstream_init(void);
+
+ls_adcstream_sample_t ls_adcstream_read_latest(enum ls_adcstream_channel_t channel);
+/**
+ * @brief average of the most recent samples; count is limited to LS_ADCSTREAM_RING_LENGTH - 1
+ */
+uint32_t ls_adcstream_read_average(enum ls_adcstream_channel_t channel, int count);
+/**
+ * @brief how many of the most recent samples (at most count, limited as for read_average) were
+ * taken at or after since_us; never blocks, so callers waiting for fresh samples subscribe instead
+ */
+int ls_adcstream_count_since(enum ls_adcstream_channel_t channel, int64_t since_us, int count);
+/**
+ * @brief sample the reflectance channels every LS_ADCSTREAM_PERIOD_US (the tape sensor is on),
+ * or stop sampling them and drop to LS_ADCSTREAM_IDLE_PERIOD_US
+ */
+void ls_adcstream_set_reflectance_sampling(bool sample);
+/**
+ * @brief toggle the reflectance emitter between samples so that LS_ADCSTREAM_REFLECTANCE
+ * holds emitter-on samples and LS_ADCSTREAM_REFLECTANCE_AMBIENT emitter-off samples; each
+ * has a full sample period to settle. Turn on only with the emitter enabled; after turning
+ * off, the sampler no longer touches the emitter and the caller sets its level.
+ */
+void ls_adcstream_set_emitter_modulation(bool modulate);
+/**
+ * @brief register a callback for new samples on one channel
+ *
+ * @return false if LS_ADCSTREAM_SUBSCRIBERS_MAX callbacks are already registered
+ */
+bool ls_adcstream_subscribe(enum ls_adcstream_channel_t channel, ls_adcstream_callback_t callback, void *arg);
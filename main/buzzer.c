@@ -19,6 +19,7 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "driver/ledc.h"
+#include "esp_timer.h"
 #include "config.h"
 #include "buzzer.h"
 #include "debug.h"
@@ -32,22 +33,311 @@
 #define BUZZER_CHANNEL (LEDC_CHANNEL_0)
 #define BUZZER_DUTY (1)
 
-bool _ls_buzzer_in_use = false;
 #define LS_BUZZER_REQUEST_DEFAULT_FREQUENCY 1000
 #define LS_BUZZER_REQUEST_DEFAULT_TICKS 1
+// one tick at the default 100Hz FreeRTOS tick rate; clicks and trills were written in ticks
+#define LS_BUZZER_TICK_MS 10
+#define LS_BUZZER_REST 0
+// piezo resonances: bucket and external control
+#define LS_BUZZER_TRILL_LOW 3100
+#define LS_BUZZER_TRILL_HIGH 4000
 
 struct ls_buzzer_request_t {
     enum ls_buzzer_effects effect;
     BaseType_t frequency;
     TickType_t ticks;
+    uint32_t generation; // requests made before a cancel or preempt are dropped
 }ls_buzzer_request_t;
 
+/**
+ * @brief one step of an effect; a nonzero alternate_hz trills between the two frequencies every tick
+ */
+typedef struct _ls_buzzer_step_t
+{
+    uint16_t frequency_hz; // LS_BUZZER_REST for silence
+    uint16_t alternate_hz;
+    uint16_t duration_ms;
+} _ls_buzzer_step_t;
+
+typedef struct _ls_buzzer_sequence_t
+{
+    const _ls_buzzer_step_t *steps;
+    uint8_t count;
+    enum ls_event_t completion_event; // LSEVT_NOOP if none
+} _ls_buzzer_sequence_t;
+
+#define _LS_BUZZER_SEQUENCE(steps) {steps, sizeof(steps) / sizeof(steps[0]), LSEVT_NOOP}
+
+static const _ls_buzzer_step_t _ls_buzzer_click[] = {{500, 0, LS_BUZZER_TICK_MS}};
+static const _ls_buzzer_step_t _ls_buzzer_click_high[] = {{600, 0, LS_BUZZER_TICK_MS}};
+static const _ls_buzzer_step_t _ls_buzzer_alert_1s[] = {{1000, 0, 1000}};
+static const _ls_buzzer_step_t _ls_buzzer_alternate_high[] = {{LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 1000}};
+static const _ls_buzzer_step_t _ls_buzzer_pre_laser_warning[] = {
+    {LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 1500}, {LS_BUZZER_REST, 0, 1000},
+    {LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 1500}, {LS_BUZZER_REST, 0, 1000},
+    {LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 500}, {LS_BUZZER_REST, 0, 500},
+    {LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 400}, {LS_BUZZER_REST, 0, 400},
+    {LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 300}, {LS_BUZZER_REST, 0, 300},
+    {LS_BUZZER_TRILL_LOW, LS_BUZZER_TRILL_HIGH, 200}, {LS_BUZZER_REST, 0, 200}};
+static const _ls_buzzer_step_t _ls_buzzer_tape_enable[] = {
+    {LS_BUZZER_SCALE_B, 0, 200}, {LS_BUZZER_SCALE_CC, 0, 200}};
+static const _ls_buzzer_step_t _ls_buzzer_tape_disable[] = {
+    {LS_BUZZER_SCALE_D, 0, 200}, {LS_BUZZER_SCALE_C, 0, 200}};
+static const _ls_buzzer_step_t _ls_buzzer_tape_misread[] = {
+    {LS_BUZZER_SCALE_F, 0, 100}, {LS_BUZZER_SCALE_B, 0, 100}, {LS_BUZZER_SCALE_F, 0, 100},
+    {LS_BUZZER_REST, 0, 200}};
+static const _ls_buzzer_step_t _ls_buzzer_home_success[] = {
+    {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_E, 0, 100}, {LS_BUZZER_SCALE_G, 0, 100}, {LS_BUZZER_SCALE_CC, 0, 300},
+    {LS_BUZZER_REST, 0, 300}};
+static const _ls_buzzer_step_t _ls_buzzer_home_fail[] = {
+    {LS_BUZZER_SCALE_A, 0, 100}, {LS_BUZZER_SCALE_F, 0, 100}, {LS_BUZZER_SCALE_A, 0, 100}, {LS_BUZZER_SCALE_F, 0, 100},
+    {LS_BUZZER_SCALE_D, 0, 400},
+    {LS_BUZZER_REST, 0, 300}};
+static const _ls_buzzer_step_t _ls_buzzer_map_fail[] = {
+    {LS_BUZZER_SCALE_A, 0, 200}, {LS_BUZZER_SCALE_F, 0, 300}, {LS_BUZZER_SCALE_D, 0, 400},
+    {LS_BUZZER_REST, 0, 500}};
+static const _ls_buzzer_step_t _ls_buzzer_tilt_fail[] = {
+    {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_B, 0, 100}, {LS_BUZZER_SCALE_A, 0, 100}, {LS_BUZZER_SCALE_G, 0, 100},
+    {LS_BUZZER_SCALE_F, 0, 100}, {LS_BUZZER_SCALE_E, 0, 100}, {LS_BUZZER_SCALE_D, 0, 100}, {LS_BUZZER_SCALE_C, 0, 100},
+    {LS_BUZZER_SCALE_bb, 0, 400},
+    {LS_BUZZER_REST, 0, 500}};
+static const _ls_buzzer_step_t _ls_buzzer_settings_control_enter[] = {
+    {LS_BUZZER_SCALE_F, 0, 100}, {LS_BUZZER_SCALE_G, 0, 100}, {LS_BUZZER_SCALE_A, 0, 100}, {LS_BUZZER_SCALE_B, 0, 100},
+    {LS_BUZZER_SCALE_CC, 0, 100}};
+static const _ls_buzzer_step_t _ls_buzzer_settings_control_leave[] = {
+    {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_B, 0, 100}, {LS_BUZZER_SCALE_A, 0, 100}, {LS_BUZZER_SCALE_G, 0, 100},
+    {LS_BUZZER_SCALE_F, 0, 100}};
+static const _ls_buzzer_step_t _ls_buzzer_root[] = {{LS_BUZZER_SCALE_C, 0, 200}};
+static const _ls_buzzer_step_t _ls_buzzer_octave[] = {{LS_BUZZER_SCALE_CC, 0, 200}};
+static const _ls_buzzer_step_t _ls_buzzer_wake[] = {
+    {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_D, 0, 100}, {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_E, 0, 100},
+    {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_F, 0, 100}, {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_G, 0, 100},
+    {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_A, 0, 100}, {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_B, 0, 100},
+    {LS_BUZZER_SCALE_C, 0, 100}, {LS_BUZZER_SCALE_CC, 0, 100}};
+static const _ls_buzzer_step_t _ls_buzzer_sleep[] = {
+    {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_B, 0, 100}, {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_A, 0, 100},
+    {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_G, 0, 100}, {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_F, 0, 100},
+    {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_E, 0, 100}, {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_D, 0, 100},
+    {LS_BUZZER_SCALE_CC, 0, 100}, {LS_BUZZER_SCALE_C, 0, 100}};
+static const _ls_buzzer_step_t _ls_buzzer_nothing[] = {{LS_BUZZER_REST, 0, LS_BUZZER_TICK_MS}};
+
+// indexed by enum ls_buzzer_effects; LS_BUZZER_PLAY_TONE is built from the request
+static const _ls_buzzer_sequence_t _ls_buzzer_sequences[] = {
+    [LS_BUZZER_CLICK] = _LS_BUZZER_SEQUENCE(_ls_buzzer_click),
+    [LS_BUZZER_CLICK_HIGH] = _LS_BUZZER_SEQUENCE(_ls_buzzer_click_high),
+    [LS_BUZZER_ALERT_1S] = _LS_BUZZER_SEQUENCE(_ls_buzzer_alert_1s),
+    [LS_BUZZER_ALTERNATE_HIGH] = _LS_BUZZER_SEQUENCE(_ls_buzzer_alternate_high),
+    [LS_BUZZER_PRE_LASER_WARNING] = {_ls_buzzer_pre_laser_warning,
+                                     sizeof(_ls_buzzer_pre_laser_warning) / sizeof(_ls_buzzer_pre_laser_warning[0]),
+                                     LSEVT_BUZZER_WARNING_COMPLETE},
+    [LS_BUZZER_PLAY_TAPE_ENABLE] = _LS_BUZZER_SEQUENCE(_ls_buzzer_tape_enable),
+    [LS_BUZZER_PLAY_TAPE_DISABLE] = _LS_BUZZER_SEQUENCE(_ls_buzzer_tape_disable),
+    [LS_BUZZER_PLAY_TAPE_MISREAD] = _LS_BUZZER_SEQUENCE(_ls_buzzer_tape_misread),
+    [LS_BUZZER_PLAY_HOME_SUCCESS] = _LS_BUZZER_SEQUENCE(_ls_buzzer_home_success),
+    [LS_BUZZER_PLAY_HOME_FAIL] = _LS_BUZZER_SEQUENCE(_ls_buzzer_home_fail),
+    [LS_BUZZER_PLAY_MAP_FAIL] = _LS_BUZZER_SEQUENCE(_ls_buzzer_map_fail),
+    [LS_BUZZER_PLAY_TILT_FAIL] = _LS_BUZZER_SEQUENCE(_ls_buzzer_tilt_fail),
+    [LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER] = _LS_BUZZER_SEQUENCE(_ls_buzzer_settings_control_enter),
+    [LS_BUZZER_PLAY_SETTINGS_CONTROL_LEAVE] = _LS_BUZZER_SEQUENCE(_ls_buzzer_settings_control_leave),
+    [LS_BUZZER_PLAY_ROOT] = _LS_BUZZER_SEQUENCE(_ls_buzzer_root),
+    [LS_BUZZER_PLAY_OCTAVE] = _LS_BUZZER_SEQUENCE(_ls_buzzer_octave),
+    [LS_BUZZER_PLAY_WAKE] = _LS_BUZZER_SEQUENCE(_ls_buzzer_wake),
+    [LS_BUZZER_PLAY_SLEEP] = _LS_BUZZER_SEQUENCE(_ls_buzzer_sleep),
+    [LS_BUZZER_PLAY_NOTHING] = _LS_BUZZER_SEQUENCE(_ls_buzzer_nothing),
+};
+#define LS_BUZZER_SEQUENCE_COUNT (sizeof(_ls_buzzer_sequences) / sizeof(_ls_buzzer_sequences[0]))
+
+// sequencer state, shared by the esp_timer callback and the API; guarded by _ls_buzzer_spinlock
+// (a spinlock, as the callback runs in the esp_timer task and must not block)
+static portMUX_TYPE _ls_buzzer_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t _ls_buzzer_timer = NULL;
+static TaskHandle_t _ls_buzzer_task_handle = NULL;
+static bool _ls_buzzer_in_use = false;
+static bool _ls_buzzer_completed = false;
+static uint32_t _ls_buzzer_generation = 0;
+static _ls_buzzer_sequence_t _ls_buzzer_playing;
+static _ls_buzzer_step_t _ls_buzzer_tone_step; // LS_BUZZER_PLAY_TONE plays this
+static uint8_t _ls_buzzer_step_index;
+static bool _ls_buzzer_alternate;
+static int64_t _ls_buzzer_step_ends_us;
+// total length of requests still in ls_buzzer_queue
+static uint32_t _ls_buzzer_queued_ms = 0;
+static portMUX_TYPE _ls_buzzer_queued_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief only the pitch changes between notes; the timer and channel are configured once
+ */
 static void _ls_buzzer_frequency(uint32_t freq)
 {
+    if (LS_BUZZER_REST == freq)
+    {
+        ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0);
+        return;
+    }
+    ledc_set_freq(BUZZER_SPEED, BUZZER_TIMER, freq);
+    ledc_update_duty(BUZZER_SPEED, BUZZER_CHANNEL); // restarts output after a rest
+}
+
+static uint32_t _ls_buzzer_sequence_ms(const _ls_buzzer_sequence_t *sequence, uint8_t first)
+{
+    uint32_t ms = 0;
+    for (int i = first; i < sequence->count; i++)
+    {
+        ms += sequence->steps[i].duration_ms;
+    }
+    return ms;
+}
+
+static uint32_t _ls_buzzer_request_ms(const struct ls_buzzer_request_t *request)
+{
+    if (LS_BUZZER_PLAY_TONE == request->effect)
+    {
+        return request->ticks * portTICK_PERIOD_MS;
+    }
+    return request->effect < LS_BUZZER_SEQUENCE_COUNT ? _ls_buzzer_sequence_ms(&_ls_buzzer_sequences[request->effect], 0) : 0;
+}
+
+/**
+ * @brief sound the current step; call holding _ls_buzzer_spinlock
+ */
+static void _ls_buzzer_start_step(void)
+{
+    const _ls_buzzer_step_t *step = &_ls_buzzer_playing.steps[_ls_buzzer_step_index];
+    _ls_buzzer_alternate = false;
+    _ls_buzzer_step_ends_us = esp_timer_get_time() + step->duration_ms * 1000LL;
+    _ls_buzzer_frequency(step->frequency_hz);
+    uint32_t ms = (step->alternate_hz && step->duration_ms > LS_BUZZER_TICK_MS) ? LS_BUZZER_TICK_MS : step->duration_ms;
+    esp_timer_start_once(_ls_buzzer_timer, ms * 1000ULL);
+}
+
+/**
+ * @brief silence the buzzer; call holding _ls_buzzer_spinlock, then wake the handler task once released
+ */
+static void _ls_buzzer_finish(bool completed)
+{
+    esp_timer_stop(_ls_buzzer_timer);
+    ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0);
+    _ls_buzzer_in_use = false;
+    _ls_buzzer_completed = completed;
+}
+
+static void _ls_buzzer_timer_callback(void *arg)
+{
+    bool finished = false;
+    taskENTER_CRITICAL(&_ls_buzzer_spinlock);
+    if (_ls_buzzer_in_use)
+    {
+        const _ls_buzzer_step_t *step = &_ls_buzzer_playing.steps[_ls_buzzer_step_index];
+        int64_t remaining_us = _ls_buzzer_step_ends_us - esp_timer_get_time();
+        if (step->alternate_hz && remaining_us > 0)
+        {
+            _ls_buzzer_alternate = !_ls_buzzer_alternate;
+            _ls_buzzer_frequency(_ls_buzzer_alternate ? step->alternate_hz : step->frequency_hz);
+            esp_timer_start_once(_ls_buzzer_timer, remaining_us > LS_BUZZER_TICK_MS * 1000LL ? LS_BUZZER_TICK_MS * 1000LL : remaining_us);
+        }
+        else if (++_ls_buzzer_step_index < _ls_buzzer_playing.count)
+        {
+            _ls_buzzer_start_step();
+        }
+        else
+        {
+            _ls_buzzer_finish(true);
+            finished = true;
+        }
+    }
+    taskEXIT_CRITICAL(&_ls_buzzer_spinlock);
+    if (finished)
+    {
+        xTaskNotifyGive(_ls_buzzer_task_handle);
+    }
+}
+
+/**
+ * @brief begin playing a request unless it was cancelled while queued
+ * @return true if the sequencer will notify the handler task when it is done
+ */
+static bool _ls_buzzer_start(const struct ls_buzzer_request_t *request)
+{
+    bool started = false;
+    if (LS_BUZZER_PLAY_TONE != request->effect && request->effect >= LS_BUZZER_SEQUENCE_COUNT)
+    {
+#ifdef LSDEBUG_BUZZER
+        ls_debug_printf("Unknown ls_buzzer_effect %d -- I'm confused", request->effect);
+#endif
+        return false;
+    }
+    taskENTER_CRITICAL(&_ls_buzzer_spinlock);
+    if (request->generation == _ls_buzzer_generation)
+    {
+        if (LS_BUZZER_PLAY_TONE == request->effect)
+        {
+            _ls_buzzer_tone_step.frequency_hz = request->frequency;
+            _ls_buzzer_tone_step.alternate_hz = 0;
+            _ls_buzzer_tone_step.duration_ms = request->ticks > 0 ? request->ticks * portTICK_PERIOD_MS : 1;
+            _ls_buzzer_playing.steps = &_ls_buzzer_tone_step;
+            _ls_buzzer_playing.count = 1;
+            _ls_buzzer_playing.completion_event = LSEVT_NOOP;
+            started = true;
+        }
+        else
+        {
+            _ls_buzzer_playing = _ls_buzzer_sequences[request->effect];
+            started = _ls_buzzer_playing.count > 0;
+        }
+    }
+    if (started)
+    {
+        _ls_buzzer_step_index = 0;
+        _ls_buzzer_in_use = true;
+        _ls_buzzer_start_step();
+    }
+    taskEXIT_CRITICAL(&_ls_buzzer_spinlock);
+    return started;
+}
+
+/**
+ * @brief drop everything queued and stop whatever is playing
+ */
+static void _ls_buzzer_stop_all(void)
+{
+    taskENTER_CRITICAL(&_ls_buzzer_spinlock);
+    _ls_buzzer_generation++;
+    bool stopped = _ls_buzzer_in_use;
+    if (stopped)
+    {
+        _ls_buzzer_finish(false);
+    }
+    taskEXIT_CRITICAL(&_ls_buzzer_spinlock);
+    xQueueReset(ls_buzzer_queue);
+    taskENTER_CRITICAL(&_ls_buzzer_queued_spinlock);
+    _ls_buzzer_queued_ms = 0;
+    taskEXIT_CRITICAL(&_ls_buzzer_queued_spinlock);
+    if (stopped)
+    {
+        xTaskNotifyGive(_ls_buzzer_task_handle);
+    }
+}
+
+static void _ls_buzzer_send(struct ls_buzzer_request_t *request, bool to_front)
+{
+    uint32_t ms = _ls_buzzer_request_ms(request);
+    request->generation = _ls_buzzer_generation;
+    // don't block if queue full
+    if (pdTRUE == (to_front ? xQueueSendToFront(ls_buzzer_queue, (void *)request, 0) : xQueueSend(ls_buzzer_queue, (void *)request, 0)))
+    {
+        taskENTER_CRITICAL(&_ls_buzzer_queued_spinlock);
+        _ls_buzzer_queued_ms += ms;
+        taskEXIT_CRITICAL(&_ls_buzzer_queued_spinlock);
+    }
+}
+
+void ls_buzzer_init(void)
+{
+    ls_buzzer_queue = xQueueCreate(32, sizeof(ls_buzzer_request_t));
     ledc_timer_config_t ledc_timer = {
         .speed_mode = BUZZER_SPEED,
         .duty_resolution = BUZZER_RESOLUTION,
-        .freq_hz = freq,
+        .freq_hz = LS_BUZZER_REQUEST_DEFAULT_FREQUENCY,
         .timer_num = BUZZER_TIMER,
         .clk_cfg = BUZZER_CLOCK,
     };
@@ -61,11 +351,13 @@ static void _ls_buzzer_frequency(uint32_t freq)
         .hpoint = 0,
     };
     ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
-}
-
-void ls_buzzer_init(void)
-{
-    ls_buzzer_queue = xQueueCreate(32, sizeof(ls_buzzer_request_t));
+    ESP_ERROR_CHECK(ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0));
+    esp_timer_create_args_t timer_args = {
+        .callback = &_ls_buzzer_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "buzzer",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &_ls_buzzer_timer));
 }
 
 void ls_buzzer_effect(enum ls_buzzer_effects effect)
@@ -74,70 +366,53 @@ void ls_buzzer_effect(enum ls_buzzer_effects effect)
     request.effect = effect;
     request.frequency = LS_BUZZER_REQUEST_DEFAULT_FREQUENCY;
     request.ticks = LS_BUZZER_REQUEST_DEFAULT_TICKS;
-    xQueueSend(ls_buzzer_queue, (void *)&request, 0); // don't block if queue full
-}
-
-bool ls_buzzer_in_use(void)
-{
-    return (_ls_buzzer_in_use || (uxQueueMessagesWaiting(ls_buzzer_queue) > 0));
+    _ls_buzzer_send(&request, false);
 }
 
-
-static void _ls_buzzer_effect_click(int frequency)
+void ls_buzzer_preempt(enum ls_buzzer_effects effect)
 {
-#ifdef LSDEBUG_BUZZER
-    ls_debug_printf("Buzzer Click at %dHz\n", frequency);
-#endif
-    _ls_buzzer_frequency(frequency);
-    vTaskDelay(1);
+    struct ls_buzzer_request_t request;
+    request.effect = effect;
+    request.frequency = LS_BUZZER_REQUEST_DEFAULT_FREQUENCY;
+    request.ticks = LS_BUZZER_REQUEST_DEFAULT_TICKS;
+    _ls_buzzer_stop_all();
+    _ls_buzzer_send(&request, true);
 }
 
-static void _ls_buzzer_play_note(enum ls_buzzer_scale note, int ms_duration)
+void ls_buzzer_cancel(void)
 {
-    _ls_buzzer_frequency((uint32_t)note);
-    vTaskDelay(pdMS_TO_TICKS(ms_duration));
-    ESP_ERROR_CHECK(ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0));
+    _ls_buzzer_stop_all();
 }
 
-static void _ls_buzzer_effect_alternate_high(int duration_ms)
+bool ls_buzzer_in_use(void)
 {
-#ifdef LSDEBUG_BUZZER
-    ls_debug_printf("Buzzer Alternate High\n");
-#endif
-    for (int i = 0; i < pdMS_TO_TICKS(duration_ms); i += 2)
-    {
-        _ls_buzzer_frequency(3100); // resonant frequency of bucket piezo
-        vTaskDelay(1);
-        _ls_buzzer_frequency(4000); // resonant frequency of external control piezo
-        vTaskDelay(1);
-    }
-    ESP_ERROR_CHECK(ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0));
+    return (_ls_buzzer_in_use || (uxQueueMessagesWaiting(ls_buzzer_queue) > 0));
 }
 
-static void _ls_buzzer_pre_laser_warning(void)
+uint32_t ls_buzzer_remaining_ms(void)
 {
-#ifdef LSDEBUG_BUZZER
-    ls_debug_printf("Begin pre-laser warning\n");
-#endif
-    for (int i = 0; i < 2; i++)
+    uint32_t ms = 0;
+    taskENTER_CRITICAL(&_ls_buzzer_spinlock);
+    if (_ls_buzzer_in_use)
     {
-        _ls_buzzer_effect_alternate_high(1500);
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        int64_t step_us = _ls_buzzer_step_ends_us - esp_timer_get_time();
+        ms = (step_us > 0 ? (uint32_t)(step_us / 1000) : 0) + _ls_buzzer_sequence_ms(&_ls_buzzer_playing, _ls_buzzer_step_index + 1);
     }
-    for (int i = 0; i < 4; i++)
-    {
-        _ls_buzzer_effect_alternate_high(500 - i * 100);
-        vTaskDelay(pdMS_TO_TICKS(500 - i * 100));
-    }
-    ls_event event;
-    event.type = LSEVT_BUZZER_WARNING_COMPLETE;
-    event.value = NULL;
-    xQueueSendToBack(ls_event_queue, (void *)&event, pdMS_TO_TICKS(10000));
+    taskEXIT_CRITICAL(&_ls_buzzer_spinlock);
+    taskENTER_CRITICAL(&_ls_buzzer_queued_spinlock);
+    ms += _ls_buzzer_queued_ms;
+    taskEXIT_CRITICAL(&_ls_buzzer_queued_spinlock);
+    return ms;
 }
 
+/**
+ * @brief Hands queued requests to the timer-driven sequencer one at a time. It sleeps while
+ * an effect plays and only wakes to start the next one or send a completion event.
+ */
 void ls_buzzer_handler_task(void *pvParameter)
 {
     struct ls_buzzer_request_t received;
+    _ls_buzzer_task_handle = xTaskGetCurrentTaskHandle();
     while (1)
     {
         if (xQueueReceive(ls_buzzer_queue, &received, portMAX_DELAY) != pdTRUE)
@@ -145,156 +420,35 @@ void ls_buzzer_handler_task(void *pvParameter)
 #ifdef LSDEBUG_BUZZER
             ls_debug_printf("No buzz requested maximum delay... getting very bored.\n");
 #endif
+            continue;
         }
-        else
-        {
-            _ls_buzzer_in_use = true;
-            switch (received.effect)
-            {
-            case LS_BUZZER_CLICK:
-                _ls_buzzer_effect_click(500);
-                break;
-            case LS_BUZZER_CLICK_HIGH:
-                _ls_buzzer_effect_click(600);
-                break;
-            case LS_BUZZER_ALERT_1S:
-#ifdef LSDEBUG_BUZZER
-                ls_debug_printf("Buzzer Alert 1s\n");
-#endif
-                _ls_buzzer_frequency(1000);
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                break;
-            case LS_BUZZER_PLAY_TONE:
-                _ls_buzzer_frequency(received.frequency);
-                vTaskDelay(received.ticks);
-                ESP_ERROR_CHECK(ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0));
-                break;
-            case LS_BUZZER_ALTERNATE_HIGH:
-                _ls_buzzer_effect_alternate_high(1000);
-                break;
-            case LS_BUZZER_PRE_LASER_WARNING:
-                _ls_buzzer_pre_laser_warning();
-                break;
-            case LS_BUZZER_PLAY_TAPE_ENABLE:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 200);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 200);
-                break;
-            case LS_BUZZER_PLAY_TAPE_DISABLE:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_D, 200);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 200);
-                break;
-            case LS_BUZZER_PLAY_TAPE_MISREAD:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                vTaskDelay(pdMS_TO_TICKS(200)); // rest
-                break;
-            case LS_BUZZER_PLAY_HOME_SUCCESS:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_E, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_G, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 300);
-                vTaskDelay(pdMS_TO_TICKS(300)); // rest
-                break;
-            case LS_BUZZER_PLAY_HOME_FAIL:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_D, 400);
-                vTaskDelay(pdMS_TO_TICKS(300)); // rest
-                break;
-            case LS_BUZZER_PLAY_MAP_FAIL:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 200);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 300);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_D, 400);
-                vTaskDelay(pdMS_TO_TICKS(500)); // rest
-                break;
-            case LS_BUZZER_PLAY_TILT_FAIL:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_G, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_E, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_D, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_bb, 400);
-                vTaskDelay(pdMS_TO_TICKS(500)); // rest
-                break;
-            case LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_G, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                break;
-            case LS_BUZZER_PLAY_SETTINGS_CONTROL_LEAVE:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_G, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                break;
-            case LS_BUZZER_PLAY_ROOT:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 200);
-                break;
-            case LS_BUZZER_PLAY_OCTAVE:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 200);
-                break;
-            case LS_BUZZER_PLAY_WAKE:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_D, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_E, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_G, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                break;
-            case LS_BUZZER_PLAY_SLEEP:
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_B, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_A, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_G, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_F, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_E, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_D, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_CC, 100);
-                _ls_buzzer_play_note(LS_BUZZER_SCALE_C, 100);
-                break;
-            case LS_BUZZER_PLAY_NOTHING:
-                ESP_ERROR_CHECK(ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0));
-                vTaskDelay(1);
-                break;
-            default:;
+        uint32_t ms = _ls_buzzer_request_ms(&received);
+        taskENTER_CRITICAL(&_ls_buzzer_queued_spinlock);
+        _ls_buzzer_queued_ms = _ls_buzzer_queued_ms > ms ? _ls_buzzer_queued_ms - ms : 0;
+        taskEXIT_CRITICAL(&_ls_buzzer_queued_spinlock);
 #ifdef LSDEBUG_BUZZER
-                ls_debug_printf("Unknown ls_buzzer_effect %d -- I'm confused", received.effect);
+        ls_debug_printf("Buzzer effect %d for %ums\n", received.effect, ms);
 #endif
-            }
+        if (!_ls_buzzer_start(&received))
+        {
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (_ls_buzzer_completed && LSEVT_NOOP != _ls_buzzer_playing.completion_event)
+        {
+            ls_event event = ls_event_new(_ls_buzzer_playing.completion_event);
+            ls_event_send(&event, pdMS_TO_TICKS(10000));
         }
-        ESP_ERROR_CHECK(ledc_stop(BUZZER_SPEED, BUZZER_CHANNEL, 0));
-        _ls_buzzer_in_use = false;
     }
 }
+
 void ls_buzzer_note(enum ls_buzzer_scale note, TickType_t ticks)
 {
     struct ls_buzzer_request_t request;
     request.effect = LS_BUZZER_PLAY_TONE;
     request.frequency = _constrain((BaseType_t) note, 500, 22000);
     request.ticks = ticks;
-    xQueueSend(ls_buzzer_queue, (void *)&request, 0); // don't block if queue full
+    _ls_buzzer_send(&request, false);
 };
 
 void ls_buzzer_tone(BaseType_t frequency_hz)
@@ -303,5 +457,5 @@ void ls_buzzer_tone(BaseType_t frequency_hz)
     request.effect = LS_BUZZER_PLAY_TONE;
     request.frequency = (BaseType_t) _constrain(frequency_hz, 500, 22000);;
     request.ticks = LS_BUZZER_REQUEST_DEFAULT_TICKS;
-    xQueueSend(ls_buzzer_queue, (void *)&request, 0); // don't block if queue full
+    _ls_buzzer_send(&request, false);
 }
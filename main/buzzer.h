@@ -66,8 +66,26 @@ QueueHandle_t ls_buzzer_queue;
 
 void ls_buzzer_init(void);
 
+/**
+ * @brief queue an effect to play after anything already queued
+ */
 void ls_buzzer_effect(enum ls_buzzer_effects effect);
 
+/**
+ * @brief stop the current effect, discard the queue, and play this effect now
+ */
+void ls_buzzer_preempt(enum ls_buzzer_effects effect);
+
+/**
+ * @brief silence the buzzer and discard everything queued; a cancelled effect sends no completion event
+ */
+void ls_buzzer_cancel(void);
+
+/**
+ * @brief milliseconds until the current effect and everything queued behind it have played
+ */
+uint32_t ls_buzzer_remaining_ms(void);
+
 void ls_buzzer_note(enum ls_buzzer_scale note, TickType_t ticks);
 
 void ls_buzzer_tone(BaseType_t frequency_hz);
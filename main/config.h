@@ -18,6 +18,7 @@
 #pragma once
 #include "debug.h"
 #include "driver/gpio.h"
+#include "driver/adc.h"
 
 // these GPIO assignments changed from the Nov '21 test board (rectangular)
 // to the January/April '22 kit boards. On detecting the MPU6050 accelerometer
@@ -74,8 +75,17 @@ gpio_num_t lsgpio_servopulse(void);
 #define LSI2C_SDA 21
 #define LSI2C_SCL 22
 #define LSI2C_FREQ_HZ 400000
-// currently unused
+// transactions waiting for the I2C service task; see ls_i2c_submit()
+#define LS_I2C_QUEUE_LENGTH 8
+#define LS_I2C_TASK_PRIORITY 18
+// a six-byte burst takes well under 1ms at 400kHz; anything near this is a stuck bus
+#define LS_I2C_TIMEOUT_MS 20
+// with LSDEBUG_I2C, the I2C task prints its statistics this often and after every bus recovery
+#define LS_I2C_STATS_PRINT_MS 60000
+// accelerometer interrupt output (LIS2DH12 INT1 / KXTJ3 INT), active high
 #define LSGPIO_SPARE2 23
+#define LSGPIO_TILTINTERRUPT LSGPIO_SPARE2
+// currently unused
 #define LSGPIO_SPARE3 1
 #define LSGPIO_SPARE4 3
 
@@ -92,6 +102,20 @@ gpio_num_t lsgpio_servopulse(void);
 #define LS_SERVO_MCPWM_IO_SIGNALS MCPWM0A
 #define LS_SERVO_MCPWM_TIMER MCPWM_TIMER_0
 #define LS_SERVO_MCPWM_GENERATOR MCPWM_OPR_A
+// the servo only uses one pulse per 50Hz PWM frame, so the motion engine updates once per frame
+#define LS_SERVO_FRAME_US 20000
+// acceleration limit for servo moves (pulse width microseconds per second per second)
+#define LS_SERVO_ACCELERATION_US_PER_S2 4000
+// servo calibration (see servocal.h): up to this many (us, millidegree) points per unit
+#define LS_SERVOCAL_POINTS_MAX 8
+// uncalibrated servos are assumed linear at this many millidegrees per 1000us, 0 at LS_SERVO_US_MID
+#define LS_SERVOCAL_DEFAULT_MDEG_PER_1000US 90000
+// servo calibration capture in secondary settings: aim the laser at each reference mark in turn
+// with the bottom angle slider and hold it there; the marks are at FIRST, FIRST+STEP, ... millidegrees
+#define LS_SERVOCAL_CAPTURE_POINTS 4
+#define LS_SERVOCAL_CAPTURE_FIRST_MDEG 0
+#define LS_SERVOCAL_CAPTURE_STEP_MDEG 15000
+#define LS_SERVOCAL_CAPTURE_HOLD_MS 5000
 // selftest holds the servo at midpoint this long to allow adjustment
 #define LS_SERVO_SELFTEST_HOLD_MS 5000
 
@@ -124,27 +148,53 @@ gpio_num_t lsgpio_servopulse(void);
 #define LS_CONTROLS_READING_TOP 4040
 // any ADC reading <= LS_CONTROLS_READING_BOTTOM is considered min
 #define LS_CONTROLS_READING_BOTTOM 50
-// any ADC reading must change by this much from its previous value to be registered.
+// a filtered reading must change by this much from its last reported value to be registered.
 #define LS_CONTROLS_READING_MOVE_THRESHOLD 20
-#define LS_CONTROLS_READINGS_TO_AVERAGE 5
-// when controls are connected, readings are sent every tick, so 50 reads=~5sec
-#define LS_CONTROLS_FASTREADS_AFTER_MOVE 50
+// ...or by this much for the knob that moved most recently, so it tracks finely once grabbed
+#define LS_CONTROLS_READING_LIVE_THRESHOLD 6
+// each scan takes the median of this many raw reads per knob (odd)
+#define LS_CONTROLS_MEDIAN_READS 5
+// then low-pass filters medians with weight 1/2^LS_CONTROLS_FILTER_SHIFT on the newest
+#define LS_CONTROLS_FILTER_SHIFT 1
+// scan intervals: while a knob is moving, while connected but idle, and while disconnected
+// (only the connection channel is read then)
+#define LS_CONTROLS_SCAN_MOVING_MS 20
+#define LS_CONTROLS_SCAN_IDLE_MS 150
+#define LS_CONTROLS_SCAN_DISCONNECTED_MS 600
+// a knob counts as moving for this long after its last registered change
+#define LS_CONTROLS_MOVING_HOLD_MS 2000
 // a second connection must happen within this many microseconds to enter the secondary controls
 #define LS_CONTROLS_SECONDARY_US_TIME 6000000L
 
-// values read by ADC for tape reflectance sensor
-// based on testing conducted March 18 '22
-#define LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET 1750
-#define LS_REFLECTANCE_ADC_MIN_BLACK_TAPE 2750
-#define LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET 2000
-#define LS_REFLECTANCE_ADC_MAX_SILVER_TAPE 500
+// all ADC1 channels are read at this attenuation; see adcstream.c and adccal.c
+#define LS_ADC1_ATTENUATION ADC_ATTEN_DB_11
+// used for calibration only on chips without Vref or two-point values in eFuse
+#define LS_ADCCAL_DEFAULT_VREF_MV 1100
+
+// millivolts read by ADC for tape reflectance sensor
+// based on testing conducted March 18 '22 (raw 1750, 2750, 2000, 500), converted
+// with a typical 11dB characterization of 142mV + 0.75mV per count
+#define LS_REFLECTANCE_MV_MAX_WHITE_BUCKET 1455
+#define LS_REFLECTANCE_MV_MIN_BLACK_TAPE 2205
+#define LS_REFLECTANCE_MV_MIN_BLACK_BUCKET 1640
+#define LS_REFLECTANCE_MV_MAX_SILVER_TAPE 515
 
-// approximate midpoints between settings (3 boards tested Apr 2 '22)
-#define LS_TAPEMODE_THRESHOLD_1 300
-#define LS_TAPEMODE_THRESHOLD_2 975
-#define LS_TAPEMODE_THRESHOLD_3 1750
-#define LS_TAPEMODE_THRESHOLD_4 2525
-#define LS_TAPEMODE_THRESHOLD_5 3525
+// approximate midpoints between settings in millivolts (3 boards tested Apr 2 '22 at
+// raw 300, 975, 1750, 2525, 3525; converted as above)
+#define LS_TAPEMODE_THRESHOLD_MV_1 370
+#define LS_TAPEMODE_THRESHOLD_MV_2 875
+#define LS_TAPEMODE_THRESHOLD_MV_3 1455
+#define LS_TAPEMODE_THRESHOLD_MV_4 2035
+#define LS_TAPEMODE_THRESHOLD_MV_5 2785
+
+// read the tape with the emitter alternately on and off to reject ambient (sun) light; see tape.h
+#define LS_TAPE_DIFFERENTIAL_ENABLE
+// phototransistor settling after the emitter switches; it gets one ADC stream period
+#define LS_TAPE_DIFFERENTIAL_SETTLE_US 500
+// reflectance sensor reading with no light at all
+#define LS_TAPE_DARK_RAW 4095
+// mapping reads a bin once fresh samples arrive, or after this long regardless
+#define LS_TAPE_SAMPLES_TIMEOUT_MS 100
 
 // we want two tape map entries per fullstep (microstepping must be 2 or larger)
 #define LS_MAP_ENTRY_COUNT (LS_STEPPER_FULLSTEPS_PER_ROTATION * 2)
@@ -153,6 +203,14 @@ gpio_num_t lsgpio_servopulse(void);
 #define LS_MAP_ALLOWABLE_MISREAD_PERCENT 12
 #define LS_MAP_HISTOGRAM_BINCOUNT 32
 
+// coordinated pan/tilt paths (see path.h); define LS_PATH_ACTIVE_PATTERN to use one in the active state instead of random movement
+//#define LS_PATH_ACTIVE_PATTERN LS_PATH_PATTERN_LISSAJOUS
+#define LS_PATH_WAYPOINTS_MAX 64
+#define LS_PATH_LISSAJOUS_AZIMUTH_FREQUENCY 3
+#define LS_PATH_LISSAJOUS_ELEVATION_FREQUENCY 2
+#define LS_PATH_ZIGZAG_TEETH 12
+#define LS_PATH_SPIRAL_TURNS 4
+
 #define LS_HOME_ATTEMPTS_ALLOWED 3
 #define LS_HOME_HOMINGS_TO_AVERAGE 5
 #define LS_HOME_INITIAL_ROTATIONS 5
@@ -170,13 +228,27 @@ gpio_num_t lsgpio_servopulse(void);
 #endif
 
 // light levels based on sample data recorded in lightsense.h; roughly 40lux on, 20lux off
-#define LS_LIGHTSENSE_DAY_THRESHOLD 1000
-#define LS_LIGHTSENSE_NIGHT_THRESHOLD 500
-#define LS_LIGHTSENSE_READING_INTERVAL_MS 4000
-#define LS_LIGHTSENSE_READINGS_TO_SWITCH 4 
+// (calibrated millivolts; formerly raw readings of 1000 and 500)
+#define LS_LIGHTSENSE_DAY_THRESHOLD_MV 950
+#define LS_LIGHTSENSE_NIGHT_THRESHOLD_MV 545
+// thresholds are constrained to the sensor's range at 11dB attenuation
+#define LS_LIGHTSENSE_THRESHOLD_MV_MAX 3300
+// the light estimate is a low-pass filtered millivolt reading with this time constant
+#define LS_LIGHTSENSE_FILTER_TAU_MS 12000
+// once the mode changes, it stays at least this long
+#define LS_LIGHTSENSE_MIN_DWELL_MS 60000
+// sample quickly while the estimate is between the thresholds or this close to one; slowly otherwise
+#define LS_LIGHTSENSE_NEAR_THRESHOLD_MV 150
+#define LS_LIGHTSENSE_INTERVAL_FAST_MS 1000
+#define LS_LIGHTSENSE_INTERVAL_SLOW_MS 8000
 
-#define LS_TILT_THRESHOLD_DETECTED_MG 890
-#define LS_TILT_THRESHOLD_OK_MG 920
+// angle from the installed orientation (formerly Z below 890mg / above 920mg, i.e. about 27 / 23 degrees from level)
+#define LS_TILT_THRESHOLD_DETECTED_MDEG 27000
+#define LS_TILT_THRESHOLD_OK_MDEG 23000
+// the installed orientation may not be captured further than this from level
+#define LS_TILT_CALIBRATION_MAX_MDEG 20000
+// readings averaged to capture the installed orientation
+#define LS_TILT_CALIBRATION_READINGS 16
 #ifdef LSDEBUG_I2C
 // the accelerometer will check this frequently if I2C debug is active
 #define LS_TILT_REPORT_RATE_MS 200
@@ -184,5 +256,81 @@ gpio_num_t lsgpio_servopulse(void);
 // the accelerometer will check this frequently during normal operation
 #define LS_TILT_REPORT_RATE_MS 400
 #endif
+// use the accelerometer's threshold interrupt on LSGPIO_TILTINTERRUPT rather than polling while upright
+// (not the MPU6050, whose interrupt pin is not wired on the November '21 test boards);
+// boards whose INT pin is not wired to that spare GPIO are caught by the pull-up probe when arming and poll instead
+#define LS_TILT_INTERRUPT_ENABLE
+#define LS_TILT_INTERRUPT_ODR_HZ 50
+// how long the condition must persist before the accelerometer raises its interrupt
+#define LS_TILT_INTERRUPT_DURATION_MS 100
+// after a motion interrupt, readings to confirm a tilt are taken this often
+#define LS_TILT_INTERRUPT_CONFIRM_MS 20
+// while upright, one reading this often guards against a missed interrupt (e.g., a tip too slow
+// for the KXTJ3's motion engine); a disagreeing reading switches to confirming at LS_TILT_INTERRUPT_CONFIRM_MS
+#define LS_TILT_INTERRUPT_BACKSTOP_MS 2000
+
+// states waiting for the buzzer/stepper to finish re-check this often; keep well under the tilt response budget
+#define LS_STATE_SETTLE_POLL_MS 10
+// states register deadlines instead of relying on a periodic no-op event; these are the intervals they use
+#define LS_STATE_ERROR_ALERT_INTERVAL_MS 30000
+#define LS_STATE_SLEEP_SNORE_INTERVAL_MS 40000
+#define LS_STATE_SECONDARY_SETTINGS_REMINDER_MS 50000
+// event queue depth per priority level (see events.h); slider and light events coalesce so UI can stay short
+#define LS_EVENT_QUEUE_SAFETY_LENGTH 4
+#define LS_EVENT_QUEUE_MOTION_LENGTH 24
+#define LS_EVENT_QUEUE_UI_LENGTH 8
+
+// record per-event-type queue wait and handler time histograms; see eventstats.h
+//#define LS_EVENTSTATS_ENABLE
+// distinct event types tracked; types seen after this many are not recorded
+#define LS_EVENTSTATS_TYPES_MAX 32
+// the state machine prints the statistics this often while they are enabled
+#define LS_EVENTSTATS_PRINT_MS 60000
+
+// run the scripted benchmark scenarios on the host build's simulated plant, one per restart; see scenario.h
+//#define LS_SCENARIO_ENABLE
+// a scenario that has not finished this long after boot is reported as failed
+#define LS_SCENARIO_TIMEOUT_MS 600000
+#define LS_SCENARIO_TIME_TO_LASER_MAX_MS 120000
+#define LS_SCENARIO_HOMING_MAX_MS 30000
+#define LS_SCENARIO_MAPPING_MAX_MS 90000
+// how long after the laser comes on to watch which enabled map entries the sweep reaches
+#define LS_SCENARIO_COVERAGE_WINDOW_MS 60000
+#define LS_SCENARIO_COVERAGE_MIN_PERMIL 600
+#define LS_SCENARIO_NO_TAPE_SETTLE_MAX_MS 120000
+// how long into map building the simulated brownout restarts the chip
+#define LS_SCENARIO_BROWNOUT_AFTER_MS 5000
+#define LS_SCENARIO_DAWN_TO_LASER_MAX_MS 45000
+// the tilt-latency scenario sends LSEVT_TILT_DETECTED a seeded time up to this long after entering each state
+#define LS_SCENARIO_TILT_INJECT_WINDOW_MS 1000
+#define LS_SCENARIO_TILT_LATENCY_MAX_MS 20
+
+// stream the accelerometer FIFO and look for resonance and stalls at the stepper's step rate; see vibration.h
+// (LIS2DH12 only; the tilt interrupt then shares its faster output data rate)
+//#define LS_VIBRATION_ENABLE
+#define LS_VIBRATION_ODR_HZ 400
+// FIFO holds 32 samples (80ms at 400Hz); drain it at least this often
+#define LS_VIBRATION_BATCH_MS 50
+// samples per analysis block; bins are LS_VIBRATION_ODR_HZ / LS_VIBRATION_BLOCK_SAMPLES Hz wide
+#define LS_VIBRATION_BLOCK_SAMPLES 128
+// a block is analysed only if the step rate stayed within this many steps/s of its start
+#define LS_VIBRATION_RATE_TOLERANCE 60
+// speed bands between LS_STEPPER_STEPS_PER_SECOND_MIN and _MAX, each with its own resonance estimate
+#define LS_VIBRATION_BANDS 16
+// step-tone amplitude above which a speed band counts as resonant
+#define LS_VIBRATION_RESONANCE_MG 60
+// broadband vibration with little step tone suggests the motor is skipping
+#define LS_VIBRATION_STALL_RMS_MG 150
+#define LS_VIBRATION_STALL_TONE_MG 15
+// long-term vibration while moving above which bearings are reported as worn
+#define LS_VIBRATION_WEAR_RMS_MG 80
 
-#define LS_EVENT_NOOP_TIMEOUT_MS 50000
\ No newline at end of file
+// ADC1 channels are sampled together this often by the ADC stream service while the tape sensor is on; see adcstream.h
+#define LS_ADCSTREAM_PERIOD_US 1000
+// ...and this often otherwise, when only the light sensor (read once a second at most) and tape setting matter
+#define LS_ADCSTREAM_IDLE_PERIOD_US 50000
+// samples kept per channel; must be a power of two
+#define LS_ADCSTREAM_RING_LENGTH 16
+#define LS_ADCSTREAM_SUBSCRIBERS_MAX 4
+// samples averaged for a tape, light or tape setting reading (formerly 4 blocking reads each)
+#define LS_ADCSTREAM_READ_AVERAGE 4
\ No newline at end of file
@@ -48,67 +48,90 @@ enum ls_controls_status ls_controls_get_current_status(void)
     return ls_controls_current_status;
 }
 
-#define _ls_controls_task_knobs_havent_moved()                \
-    {                                                         \
-        for (int i = 0; i < LS_CONTROLS_TASK_KNOB_COUNT; i++) \
-            moved_knob[i] = false;                            \
+#define LS_CONTROLS_TASK_KNOB_COUNT 4
+#define LS_CONTROLS_TASK_SLIDER_COUNT 3
+#define LS_CONTROLS_TASK_CONNECTION_READINGS 3
+// filtered values carry this many fractional bits
+#define LS_CONTROLS_FILTER_FRACTION_BITS 4
+
+static const adc2_channel_t _ls_controls_knob_channels[LS_CONTROLS_TASK_KNOB_COUNT] = {LSADC2_KNOB3, LSADC2_KNOB4, LSADC2_KNOB5, LSADC2_KNOB6};
+static const enum ls_event_t _ls_controls_knob_events[LS_CONTROLS_TASK_SLIDER_COUNT] = {LSEVT_CONTROLS_SPEED, LSEVT_CONTROLS_TOPANGLE, LSEVT_CONTROLS_BOTTOMANGLE};
+static BaseType_t *const _ls_controls_knob_values[LS_CONTROLS_TASK_SLIDER_COUNT] = {&_ls_controls_current_speed, &_ls_controls_current_topangle, &_ls_controls_current_bottomangle};
+
+/**
+ * @brief median of LS_CONTROLS_MEDIAN_READS raw reads; rejects the occasional ADC2 spike
+ * that an average would smear into a false move. Caller holds adc2_mux.
+ */
+static int _ls_controls_read_median(int knob)
+{
+    int reads[LS_CONTROLS_MEDIAN_READS];
+    for (int i = 0; i < LS_CONTROLS_MEDIAN_READS; i++)
+    {
+        int adc_reading = 0;
+        ESP_ERROR_CHECK(adc2_get_raw(_ls_controls_knob_channels[knob], ADC_WIDTH_12Bit, &adc_reading));
+        // insertion sort as we go
+        int j = i;
+        for (; j > 0 && reads[j - 1] > adc_reading; j--)
+        {
+            reads[j] = reads[j - 1];
+        }
+        reads[j] = adc_reading;
     }
+    return reads[LS_CONTROLS_MEDIAN_READS / 2];
+}
+
+static enum ls_controls_status _ls_controls_status_from_reading(int adc)
+{
+    if (adc < LS_CONTROLS_ADC_MAX_DISCONNECT)
+    {
+        return LS_CONTROLS_STATUS_DISCONNECTED;
+    }
+    if (_ls_controls_connected(adc))
+    {
+        return LS_CONTROLS_STATUS_CONNECTED;
+    }
+    return LS_CONTROLS_STATUS_INVALID;
+}
+
 void ls_controls_task(void *pvParameter)
 {
-#define LS_CONTROLS_TASK_KNOB_COUNT 4
-#define LS_CONTROLS_TASK_CONNECTION_READINGS 3
     uint8_t connection_reading = 0;
-    adc2_channel_t knob_channels[] = {LSADC2_KNOB3, LSADC2_KNOB4, LSADC2_KNOB5, LSADC2_KNOB6};
-    uint32_t knob_readings[LS_CONTROLS_TASK_KNOB_COUNT];
-    bool moved_knob[LS_CONTROLS_TASK_KNOB_COUNT];
-    _ls_controls_task_knobs_havent_moved();
+    int32_t filtered[LS_CONTROLS_TASK_SLIDER_COUNT] = {0};
+    int live_knob = -1; // the knob that moved most recently, if it is still moving
+    int64_t live_until_us = 0;
     int64_t last_connected_at_us_time = 0L; // used to enter secondary controls
-    int fastreads = 0;
     enum ls_controls_status connection_readings[LS_CONTROLS_TASK_CONNECTION_READINGS];
     for (int i = 0; i < LS_CONTROLS_TASK_CONNECTION_READINGS; i++)
     {
         connection_readings[i] = LS_CONTROLS_STATUS_INVALID;
     }
+    // atten 11 by default... shouldn't need to focus on lower voltages?
+    for (int knob = 0; knob < LS_CONTROLS_TASK_KNOB_COUNT; knob++)
+    {
+        ESP_ERROR_CHECK(adc2_config_channel_atten(_ls_controls_knob_channels[knob], ADC_ATTEN_11db));
+    }
+    TickType_t last_scan = xTaskGetTickCount();
     while (1)
     {
-        // read knobs
+        // the sliders are only scanned while connected
+        bool scan_sliders = ls_controls_current_status == LS_CONTROLS_STATUS_CONNECTED;
+        int medians[LS_CONTROLS_TASK_KNOB_COUNT];
         xSemaphoreTake(adc2_mux, pdMS_TO_TICKS(1000));
-        for (int knob = 0; knob < LS_CONTROLS_TASK_KNOB_COUNT; knob++)
+        for (int knob = scan_sliders ? 0 : LS_CONTROLS_TASK_SLIDER_COUNT; knob < LS_CONTROLS_TASK_KNOB_COUNT; knob++)
         {
-            int adc_reading = 0;
-            uint32_t adc_sum = 0;
-            // atten 11 by default... shouldn't need to focus on lower voltages?
-            ESP_ERROR_CHECK(adc2_config_channel_atten(knob_channels[knob], ADC_ATTEN_11db));
-            for (int i = 0; i < LS_CONTROLS_READINGS_TO_AVERAGE; i++)
-            {
-                ESP_ERROR_CHECK(adc2_get_raw(knob_channels[knob], ADC_WIDTH_12Bit, &adc_reading));
-                adc_sum += adc_reading;
-            }
-            knob_readings[knob] = adc_sum / LS_CONTROLS_READINGS_TO_AVERAGE;
+            medians[knob] = _ls_controls_read_median(knob);
         }
         xSemaphoreGive(adc2_mux);
 
         // update status
         connection_reading = (connection_reading + 1) % LS_CONTROLS_TASK_CONNECTION_READINGS;
-        if (knob_readings[3] < LS_CONTROLS_ADC_MAX_DISCONNECT)
-        {
-            connection_readings[connection_reading] = LS_CONTROLS_STATUS_DISCONNECTED;
-        }
-        else if (_ls_controls_connected(knob_readings[3]))
-        {
-            connection_readings[connection_reading] = LS_CONTROLS_STATUS_CONNECTED;
-        }
-        else
-        {
-            connection_readings[connection_reading] = LS_CONTROLS_STATUS_INVALID;
-        }
+        connection_readings[connection_reading] = _ls_controls_status_from_reading(medians[3]);
         if ((connection_readings[0] == connection_readings[1]) && (connection_readings[0] == connection_readings[2]))
         {
             if (ls_controls_current_status != connection_readings[0])
             {
                 ls_controls_current_status = connection_readings[0];
-                ls_event connection_event;
-                connection_event.value = NULL;
+                ls_event connection_event = ls_event_new(LSEVT_CONTROLS_DISCONNECTED);
                 switch (ls_controls_current_status)
                 {
                 case LS_CONTROLS_STATUS_CONNECTED:
@@ -116,10 +139,15 @@ void ls_controls_task(void *pvParameter)
 #ifdef LSDEBUG_CONTROLS
                     ls_debug_printf("Controls status CONNECTED about %lld microseconds after last connection\n", esp_timer_get_time()-last_connected_at_us_time);
 #endif
-                    _ls_controls_current_speed = knob_readings[0];
-                    _ls_controls_current_topangle = knob_readings[1];
-                    _ls_controls_current_bottomangle = knob_readings[2];
-                    _ls_controls_task_knobs_havent_moved();
+                    // sliders were not being scanned; start their filters and reported values where they are now
+                    xSemaphoreTake(adc2_mux, pdMS_TO_TICKS(1000));
+                    for (int knob = 0; knob < LS_CONTROLS_TASK_SLIDER_COUNT; knob++)
+                    {
+                        *_ls_controls_knob_values[knob] = _ls_controls_read_median(knob);
+                        filtered[knob] = *_ls_controls_knob_values[knob] << LS_CONTROLS_FILTER_FRACTION_BITS;
+                    }
+                    xSemaphoreGive(adc2_mux);
+                    live_knob = -1;
                     if (esp_timer_get_time() - LS_CONTROLS_SECONDARY_US_TIME < last_connected_at_us_time)
                     {
                         connection_event.type = LSEVT_CONTROLS_CONNECT_SECONDARY;
@@ -139,69 +167,42 @@ void ls_controls_task(void *pvParameter)
 #endif
                     break;
                 }
-                xQueueSendToBack(ls_event_queue, (void *)&connection_event, pdMS_TO_TICKS(1000));
+                ls_event_send(&connection_event, pdMS_TO_TICKS(1000));
             }
         }
-#ifdef LSDEBUG_CONTROLS
-        ls_debug_printf("External control knobs: %d\t %d\t %d\t %d\n", knob_readings[0], knob_readings[1], knob_readings[2], knob_readings[3]);
-#endif
-        if (ls_controls_get_current_status() == LS_CONTROLS_STATUS_CONNECTED && _ls_controls_connected(knob_readings[3]))
+        if (scan_sliders && ls_controls_get_current_status() == LS_CONTROLS_STATUS_CONNECTED && _ls_controls_connected(medians[3]))
         {
-            if (moved_knob[0] || _difference_exceeds_threshold(_ls_controls_current_speed, knob_readings[0], LS_CONTROLS_READING_MOVE_THRESHOLD))
-            {
-                if (!moved_knob[0])
-                {
-                    fastreads = LS_CONTROLS_FASTREADS_AFTER_MOVE;
-                }
-                _ls_controls_task_knobs_havent_moved();
-                moved_knob[0] = fastreads > 0;
-                fastreads--;
-                _ls_controls_current_speed = knob_readings[0];
-                ls_event event;
-                event.type = LSEVT_CONTROLS_SPEED;
-                event.value = (void *)&_ls_controls_current_speed;
-                xQueueSendToBack(ls_event_queue, (void *)&event, 0);
 #ifdef LSDEBUG_CONTROLS
-                ls_debug_printf("Controls new value speed=%d\n", _ls_controls_current_speed);
+            ls_debug_printf("External control knobs: %d\t %d\t %d\t %d\n", medians[0], medians[1], medians[2], medians[3]);
 #endif
-            }
-            if (moved_knob[1] || _difference_exceeds_threshold(_ls_controls_current_topangle, knob_readings[1], LS_CONTROLS_READING_MOVE_THRESHOLD))
+            if (live_knob >= 0 && esp_timer_get_time() > live_until_us)
             {
-                if (!moved_knob[1])
-                {
-                    fastreads = LS_CONTROLS_FASTREADS_AFTER_MOVE;
-                }
-                _ls_controls_task_knobs_havent_moved();
-                moved_knob[1] = fastreads > 0;
-                fastreads--;
-                _ls_controls_current_topangle = knob_readings[1];
-                ls_event event;
-                event.type = LSEVT_CONTROLS_TOPANGLE;
-                event.value = (void *)&_ls_controls_current_topangle;
-                xQueueSendToBack(ls_event_queue, (void *)&event, 0);
-#ifdef LSDEBUG_CONTROLS
-                ls_debug_printf("Controls new value topangle=%d\n", _ls_controls_current_topangle);
-#endif
+                live_knob = -1;
             }
-            if (moved_knob[2] || _difference_exceeds_threshold(_ls_controls_current_bottomangle, knob_readings[2], LS_CONTROLS_READING_MOVE_THRESHOLD))
+            for (int knob = 0; knob < LS_CONTROLS_TASK_SLIDER_COUNT; knob++)
             {
-                if (!moved_knob[2])
+                filtered[knob] += ((medians[knob] << LS_CONTROLS_FILTER_FRACTION_BITS) - filtered[knob]) >> LS_CONTROLS_FILTER_SHIFT;
+                BaseType_t value = filtered[knob] >> LS_CONTROLS_FILTER_FRACTION_BITS;
+                BaseType_t threshold = knob == live_knob ? LS_CONTROLS_READING_LIVE_THRESHOLD : LS_CONTROLS_READING_MOVE_THRESHOLD;
+                if (_difference_exceeds_threshold(*_ls_controls_knob_values[knob], value, threshold))
                 {
-                    fastreads = LS_CONTROLS_FASTREADS_AFTER_MOVE;
-                }
-                _ls_controls_task_knobs_havent_moved();
-                moved_knob[2] = fastreads > 0;
-                fastreads--;
-                _ls_controls_current_bottomangle = knob_readings[2];
-                ls_event event;
-                event.type = LSEVT_CONTROLS_BOTTOMANGLE;
-                event.value = (void *)&_ls_controls_current_bottomangle;
-                xQueueSendToBack(ls_event_queue, (void *)&event, 0);
+                    *_ls_controls_knob_values[knob] = value;
+                    live_knob = knob;
+                    live_until_us = esp_timer_get_time() + LS_CONTROLS_MOVING_HOLD_MS * 1000LL;
+                    ls_event event = ls_event_new(_ls_controls_knob_events[knob]);
+                    event.value.adc = value;
+                    ls_event_send(&event, 0);
 #ifdef LSDEBUG_CONTROLS
-                ls_debug_printf("Controls new value bottomangle=%d\n", _ls_controls_current_bottomangle);
+                    ls_debug_printf("Controls new value knob %d=%d\n", knob, value);
 #endif
+                }
             }
         }
-        vTaskDelay(ls_controls_current_status == LS_CONTROLS_STATUS_CONNECTED ? pdMS_TO_TICKS(100) : pdMS_TO_TICKS(600));
+        TickType_t interval = pdMS_TO_TICKS(LS_CONTROLS_SCAN_DISCONNECTED_MS);
+        if (ls_controls_current_status == LS_CONTROLS_STATUS_CONNECTED)
+        {
+            interval = pdMS_TO_TICKS(live_knob >= 0 ? LS_CONTROLS_SCAN_MOVING_MS : LS_CONTROLS_SCAN_IDLE_MS);
+        }
+        vTaskDelayUntil(&last_scan, interval > 0 ? interval : 1);
     }
 }
\ No newline at end of file
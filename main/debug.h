@@ -74,4 +74,13 @@ extern SemaphoreHandle_t print_mux; // in ls2022_esp32.c
 
 //#define LSDEBUG_TILT
 
+// reports events dropped because their queue was full
+//#define LSDEBUG_EVENTS
+
+// reports each analysed block of accelerometer vibration, plus resonance, stall and wear findings
+//#define LSDEBUG_VIBRATION
+
+// reports readers that raced the ADC stream sampler and had to retry
+//#define LSDEBUG_ADCSTREAM
+
 #endif
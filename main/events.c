@@ -16,10 +16,279 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "events.h"
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+static QueueHandle_t _ls_event_queues[LS_EVENT_PRIORITY_COUNT];
+// counts events waiting across all levels so the receiver can block on one handle
+static SemaphoreHandle_t _ls_event_available;
+
+// coalescing: at most one event per slot is queued; later sends overwrite the waiting copy
+enum _ls_event_coalesce_slot_t
+{
+    _LS_EVENT_COALESCE_NONE = -1,
+    _LS_EVENT_COALESCE_NOOP,
+    _LS_EVENT_COALESCE_LIGHT, // day and night share a slot; only the latest matters
+    _LS_EVENT_COALESCE_CONTROLS_SPEED,
+    _LS_EVENT_COALESCE_CONTROLS_TOPANGLE,
+    _LS_EVENT_COALESCE_CONTROLS_BOTTOMANGLE,
+    _LS_EVENT_COALESCE_SLOT_COUNT,
+};
+static ls_event _ls_event_coalesce_latest[_LS_EVENT_COALESCE_SLOT_COUNT];
+static bool _ls_event_coalesce_pending[_LS_EVENT_COALESCE_SLOT_COUNT];
+static portMUX_TYPE _ls_event_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t _ls_event_dropped_count[LSEVT_TYPE_LIMIT];
+static uint32_t _ls_event_coalesced_count[LSEVT_TYPE_LIMIT];
+
+// ISR-to-task latency is measured from the event's own timestamp for types that ISRs send
+static bool _ls_event_from_isr[LSEVT_TYPE_LIMIT];
+static uint32_t _ls_event_isr_latency_last_us[LSEVT_TYPE_LIMIT];
+static uint32_t _ls_event_isr_latency_max_us[LSEVT_TYPE_LIMIT];
+
+static enum ls_event_priority_t IRAM_ATTR _ls_event_priority(enum ls_event_t type)
+{
+    switch (type)
+    {
+    case LSEVT_TILT_OK:
+    case LSEVT_TILT_DETECTED:
+        return LS_EVENT_PRIORITY_SAFETY;
+    case LSEVT_NOOP:
+    case LSEVT_CONTROLS_CONNECTED:
+    case LSEVT_CONTROLS_DISCONNECTED:
+    case LSEVT_CONTROLS_SPEED:
+    case LSEVT_CONTROLS_TOPANGLE:
+    case LSEVT_CONTROLS_BOTTOMANGLE:
+    case LSEVT_CONTROLS_CONNECT_SECONDARY:
+        return LS_EVENT_PRIORITY_UI;
+    default:
+        return LS_EVENT_PRIORITY_MOTION;
+    }
+}
+
+static enum _ls_event_coalesce_slot_t IRAM_ATTR _ls_event_coalesce_slot(enum ls_event_t type)
+{
+    switch (type)
+    {
+    case LSEVT_NOOP:
+        return _LS_EVENT_COALESCE_NOOP;
+    case LSEVT_LIGHT_DAY:
+    case LSEVT_LIGHT_NIGHT:
+        return _LS_EVENT_COALESCE_LIGHT;
+    case LSEVT_CONTROLS_SPEED:
+        return _LS_EVENT_COALESCE_CONTROLS_SPEED;
+    case LSEVT_CONTROLS_TOPANGLE:
+        return _LS_EVENT_COALESCE_CONTROLS_TOPANGLE;
+    case LSEVT_CONTROLS_BOTTOMANGLE:
+        return _LS_EVENT_COALESCE_CONTROLS_BOTTOMANGLE;
+    default:
+        return _LS_EVENT_COALESCE_NONE;
+    }
+}
+
+static void IRAM_ATTR _ls_event_count(uint32_t *counts, enum ls_event_t type)
+{
+    if (type < LSEVT_TYPE_LIMIT)
+    {
+        counts[type]++;
+    }
+}
+
+/**
+ * @brief If the event's slot already has one waiting, overwrite it and return true.
+ * Otherwise claim the slot and return false; the caller must then queue a copy
+ * (and release the slot if that fails).
+ */
+static bool IRAM_ATTR _ls_event_coalesce(const ls_event *event, enum _ls_event_coalesce_slot_t slot)
+{
+    bool coalesced;
+    portENTER_CRITICAL_SAFE(&_ls_event_mux);
+    _ls_event_coalesce_latest[slot] = *event;
+    coalesced = _ls_event_coalesce_pending[slot];
+    _ls_event_coalesce_pending[slot] = true;
+    if (coalesced)
+    {
+        _ls_event_count(_ls_event_coalesced_count, event->type);
+    }
+    portEXIT_CRITICAL_SAFE(&_ls_event_mux);
+    return coalesced;
+}
+
+static void IRAM_ATTR _ls_event_coalesce_release(enum _ls_event_coalesce_slot_t slot)
+{
+    portENTER_CRITICAL_SAFE(&_ls_event_mux);
+    _ls_event_coalesce_pending[slot] = false;
+    portEXIT_CRITICAL_SAFE(&_ls_event_mux);
+}
+
+static BaseType_t _ls_event_send(const ls_event *event, TickType_t ticks_to_wait, bool to_front)
+{
+    enum _ls_event_coalesce_slot_t slot = _ls_event_coalesce_slot(event->type);
+    if (_LS_EVENT_COALESCE_NONE != slot && _ls_event_coalesce(event, slot))
+    {
+        return pdPASS;
+    }
+    QueueHandle_t queue = _ls_event_queues[_ls_event_priority(event->type)];
+    BaseType_t result = to_front ? xQueueSendToFront(queue, (void *)event, ticks_to_wait)
+                                 : xQueueSendToBack(queue, (void *)event, ticks_to_wait);
+    if (pdPASS == result)
+    {
+        xSemaphoreGive(_ls_event_available);
+        return pdPASS;
+    }
+    if (_LS_EVENT_COALESCE_NONE != slot)
+    {
+        _ls_event_coalesce_release(slot);
+    }
+    portENTER_CRITICAL(&_ls_event_mux);
+    _ls_event_count(_ls_event_dropped_count, event->type);
+    portEXIT_CRITICAL(&_ls_event_mux);
+#ifdef LSDEBUG_EVENTS
+    ls_debug_printf("Dropped event %d; queue level %d full\n", event->type, _ls_event_priority(event->type));
+#endif
+    return result;
+}
+
+static BaseType_t IRAM_ATTR _ls_event_send_from_isr(const ls_event *event, BaseType_t *higher_priority_task_woken, bool to_front)
+{
+    enum _ls_event_coalesce_slot_t slot = _ls_event_coalesce_slot(event->type);
+    if (_LS_EVENT_COALESCE_NONE != slot && _ls_event_coalesce(event, slot))
+    {
+        return pdPASS;
+    }
+    QueueHandle_t queue = _ls_event_queues[_ls_event_priority(event->type)];
+    BaseType_t result = to_front ? xQueueSendToFrontFromISR(queue, (void *)event, higher_priority_task_woken)
+                                 : xQueueSendToBackFromISR(queue, (void *)event, higher_priority_task_woken);
+    if (pdPASS == result)
+    {
+        if (event->type < LSEVT_TYPE_LIMIT)
+        {
+            _ls_event_from_isr[event->type] = true;
+        }
+        xSemaphoreGiveFromISR(_ls_event_available, higher_priority_task_woken);
+        return pdPASS;
+    }
+    if (_LS_EVENT_COALESCE_NONE != slot)
+    {
+        _ls_event_coalesce_release(slot);
+    }
+    portENTER_CRITICAL_ISR(&_ls_event_mux);
+    _ls_event_count(_ls_event_dropped_count, event->type);
+    portEXIT_CRITICAL_ISR(&_ls_event_mux);
+    return result;
+}
 
 void ls_event_queue_init(void)
 {
-    ls_event_queue = xQueueCreate(32, sizeof(ls_event));
+    _ls_event_queues[LS_EVENT_PRIORITY_SAFETY] = xQueueCreate(LS_EVENT_QUEUE_SAFETY_LENGTH, sizeof(ls_event));
+    _ls_event_queues[LS_EVENT_PRIORITY_MOTION] = xQueueCreate(LS_EVENT_QUEUE_MOTION_LENGTH, sizeof(ls_event));
+    _ls_event_queues[LS_EVENT_PRIORITY_UI] = xQueueCreate(LS_EVENT_QUEUE_UI_LENGTH, sizeof(ls_event));
+    _ls_event_available = xSemaphoreCreateCounting(LS_EVENT_QUEUE_SAFETY_LENGTH + LS_EVENT_QUEUE_MOTION_LENGTH + LS_EVENT_QUEUE_UI_LENGTH, 0);
+}
+
+BaseType_t ls_event_send(const ls_event *event, TickType_t ticks_to_wait)
+{
+    return _ls_event_send(event, ticks_to_wait, false);
+}
+
+BaseType_t ls_event_send_to_front(const ls_event *event, TickType_t ticks_to_wait)
+{
+    return _ls_event_send(event, ticks_to_wait, true);
+}
+
+BaseType_t IRAM_ATTR ls_event_send_from_isr(const ls_event *event, BaseType_t *higher_priority_task_woken)
+{
+    return _ls_event_send_from_isr(event, higher_priority_task_woken, false);
+}
+
+BaseType_t IRAM_ATTR ls_event_send_to_front_from_isr(const ls_event *event, BaseType_t *higher_priority_task_woken)
+{
+    return _ls_event_send_from_isr(event, higher_priority_task_woken, true);
+}
+
+static void _ls_event_record_isr_latency(const ls_event *event)
+{
+    enum ls_event_t type = event->type;
+    if (type >= LSEVT_TYPE_LIMIT || !_ls_event_from_isr[type])
+    {
+        return;
+    }
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - event->time_us);
+    _ls_event_isr_latency_last_us[type] = latency;
+    if (latency > _ls_event_isr_latency_max_us[type])
+    {
+        _ls_event_isr_latency_max_us[type] = latency;
+#ifdef LSDEBUG_EVENTS
+        ls_debug_printf("New maximum ISR latency %uus for event %d\n", latency, type);
+#endif
+    }
+}
+
+BaseType_t ls_event_receive(ls_event *event, TickType_t ticks_to_wait)
+{
+    if (pdTRUE != xSemaphoreTake(_ls_event_available, ticks_to_wait))
+    {
+        return pdFALSE;
+    }
+    // every give follows a successful send, so one of the levels has an event
+    for (int level = 0; level < LS_EVENT_PRIORITY_COUNT; level++)
+    {
+        if (pdTRUE == xQueueReceive(_ls_event_queues[level], event, 0))
+        {
+            enum _ls_event_coalesce_slot_t slot = _ls_event_coalesce_slot(event->type);
+            if (_LS_EVENT_COALESCE_NONE != slot)
+            {
+                // deliver whatever was sent last, then let the next send queue again
+                portENTER_CRITICAL(&_ls_event_mux);
+                *event = _ls_event_coalesce_latest[slot];
+                _ls_event_coalesce_pending[slot] = false;
+                portEXIT_CRITICAL(&_ls_event_mux);
+            }
+            _ls_event_record_isr_latency(event);
+            return pdTRUE;
+        }
+    }
+    return pdFALSE;
+}
+
+enum ls_event_priority_t ls_event_get_priority(enum ls_event_t type)
+{
+    return _ls_event_priority(type);
+}
+
+UBaseType_t ls_event_get_waiting_count(enum ls_event_priority_t level)
+{
+    return level < LS_EVENT_PRIORITY_COUNT ? uxQueueMessagesWaiting(_ls_event_queues[level]) : 0;
+}
+
+uint32_t ls_event_get_dropped_count(enum ls_event_t type)
+{
+    return type < LSEVT_TYPE_LIMIT ? _ls_event_dropped_count[type] : 0;
+}
+
+uint32_t ls_event_get_coalesced_count(enum ls_event_t type)
+{
+    return type < LSEVT_TYPE_LIMIT ? _ls_event_coalesced_count[type] : 0;
+}
+
+uint32_t ls_event_get_isr_latency_us(enum ls_event_t type)
+{
+    return type < LSEVT_TYPE_LIMIT ? _ls_event_isr_latency_last_us[type] : 0;
+}
+
+uint32_t ls_event_get_isr_latency_max_us(enum ls_event_t type)
+{
+    return type < LSEVT_TYPE_LIMIT ? _ls_event_isr_latency_max_us[type] : 0;
+}
+
+ls_event IRAM_ATTR ls_event_new(enum ls_event_t type)
+{
+    ls_event event;
+    event.type = type;
+    event.value.position = 0;
+    event.time_us = esp_timer_get_time();
+    return event;
 }
 
 void ls_event_enqueue_noop(void)
@@ -28,29 +297,25 @@ void ls_event_enqueue_noop(void)
 }
 
 /**
- * Add an event of specified type at the back of the queue; value is NULL
+ * Add an event of specified type at the back of its queue; value is zero
 */
 void ls_event_enqueue(enum ls_event_t type)
 {
-    ls_event event;
-    event.type = type;
-    event.value = NULL;
-    xQueueSendToBack(ls_event_queue, (void *)&event, 0);
+    ls_event event = ls_event_new(type);
+    ls_event_send(&event, 0);
 }
 
 /**
- * Insert an event of the specified type at the front of the queue; value is NULL
+ * Insert an event of the specified type at the front of its queue; value is zero
 */
 void ls_event_enqueue_front(enum ls_event_t type)
 {
-    ls_event event;
-    event.type = type;
-    event.value = NULL;
-    xQueueSendToFront(ls_event_queue, (void *)&event, 0);
+    ls_event event = ls_event_new(type);
+    ls_event_send_to_front(&event, 0);
 }
 bool ls_event_queue_has_messages(void)
 {
-    return uxQueueMessagesWaiting(ls_event_queue) > 0;
+    return uxSemaphoreGetCount(_ls_event_available) > 0;
 }
 void ls_event_enqueue_noop_if_queue_empty(void)
 {
@@ -62,5 +327,15 @@ void ls_event_enqueue_noop_if_queue_empty(void)
 
 void ls_event_empty_queue(void)
 {
-    xQueueReset(ls_event_queue);
+    xQueueReset(_ls_event_available);
+    for (int level = 0; level < LS_EVENT_PRIORITY_COUNT; level++)
+    {
+        xQueueReset(_ls_event_queues[level]);
+    }
+    portENTER_CRITICAL(&_ls_event_mux);
+    for (int slot = 0; slot < _LS_EVENT_COALESCE_SLOT_COUNT; slot++)
+    {
+        _ls_event_coalesce_pending[slot] = false;
+    }
+    portEXIT_CRITICAL(&_ls_event_mux);
 }
\ No newline at end of file
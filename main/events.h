@@ -23,8 +23,9 @@
 enum ls_event_t
 {
     LSEVT_NOOP=0, // nothing happened, but we need an event to keep processing internal behavior
-    LSEVT_STATE_ENTRY=1, // inserted by state machine on state change to allow new state to initialize
+    LSEVT_STATE_ENTRY=1, // passed to handlers that want to see state entry as an event (selftest); states normally use an entry hook
     LSEVT_SUBSTATE_ENTRY, // inserted by (sub) state to allow successor to initialize
+    LSEVT_STATE_DEADLINE, // delivered by the state machine (not queued) when the deadline set by the current state arrives
     
     LSEVT_MAGNET_ENTER = 20, // rotating arm's magnet enters detection area
     LSEVT_MAGNET_LEAVE, // rotating arm's magnet leaves detection area
@@ -40,13 +41,15 @@ enum ls_event_t
 
     LSEVT_CONTROLS_CONNECTED = 60, // external controls switched "on"
     LSEVT_CONTROLS_DISCONNECTED, // extenral controls switched "off"
-    LSEVT_CONTROLS_SPEED, // external control slider 1 moved (ls_event.value is pointer to ADC value)
-    LSEVT_CONTROLS_TOPANGLE, // external control slider 2 moved (ls_event.value is pointer to ADC value)
-    LSEVT_CONTROLS_BOTTOMANGLE, // external control slider 3 moved (ls_event.value is pointer to ADC value)
+    LSEVT_CONTROLS_SPEED, // external control slider 1 moved (ls_event.value.adc is the reading)
+    LSEVT_CONTROLS_TOPANGLE, // external control slider 2 moved (ls_event.value.adc is the reading)
+    LSEVT_CONTROLS_BOTTOMANGLE, // external control slider 3 moved (ls_event.value.adc is the reading)
     LSEVT_CONTROLS_CONNECT_SECONDARY, // controls entered, exited, and reentered
 
     LSEVT_BUZZER_WARNING_COMPLETE = 80, // long pre-laser warning sequence of tones has finished
 
+    LSEVT_TAPE_SAMPLES_READY = 90, // the tape sensor has the fresh samples asked for by ls_tape_sensor_request_samples()
+
     LSEVT_HOME_COMPLETED = 100, // the homing routine has moved the arm to the reference location
     LSEVT_HOME_FAILED, // the homing routing could not locate the reference location
     LSEVT_REHOME_REQUIRED, // homing must be done again to ensure stability of position over time
@@ -56,15 +59,40 @@ enum ls_event_t
 
     LSEVT_TILT_OK = 120, // the tilt sensor indicates the device orientation is in bounds
     LSEVT_TILT_DETECTED, // the tilt sensor indicates the device orientation is out of bounds
+
+    LSEVT_TYPE_LIMIT = 128, // not an event; all event types must be below this (size of per-type tables)
 }; 
 
+/**
+ * @brief Events are copied by value; which member of value applies depends on type
+ */
 typedef struct ls_event
 {
     enum ls_event_t type;
-    void *value;
+    union
+    {
+        int32_t position; // LSEVT_MAGNET_*: stepper position when detected (negative just before 0)
+        int32_t adc;      // LSEVT_CONTROLS_SPEED, _TOPANGLE, _BOTTOMANGLE: reading of the control
+    } value;
+    int64_t time_us; // esp_timer_get_time() when the source created the event
 } ls_event;
 
-QueueHandle_t ls_event_queue;
+/**
+ * @brief An event of this type, zero value, stamped with the current time; safe to call from ISRs
+ */
+ls_event ls_event_new(enum ls_event_t type);
+
+/**
+ * @brief Events are held at three priority levels and always received highest level first.
+ * Within a level, order is FIFO except for the _to_front variants.
+ */
+enum ls_event_priority_t
+{
+    LS_EVENT_PRIORITY_SAFETY,  // tilt
+    LS_EVENT_PRIORITY_MOTION,  // stepper, servo, magnet, homing, mapping, light, buzzer
+    LS_EVENT_PRIORITY_UI,      // controls and no-ops
+    LS_EVENT_PRIORITY_COUNT,
+};
 
 void ls_event_queue_init(void);
 
@@ -77,4 +105,36 @@ void ls_event_enqueue(enum ls_event_t type);
 void ls_event_enqueue_front(enum ls_event_t type);
 bool ls_event_queue_has_messages(void);
 void ls_event_enqueue_noop_if_queue_empty(void);
-void ls_event_empty_queue(void);
\ No newline at end of file
+void ls_event_empty_queue(void);
+
+/**
+ * @brief Queue an event at the back of its priority level.
+ *
+ * Events for which only the latest value matters (slider values, day/night, no-ops) coalesce:
+ * if one is already waiting, it is replaced in place rather than queued again.
+ *
+ * @return pdPASS if queued or coalesced; errQUEUE_FULL if dropped (counted per type)
+ */
+BaseType_t ls_event_send(const ls_event *event, TickType_t ticks_to_wait);
+BaseType_t ls_event_send_to_front(const ls_event *event, TickType_t ticks_to_wait);
+BaseType_t ls_event_send_from_isr(const ls_event *event, BaseType_t *higher_priority_task_woken);
+BaseType_t ls_event_send_to_front_from_isr(const ls_event *event, BaseType_t *higher_priority_task_woken);
+
+/**
+ * @brief Receive the next event, highest priority level first; for the state machine task only
+ *
+ * @return pdTRUE if an event was received before ticks_to_wait elapsed
+ */
+BaseType_t ls_event_receive(ls_event *event, TickType_t ticks_to_wait);
+
+enum ls_event_priority_t ls_event_get_priority(enum ls_event_t type);
+UBaseType_t ls_event_get_waiting_count(enum ls_event_priority_t level);
+uint32_t ls_event_get_dropped_count(enum ls_event_t type);
+uint32_t ls_event_get_coalesced_count(enum ls_event_t type);
+
+/**
+ * @brief Time from an ISR sending this type of event until the state machine received it
+ * (most recent and maximum since boot), in microseconds
+ */
+uint32_t ls_event_get_isr_latency_us(enum ls_event_t type);
+uint32_t ls_event_get_isr_latency_max_us(enum ls_event_t type);
\ No newline at end of file
@@ -0,0 +1,185 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "eventstats.h"
+
+#ifdef LS_EVENTSTATS_ENABLE
+#include <stdio.h>
+#include <string.h>
+
+// event types are sparse (0..LSEVT_TYPE_LIMIT), so each gets a compact slot the first time it is seen
+#define _LS_EVENTSTATS_SLOT_NONE 0xFF
+static uint8_t _ls_eventstats_slot[LSEVT_TYPE_LIMIT];
+static enum ls_event_t _ls_eventstats_slot_type[LS_EVENTSTATS_TYPES_MAX];
+static ls_eventstats_type_t _ls_eventstats[LS_EVENTSTATS_TYPES_MAX];
+static int _ls_eventstats_slots_used = 0;
+static UBaseType_t _ls_eventstats_high_water[LS_EVENT_PRIORITY_COUNT];
+static portMUX_TYPE _ls_eventstats_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool _ls_eventstats_initialized = false;
+static int64_t _ls_eventstats_printed_us = 0;
+
+static void _ls_eventstats_clear(void)
+{
+    memset(_ls_eventstats_slot, _LS_EVENTSTATS_SLOT_NONE, sizeof(_ls_eventstats_slot));
+    memset(_ls_eventstats, 0, sizeof(_ls_eventstats));
+    memset(_ls_eventstats_high_water, 0, sizeof(_ls_eventstats_high_water));
+    _ls_eventstats_slots_used = 0;
+    _ls_eventstats_initialized = true;
+}
+
+static int _ls_eventstats_bucket(uint32_t us)
+{
+    int bucket = 0;
+    for (uint32_t limit = LS_EVENTSTATS_HISTOGRAM_FIRST_US; us >= limit && bucket < LS_EVENTSTATS_HISTOGRAM_BUCKETS - 1; limit <<= 1)
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+static uint32_t _ls_eventstats_elapsed_us(int64_t from, int64_t to)
+{
+    return to > from ? (uint32_t)(to - from) : 0;
+}
+
+void ls_eventstats_record(const ls_event *event, int64_t dispatched_us, int64_t handled_us)
+{
+    if (event->type >= LSEVT_TYPE_LIMIT)
+    {
+        return;
+    }
+    uint32_t wait_us = _ls_eventstats_elapsed_us(event->time_us, dispatched_us);
+    uint32_t handler_us = _ls_eventstats_elapsed_us(dispatched_us, handled_us);
+    UBaseType_t waiting[LS_EVENT_PRIORITY_COUNT];
+    for (int level = 0; level < LS_EVENT_PRIORITY_COUNT; level++)
+    {
+        waiting[level] = ls_event_get_waiting_count(level);
+    }
+
+    portENTER_CRITICAL(&_ls_eventstats_mux);
+    if (!_ls_eventstats_initialized)
+    {
+        _ls_eventstats_clear();
+    }
+    uint8_t slot = _ls_eventstats_slot[event->type];
+    if (_LS_EVENTSTATS_SLOT_NONE == slot && _ls_eventstats_slots_used < LS_EVENTSTATS_TYPES_MAX)
+    {
+        slot = _ls_eventstats_slots_used++;
+        _ls_eventstats_slot[event->type] = slot;
+        _ls_eventstats_slot_type[slot] = event->type;
+    }
+    if (_LS_EVENTSTATS_SLOT_NONE != slot)
+    {
+        ls_eventstats_type_t *stats = &_ls_eventstats[slot];
+        stats->count++;
+        stats->wait_total_us += wait_us;
+        stats->handler_total_us += handler_us;
+        stats->wait_max_us = wait_us > stats->wait_max_us ? wait_us : stats->wait_max_us;
+        stats->handler_max_us = handler_us > stats->handler_max_us ? handler_us : stats->handler_max_us;
+        stats->wait_histogram[_ls_eventstats_bucket(wait_us)]++;
+        stats->handler_histogram[_ls_eventstats_bucket(handler_us)]++;
+    }
+    if (LSEVT_STATE_DEADLINE != event->type)
+    {
+        // the event just received was waiting in its own level too; deadlines are never queued
+        waiting[ls_event_get_priority(event->type)]++;
+    }
+    for (int level = 0; level < LS_EVENT_PRIORITY_COUNT; level++)
+    {
+        if (waiting[level] > _ls_eventstats_high_water[level])
+        {
+            _ls_eventstats_high_water[level] = waiting[level];
+        }
+    }
+    bool print_due = handled_us - _ls_eventstats_printed_us >= LS_EVENTSTATS_PRINT_MS * 1000LL;
+    if (print_due)
+    {
+        _ls_eventstats_printed_us = handled_us;
+    }
+    portEXIT_CRITICAL(&_ls_eventstats_mux);
+    if (print_due)
+    {
+        ls_eventstats_print();
+    }
+}
+
+bool ls_eventstats_get(enum ls_event_t type, ls_eventstats_type_t *stats)
+{
+    bool found = false;
+    portENTER_CRITICAL(&_ls_eventstats_mux);
+    if (_ls_eventstats_initialized && type < LSEVT_TYPE_LIMIT && _LS_EVENTSTATS_SLOT_NONE != _ls_eventstats_slot[type])
+    {
+        *stats = _ls_eventstats[_ls_eventstats_slot[type]];
+        found = true;
+    }
+    portEXIT_CRITICAL(&_ls_eventstats_mux);
+    return found;
+}
+
+UBaseType_t ls_eventstats_get_high_water(enum ls_event_priority_t level)
+{
+    return level < LS_EVENT_PRIORITY_COUNT ? _ls_eventstats_high_water[level] : 0;
+}
+
+void ls_eventstats_reset(void)
+{
+    portENTER_CRITICAL(&_ls_eventstats_mux);
+    _ls_eventstats_clear();
+    portEXIT_CRITICAL(&_ls_eventstats_mux);
+}
+
+static void _ls_eventstats_print_histogram(const char *label, const uint32_t *histogram)
+{
+    printf("  %s", label);
+    for (int bucket = 0; bucket < LS_EVENTSTATS_HISTOGRAM_BUCKETS; bucket++)
+    {
+        printf(" %u", histogram[bucket]);
+    }
+    printf("\n");
+}
+
+void ls_eventstats_print(void)
+{
+    ls_eventstats_type_t stats;
+    printf("Event statistics (histogram buckets: <%dus, then doubling)\n", LS_EVENTSTATS_HISTOGRAM_FIRST_US);
+    for (int slot = 0; slot < _ls_eventstats_slots_used; slot++)
+    {
+        enum ls_event_t type = _ls_eventstats_slot_type[slot];
+        if (!ls_eventstats_get(type, &stats) || 0 == stats.count)
+        {
+            continue;
+        }
+        printf("Event %3d: %u dispatched; wait avg %uus max %uus; handler avg %uus max %uus\n", type, stats.count,
+               (uint32_t)(stats.wait_total_us / stats.count), stats.wait_max_us,
+               (uint32_t)(stats.handler_total_us / stats.count), stats.handler_max_us);
+        _ls_eventstats_print_histogram("wait:   ", stats.wait_histogram);
+        _ls_eventstats_print_histogram("handler:", stats.handler_histogram);
+    }
+    for (int level = 0; level < LS_EVENT_PRIORITY_COUNT; level++)
+    {
+        printf("Queue level %d high water: %u\n", level, ls_eventstats_get_high_water(level));
+    }
+    for (int type = 0; type < LSEVT_TYPE_LIMIT; type++)
+    {
+        if (ls_event_get_dropped_count(type) > 0 || ls_event_get_coalesced_count(type) > 0)
+        {
+            printf("Event %3d: %u dropped, %u coalesced\n", type, ls_event_get_dropped_count(type), ls_event_get_coalesced_count(type));
+        }
+    }
+}
+
+#endif
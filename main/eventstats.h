@@ -0,0 +1,70 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "config.h"
+#include "events.h"
+
+/**
+ * Dispatch instrumentation for the state machine: per event type, how long events waited
+ * between their source and dispatch, how long the state machine took to handle them,
+ * plus queue high-water marks per priority level. Everything compiles away unless
+ * LS_EVENTSTATS_ENABLE is defined in config.h.
+ */
+#ifdef LS_EVENTSTATS_ENABLE
+#include "esp_timer.h"
+
+// bucket 0 is under 16us; each following bucket doubles; the last also holds everything longer
+#define LS_EVENTSTATS_HISTOGRAM_BUCKETS 12
+#define LS_EVENTSTATS_HISTOGRAM_FIRST_US 16
+
+typedef struct ls_eventstats_type_t
+{
+    uint32_t count;
+    uint32_t wait_max_us;
+    uint64_t wait_total_us;
+    uint32_t handler_max_us;
+    uint64_t handler_total_us;
+    uint32_t wait_histogram[LS_EVENTSTATS_HISTOGRAM_BUCKETS];
+    uint32_t handler_histogram[LS_EVENTSTATS_HISTOGRAM_BUCKETS];
+} ls_eventstats_type_t;
+
+/**
+ * @brief Called by the state machine after each event
+ *
+ * @param event as received; its time_us is when the source created it
+ * @param dispatched_us esp_timer_get_time() just before the handler ran
+ * @param handled_us esp_timer_get_time() after the handler (and any transition) finished
+ */
+void ls_eventstats_record(const ls_event *event, int64_t dispatched_us, int64_t handled_us);
+
+/**
+ * @brief Copy the statistics for one event type
+ *
+ * @return false if no event of that type has been dispatched since the last reset
+ */
+bool ls_eventstats_get(enum ls_event_t type, ls_eventstats_type_t *stats);
+UBaseType_t ls_eventstats_get_high_water(enum ls_event_priority_t level);
+
+/**
+ * @brief printf a summary of every event type seen, queue high-water marks and drop counts;
+ * ls_eventstats_record() calls this every LS_EVENTSTATS_PRINT_MS
+ */
+void ls_eventstats_print(void);
+void ls_eventstats_reset(void);
+
+#endif
@@ -17,16 +17,21 @@
 */
 #include "i2c.h"
 #include <stdio.h>
+#include <string.h>
 #include "driver/i2c.h"
 #include "config.h"
 #include "debug.h"
-#include "mpu6050.h"
-#include "kxtj3.h"
-#include "lis2dh12.h"
+#include "accel.h"
 #include "math.h"
 #include "events.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
 #include "settings.h"
+#include "tiltcal.h"
 
 // https://github.com/espressif/esp-idf/blob/a82e6e63d98bb051d4c59cb3d440c537ab9f74b0/examples/peripherals/i2c/i2c_tools/main/cmd_i2ctools.c
 #define I2C_MASTER_TX_BUF_DISABLE 0 /*!< I2C master doesn't need buffer */
@@ -75,121 +80,326 @@ static esp_err_t i2c_master_init(void)
     return status;
 }
 
-esp_err_t ls_i2c_write_reg_byte(uint8_t device_address, uint8_t register_number, uint8_t data)
+// All bus traffic goes through one service task that owns the driver, so no caller ever
+// blocks inside i2c_master_cmd_begin on someone else's wedged device. Transactions run
+// from a queue with their own timeouts; a timed-out transaction resets the bus.
+
+typedef struct _ls_i2c_queued_t
+{
+    ls_i2c_request_t request;
+    int64_t queued_us;
+} _ls_i2c_queued_t;
+
+static QueueHandle_t _ls_i2c_queue = NULL;
+// the service task is the only user, so one command link buffer sized for a write then a read will do
+static uint8_t _ls_i2c_cmd_buffer[I2C_LINK_RECOMMENDED_SIZE(2)];
+// synchronous callers take turns; each waits for its own completion
+static SemaphoreHandle_t _ls_i2c_sync_mux = NULL;
+static SemaphoreHandle_t _ls_i2c_sync_done = NULL;
+static esp_err_t _ls_i2c_sync_result;
+static ls_i2c_stats_t _ls_i2c_stats;
+static portMUX_TYPE _ls_i2c_stats_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_err_t _ls_i2c_execute(const ls_i2c_request_t *request)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);                                                            // S
-    i2c_master_write_byte(cmd, device_address << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // SAD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN);                        // RA (ACK)
-    i2c_master_write_byte(cmd, data, ACK_CHECK_EN);                                   // DATA (ACK)
-    i2c_master_stop(cmd);                                                             // P
-    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(_ls_i2c_cmd_buffer, sizeof(_ls_i2c_cmd_buffer));
+    i2c_master_start(cmd);                                                                     // S
+    i2c_master_write_byte(cmd, request->device_address << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // SAD+W (ACK)
+    switch (request->kind)
+    {
+    case LS_I2C_REQUEST_PROBE:
+        // from https://github.com/espressif/esp-idf/blob/a82e6e63d98bb051d4c59cb3d440c537ab9f74b0/examples/peripherals/i2c/i2c_tools/main/cmd_i2ctools.c lines 130ff
+        break;
+    case LS_I2C_REQUEST_WRITE:
+        i2c_master_write_byte(cmd, request->register_number, ACK_CHECK_EN);           // RA (ACK)
+        i2c_master_write(cmd, request->data, request->length, ACK_CHECK_EN);          // DATA (ACK) ...
+        break;
+    case LS_I2C_REQUEST_READ:
+        // see page 23 of KXTJ3-1057 specification
+        i2c_master_write_byte(cmd, request->register_number, ACK_CHECK_EN);                       // RA (ACK)
+        i2c_master_start(cmd);                                                                    // S
+        i2c_master_write_byte(cmd, request->device_address << 1 | I2C_MASTER_READ, ACK_CHECK_EN); // SAD+R (ACK)
+        i2c_master_read(cmd, request->data, request->length, I2C_MASTER_LAST_NACK);               // (DATA) ACK ... (DATA) NACK
+        break;
+    }
+    i2c_master_stop(cmd); // P
+    TickType_t ticks = pdMS_TO_TICKS(request->timeout_ms > 0 ? request->timeout_ms : LS_I2C_TIMEOUT_MS);
+    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, ticks > 0 ? ticks : 1);
+    i2c_cmd_link_delete_static(cmd);
     return ret;
 }
 
-esp_err_t ls_i2c_read_reg_uint8(uint8_t device_address, uint8_t register_number, uint8_t *data)
+/**
+ * @brief A device holding SDA low mid-byte is released by clocking SCL until it lets go,
+ * then sending a STOP; the driver is reinstalled afterwards.
+ *
+ * @return false if SDA was still low after the clocks
+ */
+static bool _ls_i2c_recover_bus(void)
 {
-    // see page 23 of KXTJ3-1057 specification
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);                                                            // S
-    i2c_master_write_byte(cmd, device_address << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // SAD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN);                        // RA (ACK)
-    i2c_master_start(cmd);                                                            // S
-    i2c_master_write_byte(cmd, device_address << 1 | I2C_MASTER_READ, ACK_CHECK_EN);  // SAD+R (ACK)
-    i2c_master_read_byte(cmd, data, I2C_MASTER_NACK);                                 // (DATA) ACK
-    i2c_master_stop(cmd);                                                             // P
-    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+    i2c_driver_delete(LSI2C_PORT);
+    gpio_set_direction(LSI2C_SDA, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_direction(LSI2C_SCL, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(LSI2C_SDA, 1);
+    gpio_set_level(LSI2C_SCL, 1);
+    for (int i = 0; i < 9 && 0 == gpio_get_level(LSI2C_SDA); i++)
+    {
+        gpio_set_level(LSI2C_SCL, 0);
+        esp_rom_delay_us(5);
+        gpio_set_level(LSI2C_SCL, 1);
+        esp_rom_delay_us(5);
+    }
+    // STOP: SDA rises while SCL is high
+    gpio_set_level(LSI2C_SCL, 0);
+    gpio_set_level(LSI2C_SDA, 0);
+    esp_rom_delay_us(5);
+    gpio_set_level(LSI2C_SCL, 1);
+    esp_rom_delay_us(5);
+    gpio_set_level(LSI2C_SDA, 1);
+    esp_rom_delay_us(5);
+    bool released = 0 != gpio_get_level(LSI2C_SDA);
+    i2c_master_init();
+    return released;
 }
 
-bool ls_i2c_init(void)
+static void _ls_i2c_task(void *pvParameter)
 {
-    if (!_ls_i2c_initialized && i2c_master_init() == ESP_OK)
+    _ls_i2c_queued_t item;
+#ifdef LSDEBUG_I2C
+    int64_t stats_printed_us = 0;
+#endif
+    while (1)
     {
-        _ls_i2c_initialized = true;
-        vTaskDelay(1); // allow bus to settle down
+        xQueueReceive(_ls_i2c_queue, &item, portMAX_DELAY);
+        int64_t started_us = esp_timer_get_time();
+        esp_err_t result = _ls_i2c_execute(&item.request);
+        int64_t finished_us = esp_timer_get_time();
+        // a NACK (ESP_FAIL) just means nobody answered; a timeout means the bus may be stuck
+        bool recover = ESP_ERR_TIMEOUT == result;
+        bool recovered = recover && _ls_i2c_recover_bus();
+
+        uint32_t wait_us = (uint32_t)(started_us - item.queued_us);
+        uint32_t transaction_us = (uint32_t)(finished_us - started_us);
+        taskENTER_CRITICAL(&_ls_i2c_stats_spinlock);
+        _ls_i2c_stats.transactions++;
+        _ls_i2c_stats.failures += (ESP_OK == result) ? 0 : 1;
+        _ls_i2c_stats.timeouts += recover ? 1 : 0;
+        _ls_i2c_stats.failed_recoveries += (recover && !recovered) ? 1 : 0;
+        _ls_i2c_stats.wait_max_us = wait_us > _ls_i2c_stats.wait_max_us ? wait_us : _ls_i2c_stats.wait_max_us;
+        _ls_i2c_stats.transaction_max_us = transaction_us > _ls_i2c_stats.transaction_max_us ? transaction_us : _ls_i2c_stats.transaction_max_us;
+        _ls_i2c_stats.transaction_total_us += transaction_us;
+        taskEXIT_CRITICAL(&_ls_i2c_stats_spinlock);
 #ifdef LSDEBUG_I2C
-        ls_debug_printf("I2C LIS2DH: %d\n", ls_i2c_has_lis2dh12());
-        ls_debug_printf("I2C KXTJ3: %d\n", ls_i2c_has_kxtj3());
-        ls_debug_printf("I2C MPU6050: %d\n", ls_i2c_has_mpu6050());
+        if (recover)
+        {
+            ls_debug_printf("I2C transaction with 0x%02x timed out; bus %s\n", item.request.device_address,
+                            recovered ? "recovered" : "still held low");
+        }
+        if (recover || finished_us - stats_printed_us >= LS_I2C_STATS_PRINT_MS * 1000LL)
+        {
+            stats_printed_us = finished_us;
+            ls_i2c_print_stats();
+        }
 #endif
+
+        if (NULL != item.request.callback)
+        {
+            item.request.callback(result, item.request.arg);
+        }
+        if (NULL != item.request.notify_task)
+        {
+            xTaskNotify(item.request.notify_task, (uint32_t)result, eSetValueWithOverwrite);
+        }
     }
-    return _ls_i2c_initialized;
 }
 
-bool ls_i2c_probe_address(uint8_t address)
+bool ls_i2c_submit(const ls_i2c_request_t *request, TickType_t ticks_to_wait)
 {
     if (!ls_i2c_init())
     {
         return false;
     }
+    _ls_i2c_queued_t item = {.request = *request, .queued_us = esp_timer_get_time()};
+    if (pdTRUE != xQueueSend(_ls_i2c_queue, &item, ticks_to_wait))
+    {
+        return false;
+    }
+    UBaseType_t waiting = uxQueueMessagesWaiting(_ls_i2c_queue);
+    taskENTER_CRITICAL(&_ls_i2c_stats_spinlock);
+    _ls_i2c_stats.queue_high_water = waiting > _ls_i2c_stats.queue_high_water ? waiting : _ls_i2c_stats.queue_high_water;
+    taskEXIT_CRITICAL(&_ls_i2c_stats_spinlock);
+    return true;
+}
 
-    // from https://github.com/espressif/esp-idf/blob/a82e6e63d98bb051d4c59cb3d440c537ab9f74b0/examples/peripherals/i2c/i2c_tools/main/cmd_i2ctools.c lines 130ff
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (address << 1) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, 50 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
-
-    return (ret == ESP_OK);
+static void _ls_i2c_sync_callback(esp_err_t result, void *arg)
+{
+    _ls_i2c_sync_result = result;
+    xSemaphoreGive(_ls_i2c_sync_done);
 }
-enum ls_i2c_accelerometer_device_t ls_i2c_accelerometer_device(void)
+
+/**
+ * @brief submit and wait; the service task's timeout bounds how long this can take
+ */
+static esp_err_t _ls_i2c_transact(ls_i2c_request_t *request)
 {
-    if (_ls_i2c_accelerometer_device != LS_I2C_ACCELEROMETER_NONE)
+    if (!ls_i2c_init())
     {
-        return _ls_i2c_accelerometer_device;
+        return ESP_ERR_INVALID_STATE;
     }
-    if (ls_i2c_has_lis2dh12())
+    request->callback = _ls_i2c_sync_callback;
+    xSemaphoreTake(_ls_i2c_sync_mux, portMAX_DELAY);
+    esp_err_t result = ESP_ERR_NO_MEM;
+    if (ls_i2c_submit(request, portMAX_DELAY))
     {
-        lis2dh12_begin();
-        _ls_i2c_accelerometer_device = LS_I2C_ACCELEROMETER_LIS2DH12;
+        xSemaphoreTake(_ls_i2c_sync_done, portMAX_DELAY);
+        result = _ls_i2c_sync_result;
     }
-    if (ls_i2c_has_kxtj3())
+    xSemaphoreGive(_ls_i2c_sync_mux);
+    return result;
+}
+
+esp_err_t ls_i2c_write_reg_byte(uint8_t device_address, uint8_t register_number, uint8_t data)
+{
+    ls_i2c_request_t request = {
+        .kind = LS_I2C_REQUEST_WRITE,
+        .device_address = device_address,
+        .register_number = register_number,
+        .data = &data,
+        .length = 1,
+    };
+    return _ls_i2c_transact(&request);
+}
+
+esp_err_t ls_i2c_read_regs(uint8_t device_address, uint8_t register_number, uint8_t *data, size_t length)
+{
+    ls_i2c_request_t request = {
+        .kind = LS_I2C_REQUEST_READ,
+        .device_address = device_address,
+        .register_number = register_number,
+        .data = data,
+        .length = length,
+    };
+    return _ls_i2c_transact(&request);
+}
+
+esp_err_t ls_i2c_read_reg_uint8(uint8_t device_address, uint8_t register_number, uint8_t *data)
+{
+    return ls_i2c_read_regs(device_address, register_number, data, 1);
+}
+
+bool ls_i2c_init(void)
+{
+    if (NULL == _ls_i2c_queue)
     {
-        kxtj3_begin();
-        _ls_i2c_accelerometer_device = LS_I2C_ACCELEROMETER_KXTJ3;
+        _ls_i2c_queue = xQueueCreate(LS_I2C_QUEUE_LENGTH, sizeof(_ls_i2c_queued_t));
+        _ls_i2c_sync_mux = xSemaphoreCreateMutex();
+        _ls_i2c_sync_done = xSemaphoreCreateBinary();
     }
-    if (ls_i2c_has_mpu6050())
+    if (!_ls_i2c_initialized && i2c_master_init() == ESP_OK)
     {
-        mpu6050_begin();
-        _ls_i2c_accelerometer_device = LS_I2C_ACCELEROMETER_MPU6050;
+        _ls_i2c_initialized = true;
+        xTaskCreate(&_ls_i2c_task, "i2c_task", configMINIMAL_STACK_SIZE * 3, NULL, LS_I2C_TASK_PRIORITY, NULL);
+        vTaskDelay(1); // allow bus to settle down
+#ifdef LSDEBUG_I2C
+        ls_debug_printf("I2C LIS2DH: %d\n", ls_i2c_has_lis2dh12());
+        ls_debug_printf("I2C KXTJ3: %d\n", ls_i2c_has_kxtj3());
+        ls_debug_printf("I2C MPU6050: %d\n", ls_i2c_has_mpu6050());
+#endif
     }
-    // if we haven't yet detected an accelerometer, we may need to try harder.
+    return _ls_i2c_initialized;
+}
+
+bool ls_i2c_probe_address(uint8_t address)
+{
+    ls_i2c_request_t request = {
+        .kind = LS_I2C_REQUEST_PROBE,
+        .device_address = address,
+        .timeout_ms = 50,
+    };
+    return ESP_OK == _ls_i2c_transact(&request);
+}
 
-    if (LS_I2C_ACCELEROMETER_NONE == _ls_i2c_accelerometer_device) 
+void ls_i2c_get_stats(ls_i2c_stats_t *stats)
+{
+    taskENTER_CRITICAL(&_ls_i2c_stats_spinlock);
+    *stats = _ls_i2c_stats;
+    taskEXIT_CRITICAL(&_ls_i2c_stats_spinlock);
+}
+
+void ls_i2c_reset_stats(void)
+{
+    taskENTER_CRITICAL(&_ls_i2c_stats_spinlock);
+    memset(&_ls_i2c_stats, 0, sizeof(_ls_i2c_stats));
+    taskEXIT_CRITICAL(&_ls_i2c_stats_spinlock);
+}
+
+void ls_i2c_print_stats(void)
+{
+    ls_i2c_stats_t stats;
+    ls_i2c_get_stats(&stats);
+    printf("I2C: %u transactions, %u failed, %u timed out (bus still held low after %u); queue high water %u\n",
+           stats.transactions, stats.failures, stats.timeouts, stats.failed_recoveries, stats.queue_high_water);
+    printf("I2C: wait max %uus; transaction max %uus, mean %uus\n", stats.wait_max_us, stats.transaction_max_us,
+           stats.transactions > 0 ? (uint32_t)(stats.transaction_total_us / stats.transactions) : 0);
+}
+
+static const ls_accel_driver_t *_ls_i2c_accel_driver = NULL;
+
+// probed in this order; the MPU6050 probe may need to reset the chip before it answers
+static const ls_accel_driver_t *const _ls_i2c_accel_drivers[] = {
+    &ls_accel_driver_lis2dh12,
+    &ls_accel_driver_kxtj3,
+    &ls_accel_driver_mpu6050,
+};
+
+const ls_accel_driver_t *ls_i2c_accelerometer_driver(void)
+{
+    if (NULL != _ls_i2c_accel_driver)
+    {
+        return _ls_i2c_accel_driver;
+    }
+    for (int i = 0; i < sizeof(_ls_i2c_accel_drivers) / sizeof(_ls_i2c_accel_drivers[0]); i++)
     {
-        if (ESP_OK == mpu6050_attempt_reset())
+        if (_ls_i2c_accel_drivers[i]->probe())
         {
-            printf("Detected MPU6050 accelerometer via MPU6050 reset\r\n");
-            _ls_i2c_accelerometer_device = LS_I2C_ACCELEROMETER_MPU6050;
+            printf("Detected %s accelerometer\n", _ls_i2c_accel_drivers[i]->name);
+            if (ESP_OK != _ls_i2c_accel_drivers[i]->init())
+            {
+                printf("%s accelerometer did not initialize\n", _ls_i2c_accel_drivers[i]->name);
+            }
+            _ls_i2c_accel_driver = _ls_i2c_accel_drivers[i];
+            _ls_i2c_accelerometer_device = (enum ls_i2c_accelerometer_device_t)_ls_i2c_accel_driver->device;
+            break;
         }
     }
+    return _ls_i2c_accel_driver;
+}
+
+enum ls_i2c_accelerometer_device_t ls_i2c_accelerometer_device(void)
+{
+    ls_i2c_accelerometer_driver();
     return _ls_i2c_accelerometer_device;
 }
 
+esp_err_t ls_i2c_read_accel_xyz(ls_accel_xyz_t *xyz)
+{
+    if (NULL == ls_i2c_accelerometer_driver())
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return _ls_i2c_accel_driver->read_xyz(xyz);
+}
+
 float ls_i2c_read_accel_z(void)
 {
-    ls_i2c_init();
-    switch (ls_i2c_accelerometer_device())
+    ls_accel_xyz_t xyz;
+    if (ESP_OK != ls_i2c_read_accel_xyz(&xyz))
     {
-    case LS_I2C_ACCELEROMETER_KXTJ3:
-        return kxtj3_read_accel_z();
-        break;
-    case LS_I2C_ACCELEROMETER_LIS2DH12:
-        return lis2dh120_read_accel_z();
-        break;
-    case LS_I2C_ACCELEROMETER_MPU6050:
-        return mpu6050_read_accel_z();
-        break;
-    case LS_I2C_ACCELEROMETER_NONE:
         return nanf("");
-        break;
     }
-    return nanf("");
+    return xyz.z;
 }
+
 /*
 float ls_i2c_read_temp(void)
 {
@@ -211,30 +421,173 @@ float ls_i2c_read_temp(void)
 }
 */
 
-static enum _ls_tilt_task_tilt_status_t _ls_tilt_task_raw_to_status(float raw)
+static enum _ls_tilt_task_tilt_status_t _ls_tilt_task_read_status(void)
 {
-    BaseType_t milli_gs = (BaseType_t)(raw * 1000);
-#ifdef LSDEBUG_I2C
-//        ls_debug_printf("milli-g's=%d\n", milli_gs);
-#endif
-    if (milli_gs < ls_settings_get_tilt_threshold_mg_detected())
+    ls_accel_xyz_t xyz;
+    if (ESP_OK != ls_i2c_read_accel_xyz(&xyz))
+    {
+        return LS_TILT_TASK_TILT_STATUS_UNDEFINED;
+    }
+    ls_tiltcal_orientation_t orientation;
+    ls_tiltcal_orientation_from_mg((int32_t)(xyz.x * 1000), (int32_t)(xyz.y * 1000), (int32_t)(xyz.z * 1000), &orientation);
+    int32_t deviation_mdeg = ls_tiltcal_deviation_mdeg(&orientation);
+    enum _ls_tilt_task_tilt_status_t status = LS_TILT_TASK_TILT_STATUS_UNDEFINED;
+    if (deviation_mdeg > ls_settings_get_tilt_threshold_mdeg_detected())
     {
-        return LS_TILT_TASK_TILT_STATUS_DETECTED;
+        status = LS_TILT_TASK_TILT_STATUS_DETECTED;
     }
-    if (milli_gs > ls_settings_get_tilt_threshold_mg_ok())
+    else if (deviation_mdeg < ls_settings_get_tilt_threshold_mdeg_ok())
     {
-        return LS_TILT_TASK_TILT_STATUS_OK;
+        status = LS_TILT_TASK_TILT_STATUS_OK;
     }
-    return LS_TILT_TASK_TILT_STATUS_UNDEFINED;
+#ifdef LSDEBUG_TILT
+    ls_debug_printf("I2C pitch=%d roll=%d deviation=%d millidegrees [%d]\n", orientation.pitch_mdeg, orientation.roll_mdeg, deviation_mdeg, status);
+#endif
+    return status;
 }
 #define LS_TILT_TASK_TILT_STATUS_READINGS_COUNT 5
+
+static TaskHandle_t _ls_tilt_task_handle = NULL;
+static volatile bool _ls_tilt_calibration_requested = false;
+static bool _ls_tilt_interrupt_posts_detected = false;
+static uint8_t _ls_tilt_interrupt_duration = 1;
+
+static void IRAM_ATTR _ls_tilt_isr(void *pvParameter)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (_ls_tilt_interrupt_posts_detected)
+    {
+        // the pin only rises once Z has been below the detection threshold, so the tilt is already confirmed
+        ls_event event = ls_event_new(LSEVT_TILT_DETECTED);
+        ls_event_send_to_front_from_isr(&event, &higher_priority_task_woken);
+    }
+    vTaskNotifyGiveFromISR(_ls_tilt_task_handle, &higher_priority_task_woken);
+    if (pdTRUE == higher_priority_task_woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief set up the accelerometer interrupt, if this hardware can use one
+ *
+ * @return the driver raising it, or NULL to poll
+ */
+static const ls_accel_driver_t *_ls_tilt_interrupt_begin(void)
+{
+#ifdef LS_TILT_INTERRUPT_ENABLE
+    const ls_accel_driver_t *driver = ls_i2c_accelerometer_driver();
+    if (NULL == driver || LS_I2C_ACCELEROMETER_MPU6050 == driver->device)
+    {
+        return NULL;
+    }
+    uint32_t odr_hz = LS_TILT_INTERRUPT_ODR_HZ;
+#ifdef LS_VIBRATION_ENABLE
+    if (NULL != driver->configure_fifo)
+    {
+        odr_hz = LS_VIBRATION_ODR_HZ; // the vibration stream sets this rate, too
+    }
+#endif
+    driver->configure_odr(odr_hz);
+    _ls_tilt_interrupt_duration = odr_hz * LS_TILT_INTERRUPT_DURATION_MS / 1000;
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << LSGPIO_TILTINTERRUPT,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE, // stays quiet if the interrupt is not wired
+        .intr_type = GPIO_INTR_POSEDGE,
+    };
+    gpio_config(&io_conf);
+    gpio_install_isr_service(0); // normally already done by ls_magnet_isr_begin
+    gpio_isr_handler_add(LSGPIO_TILTINTERRUPT, &_ls_tilt_isr, NULL);
+    return driver;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * @brief (re)arm the interrupt for the current settings and installed orientation
+ *
+ * @return false if the interrupt cannot serve this orientation and the task must poll
+ */
+static bool _ls_tilt_interrupt_arm(const ls_accel_driver_t *driver)
+{
+    int32_t limit_mdeg = ls_settings_get_tilt_threshold_mdeg_detected();
+    int32_t reference_mdeg = ls_tiltcal_get_reference_tilt_mdeg();
+    // Z falls below cos(limit - reference) before the deviation can reach the limit in any direction,
+    // but that leaves the pin quiet in the installed orientation only if it is within half the limit
+    if (2 * reference_mdeg >= limit_mdeg)
+    {
+        driver->configure_interrupt(0, 0);
+#ifdef LSDEBUG_TILT
+        ls_debug_printf("I2C tilt interrupt unusable %d millidegrees from level; polling\n", reference_mdeg);
+#endif
+        return false;
+    }
+    // from level, Z below the threshold is itself the tilt; otherwise the task confirms it
+    _ls_tilt_interrupt_posts_detected = driver->interrupt_follows_z && 0 == reference_mdeg;
+    BaseType_t threshold_mg = (BaseType_t)(1000.0f * cosf((limit_mdeg - reference_mdeg) * (float)M_PI / 180000.0f));
+    if (!driver->interrupt_follows_z)
+    {
+        // motion-only engines see the change in acceleration tilting to that threshold would cause
+        threshold_mg = 1000 - threshold_mg;
+    }
+    driver->configure_interrupt(threshold_mg > 0 ? threshold_mg : 1, _ls_tilt_interrupt_duration);
+    // the quiet pin is driven low; if a pull-up can raise it, nothing is driving it
+    gpio_set_pull_mode(LSGPIO_TILTINTERRUPT, GPIO_PULLUP_ONLY);
+    esp_rom_delay_us(50);
+    int level = gpio_get_level(LSGPIO_TILTINTERRUPT);
+    gpio_set_pull_mode(LSGPIO_TILTINTERRUPT, GPIO_PULLDOWN_ONLY);
+    if (level)
+    {
+        driver->configure_interrupt(0, 0);
+        printf("Tilt interrupt on GPIO %d is not driven by the %s; polling\n", LSGPIO_TILTINTERRUPT, driver->name);
+        return false;
+    }
+#ifdef LSDEBUG_TILT
+    ls_debug_printf("I2C tilt interrupt armed at %d mg on %s\n", threshold_mg, driver->name);
+#endif
+    return true;
+}
+
+void ls_tilt_request_calibration(void)
+{
+    _ls_tilt_calibration_requested = true;
+    if (NULL != _ls_tilt_task_handle)
+    {
+        xTaskNotifyGive(_ls_tilt_task_handle);
+    }
+}
+
+static void _ls_tilt_calibrate(void)
+{
+    int32_t sum_x = 0, sum_y = 0, sum_z = 0;
+    int count = 0;
+    for (int i = 0; i < LS_TILT_CALIBRATION_READINGS; i++)
+    {
+        ls_accel_xyz_t xyz;
+        if (ESP_OK == ls_i2c_read_accel_xyz(&xyz))
+        {
+            sum_x += (int32_t)(xyz.x * 1000);
+            sum_y += (int32_t)(xyz.y * 1000);
+            sum_z += (int32_t)(xyz.z * 1000);
+            count++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(LS_TILT_INTERRUPT_CONFIRM_MS));
+    }
+    if (count > 0 && ls_tiltcal_set_reference_mg(sum_x / count, sum_y / count, sum_z / count))
+    {
+        ls_tiltcal_save();
+    }
+}
+
 void ls_tilt_task(void *pvParameter)
 {
     ls_event event;
-    event.type = LSEVT_NOOP;
-    event.value = NULL;
     enum _ls_tilt_task_tilt_status_t readings[LS_TILT_TASK_TILT_STATUS_READINGS_COUNT];
     enum _ls_tilt_task_tilt_status_t current_status = LS_TILT_TASK_TILT_STATUS_UNDEFINED;
+    _ls_tilt_task_handle = xTaskGetCurrentTaskHandle();
     // ls_i2c_init(); // done by main
     // ls_i2c_accelerometer_device(); // done by main
     // the MPU6050, in particular, can take a while to initialize
@@ -246,17 +599,56 @@ void ls_tilt_task(void *pvParameter)
     }
     for (int i = 0; i < LS_TILT_TASK_TILT_STATUS_READINGS_COUNT; i++)
     {
-        readings[i] = _ls_tilt_task_raw_to_status(ls_i2c_read_accel_z());
+        readings[i] = _ls_tilt_task_read_status();
     }
+    const ls_accel_driver_t *interrupt_driver = _ls_tilt_interrupt_begin();
+    bool interrupt_armed = false;
+    bool interrupt_usable = false;
+    bool confirming = false;
     int readings_index = 0;
     while (1)
     {
-        float raw = ls_i2c_read_accel_z();
-        enum _ls_tilt_task_tilt_status_t status = _ls_tilt_task_raw_to_status(raw);
-//        xQueueSendToBack(ls_event_queue, (void *)&event, 0);
+        if (_ls_tilt_calibration_requested)
+        {
+            _ls_tilt_calibration_requested = false;
+            _ls_tilt_calibrate();
+            interrupt_armed = false; // its threshold depends on the installed orientation
+        }
+        if (NULL != interrupt_driver && LS_TILT_TASK_TILT_STATUS_OK == current_status)
+        {
+            if (!interrupt_armed)
+            {
+                interrupt_usable = _ls_tilt_interrupt_arm(interrupt_driver);
+                interrupt_armed = true;
+                ulTaskNotifyTake(pdTRUE, 0); // discard anything raised while we were polling
+            }
+            // nothing to poll while upright; wait for the accelerometer to report a change
+            if (interrupt_usable && !confirming && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LS_TILT_INTERRUPT_BACKSTOP_MS)) > 0)
+            {
+                if (_ls_tilt_calibration_requested)
+                {
+                    continue;
+                }
+                if (_ls_tilt_interrupt_posts_detected && gpio_get_level(LSGPIO_TILTINTERRUPT))
+                {
+                    // the ISR has already sent LSEVT_TILT_DETECTED
+                    current_status = LS_TILT_TASK_TILT_STATUS_DETECTED;
+                    for (int i = 0; i < LS_TILT_TASK_TILT_STATUS_READINGS_COUNT; i++)
+                    {
+                        readings[i] = current_status;
+                    }
+                    interrupt_armed = false;
 #ifdef LSDEBUG_TILT
-        ls_debug_printf("I2C Z-acceleration=%0.2f [%d]\n", raw, status);
+                    ls_debug_printf("I2C tilt status now = %d (interrupt)\n", current_status);
 #endif
+                    continue;
+                }
+                confirming = true;
+            }
+        }
+        enum _ls_tilt_task_tilt_status_t status = _ls_tilt_task_read_status();
+        // a reading that disagrees (e.g., from the backstop) is confirmed quickly rather than at the slow rate
+        confirming = confirming || status != current_status;
         readings[readings_index++] = status;
         readings_index = readings_index % LS_TILT_TASK_TILT_STATUS_READINGS_COUNT;
         bool all_agree = true;
@@ -271,12 +663,12 @@ void ls_tilt_task(void *pvParameter)
                 switch (readings[0])
                 {
                 case LS_TILT_TASK_TILT_STATUS_OK:
-                    event.type = LSEVT_TILT_OK;
-                    xQueueSendToBack(ls_event_queue, (void *)&event, 0);
+                    event = ls_event_new(LSEVT_TILT_OK);
+                    ls_event_send(&event, 0);
                     break;
                 case LS_TILT_TASK_TILT_STATUS_DETECTED:
-                    event.type = LSEVT_TILT_DETECTED;
-                    xQueueSendToBack(ls_event_queue, (void *)&event, 0);
+                    event = ls_event_new(LSEVT_TILT_DETECTED);
+                    ls_event_send(&event, 0);
                     break;
                 default:;
                 }
@@ -284,8 +676,13 @@ void ls_tilt_task(void *pvParameter)
 #ifdef LSDEBUG_TILT
                 ls_debug_printf("I2C tilt status now = %d\n", current_status);
 #endif
+                if (LS_TILT_TASK_TILT_STATUS_OK != current_status)
+                {
+                    interrupt_armed = false; // re-read the threshold setting on recovery
+                }
             } // new status
+            confirming = false;
         }     // all agree
-        vTaskDelay(pdMS_TO_TICKS(LS_TILT_REPORT_RATE_MS));
+        vTaskDelay(pdMS_TO_TICKS(confirming ? LS_TILT_INTERRUPT_CONFIRM_MS : LS_TILT_REPORT_RATE_MS));
     }
 }
\ No newline at end of file
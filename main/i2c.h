@@ -18,7 +18,9 @@
 #pragma once
 // FreeRTOS.h defines bool type
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "config.h"
+#include "accel.h"
 
 enum ls_i2c_accelerometer_device_t {
     LS_I2C_ACCELEROMETER_NONE,
@@ -32,6 +34,40 @@ enum ls_i2c_accelerometer_device_t {
 #define LS_I2C_ADDRESS_MPU6050 0x69
 
 
+enum ls_i2c_request_kind_t {
+    LS_I2C_REQUEST_READ,  // length bytes starting at register_number into data
+    LS_I2C_REQUEST_WRITE, // register_number, then length bytes from data
+    LS_I2C_REQUEST_PROBE  // address only; succeeds if the device acknowledges
+};
+
+/**
+ * @brief called from the I2C service task when a request completes; must not wait on the I2C bus
+ */
+typedef void (*ls_i2c_callback_t)(esp_err_t result, void *arg);
+
+typedef struct ls_i2c_request_t {
+    enum ls_i2c_request_kind_t kind;
+    uint8_t device_address;
+    uint8_t register_number;
+    uint8_t *data; // must stay valid until the request completes
+    size_t length;
+    uint16_t timeout_ms; // 0 uses LS_I2C_TIMEOUT_MS
+    ls_i2c_callback_t callback; // optional
+    void *arg;
+    TaskHandle_t notify_task; // optional; notified with the esp_err_t result as its value
+} ls_i2c_request_t;
+
+typedef struct ls_i2c_stats_t {
+    uint32_t transactions;
+    uint32_t failures;
+    uint32_t timeouts; // each is followed by a bus recovery
+    uint32_t failed_recoveries; // SDA still held low afterwards
+    uint32_t queue_high_water;
+    uint32_t wait_max_us; // queued until started
+    uint32_t transaction_max_us;
+    uint64_t transaction_total_us;
+} ls_i2c_stats_t;
+
 /**
  * @brief attempt to initialize and install the EPS32 i2c driver and detect accelerometer
  * 
@@ -53,9 +89,30 @@ bool ls_i2c_probe_address(uint8_t);
 #define ls_i2c_has_mpu6050() ls_i2c_probe_address(LS_I2C_ADDRESS_MPU6050)
 
 enum ls_i2c_accelerometer_device_t ls_i2c_accelerometer_device(void);
+/**
+ * @brief detect and initialize the accelerometer on first use
+ *
+ * @return its driver, or NULL if none answered
+ */
+const ls_accel_driver_t *ls_i2c_accelerometer_driver(void);
+
+/**
+ * @brief Queue a transaction for the I2C service task without waiting for it
+ *
+ * @return false if the queue stayed full for ticks_to_wait
+ */
+bool ls_i2c_submit(const ls_i2c_request_t *request, TickType_t ticks_to_wait);
+void ls_i2c_get_stats(ls_i2c_stats_t *stats);
+void ls_i2c_reset_stats(void);
+void ls_i2c_print_stats(void);
 
+// these submit a request and wait for it; do not call them from an ls_i2c_callback_t
 esp_err_t ls_i2c_write_reg_byte(uint8_t device_address, uint8_t register_number, uint8_t data);
 esp_err_t ls_i2c_read_reg_uint8(uint8_t device_address, uint8_t register_number, uint8_t *data);
+/**
+ * @brief read length consecutive registers in one transaction; the device must auto-increment
+ */
+esp_err_t ls_i2c_read_regs(uint8_t device_address, uint8_t register_number, uint8_t *data, size_t length);
 
 /**
  * @brief Acceleration downward on board should always be near 1.0g
@@ -63,6 +120,7 @@ esp_err_t ls_i2c_read_reg_uint8(uint8_t device_address, uint8_t register_number,
  * @return float or NaN if no device
  */
 float ls_i2c_read_accel_z(void);
+esp_err_t ls_i2c_read_accel_xyz(ls_accel_xyz_t *xyz);
 
 /**
  * @brief Some accelerometers provide temperature data, too which might be useful
@@ -72,3 +130,7 @@ float ls_i2c_read_accel_z(void);
 //float ls_i2c_read_temp(void);
 
 void ls_tilt_task(void *pvParameter);
+/**
+ * @brief Have ls_tilt_task capture the current orientation as the installed reference and save it
+ */
+void ls_tilt_request_calibration(void);
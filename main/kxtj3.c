@@ -17,66 +17,25 @@
 */
 #include "freertos/FreeRTOS.h"
 #include "kxtj3.h"
+#include "i2c.h"
 #include "driver/i2c.h"
 
-#define ACK_CHECK_EN 0x1                        /*!< I2C master will check ack from slave*/
-#define ACK_CHECK_DIS 0x0                       /*!< I2C master will not check ack from slave */
-#define ACK_VAL 0x0                             /*!< I2C ack value */
-#define NACK_VAL 0x1                            /*!< I2C nack value */
-
 static uint8_t kxtj3_addr = KSTJ3_ADDR;
+// shadows of the registers that may only be written in standby (PC1 = 0)
+static uint8_t _kxtj3_ctrl_reg1 = KXTJ3_CTRL_REG1_PC1;
+static uint8_t _kxtj3_data_ctrl = 0x02; // reset value: 50Hz
 
 static esp_err_t kxtj3_write_reg_byte(uint8_t register_number, uint8_t data)
 {
     // see page 23 of KXTJ3-1057 specification
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, kxtj3_addr << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // SAD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN); // RA (ACK)
-    i2c_master_write_byte(cmd, data, ACK_CHECK_EN); // DATA (ACK)
-    i2c_master_stop(cmd); // P
-    esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+    return ls_i2c_write_reg_byte(kxtj3_addr, register_number, data);
 }
 
 static esp_err_t kxtj3_read_reg_uint8(uint8_t register_number, uint8_t *data)
 {
     // see page 23 of KXTJ3-1057 specification
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, kxtj3_addr << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // SAD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN); // RA (ACK)
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, kxtj3_addr << 1 | I2C_MASTER_READ, ACK_CHECK_EN); // SAD+R (ACK)
-    i2c_master_read_byte(cmd, data, I2C_MASTER_NACK); // (DATA) ACK
-    i2c_master_stop(cmd); // P
-    esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
-}
-// unused unless we need high-resolution measurement (maybe bluetooth compass?)
-/*
-static esp_err_t kxtj3_read_reg_int16(uint8_t register_number, int16_t *data)
-{
-    uint8_t data_h=0, data_l=0;
-    // see page 23 of KXTJ3-1057 specification
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, kxtj3_addr << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // SAD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN); // RA (ACK)
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, kxtj3_addr << 1 | I2C_MASTER_READ, ACK_CHECK_EN); // SAD+R (ACK)
-    i2c_master_read_byte(cmd, &data_l, I2C_MASTER_ACK); // (DATA) ACK
-    i2c_master_read_byte(cmd, &data_h, I2C_MASTER_NACK); // (DATA) NACK
-    i2c_master_stop(cmd); // P
-    esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    // reassemble 2s-complement value from separate high and low bytes
-    *data = ((data_h & 0x80) ? -32878 : 0) + (data_h & 0x7f) * 256 + data_l;
-    return ret;
+    return ls_i2c_read_reg_uint8(kxtj3_addr, register_number, data);
 }
-*/
 
 static void kxtj3_fail(void)
 {
@@ -150,27 +109,120 @@ static esp_err_t kxtj3_software_reset_sequence(void)
     return ESP_OK;
 }
 
+static bool kxtj3_probe(void)
+{
+    return ls_i2c_has_kxtj3();
+}
+
+/**
+ * @brief apply the shadowed configuration: standby, write, then operating
+ */
+static esp_err_t kxtj3_apply_config(void)
+{
+    esp_err_t result = kxtj3_write_reg_byte(KXTJ3_CTRL_REG1, _kxtj3_ctrl_reg1 & ~KXTJ3_CTRL_REG1_PC1); // standby
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    kxtj3_write_reg_byte(KXTJ3_DATA_CTRL_REG, _kxtj3_data_ctrl);
+    return kxtj3_write_reg_byte(KXTJ3_CTRL_REG1, _kxtj3_ctrl_reg1); // operating
+}
+
 /**
  * @brief Initialize the KXTJ3-1057 accelerometer
  * 
  */
-void kxtj3_begin(void)
+static esp_err_t kxtj3_begin(void)
 {
    if(1) {
        kxtj3_software_reset_sequence();
    }
     // reset value of CTRL_REG1 is 0x00: standby mode, but I suppose there's no harm in making sure.
-    ESP_ERROR_CHECK(kxtj3_write_reg_byte(KXTJ3_CTRL_REG1, 0x00));//standby
     // all the defaults seem good... 
-    ESP_ERROR_CHECK(kxtj3_write_reg_byte(KXTJ3_CTRL_REG1, 0x80));//operating
+    return kxtj3_apply_config();
 }
 
-float kxtj3_read_accel_z(void)
+static esp_err_t kxtj3_read_xyz(ls_accel_xyz_t *xyz)
 {
-    // using low-resolution (8-bit signed)
-    uint8_t raw=0;
-    ESP_ERROR_CHECK(kxtj3_read_reg_uint8(KXTJ3_ACCEL_ZOUT_H, &raw));
-    int8_t value = ((raw & 0x80) ? -128 : 0) + (raw & 0x7f);
-    return ((float) value / 64.0); // +/- 2g
+    // using low-resolution (8-bit signed in each high byte); registers auto-increment
+    uint8_t raw[6];
+    esp_err_t result = ls_i2c_read_regs(kxtj3_addr, KXTJ3_ACCEL_XOUT_L, raw, sizeof(raw));
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    xyz->x = (float)(int8_t)raw[1] / 64.0f; // +/- 2g
+    xyz->y = (float)(int8_t)raw[3] / 64.0f;
+    xyz->z = (float)(int8_t)raw[5] / 64.0f;
+    return ESP_OK;
+}
+
+static esp_err_t kxtj3_configure_odr(uint32_t hz)
+{
+    // OSA codes 0x08..0x0B are 0.781..6.25Hz; 0x00..0x07 are 12.5..1600Hz, doubling each step
+    if (hz <= 1)
+    {
+        _kxtj3_data_ctrl = 0x09;
+    }
+    else if (hz <= 3)
+    {
+        _kxtj3_data_ctrl = 0x0A;
+    }
+    else if (hz <= 6)
+    {
+        _kxtj3_data_ctrl = 0x0B;
+    }
+    else
+    {
+        uint8_t osa = 0;
+        for (uint32_t decihertz = 125; decihertz < hz * 10 && osa < 0x07; decihertz *= 2)
+        {
+            osa++;
+        }
+        _kxtj3_data_ctrl = osa;
+    }
+    return kxtj3_apply_config();
+}
+
+static esp_err_t kxtj3_configure_interrupt(uint16_t threshold_mg, uint8_t duration)
+{
+    if (0 == threshold_mg)
+    {
+        _kxtj3_ctrl_reg1 &= ~KXTJ3_CTRL_REG1_WUFE;
+        kxtj3_write_reg_byte(KXTJ3_INT_CTRL_REG1, 0);
+        return kxtj3_apply_config();
+    }
+    // the wake-up engine compares the change in acceleration against a 12-bit threshold
+    uint32_t counts = (uint32_t)threshold_mg * 1000 / KXTJ3_WAKEUP_THRESHOLD_UG_PER_COUNT;
+    if (counts > 0x0FFF)
+    {
+        counts = 0x0FFF;
+    }
+    _kxtj3_ctrl_reg1 |= KXTJ3_CTRL_REG1_WUFE;
+    esp_err_t result = kxtj3_write_reg_byte(KXTJ3_CTRL_REG1, _kxtj3_ctrl_reg1 & ~KXTJ3_CTRL_REG1_PC1); // standby
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    kxtj3_write_reg_byte(KXTJ3_CTRL_REG2, KXTJ3_CTRL_REG2_OWUF_50HZ);
+    kxtj3_write_reg_byte(KXTJ3_WAKEUP_THRESHOLD_H, counts >> 4);
+    kxtj3_write_reg_byte(KXTJ3_WAKEUP_THRESHOLD_L, (counts & 0x0F) << 4);
+    kxtj3_write_reg_byte(KXTJ3_WAKEUP_COUNTER, duration > 0 ? duration : 1);
+    kxtj3_write_reg_byte(KXTJ3_INT_CTRL_REG2, KXTJ3_INT_CTRL_REG2_ALL_AXES);
+    // pulsed rather than latched so no I2C read is needed to release the pin
+    kxtj3_write_reg_byte(KXTJ3_INT_CTRL_REG1, KXTJ3_INT_CTRL_REG1_IEN | KXTJ3_INT_CTRL_REG1_IEA | KXTJ3_INT_CTRL_REG1_IEL);
+    return kxtj3_apply_config();
 }
 
+const ls_accel_driver_t ls_accel_driver_kxtj3 = {
+    .name = "KXTJ3",
+    .device = LS_I2C_ACCELEROMETER_KXTJ3,
+    .probe = kxtj3_probe,
+    .init = kxtj3_begin,
+    .read_xyz = kxtj3_read_xyz,
+    .configure_odr = kxtj3_configure_odr,
+    .configure_interrupt = kxtj3_configure_interrupt,
+    .interrupt_follows_z = false,
+    .configure_fifo = NULL, // no FIFO
+    .read_fifo = NULL,
+};
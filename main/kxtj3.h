@@ -16,13 +16,29 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #pragma once
+#include "accel.h"
 // loosely adapted from https://github.com/tockn/MPU6050_tockn
 
 // Address pad is connected to ground on Jan '22 kit boards
 #define KSTJ3_ADDR         0x0E
 #define KSTJ3_ADDR_FLIPPED 0x0C
 #define KXTJ3_CTRL_REG1 0x1B
+#define KXTJ3_CTRL_REG1_PC1 0x80
+#define KXTJ3_CTRL_REG1_WUFE 0x02
 #define KXTJ3_CTRL_REG2 0x1D
+#define KXTJ3_CTRL_REG2_OWUF_50HZ 0x06
+#define KXTJ3_INT_CTRL_REG1 0x1E
+#define KXTJ3_INT_CTRL_REG1_IEN 0x20
+#define KXTJ3_INT_CTRL_REG1_IEA 0x10
+#define KXTJ3_INT_CTRL_REG1_IEL 0x08
+#define KXTJ3_INT_CTRL_REG2 0x1F
+#define KXTJ3_INT_CTRL_REG2_ALL_AXES 0x3F
+#define KXTJ3_DATA_CTRL_REG 0x21
+#define KXTJ3_WAKEUP_COUNTER 0x29
+#define KXTJ3_WAKEUP_THRESHOLD_H 0x6A
+#define KXTJ3_WAKEUP_THRESHOLD_L 0x6B
+#define KXTJ3_WAKEUP_THRESHOLD_UG_PER_COUNT 3900
+#define KXTJ3_ACCEL_XOUT_L 0x06
 #define KXTJ3_ACCEL_ZOUT_L 0x0A
 #define KXTJ3_ACCEL_ZOUT_H 0x0B
 #define KXTJ3_WHO_AM_I_REG     0x0F
@@ -31,5 +47,4 @@
 #define KXTJ3_DCST_RESP_REG 0x0C
 #define KXTJ3_DCST_RESP_VALUE 0x55
 
-void kxtj3_begin(void);
-float kxtj3_read_accel_z(void);
+// exposed only through ls_accel_driver_kxtj3 (accel.h)
@@ -26,8 +26,9 @@
 #include "esp_adc_cal.h"
 #include "settings.h"
 #include "states.h"
+#include "adcstream.h"
+#include "adccal.h"
 
-extern SemaphoreHandle_t adc1_mux;
 extern SemaphoreHandle_t print_mux;
 
 static enum ls_lightsense_mode_t _ls_lightsense_current_mode = LS_LIGHTSENSE_MODE_STARTUP;
@@ -36,13 +37,17 @@ enum ls_lightsense_mode_t ls_lightsense_current_mode(void)
     return _ls_lightsense_current_mode;
 }
 
-static enum ls_lightsense_level_t _ls_lightsense_level_from_adc(uint32_t adc_reading)
+/**
+ * @brief classify a filtered reading; the day threshold is above the night threshold, so
+ * anything between them keeps the current mode (hysteresis)
+ */
+static enum ls_lightsense_level_t _ls_lightsense_level_from_mv(uint32_t mv, uint32_t on_mv, uint32_t off_mv)
 {
-    if (adc_reading >= ls_settings_get_light_threshold_on())
+    if (mv >= on_mv)
     {
         return LS_LIGHTSENSE_LEVEL_DAY;
     }
-    if (adc_reading <= ls_settings_get_light_threshold_off())
+    if (mv <= off_mv)
     {
         return LS_LIGHTSENSE_LEVEL_NIGHT;
     }
@@ -51,17 +56,7 @@ static enum ls_lightsense_level_t _ls_lightsense_level_from_adc(uint32_t adc_rea
 
 int ls_lightsense_read_adc(void)
 {
-    xSemaphoreTake(adc1_mux, portMAX_DELAY);
-    adc1_config_width(ADC_WIDTH_BIT_12);
-    adc1_config_channel_atten(LSADC1_LIGHTSENSE, ADC_ATTEN_DB_11);
-    uint32_t adc_reading = 0;
-    for (int i = 0; i < 4; i++)
-    {
-        adc_reading += adc1_get_raw((adc1_channel_t)LSADC1_LIGHTSENSE);
-    }
-    adc_reading /= 4;
-    xSemaphoreGive(adc1_mux);
-    return (int)adc_reading;
+    return (int)ls_adcstream_read_average(LS_ADCSTREAM_LIGHTSENSE, LS_ADCSTREAM_READ_AVERAGE);
 }
 /**
  * @brief Set current mode if event can be queued; otherwise let it try again next read
@@ -70,8 +65,7 @@ int ls_lightsense_read_adc(void)
  */
 static void _ls_lightsense_set_mode(enum ls_lightsense_mode_t mode)
 {
-    ls_event lightsense_event;
-    lightsense_event.value = NULL;
+    ls_event lightsense_event = ls_event_new(LSEVT_NOOP);
     switch (mode)
     {
     case LS_LIGHTSENSE_MODE_NIGHT:
@@ -86,7 +80,7 @@ static void _ls_lightsense_set_mode(enum ls_lightsense_mode_t mode)
 #ifdef LSDEBUG_LIGHTSENSE
     ls_debug_printf("Lightsense queueing event=%d for mode=%d\n", (int)lightsense_event.type, (int)mode);
 #endif
-    if (pdTRUE == xQueueSendToBack(ls_event_queue, (void *)&lightsense_event, 0))
+    if (pdPASS == ls_event_send(&lightsense_event, 0))
     {
         _ls_lightsense_current_mode = mode; // queued event, so set the mode
     }
@@ -99,54 +93,76 @@ static void _ls_lightsense_set_mode(enum ls_lightsense_mode_t mode)
     }
 }
 
-void ls_lightsense_read_task(void *pvParameter)
+// estimate in millivolts with LS_LIGHTSENSE_FILTER_FRACTION_BITS fractional bits
+#define LS_LIGHTSENSE_FILTER_FRACTION_BITS 8
+
+/**
+ * @brief one step of a first-order low-pass filter; the weight given to the new reading
+ * follows from the time since the previous one, so varying the interval does not change
+ * the filter's time constant
+ */
+static int32_t _ls_lightsense_filter(int32_t estimate, uint32_t mv, uint32_t elapsed_ms)
 {
-    enum ls_lightsense_level_t levels[LS_LIGHTSENSE_READINGS_TO_SWITCH];
-    for (int i = 0; i < LS_LIGHTSENSE_READINGS_TO_SWITCH; i++)
+    int32_t reading = (int32_t)mv << LS_LIGHTSENSE_FILTER_FRACTION_BITS;
+    // alpha = dt / (tau + dt), in 1/65536ths
+    int64_t alpha = ((int64_t)elapsed_ms << 16) / (LS_LIGHTSENSE_FILTER_TAU_MS + elapsed_ms);
+    return estimate + (int32_t)(((int64_t)(reading - estimate) * alpha) >> 16);
+}
+
+static uint32_t _ls_lightsense_interval_ms(uint32_t mv, uint32_t on_mv, uint32_t off_mv)
+{
+    if (mv + LS_LIGHTSENSE_NEAR_THRESHOLD_MV >= off_mv && mv <= on_mv + LS_LIGHTSENSE_NEAR_THRESHOLD_MV)
     {
-        levels[i] = LS_LIGHTSENSE_LEVEL_INDETERMINATE;
+        return LS_LIGHTSENSE_INTERVAL_FAST_MS;
     }
-    int level_index = 0;
+    return LS_LIGHTSENSE_INTERVAL_SLOW_MS;
+}
+
+void ls_lightsense_read_task(void *pvParameter)
+{
+    // start from the first reading rather than ramping up from zero
+    int32_t estimate = (int32_t)ls_adccal_raw_to_mv(ls_lightsense_read_adc()) << LS_LIGHTSENSE_FILTER_FRACTION_BITS;
+    TickType_t last_reading = xTaskGetTickCount();
+    TickType_t last_change = last_reading;
+    uint32_t interval_ms = LS_LIGHTSENSE_INTERVAL_FAST_MS;
     while (1)
     {
-        int adc_reading = ls_lightsense_read_adc();
-        levels[level_index] = _ls_lightsense_level_from_adc(adc_reading);
+        // thresholds are settings in calibrated millivolts, like the estimate
+        uint32_t on_mv = ls_settings_get_light_threshold_on_mv();
+        uint32_t off_mv = ls_settings_get_light_threshold_off_mv();
+        uint32_t mv = (uint32_t)(estimate >> LS_LIGHTSENSE_FILTER_FRACTION_BITS);
+        enum ls_lightsense_level_t level = _ls_lightsense_level_from_mv(mv, on_mv, off_mv);
+        bool dwelled = ls_lightsense_current_mode() == LS_LIGHTSENSE_MODE_STARTUP ||
+                       xTaskGetTickCount() - last_change >= pdMS_TO_TICKS(LS_LIGHTSENSE_MIN_DWELL_MS);
 #ifdef LSDEBUG_LIGHTSENSE
-        ls_debug_printf("Light sense adc=%d; level=%d\n", adc_reading, (int)levels[level_index]);
+        ls_debug_printf("Light sense estimate=%dmV (day>=%d, night<=%d); level=%d; next in %dms\n",
+                        mv, on_mv, off_mv, (int)level, _ls_lightsense_interval_ms(mv, on_mv, off_mv));
 #endif
-        bool all_agree = true;
-        for (int i = 1; all_agree && i < LS_LIGHTSENSE_READINGS_TO_SWITCH; i++)
+        enum ls_lightsense_mode_t mode_before = ls_lightsense_current_mode();
+        switch (level)
         {
-            if (levels[i] != levels[i - 1])
+        case LS_LIGHTSENSE_LEVEL_DAY:
+            if (dwelled && mode_before != LS_LIGHTSENSE_MODE_DAY)
             {
-                all_agree = false;
+                _ls_lightsense_set_mode(LS_LIGHTSENSE_MODE_DAY);
             }
-        }
-        if (all_agree)
-        {
-            switch (levels[0])
+            break;
+        case LS_LIGHTSENSE_LEVEL_NIGHT:
+            // keep reminding the state machine until it is asleep
+            if ((dwelled && mode_before != LS_LIGHTSENSE_MODE_NIGHT) ||
+                (mode_before == LS_LIGHTSENSE_MODE_NIGHT && ls_state_current != LS_STATE_SLEEP && ls_state_current != LS_STATE_SETTINGS))
             {
-            case LS_LIGHTSENSE_LEVEL_DAY:
-                if (ls_lightsense_current_mode() != LS_LIGHTSENSE_MODE_DAY)
-                {
-                    _ls_lightsense_set_mode(LS_LIGHTSENSE_MODE_DAY);
-                }
-                break;
-            case LS_LIGHTSENSE_LEVEL_NIGHT:
-                if (ls_lightsense_current_mode() != LS_LIGHTSENSE_MODE_NIGHT ||
-                (ls_state_current.func != ls_state_sleep && ls_state_current.func != ls_state_settings))
-                {
-                    _ls_lightsense_set_mode(LS_LIGHTSENSE_MODE_NIGHT);
-                }
-                break;
-            default:; // do not set mode for indeterminate or invalid levels
+                _ls_lightsense_set_mode(LS_LIGHTSENSE_MODE_NIGHT);
             }
+            break;
+        default:; // between the thresholds: keep the current mode
         }
-        // move to next level reading
-        if (++level_index > LS_LIGHTSENSE_READINGS_TO_SWITCH)
+        if (ls_lightsense_current_mode() != mode_before)
         {
-            level_index = 0;
+            last_change = xTaskGetTickCount();
         }
-        vTaskDelay(pdMS_TO_TICKS(LS_LIGHTSENSE_READING_INTERVAL_MS));
+        interval_ms = _ls_lightsense_interval_ms(mv, on_mv, off_mv);
+        vTaskDelayUntil(&last_reading, pdMS_TO_TICKS(interval_ms));
+        estimate = _ls_lightsense_filter(estimate, ls_adccal_raw_to_mv(ls_lightsense_read_adc()), interval_ms);
     }
 }
\ No newline at end of file
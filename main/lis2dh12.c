@@ -19,50 +19,224 @@
 #include "i2c.h"
 #include "freertos/FreeRTOS.h"
 #include "driver/i2c.h"
-
-#define ACK_CHECK_EN 0x1  /*!< I2C master will check ack from slave*/
-#define ACK_CHECK_DIS 0x0 /*!< I2C master will not check ack from slave */
-#define ACK_VAL 0x0       /*!< I2C ack value */
-#define NACK_VAL 0x1      /*!< I2C nack value */
+#include "esp_timer.h"
 
 #define LIS2DH_REGISTER_CFG_REG 0x1F
 #define LIS2DH_CFG_REG_TEMP_EN 0xC0
 
 #define LIS2DH_REGISTER_CTRL_REG1 0x20
+#define LIS2DH_CTRL_REG1_ODR_SHIFT 4
 #define LIS2DH_CTRL_REG1_ODR10Hz 0x20
 #define LIS2DH_CTRL_REG1_LPEN 0x08
 #define LIS2DH_CTRL_REG1_ZEN 0x04
 #define LIS2DH_CTRL_REG1_YEN 0x02
 #define LIS2DH_CTRL_REG1_XEN 0x01
 
+#define LIS2DH_REGISTER_CTRL_REG3 0x22
+#define LIS2DH_CTRL_REG3_I1_IA1 0x40
+
 #define LIS2DH_REGISTER_CTRL_REG4 0x23
 #define LIS2DH_CTRL_REG4_SCALE_2G 0x00
 #define LIS2DH_CTRL_REG4_HIGHRES 0x08
 #define LIS2DH_CTRL_REG4_LOWRES 0x00
 
+#define LIS2DH_REGISTER_CTRL_REG5 0x24
+#define LIS2DH_CTRL_REG5_FIFO_EN 0x40
+
+// setting the MSB of the register address auto-increments through a burst read
+#define LIS2DH_REGISTER_AUTO_INCREMENT 0x80
+#define LIS2DH_REGISTER_OUT_X_L 0x28
 #define LIS2DH_REGISTER_OUT_Z_L 0x2C
 #define LIS2DH_REGISTER_OUT_Z_H 0x2D
 
+#define LIS2DH_REGISTER_FIFO_CTRL_REG 0x2E
+#define LIS2DH_FIFO_CTRL_REG_BYPASS 0x00
+#define LIS2DH_FIFO_CTRL_REG_STREAM 0x80
+#define LIS2DH_REGISTER_FIFO_SRC_REG 0x2F
+#define LIS2DH_FIFO_SRC_REG_FSS 0x1F
+#define LIS2DH_FIFO_DEPTH 32
+
+#define LIS2DH_REGISTER_INT1_CFG 0x30
+#define LIS2DH_INT1_CFG_ZLIE 0x10
+#define LIS2DH_REGISTER_INT1_THS 0x32
+#define LIS2DH_INT1_THS_MG_PER_LSB 16 // at +/- 2g
+#define LIS2DH_REGISTER_INT1_DURATION 0x33
+
 #define LIS2DH_REGISTER_OUT_TEMP_L 0x0C
 #define LIS2DH_REGISTER_OUT_TEMP_H 0x0D
 
-void lis2dh12_begin(void)
+static uint8_t _lis2dh12_ctrl_reg1 = LIS2DH_CTRL_REG1_ODR10Hz | LIS2DH_CTRL_REG1_LPEN |
+                                     LIS2DH_CTRL_REG1_XEN | LIS2DH_CTRL_REG1_YEN | LIS2DH_CTRL_REG1_ZEN;
+
+// while the FIFO streams, reading the output registers would pop its oldest entry, so
+// read_xyz reports the newest sample read_fifo drained instead
+static uint32_t _lis2dh12_fifo_hz = 0;
+static ls_accel_mg_t _lis2dh12_fifo_newest;
+static int64_t _lis2dh12_fifo_newest_us = 0;
+static portMUX_TYPE _lis2dh12_fifo_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool lis2dh12_probe(void)
+{
+    return ls_i2c_has_lis2dh12();
+}
+
+static esp_err_t lis2dh12_begin(void)
 {
     // set 2G 8-bit data
-    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG4,
-                          LIS2DH_CTRL_REG4_SCALE_2G | LIS2DH_CTRL_REG4_LOWRES);
-    // set 10Hz low-power Z-axis only
-    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG1,
-                          LIS2DH_CTRL_REG1_ODR10Hz | LIS2DH_CTRL_REG1_LPEN | LIS2DH_CTRL_REG1_ZEN);
+    esp_err_t result = ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG4,
+                                             LIS2DH_CTRL_REG4_SCALE_2G | LIS2DH_CTRL_REG4_LOWRES);
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    // set 10Hz low-power, all axes
+    return ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG1, _lis2dh12_ctrl_reg1);
 // enable temperature
 //    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CFG_REG, LIS2DH_CFG_REG_TEMP_EN);
 }
-float lis2dh120_read_accel_z(void)
+
+static esp_err_t lis2dh12_read_xyz(ls_accel_xyz_t *xyz)
+{
+    if (_lis2dh12_fifo_hz > 0)
+    {
+        taskENTER_CRITICAL(&_lis2dh12_fifo_spinlock);
+        ls_accel_mg_t newest = _lis2dh12_fifo_newest;
+        int64_t newest_us = _lis2dh12_fifo_newest_us;
+        taskEXIT_CRITICAL(&_lis2dh12_fifo_spinlock);
+        // nothing drained within two FIFO spans means the stream has stopped being read
+        if (esp_timer_get_time() - newest_us > 2LL * LIS2DH_FIFO_DEPTH * 1000000 / _lis2dh12_fifo_hz)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        xyz->x = newest.x / 1000.0f;
+        xyz->y = newest.y / 1000.0f;
+        xyz->z = newest.z / 1000.0f;
+        return ESP_OK;
+    }
+    // low-power mode leaves 8-bit signed values in the high byte of each axis
+    uint8_t raw[6];
+    esp_err_t result = ls_i2c_read_regs(LS_I2C_ADDRESS_LIS2DH12,
+                                        LIS2DH_REGISTER_OUT_X_L | LIS2DH_REGISTER_AUTO_INCREMENT, raw, sizeof(raw));
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    xyz->x = (float)(int8_t)raw[1] / 64.0f; // +/- 2g
+    xyz->y = (float)(int8_t)raw[3] / 64.0f;
+    xyz->z = (float)(int8_t)raw[5] / 64.0f;
+    return ESP_OK;
+}
+
+static esp_err_t lis2dh12_configure_odr(uint32_t hz)
+{
+    // ODR field 1..7 selects 1, 10, 25, 50, 100, 200, 400Hz
+    static const uint16_t rates[] = {1, 10, 25, 50, 100, 200, 400};
+    uint8_t odr = sizeof(rates) / sizeof(rates[0]);
+    for (uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        if (rates[i] >= hz)
+        {
+            odr = i + 1;
+            break;
+        }
+    }
+    _lis2dh12_ctrl_reg1 = (_lis2dh12_ctrl_reg1 & 0x0F) | (odr << LIS2DH_CTRL_REG1_ODR_SHIFT);
+    return ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG1, _lis2dh12_ctrl_reg1);
+}
+
+static esp_err_t lis2dh12_configure_interrupt(uint16_t threshold_mg, uint8_t duration)
+{
+    if (0 == threshold_mg)
+    {
+        ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG3, 0);
+        return ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_INT1_CFG, 0);
+    }
+    uint16_t threshold = threshold_mg / LIS2DH_INT1_THS_MG_PER_LSB;
+    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_INT1_THS, threshold > 0x7F ? 0x7F : threshold);
+    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_INT1_DURATION, duration > 0x7F ? 0x7F : duration);
+    // not latched: INT1 follows the Z-low condition, so it falls again once the unit is righted
+    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_INT1_CFG, LIS2DH_INT1_CFG_ZLIE);
+    return ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG3, LIS2DH_CTRL_REG3_I1_IA1);
+}
+
+static esp_err_t lis2dh12_configure_fifo(uint32_t hz)
+{
+    if (0 == hz)
+    {
+        _lis2dh12_fifo_hz = 0;
+        ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_FIFO_CTRL_REG, LIS2DH_FIFO_CTRL_REG_BYPASS);
+        ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG5, 0);
+        _lis2dh12_ctrl_reg1 |= LIS2DH_CTRL_REG1_LPEN;
+        return ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG1, _lis2dh12_ctrl_reg1);
+    }
+    // normal (10-bit) mode while streaming: 4mg rather than 16mg resolution
+    _lis2dh12_ctrl_reg1 &= ~LIS2DH_CTRL_REG1_LPEN;
+    esp_err_t result = lis2dh12_configure_odr(hz);
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_CTRL_REG5, LIS2DH_CTRL_REG5_FIFO_EN);
+    // stream mode keeps the newest 32 samples, discarding the oldest if we fall behind
+    result = ls_i2c_write_reg_byte(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_FIFO_CTRL_REG, LIS2DH_FIFO_CTRL_REG_STREAM);
+    if (result == ESP_OK)
+    {
+        _lis2dh12_fifo_newest_us = 0; // read_xyz fails until read_fifo has drained a batch
+        _lis2dh12_fifo_hz = hz;
+    }
+    return result;
+}
+
+static esp_err_t lis2dh12_read_fifo(ls_accel_mg_t *samples, size_t max, size_t *count)
 {
-    // using low-resolution (8-bit signed)
-    uint8_t raw=0;
-    ESP_ERROR_CHECK(ls_i2c_read_reg_uint8(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_OUT_Z_H, &raw));
-    int8_t value = ((raw & 0x80) ? -128 : 0) + (raw & 0x7f);
-    return ((float) value / 64.0); // +/- 2g    
+    static uint8_t raw[LIS2DH_FIFO_DEPTH * 6];
+    uint8_t fifo_src = 0;
+    *count = 0;
+    esp_err_t result = ls_i2c_read_reg_uint8(LS_I2C_ADDRESS_LIS2DH12, LIS2DH_REGISTER_FIFO_SRC_REG, &fifo_src);
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    size_t available = fifo_src & LIS2DH_FIFO_SRC_REG_FSS;
+    if (available > max)
+    {
+        available = max;
+    }
+    if (0 == available)
+    {
+        return ESP_OK;
+    }
+    // with the FIFO enabled the address wraps from OUT_Z_H back to OUT_X_L, so one burst drains it
+    result = ls_i2c_read_regs(LS_I2C_ADDRESS_LIS2DH12,
+                              LIS2DH_REGISTER_OUT_X_L | LIS2DH_REGISTER_AUTO_INCREMENT, raw, available * 6);
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    for (size_t i = 0; i < available; i++)
+    {
+        // left-justified 10-bit values; 4mg per count at +/- 2g
+        samples[i].x = ((int16_t)(raw[i * 6 + 1] << 8 | raw[i * 6 + 0]) >> 6) * 4;
+        samples[i].y = ((int16_t)(raw[i * 6 + 3] << 8 | raw[i * 6 + 2]) >> 6) * 4;
+        samples[i].z = ((int16_t)(raw[i * 6 + 5] << 8 | raw[i * 6 + 4]) >> 6) * 4;
+    }
+    *count = available;
+    taskENTER_CRITICAL(&_lis2dh12_fifo_spinlock);
+    _lis2dh12_fifo_newest = samples[available - 1];
+    _lis2dh12_fifo_newest_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&_lis2dh12_fifo_spinlock);
+    return ESP_OK;
 }
-//float lis2dh12_read_temp(void);
\ No newline at end of file
+
+const ls_accel_driver_t ls_accel_driver_lis2dh12 = {
+    .name = "LIS2DH12",
+    .device = LS_I2C_ACCELEROMETER_LIS2DH12,
+    .probe = lis2dh12_probe,
+    .init = lis2dh12_begin,
+    .read_xyz = lis2dh12_read_xyz,
+    .configure_odr = lis2dh12_configure_odr,
+    .configure_interrupt = lis2dh12_configure_interrupt,
+    .interrupt_follows_z = true,
+    .configure_fifo = lis2dh12_configure_fifo,
+    .read_fifo = lis2dh12_read_fifo,
+};
\ No newline at end of file
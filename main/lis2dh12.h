@@ -16,7 +16,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #pragma once
+#include "accel.h"
 
-void lis2dh12_begin(void);
-float lis2dh120_read_accel_z(void);
+// exposed only through ls_accel_driver_lis2dh12 (accel.h)
 float lis2dh12_read_temp(void);
\ No newline at end of file
@@ -43,16 +43,18 @@
 #include "coverage.h"
 #include "lightsense.h"
 #include "servo.h"
+#include "servocal.h"
+#include "tiltcal.h"
 #include "settings.h"
 #include "i2c.h"
+#include "vibration.h"
+#include "scenario.h"
+#include "adcstream.h"
+#include "adccal.h"
 
-SemaphoreHandle_t adc1_mux = NULL;
 SemaphoreHandle_t adc2_mux = NULL;
-SemaphoreHandle_t i2c_mux = NULL;
 SemaphoreHandle_t print_mux = NULL;
 
-static esp_adc_cal_characteristics_t *adc_chars;
-
 
 static void print_char_val_type(esp_adc_cal_value_t val_type)
 {
@@ -83,7 +85,9 @@ void app_main(void)
 {
 
     vTaskDelay(pdMS_TO_TICKS(2000)); // let voltages settle, USB connect
-    adc1_mux = xSemaphoreCreateMutex();
+#ifdef LS_SCENARIO_ENABLE
+    ls_scenario_init(); // before the accelerometer is probed
+#endif
     adc2_mux = xSemaphoreCreateMutex();
     print_mux = xSemaphoreCreateMutex();
     printf("Initializing I2C...\n");
@@ -96,20 +100,20 @@ void app_main(void)
     }
     printf("Initializing GPIO...\n");
     ls_gpio_initialize();
-    adc_chars = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-    esp_adc_cal_value_t val_type = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_11db, ADC_WIDTH_12Bit, 1100, adc_chars);
-    print_char_val_type(val_type);
+    print_char_val_type(ls_adccal_init());
     check_efuse();
+    ls_adcstream_init();
     printf("Initialized Hardware\n");
     ls_settings_set_defaults();
     ls_settings_read();
+    ls_servocal_init();
+    ls_tiltcal_init();
     printf("Loaded settings\n");
-    adc_chars = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-    ls_state_current.func = ls_state_poweron; // default
+    ls_state_current = LS_STATE_POWERON; // default
     if(ls_i2c_accelerometer_device()==LS_I2C_ACCELEROMETER_NONE)
     {
         printf("No accelerometer detected!\n");
-        ls_state_current.func = ls_state_error_noaccel;
+        ls_state_current = LS_STATE_ERROR_NOACCEL;
     }
     ls_event_queue_init();
     ls_buzzer_init();
@@ -138,11 +142,17 @@ void app_main(void)
 
     // lowest priority (1-9)
     xTaskCreate(&ls_tilt_task, "tilt_task", configMINIMAL_STACK_SIZE * 3, NULL, 7, NULL);
+#ifdef LS_VIBRATION_ENABLE
+    xTaskCreate(&ls_vibration_task, "vibration_task", configMINIMAL_STACK_SIZE * 3, NULL, 2, NULL);
+#endif
     xTaskCreate(&ls_buzzer_handler_task, "buzzer_handler", configMINIMAL_STACK_SIZE * 2, NULL, 5, NULL);
     xTaskCreate(&ls_servo_task, "servo_task", configMINIMAL_STACK_SIZE * 3, NULL, 3, NULL);
 //    xTaskCreate(&ls_coverage_task, "coverage_task", configMINIMAL_STACK_SIZE * 3, NULL, 2, NULL); // cannot do before map is ready
     xTaskCreate(&ls_lightsense_read_task, "lightsense_read", configMINIMAL_STACK_SIZE * 3, NULL, 1, NULL);
 
+#ifdef LS_SCENARIO_ENABLE
+    xTaskCreate(&ls_scenario_task, "scenario_task", configMINIMAL_STACK_SIZE * 3, NULL, 2, NULL);
+#endif
 #ifdef LSDEBUG_TAPEMODE
     xTaskCreate(&ls_tapemode_debug_task, "tapemode_debug_task", configMINIMAL_STACK_SIZE * 3, NULL, 2, NULL);
 #endif
@@ -31,36 +31,45 @@ bool ls_magnet_is_detected(void)
     return gpio_get_level(LSGPIO_MAGNETSENSE) ? false : true;
 }
 
-extern QueueHandle_t ls_event_queue;
 int32_t IRAM_ATTR magnet_position;
 // int32_t IRAM_ATTR _ls_homing_requested;
 
-void IRAM_ATTR magnet_event_isr(void *pvParameter)
+void IRAM_ATTR ls_magnet_send_event_from_isr(bool entering, BaseType_t *higher_priority_task_woken)
 {
-    // note that the sensor pulls low when triggered
     magnet_position = ls_stepper_get_position();
     // convert to negative number if before 0
     if (magnet_position > LS_STEPPER_STEPS_PER_ROTATION / 2) 
     {
         magnet_position -= LS_STEPPER_STEPS_PER_ROTATION;
     }
-    ls_event event;
-    event.type = gpio_get_level(LSGPIO_MAGNETSENSE) ? LSEVT_MAGNET_LEAVE : LSEVT_MAGNET_ENTER;
-    event.value = (void*) magnet_position;
+    ls_event event = ls_event_new(entering ? LSEVT_MAGNET_ENTER : LSEVT_MAGNET_LEAVE);
+    event.value.position = magnet_position;
     // if(_ls_homing_requested != 0 && ls_stepper_get_direction()==LS_STEPPER_DIRECTION_FORWARD)
     // {
     //     ls_stepper_set_home_position();
     //     event.type = LSEVT_MAGNET_HOMED;
     //     _ls_homing_requested = 0;
     // }
-    xQueueSendToFrontFromISR(ls_event_queue, (void *)&event, NULL);
+    ls_event_send_to_front_from_isr(&event, higher_priority_task_woken);
+}
+
+void IRAM_ATTR magnet_event_isr(void *pvParameter)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    // note that the sensor pulls low when triggered
+    ls_magnet_send_event_from_isr(gpio_get_level(LSGPIO_MAGNETSENSE) ? false : true, &higher_priority_task_woken);
+    // GPIO ISR service handlers must yield themselves so the state machine runs now rather than at the next tick
+    if (pdTRUE == higher_priority_task_woken)
+    {
+        portYIELD_FROM_ISR();
+    }
 }
 
 void ls_magnet_isr_begin(void)
 {
+    gpio_install_isr_service(0); // default, no flags.
     // set the magnet sensor to trigger an interrupt as it enters and as it leaves
     gpio_set_intr_type(LSGPIO_MAGNETSENSE, GPIO_INTR_ANYEDGE);
-    gpio_install_isr_service(0); // default, no flags.
     gpio_isr_handler_add(LSGPIO_MAGNETSENSE, &magnet_event_isr, NULL);
     // not homing
     // _ls_homing_requested = 0;
@@ -17,9 +17,14 @@
 */
 #pragma once
 #include <stdbool.h>
+#include "freertos/FreeRTOS.h"
 
 bool ls_magnet_is_detected(void);
 void ls_magnet_isr_begin(void);
+/**
+ * @brief queue a magnet enter/leave event stamped with the current stepper position
+ */
+void ls_magnet_send_event_from_isr(bool entering, BaseType_t *higher_priority_task_woken);
 
 // bool ls_magnet_is_homing(void);
 // void ls_magnet_find_home(void);
\ No newline at end of file
@@ -15,6 +15,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include "map.h"
 #include "tape.h"
 #include "config.h"
@@ -23,8 +24,10 @@
 #include "stepper.h"
 #include "buzzer.h"
 #include "math.h"
+#include "adccal.h"
 
-#define LS_MAP_ENTRIES_REQUIRED (LS_STEPPER_STEPS_PER_ROTATION / 32 / LS_MAP_RESOLUTION)
+// one bit per map entry, rounded up to whole words
+#define LS_MAP_ENTRIES_REQUIRED ((LS_MAP_ENTRY_COUNT + 31) / 32)
 static uint32_t IRAM_ATTR _ls_map_data[LS_MAP_ENTRIES_REQUIRED];
 
 static int32_t _ls_map_all_spans_total_steps = 0;
@@ -76,6 +79,70 @@ uint32_t IRAM_ATTR ls_map_is_enabled_at(int32_t stepper_position)
     return ((ls_map_read_bit(stepper_position / LS_MAP_RESOLUTION)) > 0) ? 1 : 0;
 }
 
+// distance (in map entries) from each disabled entry to the next enabled one in each direction; 0 if enabled
+static uint16_t _ls_map_gap_entries_forward[LS_MAP_ENTRY_COUNT];
+static uint16_t _ls_map_gap_entries_reverse[LS_MAP_ENTRY_COUNT];
+
+/**
+ * @brief Precompute the gap distance tables used to plan transits across disabled regions
+ *
+ * Walks the ring backwards (for forward distances) and forwards (for reverse distances)
+ * starting at an enabled entry so that gaps which wrap past home are measured correctly.
+ */
+static void _ls_map_build_gap_tables(void)
+{
+    int anchor = -1;
+    for (int i = 0; i < LS_MAP_ENTRY_COUNT; i++)
+    {
+        if (ls_map_read_bit(i))
+        {
+            anchor = i;
+            break;
+        }
+    }
+    if (anchor < 0)
+    {
+        // nothing enabled; no gaps to plan across
+        memset(_ls_map_gap_entries_forward, 0, sizeof(_ls_map_gap_entries_forward));
+        memset(_ls_map_gap_entries_reverse, 0, sizeof(_ls_map_gap_entries_reverse));
+        return;
+    }
+    uint16_t distance = 0;
+    for (int n = 0; n < LS_MAP_ENTRY_COUNT; n++)
+    {
+        int i = (anchor - n + LS_MAP_ENTRY_COUNT) % LS_MAP_ENTRY_COUNT;
+        distance = ls_map_read_bit(i) ? 0 : distance + 1;
+        _ls_map_gap_entries_forward[i] = distance;
+    }
+    distance = 0;
+    for (int n = 0; n < LS_MAP_ENTRY_COUNT; n++)
+    {
+        int i = (anchor + n) % LS_MAP_ENTRY_COUNT;
+        distance = ls_map_read_bit(i) ? 0 : distance + 1;
+        _ls_map_gap_entries_reverse[i] = distance;
+    }
+}
+
+/**
+ * @brief How many steps in the given direction until the laser would be enabled
+ *
+ * @param stepper_position
+ * @param direction
+ * @return ls_stepper_position_t 0 if enabled at stepper_position (or no spans were found)
+ */
+ls_stepper_position_t ls_map_steps_to_enabled(ls_stepper_position_t stepper_position, enum ls_stepper_direction_t direction)
+{
+    int entry = _stepper_position_to_map_reading(stepper_position);
+    int offset = stepper_position % LS_MAP_RESOLUTION;
+    if (LS_STEPPER_DIRECTION_FORWARD == direction)
+    {
+        uint16_t entries = _ls_map_gap_entries_forward[entry];
+        return entries ? entries * LS_MAP_RESOLUTION - offset : 0;
+    }
+    uint16_t entries = _ls_map_gap_entries_reverse[entry];
+    return entries ? (entries - 1) * LS_MAP_RESOLUTION + offset + 1 : 0;
+}
+
 enum ls_map_status_t _ls_map_status = LS_MAP_STATUS_NOT_BUILT;
 void ls_map_set_status(enum ls_map_status_t status)
 {
@@ -208,27 +275,28 @@ void _ls_state_map_build_set_map(int *enable_count, int *disable_count, int *mis
     {
         enum ls_state_map_reading reading = LS_STATE_MAP_READING_MISREAD;
         uint16_t raw_adc = _ls_map_raw_adc[map_index];
+        uint32_t mv = ls_adccal_raw_to_mv(raw_adc);
         ls_stepper_position_t position = map_index * LS_MAP_RESOLUTION;
         switch (ls_tapemode())
         {
         case LS_TAPEMODE_BLACK:
         case LS_TAPEMODE_BLACK_SAFE:
-            if (raw_adc <= low_threshold || raw_adc <= LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET)
+            if (raw_adc <= low_threshold || mv <= LS_REFLECTANCE_MV_MAX_WHITE_BUCKET)
             {
                 reading = LS_STATE_MAP_READING_ENABLE;
             }
-            if (raw_adc >= high_threshold || raw_adc >= LS_REFLECTANCE_ADC_MIN_BLACK_TAPE)
+            if (raw_adc >= high_threshold || mv >= LS_REFLECTANCE_MV_MIN_BLACK_TAPE)
             {
                 reading = LS_STATE_MAP_READING_DISABLE;
             }
             break;
         case LS_TAPEMODE_REFLECT:
         case LS_TAPEMODE_REFLECT_SAFE:
-            if (raw_adc >= high_threshold || raw_adc >= LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET)
+            if (raw_adc >= high_threshold || mv >= LS_REFLECTANCE_MV_MIN_BLACK_BUCKET)
             {
                 reading = LS_STATE_MAP_READING_ENABLE;
             }
-            if (raw_adc <= low_threshold || raw_adc <= LS_REFLECTANCE_ADC_MAX_SILVER_TAPE)
+            if (raw_adc <= low_threshold || mv <= LS_REFLECTANCE_MV_MAX_SILVER_TAPE)
             {
                 reading = LS_STATE_MAP_READING_DISABLE;
             }
@@ -275,11 +343,13 @@ void _ls_state_map_build_set_map(int *enable_count, int *disable_count, int *mis
  * @param[out] enable_count must be initizlied to 0 before first call
  * @param[out] disable_count must be initizlied to 0 before first call
  * @param[out] misread_count must be initizlied to 0 before first call
+ * Call once ls_tape_sensor_request_samples() has reported fresh samples for this position.
  */
 void _ls_state_map_build_read_and_set_map(int *enable_count, int *disable_count, int *misread_count)
 {
     enum ls_state_map_reading reading = LS_STATE_MAP_READING_MISREAD;
     BaseType_t raw_adc = ls_tape_sensor_read();
+    BaseType_t mv = ls_adccal_raw_to_mv(raw_adc);
     BaseType_t pitch = 1000;
     ls_stepper_position_t position = ls_stepper_get_position();
     ls_stepper_position_t map_index = position / LS_MAP_RESOLUTION;
@@ -304,27 +374,27 @@ void _ls_state_map_build_read_and_set_map(int *enable_count, int *disable_count,
     {
     case LS_TAPEMODE_BLACK:
     case LS_TAPEMODE_BLACK_SAFE:
-        pitch = _map(_constrain(raw_adc, LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET, LS_REFLECTANCE_ADC_MIN_BLACK_TAPE),
-                     LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET, LS_REFLECTANCE_ADC_MIN_BLACK_TAPE, 1024, 2048);
+        pitch = _map(_constrain(mv, LS_REFLECTANCE_MV_MAX_WHITE_BUCKET, LS_REFLECTANCE_MV_MIN_BLACK_TAPE),
+                     LS_REFLECTANCE_MV_MAX_WHITE_BUCKET, LS_REFLECTANCE_MV_MIN_BLACK_TAPE, 1024, 2048);
         ;
-        if (raw_adc <= LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET)
+        if (mv <= LS_REFLECTANCE_MV_MAX_WHITE_BUCKET)
         {
             reading = LS_STATE_MAP_READING_ENABLE;
         }
-        if (raw_adc >= LS_REFLECTANCE_ADC_MIN_BLACK_TAPE)
+        if (mv >= LS_REFLECTANCE_MV_MIN_BLACK_TAPE)
         {
             reading = LS_STATE_MAP_READING_DISABLE;
         }
         break;
     case LS_TAPEMODE_REFLECT:
     case LS_TAPEMODE_REFLECT_SAFE:
-        pitch = _map(_constrain(raw_adc, LS_REFLECTANCE_ADC_MAX_SILVER_TAPE, LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET),
-                     LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET, LS_REFLECTANCE_ADC_MAX_SILVER_TAPE, 1024, 2048);
-        if (raw_adc >= LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET)
+        pitch = _map(_constrain(mv, LS_REFLECTANCE_MV_MAX_SILVER_TAPE, LS_REFLECTANCE_MV_MIN_BLACK_BUCKET),
+                     LS_REFLECTANCE_MV_MIN_BLACK_BUCKET, LS_REFLECTANCE_MV_MAX_SILVER_TAPE, 1024, 2048);
+        if (mv >= LS_REFLECTANCE_MV_MIN_BLACK_BUCKET)
         {
             reading = LS_STATE_MAP_READING_ENABLE;
         }
-        if (raw_adc <= LS_REFLECTANCE_ADC_MAX_SILVER_TAPE)
+        if (mv <= LS_REFLECTANCE_MV_MAX_SILVER_TAPE)
         {
             reading = LS_STATE_MAP_READING_DISABLE;
         }
@@ -489,6 +559,7 @@ Backtrace: 0x400d8faf:0x3ffba600 0x400d6df5:0x3ffba620 0x400d6fac:0x3ffba660 0x4
         current_span = current_span->next;
     } while (current_span != ls_map_span_first);
     _init_map_span_at_map_readings(ls_map_span_first);
+    _ls_map_build_gap_tables();
     return _ls_map_all_spans_total_steps;
 }
 
@@ -522,6 +593,51 @@ struct ls_map_SpanNode *ls_map_span_at(ls_stepper_position_t step)
     return _ls_map_span_at(step, ls_map_span_first);
 }
 
+/**
+ * @brief Map a fraction of the total enabled length onto a stepper position, skipping the gaps
+ *
+ * Positions are unwrapped: they count onward from the beginning of the first span and may
+ * exceed LS_STEPPER_STEPS_PER_ROTATION, so that the difference between two results is the
+ * (signed) travel between them. Without a usable map, the whole rotation is used.
+ *
+ * @param permil 0..1000 along the concatenated spans
+ * @return ls_stepper_position_t unwrapped position
+ */
+ls_stepper_position_t ls_map_position_at_enabled_permil(uint32_t permil)
+{
+    if (LS_MAP_STATUS_OK != _ls_map_status || NULL == ls_map_span_first || LS_MAP_SPANNODE_INVALID_POSITION == ls_map_span_first->begin)
+    {
+        return permil * LS_STEPPER_STEPS_PER_ROTATION / 1000;
+    }
+    int32_t total = 0;
+    struct ls_map_SpanNode *span = ls_map_span_first;
+    do
+    {
+        total += _ls_map_span_length(span);
+        span = span->next;
+    } while (span != ls_map_span_first);
+
+    int32_t remaining = permil * (total - 1) / 1000;
+    ls_stepper_position_t unwrapped_begin = ls_map_span_first->begin;
+    span = ls_map_span_first;
+    while (true)
+    {
+        int32_t length = _ls_map_span_length(span);
+        if (remaining < length || span->next == ls_map_span_first)
+        {
+            return unwrapped_begin + _constrain(remaining, 0, length - 1);
+        }
+        remaining -= length;
+        int32_t to_next_begin = span->next->begin - span->begin;
+        if (to_next_begin <= 0)
+        {
+            to_next_begin += LS_STEPPER_STEPS_PER_ROTATION;
+        }
+        unwrapped_begin += to_next_begin;
+        span = span->next;
+    }
+}
+
 struct ls_map_SpanNode *ls_map_span_next(ls_stepper_position_t step, enum ls_stepper_direction_t direction, struct ls_map_SpanNode *starting_span)
 {
     // short-circuit if there is only one span:
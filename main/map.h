@@ -70,6 +70,8 @@ void _ls_state_map_build_read_and_set_map(int *enable_count, int *disable_count,
 int ls_map_find_spans(); 
 struct ls_map_SpanNode* ls_map_span_next(ls_stepper_position_t step, enum ls_stepper_direction_t direction, struct ls_map_SpanNode* starting_span);
 struct ls_map_SpanNode* ls_map_span_at(ls_stepper_position_t step);
+ls_stepper_position_t ls_map_position_at_enabled_permil(uint32_t permil);
+ls_stepper_position_t ls_map_steps_to_enabled(ls_stepper_position_t stepper_position, enum ls_stepper_direction_t direction);
 void ls_stepper_random_strategy_map_spans(struct ls_stepper_move_t *move);
 
 #ifdef LS_TEST_SPANNODE
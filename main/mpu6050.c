@@ -17,61 +17,31 @@
 */
 #include "freertos/FreeRTOS.h"
 #include "mpu6050.h"
+#include "i2c.h"
 #include "driver/i2c.h"
 #include "config.h"
 
-#define ACK_CHECK_EN 0x1                        /*!< I2C master will check ack from slave*/
-#define ACK_CHECK_DIS 0x0                       /*!< I2C master will not check ack from slave */
-#define ACK_VAL 0x0                             /*!< I2C ack value */
-#define NACK_VAL 0x1                            /*!< I2C nack value */
-
+static uint8_t _mpu6050_pwr_mgmt_2 = MPU6050_PWR_MGMT_2_ACCEL_ONLY;
 
 static esp_err_t mpu6050_write_reg_byte(uint8_t register_number, uint8_t data)
 {
     // see page 35 of MPU-6000/MPU-6050 Product Specification; single-byte write sequence
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, MPU6050_ADDR << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // AD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN); // RA (ACK)
-    i2c_master_write_byte(cmd, data, ACK_CHECK_EN); // DATA (ACK)
-    i2c_master_stop(cmd); // P
-    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+    return ls_i2c_write_reg_byte(MPU6050_ADDR, register_number, data);
 }
 
 static esp_err_t mpu6050_read_reg_uint8(uint8_t register_number, uint8_t *data)
 {
     // see page 36 of MPU-6000/MPU-6050 Product Specification; single-byte read sequence
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, MPU6050_ADDR << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // AD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN); // RA (ACK)
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, MPU6050_ADDR << 1 | I2C_MASTER_READ, ACK_CHECK_EN); // AD+R (ACK)
-    i2c_master_read_byte(cmd, data, I2C_MASTER_NACK); // (DATA) ACK
-    i2c_master_stop(cmd); // P
-    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+    return ls_i2c_read_reg_uint8(MPU6050_ADDR, register_number, data);
 }
+
 static esp_err_t mpu6050_read_reg_int16(uint8_t register_number, int16_t *data)
 {
-    uint8_t data_h=0, data_l=0;
+    uint8_t raw[2] = {0, 0};
     // see page 36 of MPU-6000/MPU-6050 Product Specification; burst read sequence
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, MPU6050_ADDR << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN); // AD+W (ACK)
-    i2c_master_write_byte(cmd, register_number, ACK_CHECK_EN); // RA (ACK)
-    i2c_master_start(cmd); // S
-    i2c_master_write_byte(cmd, MPU6050_ADDR << 1 | I2C_MASTER_READ, ACK_CHECK_EN); // AD+R (ACK)
-    i2c_master_read_byte(cmd, &data_h, I2C_MASTER_ACK); // (DATA) ACK
-    i2c_master_read_byte(cmd, &data_l, I2C_MASTER_NACK); // (DATA) NACK
-    i2c_master_stop(cmd); // P
-    esp_err_t ret = i2c_master_cmd_begin(LSI2C_PORT, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    esp_err_t ret = ls_i2c_read_regs(MPU6050_ADDR, register_number, raw, sizeof(raw));
     // reassemble 2s-complement value from separate high and low bytes
-    *data = ((data_h & 0x80) ? -32878 : 0) + (data_h & 0x7f) * 256 + data_l;
+    *data = (int16_t)((raw[0] << 8) | raw[1]);
     return ret;
 }
 
@@ -80,7 +50,7 @@ static esp_err_t mpu6050_read_reg_int16(uint8_t register_number, int16_t *data)
  * @todone Figure out why every other time the ESP32 is reset, this device is reporting only zero values.
  * 
  */
-void mpu6050_begin(void)
+static esp_err_t mpu6050_begin(void)
 {
     ESP_ERROR_CHECK(mpu6050_write_reg_byte(MPU6050_PWR_MGMT_1, 0x80));//reset
     uint8_t address = 255;
@@ -97,10 +67,10 @@ void mpu6050_begin(void)
     // wait 100ms
     vTaskDelay(pdMS_TO_TICKS(100));
     ESP_ERROR_CHECK(mpu6050_write_reg_byte(MPU6050_PWR_MGMT_1, MPU6050_PWR_MGMT_1_CYCLE_BIT));
-    ESP_ERROR_CHECK(mpu6050_write_reg_byte(MPU6050_PWR_MGMT_2, MPU6050_PWR_MGMT_2_ZA_ONLY));
+    return mpu6050_write_reg_byte(MPU6050_PWR_MGMT_2, _mpu6050_pwr_mgmt_2);
 }
 
-esp_err_t mpu6050_attempt_reset(void)
+static esp_err_t mpu6050_attempt_reset(void)
 {
     esp_err_t result = mpu6050_write_reg_byte(MPU6050_PWR_MGMT_1, MPU6050_PWR_MGMT_1_RESET_BIT);
     if (result != ESP_OK)
@@ -113,18 +83,76 @@ esp_err_t mpu6050_attempt_reset(void)
     {
         return result;
     }
-    return mpu6050_write_reg_byte(MPU6050_PWR_MGMT_2, MPU6050_PWR_MGMT_2_ZA_ONLY);
+    return mpu6050_write_reg_byte(MPU6050_PWR_MGMT_2, _mpu6050_pwr_mgmt_2);
 }
 
-float mpu6050_read_accel_z(void)
+static bool mpu6050_probe(void)
 {
-    int16_t value=0;
-    ESP_ERROR_CHECK(mpu6050_read_reg_int16(MPU6050_ACCEL_ZOUT_H, &value));
-    return ((float) value / 16384.0);
+    // if it doesn't answer straight away, we may need to try harder.
+    if (ls_i2c_has_mpu6050())
+    {
+        return true;
+    }
+    if (ESP_OK == mpu6050_attempt_reset())
+    {
+        printf("Detected MPU6050 accelerometer via MPU6050 reset\r\n");
+        return true;
+    }
+    return false;
+}
+
+static esp_err_t mpu6050_read_xyz(ls_accel_xyz_t *xyz)
+{
+    // ACCEL_XOUT_H through ACCEL_ZOUT_L, big-endian
+    uint8_t raw[6];
+    esp_err_t result = ls_i2c_read_regs(MPU6050_ADDR, MPU6050_ACCEL_XOUT_H, raw, sizeof(raw));
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+    xyz->x = (float)(int16_t)((raw[0] << 8) | raw[1]) / 16384.0f;
+    xyz->y = (float)(int16_t)((raw[2] << 8) | raw[3]) / 16384.0f;
+    xyz->z = (float)(int16_t)((raw[4] << 8) | raw[5]) / 16384.0f;
+    return ESP_OK;
 }
+
+static esp_err_t mpu6050_configure_odr(uint32_t hz)
+{
+    // in cycle mode LP_WAKE_CTRL 0..3 wakes at 1.25, 5, 20 or 40Hz
+    uint8_t lp_wake = hz <= 1 ? 0 : hz <= 5 ? 1 : hz <= 20 ? 2 : 3;
+    _mpu6050_pwr_mgmt_2 = (lp_wake << MPU6050_PWR_MGMT_2_LP_WAKE_SHIFT) | MPU6050_PWR_MGMT_2_STBY_GYRO;
+    return mpu6050_write_reg_byte(MPU6050_PWR_MGMT_2, _mpu6050_pwr_mgmt_2);
+}
+
+static esp_err_t mpu6050_configure_interrupt(uint16_t threshold_mg, uint8_t duration)
+{
+    if (0 == threshold_mg)
+    {
+        return mpu6050_write_reg_byte(MPU6050_INT_ENABLE, 0);
+    }
+    uint16_t threshold = threshold_mg / MPU6050_MOT_THR_MG_PER_LSB;
+    mpu6050_write_reg_byte(MPU6050_MOT_THR, threshold > 0xFF ? 0xFF : threshold);
+    mpu6050_write_reg_byte(MPU6050_MOT_DUR, duration);
+    // INT_PIN_CFG reset value gives an active-high 50us pulse
+    return mpu6050_write_reg_byte(MPU6050_INT_ENABLE, MPU6050_INT_ENABLE_MOT_EN);
+}
+
 float mpu6050_read_temp(void)
 {
     int16_t value=0;
     ESP_ERROR_CHECK(mpu6050_read_reg_int16(MPU6050_TEMP_H, &value));
     return ((float) value) / 340.0 + 36.53;
 }
+
+const ls_accel_driver_t ls_accel_driver_mpu6050 = {
+    .name = "MPU6050",
+    .device = LS_I2C_ACCELEROMETER_MPU6050,
+    .probe = mpu6050_probe,
+    .init = mpu6050_begin,
+    .read_xyz = mpu6050_read_xyz,
+    .configure_odr = mpu6050_configure_odr,
+    .configure_interrupt = mpu6050_configure_interrupt,
+    .interrupt_follows_z = false,
+    .configure_fifo = NULL, // no FIFO used; its FIFO does not run in cycle mode
+    .read_fifo = NULL,
+};
@@ -16,6 +16,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #pragma once
+#include "accel.h"
 // loosely adapted from https://github.com/tockn/MPU6050_tockn
 
 // "The reset value is 0x00 for all registers other than..."
@@ -33,15 +34,21 @@
 #define MPU6050_PWR_MGMT_1_CYCLE_BIT 0x20
 #define MPU6050_PWR_MGMT_1_TEMP_DIS_BIT 0x08
 #define MPU6050_PWR_MGMT_2   0x6c
-// LP_WAKE_CTRL = b01 (5Hz wakes); STBY_XA=STBY_YA=STBY_XG=STBY_YG=STBY_ZG=1
-#define MPU6050_PWR_MGMT_2_ZA_ONLY   0x77
+// LP_WAKE_CTRL = b01 (5Hz wakes); STBY_XG=STBY_YG=STBY_ZG=1
+#define MPU6050_PWR_MGMT_2_ACCEL_ONLY 0x47
+#define MPU6050_PWR_MGMT_2_LP_WAKE_SHIFT 6
+#define MPU6050_PWR_MGMT_2_STBY_GYRO 0x07
+#define MPU6050_MOT_THR      0x1F
+#define MPU6050_MOT_THR_MG_PER_LSB 2
+#define MPU6050_MOT_DUR      0x20
+#define MPU6050_INT_ENABLE   0x38
+#define MPU6050_INT_ENABLE_MOT_EN 0x40
+#define MPU6050_ACCEL_XOUT_H 0x3B
 #define MPU6050_ACCEL_ZOUT_H 0x3F
 #define MPU6050_ACCEL_ZOUT_L 0x40
 #define MPU6050_TEMP_H       0x41
 #define MPU6050_TEMP_L       0x42
 #define MPU6050_WHO_AM_I     0x75
 
-void mpu6050_begin(void);
-float mpu6050_read_accel_z(void);
-float mpu6050_read_temp(void);
-esp_err_t mpu6050_attempt_reset(void);
\ No newline at end of file
+// exposed through ls_accel_driver_mpu6050 (accel.h)
+float mpu6050_read_temp(void);
\ No newline at end of file
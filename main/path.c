@@ -0,0 +1,214 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "path.h"
+#include "map.h"
+#include "servo.h"
+#include "settings.h"
+#include "util.h"
+#include "debug.h"
+
+// Coordinated pan/tilt paths.
+//
+// A path is a closed loop of waypoints. Each time the stepper finishes a move, the path
+// strategy takes the next segment, works out how long each axis needs for it (trapezoidal
+// profiles at the configured stepper speed and servo speed), and slows whichever axis is
+// faster so both arrive together. Generated patterns are laid out over the enabled spans
+// only, so the dense part of the pattern lands where the laser can actually shine.
+
+static ls_path_waypoint_t _ls_path_waypoints[LS_PATH_WAYPOINTS_MAX];
+static int _ls_path_count = 0;
+static int _ls_path_index = 0;
+static uint32_t _ls_path_cycle_ms = 0;
+
+static uint32_t _ls_path_stepper_ms(uint32_t steps)
+{
+    return _trapezoid_duration_ms(steps, ls_settings_get_stepper_speed(), LS_STEPPER_MOVEMENT_STEPS_DELTA_PER_SECOND);
+}
+
+// time for the slower axis; both axes will be scaled to this
+static uint32_t _ls_path_segment_ms(uint32_t steps, uint16_t from_us, uint16_t to_us)
+{
+    uint32_t stepper_ms = _ls_path_stepper_ms(steps);
+    uint32_t servo_ms = ls_servo_move_duration_ms(from_us, to_us);
+    return stepper_ms > servo_ms ? stepper_ms : servo_ms;
+}
+
+static void _ls_path_compute_cycle(void)
+{
+    _ls_path_cycle_ms = 0;
+    for (int i = 0; i < _ls_path_count; i++)
+    {
+        const ls_path_waypoint_t *from = &_ls_path_waypoints[i];
+        const ls_path_waypoint_t *to = &_ls_path_waypoints[(i + 1) % _ls_path_count];
+        _ls_path_cycle_ms += _ls_path_segment_ms(abs(to->azimuth - from->azimuth), from->elevation_us, to->elevation_us);
+    }
+#ifdef LSDEBUG_STEPPER_RANDOM
+    ls_debug_printf("Path of %d waypoints takes %dms per cycle\n", _ls_path_count, _ls_path_cycle_ms);
+#endif
+}
+
+// generators work in permil of the enabled azimuth and of the servo top..bottom range
+static void _ls_path_add_normalized(int32_t azimuth_permil, int32_t elevation_permil)
+{
+    if (_ls_path_count >= LS_PATH_WAYPOINTS_MAX)
+    {
+        return;
+    }
+    int32_t top = ls_settings_get_servo_top();
+    int32_t bottom = ls_settings_get_servo_bottom();
+    ls_path_waypoint_t *waypoint = &_ls_path_waypoints[_ls_path_count++];
+    waypoint->azimuth = ls_map_position_at_enabled_permil(_constrain(azimuth_permil, 0, 1000));
+    waypoint->elevation_us = (uint16_t)(top + (bottom - top) * _constrain(elevation_permil, 0, 1000) / 1000);
+}
+
+static void _ls_path_begin(void)
+{
+    _ls_path_count = 0;
+    _ls_path_index = 0;
+}
+
+void ls_path_set_waypoints(const ls_path_waypoint_t *waypoints, int count)
+{
+    _ls_path_begin();
+    _ls_path_count = _constrain(count, 0, LS_PATH_WAYPOINTS_MAX);
+    memcpy(_ls_path_waypoints, waypoints, _ls_path_count * sizeof(ls_path_waypoint_t));
+    _ls_path_compute_cycle();
+}
+
+void ls_path_generate_lissajous(int azimuth_frequency, int elevation_frequency, int points)
+{
+    _ls_path_begin();
+    points = _constrain(points, 2, LS_PATH_WAYPOINTS_MAX);
+    for (int i = 0; i < points; i++)
+    {
+        _ls_path_add_normalized(500 + _cos_permil(azimuth_frequency * _ANGLE_TURN * i / points) / 2,
+                                500 + _sin_permil(elevation_frequency * _ANGLE_TURN * i / points) / 2);
+    }
+    _ls_path_compute_cycle();
+}
+
+void ls_path_generate_zigzag(int teeth)
+{
+    _ls_path_begin();
+    teeth = _constrain(teeth, 1, (LS_PATH_WAYPOINTS_MAX - 1) / 2);
+    // outbound across the enabled azimuth, alternating bottom and top...
+    for (int i = 0; i <= teeth; i++)
+    {
+        _ls_path_add_normalized(i * 1000 / teeth, (i % 2) * 1000);
+    }
+    // ...and back, offset by half a tooth so the return pass fills in between
+    for (int i = teeth - 1; i >= 0; i--)
+    {
+        _ls_path_add_normalized((2 * i + 1) * 500 / teeth, ((i + 1) % 2) * 1000);
+    }
+    _ls_path_compute_cycle();
+}
+
+void ls_path_generate_spiral(int turns, int points)
+{
+    _ls_path_begin();
+    points = _constrain(points, 4, LS_PATH_WAYPOINTS_MAX);
+    int half = points / 2;
+    // radius grows out to the edge and back in while the angle keeps turning
+    for (int i = 0; i < points; i++)
+    {
+        int32_t radius = 500 * (half - abs(i - half)) / half;
+        int32_t angle = turns * _ANGLE_TURN * i / half;
+        _ls_path_add_normalized(500 + radius * _cos_permil(angle) / 1000, 500 + radius * _sin_permil(angle) / 1000);
+    }
+    _ls_path_compute_cycle();
+}
+
+void ls_path_generate(enum ls_path_pattern_t pattern)
+{
+    switch (pattern)
+    {
+    case LS_PATH_PATTERN_LISSAJOUS:
+        ls_path_generate_lissajous(LS_PATH_LISSAJOUS_AZIMUTH_FREQUENCY, LS_PATH_LISSAJOUS_ELEVATION_FREQUENCY, LS_PATH_WAYPOINTS_MAX);
+        break;
+    case LS_PATH_PATTERN_ZIGZAG:
+        ls_path_generate_zigzag(LS_PATH_ZIGZAG_TEETH);
+        break;
+    case LS_PATH_PATTERN_SPIRAL:
+        ls_path_generate_spiral(LS_PATH_SPIRAL_TURNS, LS_PATH_WAYPOINTS_MAX);
+        break;
+    case LS_PATH_PATTERN_WAYPOINTS:
+    default:
+        _ls_path_index = 0;
+        _ls_path_compute_cycle();
+        break;
+    }
+}
+
+uint32_t ls_path_get_cycle_ms(void)
+{
+    return _ls_path_cycle_ms;
+}
+
+int ls_path_get_waypoint_count(void)
+{
+    return _ls_path_count;
+}
+
+/**
+ * @brief Stepper move strategy that follows the current path, issuing the matching timed servo move
+ *
+ * @param move
+ */
+void ls_stepper_random_strategy_path(struct ls_stepper_move_t *move)
+{
+    if (_ls_path_count < 2)
+    {
+        ls_stepper_random_strategy_default(move);
+        return;
+    }
+    const ls_path_waypoint_t *from = &_ls_path_waypoints[_ls_path_index];
+    _ls_path_index = (_ls_path_index + 1) % _ls_path_count;
+    const ls_path_waypoint_t *to = &_ls_path_waypoints[_ls_path_index];
+
+    // correct for wherever the stepper actually is (e.g., joining the path for the first time)
+    // azimuths are unwrapped and may be negative, where C's % leaves a negative remainder
+    int32_t drift = ((from->azimuth % LS_STEPPER_STEPS_PER_ROTATION) + LS_STEPPER_STEPS_PER_ROTATION) % LS_STEPPER_STEPS_PER_ROTATION - ls_stepper_get_position();
+    if (drift > LS_STEPPER_STEPS_PER_ROTATION / 2)
+    {
+        drift -= LS_STEPPER_STEPS_PER_ROTATION;
+    }
+    if (drift < -LS_STEPPER_STEPS_PER_ROTATION / 2)
+    {
+        drift += LS_STEPPER_STEPS_PER_ROTATION;
+    }
+    int32_t steps = to->azimuth - from->azimuth + drift;
+    uint32_t distance = abs(steps);
+
+    uint32_t servo_ms = ls_servo_move_duration_ms(from->elevation_us, to->elevation_us);
+    uint32_t duration_ms = _ls_path_segment_ms(distance, from->elevation_us, to->elevation_us);
+    int speed = ls_stepper_set_timed_steps_per_second(_trapezoid_speed_for_duration(distance, duration_ms, LS_STEPPER_MOVEMENT_STEPS_DELTA_PER_SECOND));
+    // resonance avoidance or the speed limits may have shifted the stepper; time the servo to its actual transit
+    uint32_t stepper_ms = _trapezoid_duration_ms(distance, speed, LS_STEPPER_MOVEMENT_STEPS_DELTA_PER_SECOND);
+    duration_ms = stepper_ms > servo_ms ? stepper_ms : servo_ms;
+    ls_servo_moveto_timed(to->elevation_us, duration_ms);
+
+    move->direction = steps < 0 ? LS_STEPPER_DIRECTION_REVERSE : LS_STEPPER_DIRECTION_FORWARD;
+    move->steps = distance > 0 ? distance : 1;
+#ifdef LSDEBUG_STEPPER_RANDOM
+    ls_debug_printf("Path: waypoint %d; moving %s%d steps and servo to %dus over %dms\n",
+                    _ls_path_index, (move->direction ? "+" : "-"), move->steps, to->elevation_us, duration_ms);
+#endif
+}
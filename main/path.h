@@ -0,0 +1,50 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+#include "stepper.h"
+
+/**
+ * @brief A point on a pan/tilt path.
+ *
+ * Azimuth is an unwrapped stepper position: consecutive waypoints move by their (signed)
+ * difference, so values outside 0..LS_STEPPER_STEPS_PER_ROTATION can be used to cross home.
+ */
+typedef struct ls_path_waypoint_t {
+    ls_stepper_position_t azimuth;
+    uint16_t elevation_us;
+} ls_path_waypoint_t;
+
+typedef enum ls_path_pattern_t {
+    LS_PATH_PATTERN_WAYPOINTS, // whatever was given to ls_path_set_waypoints()
+    LS_PATH_PATTERN_LISSAJOUS,
+    LS_PATH_PATTERN_ZIGZAG,
+    LS_PATH_PATTERN_SPIRAL
+} ls_path_pattern_t;
+
+void ls_path_set_waypoints(const ls_path_waypoint_t *waypoints, int count);
+void ls_path_generate_lissajous(int azimuth_frequency, int elevation_frequency, int points);
+void ls_path_generate_zigzag(int teeth);
+void ls_path_generate_spiral(int turns, int points);
+void ls_path_generate(enum ls_path_pattern_t pattern);
+
+uint32_t ls_path_get_cycle_ms(void);
+int ls_path_get_waypoint_count(void);
+
+void ls_stepper_random_strategy_path(struct ls_stepper_move_t *move);
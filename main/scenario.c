@@ -0,0 +1,533 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "scenario.h"
+#ifdef LS_SCENARIO_ENABLE
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "simplant.h"
+#include "states.h"
+#include "stepper.h"
+#include "servo.h"
+#include "map.h"
+
+static const char *_ls_scenario_names[LS_SCENARIO_COUNT] = {
+    [LS_SCENARIO_COLD_BOOT_TAPE] = "cold_boot_tape",
+    [LS_SCENARIO_BOOT_NO_TAPE] = "boot_no_tape",
+    [LS_SCENARIO_BROWNOUT_MID_MAP] = "brownout_mid_map",
+    [LS_SCENARIO_WAKE_AT_DAWN] = "wake_at_dawn",
+    [LS_SCENARIO_TILT_LATENCY] = "tilt_latency",
+};
+
+// the tilt-latency scenario covers these states one restart at a time, indexed by _ls_scenario_restarts
+static const enum ls_state_id _ls_scenario_tilt_targets[] = {
+    LS_STATE_HOME, LS_STATE_MAP_BUILD, LS_STATE_PRELASERWARN, LS_STATE_ACTIVE,
+    LS_STATE_SETTINGS, LS_STATE_SECONDARY_SETTINGS, LS_STATE_SLEEP, LS_STATE_WAKEUP,
+    LS_STATE_SELFTEST, LS_STATE_ERROR_HOME, LS_STATE_ERROR_MAP, LS_STATE_ERROR_TILT,
+    LS_STATE_ERROR_NOACCEL};
+#define _LS_SCENARIO_TILT_TARGET_COUNT ((uint32_t)(sizeof(_ls_scenario_tilt_targets) / sizeof(_ls_scenario_tilt_targets[0])))
+
+// which scenario is running survives esp_restart() but not power loss
+static RTC_NOINIT_ATTR uint32_t _ls_scenario_magic;
+static RTC_NOINIT_ATTR uint32_t _ls_scenario_index;
+static RTC_NOINIT_ATTR uint32_t _ls_scenario_restarts; // restarts within the current scenario
+static RTC_NOINIT_ATTR uint32_t _ls_scenario_failures;
+#define _LS_SCENARIO_MAGIC 0x5CE7A210
+
+// first entry and first exit of each state since boot, or 0 if not yet seen; written by the
+// state machine task through the record hooks and read by the scenario task
+static int64_t _ls_scenario_entered_us[LS_STATE_COUNT];
+static int64_t _ls_scenario_exited_us[LS_STATE_COUNT];
+static bool _ls_scenario_visited[LS_MAP_ENTRY_COUNT];
+static ls_stepper_position_t _ls_scenario_last_stop;
+static portMUX_TYPE _ls_scenario_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t _ls_scenario_task_handle = NULL;
+
+// tilt-latency bookkeeping for this boot; the dispatch fields are written by the state machine task
+static enum ls_state_id _ls_scenario_tilt_target = LS_STATE_COUNT;
+static int64_t _ls_scenario_tilt_offset_us;
+static int _ls_scenario_tilt_stimulus; // how far through reaching the target state the plant has been taken
+static int64_t _ls_scenario_tilt_sent_us;
+static bool _ls_scenario_tilt_dispatched;
+static enum ls_state_id _ls_scenario_tilt_dispatched_in;
+static int64_t _ls_scenario_tilt_latency_us;
+static int64_t _ls_scenario_tilt_longest_handler_us;
+static int64_t _ls_scenario_tilt_reference_us; // when the target state's first reference event was dispatched
+
+/**
+ * @brief set up the plant so that the target state is reached from a fresh boot
+ */
+static void _ls_scenario_tilt_init(void)
+{
+    _ls_scenario_tilt_target = _ls_scenario_tilt_targets[_ls_scenario_restarts];
+    _ls_scenario_tilt_offset_us = esp_random() % (LS_SCENARIO_TILT_INJECT_WINDOW_MS * 1000);
+    printf("Benchmark scenario %s: state %s (%u of %u)\n", _ls_scenario_names[_ls_scenario_index],
+           ls_state_name(_ls_scenario_tilt_target), _ls_scenario_restarts + 1, _LS_SCENARIO_TILT_TARGET_COUNT);
+    switch (_ls_scenario_tilt_target)
+    {
+    case LS_STATE_SLEEP:
+    case LS_STATE_WAKEUP:
+        ls_simplant_set_light_adc(LS_SIMPLANT_LIGHT_ADC_NIGHT);
+        break;
+    case LS_STATE_SELFTEST:
+        ls_simplant_set_tapemode_adc(LS_SIMPLANT_TAPEMODE_ADC_SELFTEST);
+        break;
+    case LS_STATE_ERROR_HOME: // only the safe tape modes stop on a failure
+        ls_simplant_set_tapemode_adc(LS_SIMPLANT_TAPEMODE_ADC_SAFE);
+        ls_simplant_set_magnet_present(false);
+        break;
+    case LS_STATE_ERROR_MAP:
+        ls_simplant_set_tapemode_adc(LS_SIMPLANT_TAPEMODE_ADC_SAFE);
+        ls_simplant_set_tape_present(false);
+        break;
+    case LS_STATE_ERROR_TILT:
+        ls_simplant_set_tilted(true);
+        break;
+    case LS_STATE_ERROR_NOACCEL:
+        ls_simplant_set_accel_present(false);
+        break;
+    default:
+        break;
+    }
+}
+
+void ls_scenario_init(void)
+{
+    if (esp_reset_reason() != ESP_RST_SW || _ls_scenario_magic != _LS_SCENARIO_MAGIC || _ls_scenario_index > LS_SCENARIO_COUNT)
+    {
+        _ls_scenario_magic = _LS_SCENARIO_MAGIC;
+        _ls_scenario_index = 0;
+        _ls_scenario_restarts = 0;
+        _ls_scenario_failures = 0;
+    }
+    if (_ls_scenario_index >= LS_SCENARIO_COUNT)
+    {
+        return;
+    }
+    printf("Benchmark scenario %s (%d of %d)\n", _ls_scenario_names[_ls_scenario_index], _ls_scenario_index + 1, LS_SCENARIO_COUNT);
+    switch (_ls_scenario_index)
+    {
+    case LS_SCENARIO_BOOT_NO_TAPE:
+        ls_simplant_set_tape_present(false);
+        break;
+    case LS_SCENARIO_WAKE_AT_DAWN:
+        ls_simplant_set_light_adc(LS_SIMPLANT_LIGHT_ADC_NIGHT);
+        break;
+    case LS_SCENARIO_TILT_LATENCY:
+        _ls_scenario_tilt_init();
+        break;
+    default:
+        break;
+    }
+}
+
+static void _ls_scenario_wake_task(void)
+{
+    if (NULL != _ls_scenario_task_handle)
+    {
+        xTaskNotifyGive(_ls_scenario_task_handle);
+    }
+}
+
+void ls_scenario_record_transition(enum ls_state_id from, enum ls_state_id to)
+{
+    int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&_ls_scenario_mux);
+    if (from < LS_STATE_COUNT && 0 == _ls_scenario_exited_us[from])
+    {
+        _ls_scenario_exited_us[from] = now_us;
+    }
+    if (to < LS_STATE_COUNT && 0 == _ls_scenario_entered_us[to])
+    {
+        _ls_scenario_entered_us[to] = now_us;
+    }
+    taskEXIT_CRITICAL(&_ls_scenario_mux);
+    if (LS_STATE_ACTIVE == to)
+    {
+        _ls_scenario_last_stop = ls_stepper_get_position();
+    }
+    _ls_scenario_wake_task();
+}
+
+/**
+ * @brief mark the map entries the arm swept through on its way to where it stopped; moves
+ * are at most half a rotation, so the shorter way round is the way it went
+ */
+static void _ls_scenario_record_sweep(ls_stepper_position_t from, ls_stepper_position_t to)
+{
+    int32_t forward = (to - from + LS_STEPPER_STEPS_PER_ROTATION) % LS_STEPPER_STEPS_PER_ROTATION;
+    int32_t length = forward <= LS_STEPPER_STEPS_PER_ROTATION / 2 ? forward : LS_STEPPER_STEPS_PER_ROTATION - forward;
+    int32_t step = forward <= LS_STEPPER_STEPS_PER_ROTATION / 2 ? 1 : -1;
+    for (int32_t i = 0; i <= length; i += LS_MAP_RESOLUTION)
+    {
+        int32_t position = (from + step * i + LS_STEPPER_STEPS_PER_ROTATION) % LS_STEPPER_STEPS_PER_ROTATION;
+        _ls_scenario_visited[position / LS_MAP_RESOLUTION] = true;
+    }
+    _ls_scenario_visited[to / LS_MAP_RESOLUTION] = true;
+}
+
+/**
+ * @brief the tilt is timed from the target state's first event of this type, or from entering
+ * it for LSEVT_NOOP; map_build waits out the homing tones before its handlers read the tape
+ * sensor, so a tilt timed from entry would never meet a blocking read
+ */
+static enum ls_event_t _ls_scenario_tilt_reference_event(enum ls_state_id target)
+{
+    return LS_STATE_MAP_BUILD == target ? LSEVT_TAPE_SAMPLES_READY : LSEVT_NOOP;
+}
+
+/**
+ * @brief find the injected tilt among dispatched events, and until then the longest any
+ * event kept the state machine busy in the target state
+ */
+static void _ls_scenario_record_tilt(const ls_event *event, enum ls_state_id state, int64_t dispatched_us, int64_t handled_us)
+{
+    bool injected = false;
+    bool referenced = false;
+    taskENTER_CRITICAL(&_ls_scenario_mux);
+    if (!_ls_scenario_tilt_dispatched)
+    {
+        if (state == _ls_scenario_tilt_target && 0 == _ls_scenario_tilt_reference_us &&
+            _ls_scenario_tilt_reference_event(state) == event->type)
+        {
+            _ls_scenario_tilt_reference_us = dispatched_us;
+            referenced = true;
+        }
+        if (LSEVT_TILT_DETECTED == event->type && 0 != _ls_scenario_tilt_sent_us && event->time_us == _ls_scenario_tilt_sent_us)
+        {
+            _ls_scenario_tilt_dispatched = true;
+            _ls_scenario_tilt_dispatched_in = state;
+            _ls_scenario_tilt_latency_us = dispatched_us - event->time_us;
+            injected = true;
+        }
+        else if (state == _ls_scenario_tilt_target && handled_us - dispatched_us > _ls_scenario_tilt_longest_handler_us)
+        {
+            _ls_scenario_tilt_longest_handler_us = handled_us - dispatched_us;
+        }
+    }
+    taskEXIT_CRITICAL(&_ls_scenario_mux);
+    if (injected || referenced)
+    {
+        _ls_scenario_wake_task();
+    }
+}
+
+void ls_scenario_record_dispatch(const ls_event *event, enum ls_state_id state, int64_t dispatched_us, int64_t handled_us)
+{
+    if (LSEVT_STEPPER_FINISHED_MOVE == event->type && LS_STATE_ACTIVE == state)
+    {
+        ls_stepper_position_t position = ls_stepper_get_position();
+        _ls_scenario_record_sweep(_ls_scenario_last_stop, position);
+        _ls_scenario_last_stop = position;
+    }
+    if (LS_SCENARIO_TILT_LATENCY == _ls_scenario_index)
+    {
+        _ls_scenario_record_tilt(event, state, dispatched_us, handled_us);
+    }
+}
+
+static int64_t _ls_scenario_ms_between(int64_t from_us, int64_t to_us)
+{
+    return (from_us == 0 || to_us == 0) ? -1 : (to_us - from_us) / 1000;
+}
+
+/**
+ * @brief print one metric; a missing value (negative) always fails
+ */
+static void _ls_scenario_report(const char *metric, int64_t value, int64_t threshold, bool at_most)
+{
+    bool pass = value >= 0 && (at_most ? value <= threshold : value >= threshold);
+    if (!pass)
+    {
+        _ls_scenario_failures++;
+    }
+    printf("LSBENCH {\"scenario\":\"%s\",\"metric\":\"%s\",\"value\":%lld,\"%s\":%lld,\"pass\":%s}\n",
+           _ls_scenario_names[_ls_scenario_index], metric, (long long)value, at_most ? "max" : "min", (long long)threshold, pass ? "true" : "false");
+}
+
+/**
+ * @brief print one informational metric, which has no threshold and cannot fail
+ */
+static void _ls_scenario_report_info(const char *metric, int64_t value)
+{
+    printf("LSBENCH {\"scenario\":\"%s\",\"metric\":\"%s\",\"value\":%lld}\n",
+           _ls_scenario_names[_ls_scenario_index], metric, (long long)value);
+}
+
+static int64_t _ls_scenario_coverage_permil(void)
+{
+    int enabled = 0, reached = 0;
+    for (int i = 0; i < LS_MAP_ENTRY_COUNT; i++)
+    {
+        if (ls_map_is_enabled_at(i * LS_MAP_RESOLUTION))
+        {
+            enabled++;
+            if (_ls_scenario_visited[i])
+            {
+                reached++;
+            }
+        }
+    }
+    return enabled ? reached * 1000 / enabled : -1;
+}
+
+static void _ls_scenario_check_at(int64_t *wake_us, int64_t due_us)
+{
+    if (due_us < *wake_us)
+    {
+        *wake_us = due_us;
+    }
+}
+
+/**
+ * @brief take the plant through whatever comes between boot and the target state, then
+ * send the tilt; returns true once it has been dispatched or can no longer land in the target
+ */
+static bool _ls_scenario_tilt_is_finished(int64_t now_us, int64_t *wake_us)
+{
+    enum ls_state_id target = _ls_scenario_tilt_target;
+    taskENTER_CRITICAL(&_ls_scenario_mux);
+    int64_t active_us = _ls_scenario_entered_us[LS_STATE_ACTIVE];
+    int64_t sleep_us = _ls_scenario_entered_us[LS_STATE_SLEEP];
+    int64_t settings_entered_us = _ls_scenario_entered_us[LS_STATE_SETTINGS];
+    int64_t settings_exited_us = _ls_scenario_exited_us[LS_STATE_SETTINGS];
+    int64_t target_entered_us = _ls_scenario_entered_us[target];
+    int64_t target_exited_us = _ls_scenario_exited_us[target];
+    int64_t reference_us = LSEVT_NOOP == _ls_scenario_tilt_reference_event(target) ? target_entered_us : _ls_scenario_tilt_reference_us;
+    bool dispatched = _ls_scenario_tilt_dispatched;
+    taskEXIT_CRITICAL(&_ls_scenario_mux);
+    if (dispatched)
+    {
+        return true;
+    }
+    switch (target)
+    {
+    case LS_STATE_SETTINGS:
+    case LS_STATE_SECONDARY_SETTINGS:
+        // plug the controls in once the laser is on; for secondary settings, unplug them as
+        // soon as settings is entered and plug them back in within LS_CONTROLS_SECONDARY_US_TIME
+        if (0 == _ls_scenario_tilt_stimulus && active_us)
+        {
+            ls_simplant_set_controls_connected(true);
+            _ls_scenario_tilt_stimulus = LS_STATE_SETTINGS == target ? 3 : 1;
+        }
+        if (1 == _ls_scenario_tilt_stimulus && settings_entered_us)
+        {
+            ls_simplant_set_controls_connected(false);
+            _ls_scenario_tilt_stimulus = 2;
+        }
+        if (2 == _ls_scenario_tilt_stimulus && settings_exited_us)
+        {
+            ls_simplant_set_controls_connected(true);
+            _ls_scenario_tilt_stimulus = 3;
+        }
+        break;
+    case LS_STATE_WAKEUP:
+        if (0 == _ls_scenario_tilt_stimulus && sleep_us)
+        {
+            _ls_scenario_check_at(wake_us, sleep_us + LS_LIGHTSENSE_MIN_DWELL_MS * 1000LL);
+            if (now_us - sleep_us >= LS_LIGHTSENSE_MIN_DWELL_MS * 1000LL)
+            {
+                ls_simplant_set_light_adc(LS_SIMPLANT_LIGHT_ADC_DAY);
+                _ls_scenario_tilt_stimulus = 1;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    if (0 == target_entered_us)
+    {
+        return false;
+    }
+    if (0 == _ls_scenario_tilt_sent_us)
+    {
+        if (target_exited_us)
+        {
+            return true; // left before the tilt was due; reported as missing
+        }
+        if (0 == reference_us)
+        {
+            return false; // the record hook wakes us when the reference event comes
+        }
+        _ls_scenario_check_at(wake_us, reference_us + _ls_scenario_tilt_offset_us);
+        if (now_us - reference_us < _ls_scenario_tilt_offset_us)
+        {
+            return false;
+        }
+        ls_event event = ls_event_new(LSEVT_TILT_DETECTED);
+        taskENTER_CRITICAL(&_ls_scenario_mux);
+        _ls_scenario_tilt_sent_us = event.time_us;
+        taskEXIT_CRITICAL(&_ls_scenario_mux);
+        if (pdPASS != ls_event_send(&event, 0))
+        {
+            return true; // queue full; reported as missing
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief whether the current scenario has collected everything it needs; lowers *wake_us to
+ * when a time-based condition will next need checking
+ */
+static bool _ls_scenario_is_finished(int64_t now_us, int64_t *dawn_us, int64_t *wake_us)
+{
+    taskENTER_CRITICAL(&_ls_scenario_mux);
+    int64_t active_us = _ls_scenario_entered_us[LS_STATE_ACTIVE];
+    int64_t map_us = _ls_scenario_entered_us[LS_STATE_MAP_BUILD];
+    int64_t sleep_us = _ls_scenario_entered_us[LS_STATE_SLEEP];
+    int64_t error_map_us = _ls_scenario_entered_us[LS_STATE_ERROR_MAP];
+    taskEXIT_CRITICAL(&_ls_scenario_mux);
+    switch (_ls_scenario_index)
+    {
+    case LS_SCENARIO_COLD_BOOT_TAPE:
+        if (0 == active_us)
+        {
+            return false;
+        }
+        _ls_scenario_check_at(wake_us, active_us + LS_SCENARIO_COVERAGE_WINDOW_MS * 1000LL);
+        return now_us - active_us >= LS_SCENARIO_COVERAGE_WINDOW_MS * 1000LL;
+    case LS_SCENARIO_BOOT_NO_TAPE:
+        return active_us || error_map_us;
+    case LS_SCENARIO_BROWNOUT_MID_MAP:
+        if (0 == _ls_scenario_restarts)
+        {
+            if (0 == map_us)
+            {
+                return false;
+            }
+            _ls_scenario_check_at(wake_us, map_us + LS_SCENARIO_BROWNOUT_AFTER_MS * 1000LL);
+            if (now_us - map_us >= LS_SCENARIO_BROWNOUT_AFTER_MS * 1000LL)
+            {
+                printf("Benchmark scenario %s: browning out during map build\n", _ls_scenario_names[_ls_scenario_index]);
+                _ls_scenario_restarts++;
+                ls_simplant_preserve_across_restart();
+                esp_restart();
+            }
+            return false;
+        }
+        return active_us;
+    case LS_SCENARIO_WAKE_AT_DAWN:
+        if (*dawn_us)
+        {
+            return active_us;
+        }
+        // dawn comes well after dusk; at least long enough for the light sensor to accept a change
+        if (sleep_us)
+        {
+            _ls_scenario_check_at(wake_us, sleep_us + LS_LIGHTSENSE_MIN_DWELL_MS * 1000LL);
+            if (now_us - sleep_us >= LS_LIGHTSENSE_MIN_DWELL_MS * 1000LL)
+            {
+                ls_simplant_set_light_adc(LS_SIMPLANT_LIGHT_ADC_DAY);
+                *dawn_us = now_us;
+                // only count entering the active state after dawn
+                taskENTER_CRITICAL(&_ls_scenario_mux);
+                _ls_scenario_entered_us[LS_STATE_ACTIVE] = 0;
+                taskEXIT_CRITICAL(&_ls_scenario_mux);
+            }
+        }
+        return false;
+    case LS_SCENARIO_TILT_LATENCY:
+        return _ls_scenario_tilt_is_finished(now_us, wake_us);
+    }
+    return true;
+}
+
+static void _ls_scenario_report_all(int64_t dawn_us)
+{
+    int64_t active_us = _ls_scenario_entered_us[LS_STATE_ACTIVE];
+    switch (_ls_scenario_index)
+    {
+    case LS_SCENARIO_COLD_BOOT_TAPE:
+        _ls_scenario_report("time_to_laser_ms", active_us ? active_us / 1000 : -1, LS_SCENARIO_TIME_TO_LASER_MAX_MS, true);
+        _ls_scenario_report("homing_ms", _ls_scenario_ms_between(_ls_scenario_entered_us[LS_STATE_HOME], _ls_scenario_exited_us[LS_STATE_HOME]), LS_SCENARIO_HOMING_MAX_MS, true);
+        _ls_scenario_report("mapping_ms", _ls_scenario_ms_between(_ls_scenario_entered_us[LS_STATE_MAP_BUILD], _ls_scenario_exited_us[LS_STATE_MAP_BUILD]), LS_SCENARIO_MAPPING_MAX_MS, true);
+        _ls_scenario_report("coverage_permil", _ls_scenario_coverage_permil(), LS_SCENARIO_COVERAGE_MIN_PERMIL, false);
+        break;
+    case LS_SCENARIO_BOOT_NO_TAPE:
+    {
+        int64_t settled_us = active_us ? active_us : _ls_scenario_entered_us[LS_STATE_ERROR_MAP];
+        _ls_scenario_report("time_to_settled_ms", settled_us ? settled_us / 1000 : -1, LS_SCENARIO_NO_TAPE_SETTLE_MAX_MS, true);
+        break;
+    }
+    case LS_SCENARIO_BROWNOUT_MID_MAP:
+        // timed from the restart, which is when the chip came back up
+        _ls_scenario_report("time_to_laser_ms", active_us ? active_us / 1000 : -1, LS_SCENARIO_TIME_TO_LASER_MAX_MS, true);
+        break;
+    case LS_SCENARIO_WAKE_AT_DAWN:
+        _ls_scenario_report("dawn_to_laser_ms", _ls_scenario_ms_between(dawn_us, active_us), LS_SCENARIO_DAWN_TO_LASER_MAX_MS, true);
+        break;
+    case LS_SCENARIO_TILT_LATENCY:
+    {
+        char metric[40];
+        snprintf(metric, sizeof(metric), "%s_tilt_latency_us", ls_state_name(_ls_scenario_tilt_target));
+        int64_t latency_us = -1;
+        taskENTER_CRITICAL(&_ls_scenario_mux);
+        if (_ls_scenario_tilt_dispatched && _ls_scenario_tilt_dispatched_in == _ls_scenario_tilt_target)
+        {
+            latency_us = _ls_scenario_tilt_latency_us > _ls_scenario_tilt_longest_handler_us ? _ls_scenario_tilt_latency_us : _ls_scenario_tilt_longest_handler_us;
+        }
+        taskEXIT_CRITICAL(&_ls_scenario_mux);
+        _ls_scenario_report(metric, latency_us, LS_SCENARIO_TILT_LATENCY_MAX_MS * 1000LL, true);
+        break;
+    }
+    }
+    _ls_scenario_report_info("skipped_steps", ls_simplant_get_skipped_steps());
+    _ls_scenario_report_info("servo_max_command_latency_us", ls_servo_get_max_command_latency_us());
+    _ls_scenario_report_info("gap_time_saved_ms_per_rotation", ls_stepper_get_gap_time_saved_ms_per_rotation());
+}
+
+void ls_scenario_task(void *pvParameter)
+{
+    if (_ls_scenario_index >= LS_SCENARIO_COUNT)
+    {
+        printf("LSBENCH {\"suite\":\"done\",\"scenarios\":%d,\"failures\":%u}\n", LS_SCENARIO_COUNT, _ls_scenario_failures);
+        vTaskDelete(NULL);
+        return;
+    }
+    _ls_scenario_task_handle = xTaskGetCurrentTaskHandle();
+    int64_t dawn_us = 0;
+    while (1)
+    {
+        int64_t now_us = esp_timer_get_time();
+        int64_t wake_us = LS_SCENARIO_TIMEOUT_MS * 1000LL;
+        if (_ls_scenario_is_finished(now_us, &dawn_us, &wake_us) || now_us >= LS_SCENARIO_TIMEOUT_MS * 1000LL)
+        {
+            _ls_scenario_report_all(dawn_us);
+            break;
+        }
+        // sleep until the state machine records a transition or a timed condition comes due
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((wake_us - now_us + 999) / 1000) + 1);
+    }
+    if (LS_SCENARIO_TILT_LATENCY == _ls_scenario_index && _ls_scenario_restarts + 1 < _LS_SCENARIO_TILT_TARGET_COUNT)
+    {
+        _ls_scenario_restarts++; // next target state, from a fresh boot
+    }
+    else
+    {
+        _ls_scenario_index++;
+        _ls_scenario_restarts = 0;
+    }
+    vTaskDelay(pdMS_TO_TICKS(100)); // let the output drain
+    esp_restart();
+}
+#endif
@@ -0,0 +1,74 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "config.h"
+#include "events.h"
+#include "states.h"
+
+/**
+ * Benchmark scenarios run on the host build's simulated plant (see host/sim/simplant.h).
+ * Each scenario runs from a fresh boot; when it finishes, its metrics are printed as one
+ * JSON object per line prefixed with "LSBENCH " and the chip restarts into the next
+ * scenario. A power-on reset starts again from the first scenario. Requires LS_HOST_BUILD.
+ *
+ * Timestamps come from the state machine itself, through the record hooks below, so they
+ * are exact rather than sampled; on the host build (see host/) the whole suite is repeatable.
+ *
+ * Metrics, in milliseconds unless noted:
+ *   time_to_laser_ms: boot until the active state is entered
+ *   homing_ms, mapping_ms: time spent in the first home and map_build states
+ *   coverage_permil: share of enabled map entries the sweep reached in LS_SCENARIO_COVERAGE_WINDOW_MS
+ *   time_to_settled_ms: boot until active or error_map when there is no tape
+ *   dawn_to_laser_ms: daylight returning until the active state is entered
+ *   <state>_tilt_latency_us: microseconds from LSEVT_TILT_DETECTED being created to the state
+ *     machine dispatching it, or the longest any other event in that state kept the state
+ *     machine busy before then, whichever is more (a tilt arriving just as that event was
+ *     dispatched would have waited that long)
+ *
+ * The tilt-latency scenario restarts once per state, setting up the plant to reach that state
+ * and sending the tilt a seeded time after entering it (for map_build, after its first tape
+ * samples arrive, so the tilt lands among the sweep's reads). Power-on is not covered: it
+ * only runs its entry hook and never dispatches an event.
+ */
+#ifdef LS_SCENARIO_ENABLE
+#ifndef LS_HOST_BUILD
+#error "LS_SCENARIO_ENABLE requires the host build"
+#endif
+
+enum ls_scenario_id {
+    LS_SCENARIO_COLD_BOOT_TAPE,
+    LS_SCENARIO_BOOT_NO_TAPE,
+    LS_SCENARIO_BROWNOUT_MID_MAP,
+    LS_SCENARIO_WAKE_AT_DAWN,
+    LS_SCENARIO_TILT_LATENCY,
+    LS_SCENARIO_COUNT
+};
+
+/**
+ * @brief choose the scenario for this boot and set up the plant for it; call before
+ * the accelerometer is probed or any task reads a sensor
+ */
+void ls_scenario_init(void);
+void ls_scenario_task(void *pvParameter);
+/**
+ * @brief hooks called from the state machine task as it changes state and after it has
+ * handled each event; they only record and never block
+ */
+void ls_scenario_record_transition(enum ls_state_id from, enum ls_state_id to);
+void ls_scenario_record_dispatch(const ls_event *event, enum ls_state_id state, int64_t dispatched_us, int64_t handled_us);
+#endif
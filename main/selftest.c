@@ -24,8 +24,15 @@
 #include "laser.h"
 #include "tape.h"
 #include "tapemode.h"
+#include "states.h"
 
 int _selftest_stepper_behavior_sequence = 0;
+// the opening servo hold and warning wait on events rather than blocking the dispatcher, so tilt is still handled promptly
+static enum {
+    LS_SELFTEST_SERVO_HOLD, // servo held mid-range to check its alignment
+    LS_SELFTEST_WARNING,    // pre-laser warning playing
+    LS_SELFTEST_RUNNING,    // exercising everything
+} _selftest_phase;
 void _selftest_stepper_behavior(void)
 {
     switch (_selftest_stepper_behavior_sequence)
@@ -64,17 +71,26 @@ void _selftest_stepper_behavior(void)
 }
 void selftest_event_handler(ls_event event)
 {
-    BaseType_t *event_value = event.value;
     switch (event.type)
     {
     case LSEVT_STATE_ENTRY:
+        _selftest_phase = LS_SELFTEST_SERVO_HOLD;
         ls_servo_jumpto(LS_SERVO_US_MID);
-        vTaskDelay(pdMS_TO_TICKS(LS_SERVO_SELFTEST_HOLD_MS));
-        ls_buzzer_effect(LS_BUZZER_PRE_LASER_WARNING);
-        while(ls_buzzer_in_use())
+        ls_state_set_deadline_ms(LS_SERVO_SELFTEST_HOLD_MS);
+        break;
+    case LSEVT_STATE_DEADLINE:
+        if (LS_SELFTEST_SERVO_HOLD == _selftest_phase)
+        {
+            _selftest_phase = LS_SELFTEST_WARNING;
+            ls_buzzer_effect(LS_BUZZER_PRE_LASER_WARNING);
+        }
+        break;
+    case LSEVT_BUZZER_WARNING_COMPLETE:
+        if (LS_SELFTEST_WARNING != _selftest_phase)
         {
-            vTaskDelay(1);
+            break;
         }
+        _selftest_phase = LS_SELFTEST_RUNNING;
         ls_settings_reset_defaults();
         xTaskCreate(&ls_tape_sensor_selftest_task, "tapesense_selftest", configMINIMAL_STACK_SIZE * 2, NULL, 10, NULL);
         xTaskCreate(&ls_tapemode_selftest_task, "tapemode_selftest", configMINIMAL_STACK_SIZE * 2, NULL, 10, NULL);
@@ -86,7 +102,10 @@ void selftest_event_handler(ls_event event)
         _selftest_stepper_behavior();
         break;
     case LSEVT_STEPPER_FINISHED_MOVE:
-        _selftest_stepper_behavior();
+        if (LS_SELFTEST_RUNNING == _selftest_phase)
+        {
+            _selftest_stepper_behavior();
+        }
         break;
     case LSEVT_MAGNET_ENTER:
     case LSEVT_MAGNET_LEAVE:
@@ -107,19 +126,19 @@ void selftest_event_handler(ls_event event)
     case LSEVT_CONTROLS_SPEED:
         if (!ls_buzzer_in_use())
         {
-            ls_buzzer_tone(_map(*event_value, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 1000, 2000));
+            ls_buzzer_tone(_map(event.value.adc, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 1000, 2000));
         }
         break;
     case LSEVT_CONTROLS_TOPANGLE:
         if (!ls_buzzer_in_use())
         {
-            ls_buzzer_tone(_map(*event_value, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 2000, 4000));
+            ls_buzzer_tone(_map(event.value.adc, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 2000, 4000));
         }
         break;
     case LSEVT_CONTROLS_BOTTOMANGLE:
         if (!ls_buzzer_in_use())
         {
-            ls_buzzer_tone(_map(*event_value, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 500, 1000));
+            ls_buzzer_tone(_map(event.value.adc, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 500, 1000));
         }
         break;
     case LSEVT_TILT_DETECTED:
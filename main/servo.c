@@ -21,6 +21,7 @@
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "driver/mcpwm.h"
+#include "esp_timer.h"
 #include "esp_random.h"
 #include "bootloader_random.h"
 #include "config.h"
@@ -28,6 +29,7 @@
 #include "settings.h"
 #include "util.h"
 #include "events.h"
+#include "servocal.h"
 
 static bool _ls_servo_is_on = false; // The servo will start off from ls_gpio_initialize()
 
@@ -37,6 +39,224 @@ static void _ls_servo_jump_to_pw(uint32_t pulse_width)
     mcpwm_set_duty_in_us(LS_SERVO_MCPWM_UNIT, LS_SERVO_MCPWM_TIMER, LS_SERVO_MCPWM_GENERATOR, pulse_width);
 }
 
+/*
+ * Motion engine: a periodic esp_timer fires once per PWM frame and advances a trapezoidal
+ * velocity profile toward the target. Position, velocity and acceleration are kept in Q8
+ * fixed point (1/256 microsecond of pulse width; velocity per frame; acceleration per frame^2).
+ * The timer is only started and stopped by the servo task, so the callback never races
+ * a restart; it notifies the servo task once when it arrives, leaving the queue to commands.
+ */
+#define LS_SERVO_Q8(us) ((int32_t)(us) << 8)
+#define LS_SERVO_FRAMES_PER_SECOND (1000000 / LS_SERVO_FRAME_US)
+#define LS_SERVO_ACCELERATION_Q8 ((LS_SERVO_Q8(LS_SERVO_ACCELERATION_US_PER_S2) / LS_SERVO_FRAMES_PER_SECOND) / LS_SERVO_FRAMES_PER_SECOND)
+
+static portMUX_TYPE _ls_servo_motion_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t _ls_servo_frame_timer = NULL;
+static bool _ls_servo_frame_timer_running = false;
+static int32_t _ls_servo_position_q8 = LS_SERVO_Q8(LS_SERVO_US_MID);
+static int32_t _ls_servo_velocity_q8 = 0;
+static int32_t _ls_servo_target_q8 = LS_SERVO_Q8(LS_SERVO_US_MID);
+static int32_t _ls_servo_velocity_limit_q8 = 0; // nonzero for timed moves; otherwise the setting applies
+static bool _ls_servo_arrived = true;
+static uint32_t _ls_servo_written_pw = 0;
+// when the command currently waiting for its first frame was queued (0 if none)
+static int64_t _ls_servo_actuation_pending_since_us = 0;
+static int64_t _ls_servo_latency_max_us = 0;
+
+// notification bits for the servo task: commands are waiting in the queue, or the motion engine arrived
+#define _LS_SERVO_NOTIFY_COMMAND (1 << 0)
+#define _LS_SERVO_NOTIFY_ARRIVED (1 << 1)
+static TaskHandle_t _ls_servo_task_handle = NULL;
+
+static void _ls_servo_notify(uint32_t bits)
+{
+    if (NULL != _ls_servo_task_handle)
+    {
+        xTaskNotify(_ls_servo_task_handle, bits, eSetBits);
+    }
+}
+
+static void _ls_servo_send(struct ls_servo_event *event)
+{
+    event->queued_us = esp_timer_get_time();
+    xQueueSend(ls_servo_queue, (void *)event, 0);
+    _ls_servo_notify(_LS_SERVO_NOTIFY_COMMAND);
+}
+
+static void _ls_servo_record_latency(int64_t queued_us)
+{
+    int64_t latency = esp_timer_get_time() - queued_us;
+    if (latency > _ls_servo_latency_max_us)
+    {
+        _ls_servo_latency_max_us = latency;
+#ifdef LSDEBUG_SERVO
+        ls_debug_printf("Servo command-to-actuation latency new maximum: %lldus\n", latency);
+#endif
+    }
+}
+
+// the speed limit is the old per-tick pulse delta setting, expressed per frame so it no longer depends on the tick rate
+static int32_t _ls_servo_velocity_max_q8(void)
+{
+    return LS_SERVO_Q8(ls_settings_get_servo_pulse_delta()) * (LS_SERVO_FRAME_US / 1000) / portTICK_PERIOD_MS;
+}
+
+static uint32_t _ls_servo_speed_us_per_second(void)
+{
+    return ls_settings_get_servo_pulse_delta() * 1000 / portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief How long a profiled move between two pulse widths takes at the configured speed and acceleration
+ */
+uint32_t ls_servo_move_duration_ms(uint32_t from_us, uint32_t to_us)
+{
+    return _trapezoid_duration_ms(from_us > to_us ? from_us - to_us : to_us - from_us,
+                                  _ls_servo_speed_us_per_second(), LS_SERVO_ACCELERATION_US_PER_S2);
+}
+
+static void _ls_servo_frame_callback(void *arg)
+{
+    int32_t velocity_max = _ls_servo_velocity_max_q8();
+    int32_t acceleration = LS_SERVO_ACCELERATION_Q8 > 0 ? LS_SERVO_ACCELERATION_Q8 : 1;
+    bool just_arrived = false;
+    portENTER_CRITICAL(&_ls_servo_motion_mux);
+    if (_ls_servo_velocity_limit_q8 > 0)
+    {
+        velocity_max = _ls_servo_velocity_limit_q8;
+    }
+    if (!_ls_servo_arrived)
+    {
+        int32_t remaining = _ls_servo_target_q8 - _ls_servo_position_q8;
+        int32_t direction = remaining < 0 ? -1 : 1;
+        int32_t distance = remaining * direction;
+        // speed along the direction of the target (negative if still moving away after a retarget)
+        int32_t speed = _ls_servo_velocity_q8 * direction;
+        if (speed < 0)
+        {
+            speed += acceleration;
+        }
+        else if ((int64_t)speed * speed / (2 * acceleration) >= distance)
+        {
+            speed -= acceleration;
+            if (speed < acceleration)
+            {
+                speed = acceleration; // always creep in so we do arrive
+            }
+        }
+        else
+        {
+            speed = speed + acceleration < velocity_max ? speed + acceleration : velocity_max;
+        }
+        if (speed >= distance)
+        {
+            _ls_servo_position_q8 = _ls_servo_target_q8;
+            _ls_servo_velocity_q8 = 0;
+            _ls_servo_arrived = just_arrived = true;
+        }
+        else
+        {
+            _ls_servo_velocity_q8 = speed * direction;
+            _ls_servo_position_q8 += _ls_servo_velocity_q8;
+        }
+    }
+    uint32_t pulse_width = (uint32_t)((_ls_servo_position_q8 + 128) >> 8);
+    int64_t pending_since_us = _ls_servo_actuation_pending_since_us;
+    _ls_servo_actuation_pending_since_us = 0;
+    portEXIT_CRITICAL(&_ls_servo_motion_mux);
+    // only touch the peripheral when the pulse width actually changes
+    if (pulse_width != _ls_servo_written_pw)
+    {
+        _ls_servo_written_pw = pulse_width;
+        _ls_servo_jump_to_pw(pulse_width);
+    }
+    if (pending_since_us)
+    {
+        _ls_servo_record_latency(pending_since_us);
+    }
+    if (just_arrived)
+    {
+        _ls_servo_notify(_LS_SERVO_NOTIFY_ARRIVED);
+    }
+}
+
+static void _ls_servo_frame_timer_start(void)
+{
+    if (!_ls_servo_frame_timer_running)
+    {
+        _ls_servo_frame_timer_running = true;
+        ESP_ERROR_CHECK(esp_timer_start_periodic(_ls_servo_frame_timer, LS_SERVO_FRAME_US));
+    }
+}
+
+static void _ls_servo_frame_timer_stop(void)
+{
+    if (_ls_servo_frame_timer_running)
+    {
+        _ls_servo_frame_timer_running = false;
+        esp_timer_stop(_ls_servo_frame_timer);
+    }
+    portENTER_CRITICAL(&_ls_servo_motion_mux);
+    _ls_servo_velocity_q8 = 0;
+    portEXIT_CRITICAL(&_ls_servo_motion_mux);
+}
+
+static uint16_t _ls_servo_current_pw(void)
+{
+    portENTER_CRITICAL(&_ls_servo_motion_mux);
+    uint16_t pulse_width = (uint16_t)((_ls_servo_position_q8 + 128) >> 8);
+    portEXIT_CRITICAL(&_ls_servo_motion_mux);
+    return pulse_width;
+}
+
+static bool _ls_servo_motion_is_idle(void)
+{
+    portENTER_CRITICAL(&_ls_servo_motion_mux);
+    bool idle = _ls_servo_arrived;
+    portEXIT_CRITICAL(&_ls_servo_motion_mux);
+    return idle;
+}
+
+// begin (or retarget) a profiled move; the servo must be on. queued_us is when the command asking for it was sent (0 if internal)
+// velocity_limit_q8 overrides the speed setting for this move (0 to use the setting)
+static void _ls_servo_motion_to(uint16_t pulse_width, int64_t queued_us, int32_t velocity_limit_q8)
+{
+    portENTER_CRITICAL(&_ls_servo_motion_mux);
+    _ls_servo_target_q8 = LS_SERVO_Q8(pulse_width);
+    _ls_servo_velocity_limit_q8 = velocity_limit_q8;
+    _ls_servo_arrived = _ls_servo_target_q8 == _ls_servo_position_q8 && 0 == _ls_servo_velocity_q8;
+    bool arrived = _ls_servo_arrived;
+    if (!arrived && queued_us)
+    {
+        _ls_servo_actuation_pending_since_us = queued_us;
+    }
+    portEXIT_CRITICAL(&_ls_servo_motion_mux);
+    if (arrived)
+    {
+        _ls_servo_notify(_LS_SERVO_NOTIFY_ARRIVED);
+        if (queued_us)
+        {
+            _ls_servo_record_latency(queued_us);
+        }
+    }
+    else
+    {
+        _ls_servo_frame_timer_start();
+    }
+}
+
+// stop any move and set the position immediately
+static void _ls_servo_motion_jump(uint16_t pulse_width)
+{
+    _ls_servo_frame_timer_stop();
+    portENTER_CRITICAL(&_ls_servo_motion_mux);
+    _ls_servo_position_q8 = _ls_servo_target_q8 = LS_SERVO_Q8(pulse_width);
+    _ls_servo_arrived = true;
+    portEXIT_CRITICAL(&_ls_servo_motion_mux);
+    _ls_servo_written_pw = pulse_width;
+    _ls_servo_jump_to_pw(pulse_width);
+}
+
 // Turns on the servo
 static void _ls_servo_on()
 {
@@ -54,6 +274,7 @@ static void _ls_servo_off()
     if (_ls_servo_is_on)
     {
         _ls_servo_is_on = false;
+        _ls_servo_frame_timer_stop();
         gpio_set_level(LSGPIO_SERVOPOWERENABLE, 0);
         mcpwm_stop(LS_SERVO_MCPWM_UNIT, LS_SERVO_MCPWM_TIMER);
     }
@@ -71,11 +292,18 @@ void ls_servo_init()
     // Set PWM0A to LSGPIO_SERVOPULSE (from the example code)
     mcpwm_gpio_init(LS_SERVO_MCPWM_UNIT, LS_SERVO_MCPWM_IO_SIGNALS, LSGPIO_SERVOPULSE);
     mcpwm_config_t pwm_config = {
-        .frequency = 50, // Frequency = 50Hz, i.e. for every servo motor time period should be 20ms
+        .frequency = LS_SERVO_FRAMES_PER_SECOND, // Frequency = 50Hz, i.e. for every servo motor time period should be 20ms
         .cmpr_a = 0,     // Duty cycle of PWMxA = 0
         .counter_mode = MCPWM_UP_COUNTER,
         .duty_mode = MCPWM_DUTY_MODE_0};
     mcpwm_init(LS_SERVO_MCPWM_UNIT, LS_SERVO_MCPWM_TIMER, &pwm_config); // Configure PWM0A & PWM0B with above settings
+
+    const esp_timer_create_args_t frame_timer_args = {
+        .callback = &_ls_servo_frame_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "servo_frame"};
+    ESP_ERROR_CHECK(esp_timer_create(&frame_timer_args, &_ls_servo_frame_timer));
 }
 
 // Creates and sends a message to the servo task to turn on the servo
@@ -84,7 +312,7 @@ void ls_servo_on()
     struct ls_servo_event event;
     event.event_type = LS_SERVO_ON;
     event.data = 0;
-    xQueueSend(ls_servo_queue, (void *)&event, 0);
+    _ls_servo_send(&event);
 }
 
 // Creates and sends a message to the servo task to turn off the servo
@@ -93,7 +321,7 @@ void ls_servo_off()
     struct ls_servo_event event;
     event.event_type = LS_SERVO_OFF;
     event.data = 0;
-    xQueueSend(ls_servo_queue, (void *)&event, 0);
+    _ls_servo_send(&event);
 }
 
 // Creates and sends a message to the servo task to put the servo in sweep mode
@@ -102,7 +330,7 @@ void ls_servo_sweep()
     struct ls_servo_event event;
     event.event_type = LS_SERVO_SWEEP;
     event.data = 0;
-    xQueueSend(ls_servo_queue, (void *)&event, 0);
+    _ls_servo_send(&event);
 }
 
 // Creates and sends a message to the servo task to put the servo in random motion mode
@@ -111,7 +339,7 @@ void ls_servo_random()
     struct ls_servo_event event;
     event.event_type = LS_SERVO_MOVE_RANDOMLY;
     event.data = 0;
-    xQueueSend(ls_servo_queue, (void *)&event, 0);
+    _ls_servo_send(&event);
 }
 
 // Creates and sends a message to the servo task to move the servo smoothly to a specified position
@@ -120,7 +348,7 @@ void ls_servo_moveto(uint32_t pulsewidth_us)
     struct ls_servo_event event;
     event.event_type = LS_SERVO_MOVE_TO;
     event.data = pulsewidth_us;
-    xQueueSend(ls_servo_queue, (void *)&event, 0);
+    _ls_servo_send(&event);
 }
 
 // Creates and sends a message to the servo task to immediately jump the servo to a specified position
@@ -129,7 +357,110 @@ void ls_servo_jumpto(uint32_t pulsewidth_us)
     struct ls_servo_event event;
     event.event_type = LS_SERVO_JUMP_TO;
     event.data = pulsewidth_us;
-    xQueueSend(ls_servo_queue, (void *)&event, 0);
+    _ls_servo_send(&event);
+}
+
+// Creates and sends a message to the servo task to move the servo to a specified position, taking duration_ms to get there
+void ls_servo_moveto_timed(uint32_t pulsewidth_us, uint32_t duration_ms)
+{
+    struct ls_servo_event event;
+    event.event_type = LS_SERVO_MOVE_TO_TIMED;
+    event.data = pulsewidth_us;
+    event.duration_ms = duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms;
+    _ls_servo_send(&event);
+}
+
+void ls_servo_moveto_mdeg(int32_t mdeg)
+{
+    ls_servo_moveto(ls_servocal_mdeg_to_us(mdeg));
+}
+
+void ls_servo_jumpto_mdeg(int32_t mdeg)
+{
+    ls_servo_jumpto(ls_servocal_mdeg_to_us(mdeg));
+}
+
+void ls_servo_moveto_timed_mdeg(int32_t mdeg, uint32_t duration_ms)
+{
+    ls_servo_moveto_timed(ls_servocal_mdeg_to_us(mdeg), duration_ms);
+}
+
+int32_t ls_servo_get_top_mdeg(void)
+{
+    return ls_servocal_us_to_mdeg(ls_settings_get_servo_top());
+}
+
+int32_t ls_servo_get_bottom_mdeg(void)
+{
+    return ls_servocal_us_to_mdeg(ls_settings_get_servo_bottom());
+}
+
+int64_t ls_servo_get_max_command_latency_us(void)
+{
+    return _ls_servo_latency_max_us;
+}
+
+/**
+ * @brief Called whenever the motion engine is idle at its target in random or sweep mode.
+ *
+ * Picks the next target and returns how long to dwell before moving there. The dwell is
+ * not waited out here; the task uses it as its queue receive deadline so that commands
+ * arriving during the pause are serviced immediately.
+ *
+ * @param mode current motion mode
+ * @param next_target set to the pulse width to move to once the dwell has expired
+ * @return TickType_t dwell duration
+ */
+static TickType_t _ls_servo_choose_next_target(enum _ls_servo_motion_modes mode, uint16_t *next_target)
+{
+    uint16_t current_pulse_width = _ls_servo_current_pw();
+    *next_target = current_pulse_width;
+    if (mode == LS_SERVO_MODE_RANDOM)
+    {
+#ifdef LSDEBUG_SERVO
+        ls_debug_printf("Servo reached target, choosing new random target...\n");
+#endif
+        uint16_t min = (uint16_t)ls_settings_get_servo_top();
+        uint16_t max = (uint16_t)ls_settings_get_servo_bottom();
+        *next_target = esp_random() % (max - min + 1) + min;
+
+#ifdef LSDEBUG_SERVO
+        ls_debug_printf("New target: %d\n", *next_target);
+#endif
+        // pause when target reached
+        return pdMS_TO_TICKS(ls_settings_get_servo_random_pause_ms());
+    }
+    if (mode == LS_SERVO_MODE_SWEEP)
+    {
+        uint16_t top = (uint16_t)ls_settings_get_servo_top();
+        uint16_t bottom = (uint16_t)ls_settings_get_servo_bottom();
+        uint16_t mid = (top + bottom) / 2;
+#ifdef LSDEBUG_SERVO
+        ls_debug_printf("Servo sweep from top = %d to bottom = %d\n", top, bottom);
+#endif
+        // If the current pulse width is at the top, queue a LSEVT_SERVO_SWEEP_TOP event
+        if (current_pulse_width == top)
+        {
+            ls_event event = ls_event_new(LSEVT_SERVO_SWEEP_TOP);
+            ls_event_send(&event, 0);
+        }
+        // If the current pulse width is at the bottom, queue a LSEVT_SERVO_SWEEP_BOTTOM event
+        else if (current_pulse_width == bottom)
+        {
+            ls_event event = ls_event_new(LSEVT_SERVO_SWEEP_BOTTOM);
+            ls_event_send(&event, 0);
+        }
+        // Update the target pulse width, depending on its current position
+        // Most of the time, it will be at either end - but possibly not if we just entered sweep mode from another
+        // In that case, move towards whichever end is currently further away
+        *next_target = current_pulse_width < mid ? bottom : top;
+        // pause when target reached
+#ifdef LSDEBUG_SERVO
+        ls_debug_printf("New servo target: %d after %dms pause\n", *next_target, ls_settings_get_servo_sweep_pause_ms());
+#endif
+        return pdMS_TO_TICKS(ls_settings_get_servo_sweep_pause_ms());
+    }
+    return 0;
 }
 
 void ls_servo_task(void *pvParameter)
@@ -140,21 +471,54 @@ void ls_servo_task(void *pvParameter)
 
     // No need to turn the servo on/off here, it is already off from ls_gpio_initialize()
 
-    uint16_t current_pulse_width = LS_SERVO_US_MID;
-    uint16_t target_pulse_width = LS_SERVO_US_MID;
-
     enum _ls_servo_motion_modes mode = LS_SERVO_MODE_FIXED;
 
+    // a pause between random/sweep moves is a deadline, not a delay
+    bool dwelling = false;
+    TickType_t dwell_until = 0;
+    uint16_t dwell_target = LS_SERVO_US_MID;
+
     // Variable to hold the received event
     struct ls_servo_event received;
 
+    // anything queued before we could be notified is picked up on the first pass
+    _ls_servo_task_handle = xTaskGetCurrentTaskHandle();
+    _ls_servo_notify(_LS_SERVO_NOTIFY_COMMAND);
+
     while (1)
     {
-        // Adjust the delay based on whether or not the servo should be moving
-        bool servo_should_move = _ls_servo_is_on && (current_pulse_width != target_pulse_width || mode != LS_SERVO_MODE_FIXED);
-        TickType_t delay = servo_should_move ? 1 : portMAX_DELAY;
-
-        if (xQueueReceive(ls_servo_queue, &received, delay) == pdTRUE)
+        // all motion happens in the frame timer; this task only reacts to commands, arrivals and dwell deadlines
+        TickType_t wait = portMAX_DELAY;
+        if (dwelling)
+        {
+            TickType_t now = xTaskGetTickCount();
+            wait = (TickType_t)(dwell_until - now) < portMAX_DELAY / 2 ? dwell_until - now : 0;
+        }
+        uint32_t notified = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &notified, wait) != pdTRUE)
+        {
+            // dwell deadline expired; move on to the target chosen when it began
+            dwelling = false;
+            if (_ls_servo_is_on && mode != LS_SERVO_MODE_FIXED)
+            {
+                _ls_servo_motion_to(dwell_target, 0, 0);
+            }
+            continue;
+        }
+        // a newer command may have moved the target since the arrival was signalled
+        if ((notified & _LS_SERVO_NOTIFY_ARRIVED) && _ls_servo_motion_is_idle())
+        {
+#ifdef LSDEBUG_SERVO
+            ls_debug_printf("Servo reached %d\n", _ls_servo_current_pw());
+#endif
+            _ls_servo_frame_timer_stop();
+            if (_ls_servo_is_on && mode != LS_SERVO_MODE_FIXED && !dwelling)
+            {
+                dwell_until = xTaskGetTickCount() + _ls_servo_choose_next_target(mode, &dwell_target);
+                dwelling = true;
+            }
+        }
+        while (xQueueReceive(ls_servo_queue, &received, 0) == pdTRUE)
         {
             switch (received.event_type)
             {
@@ -163,7 +527,17 @@ void ls_servo_task(void *pvParameter)
                 ls_debug_printf("Servo task received on event, powering up!\n");
 #endif
                 _ls_servo_on();
-
+                _ls_servo_record_latency(received.queued_us);
+                // resume whatever we were doing when turned off
+                if (!_ls_servo_motion_is_idle())
+                {
+                    _ls_servo_frame_timer_start();
+                }
+                else if (mode != LS_SERVO_MODE_FIXED && !dwelling)
+                {
+                    dwell_until = xTaskGetTickCount() + _ls_servo_choose_next_target(mode, &dwell_target);
+                    dwelling = true;
+                }
                 break;
 
             case LS_SERVO_OFF:
@@ -171,6 +545,8 @@ void ls_servo_task(void *pvParameter)
                 ls_debug_printf("Servo task received off event, feeling... sleepy.....\n");
 #endif
                 _ls_servo_off();
+                _ls_servo_record_latency(received.queued_us);
+                dwelling = false;
                 break;
             case LS_SERVO_JUMP_TO:
 #ifdef LSDEBUG_SERVO
@@ -179,9 +555,9 @@ void ls_servo_task(void *pvParameter)
                 // If the servo is currently off, turn it on
                 _ls_servo_on();
                 mode = LS_SERVO_MODE_FIXED;
-                target_pulse_width = received.data;
-                _ls_servo_jump_to_pw(target_pulse_width);
-                current_pulse_width = target_pulse_width;
+                dwelling = false;
+                _ls_servo_motion_jump(received.data);
+                _ls_servo_record_latency(received.queued_us);
                 break;
             case LS_SERVO_MOVE_TO:
 #ifdef LSDEBUG_SERVO
@@ -190,7 +566,24 @@ void ls_servo_task(void *pvParameter)
                 // If the servo is currently off, turn it on
                 _ls_servo_on();
                 mode = LS_SERVO_MODE_FIXED;
-                target_pulse_width = received.data;
+                dwelling = false;
+                _ls_servo_motion_to(received.data, received.queued_us, 0);
+                break;
+            case LS_SERVO_MOVE_TO_TIMED:
+#ifdef LSDEBUG_SERVO
+                ls_debug_printf("Servo task received timed move_to event with pulse width %d over %dms\n", received.data, received.duration_ms);
+#endif
+                // If the servo is currently off, turn it on
+                _ls_servo_on();
+                mode = LS_SERVO_MODE_FIXED;
+                dwelling = false;
+                {
+                    uint16_t from = _ls_servo_current_pw();
+                    uint32_t distance = from > received.data ? from - received.data : received.data - from;
+                    uint32_t speed = _trapezoid_speed_for_duration(distance, received.duration_ms, LS_SERVO_ACCELERATION_US_PER_S2);
+                    int32_t limit = LS_SERVO_Q8(speed) / LS_SERVO_FRAMES_PER_SECOND;
+                    _ls_servo_motion_to(received.data, received.queued_us, limit > 0 ? limit : 1);
+                }
                 break;
             case LS_SERVO_MOVE_RANDOMLY:
 #ifdef LSDEBUG_SERVO
@@ -198,8 +591,17 @@ void ls_servo_task(void *pvParameter)
 #endif
                 // If the servo is currently off, turn it on
                 _ls_servo_on();
-                mode = LS_SERVO_MODE_RANDOM;
-                target_pulse_width = current_pulse_width;
+                _ls_servo_record_latency(received.queued_us);
+                if (mode != LS_SERVO_MODE_RANDOM)
+                {
+                    mode = LS_SERVO_MODE_RANDOM;
+                    dwelling = false;
+                }
+                if (_ls_servo_motion_is_idle() && !dwelling)
+                {
+                    dwell_until = xTaskGetTickCount() + _ls_servo_choose_next_target(mode, &dwell_target);
+                    dwelling = true;
+                }
                 break;
             case LS_SERVO_SWEEP:
 #ifdef LSDEBUG_SERVO
@@ -207,10 +609,16 @@ void ls_servo_task(void *pvParameter)
 #endif
                 // If the servo is currently off, turn it on
                 _ls_servo_on();
+                _ls_servo_record_latency(received.queued_us);
                 if (mode != LS_SERVO_MODE_SWEEP)
                 {
-                    target_pulse_width = current_pulse_width;
                     mode = LS_SERVO_MODE_SWEEP;
+                    dwelling = false;
+                    if (_ls_servo_motion_is_idle())
+                    {
+                        dwell_until = xTaskGetTickCount() + _ls_servo_choose_next_target(mode, &dwell_target);
+                        dwelling = true;
+                    }
                 }
                 break;
             default:;
@@ -219,73 +627,5 @@ void ls_servo_task(void *pvParameter)
 #endif
             }
         }
-
-        // If no event was received within the delay, move the servo before looping again.
-        else
-        {
-            // Check if we're already at the target pulse width,
-            // and (possibly) change it depending on the mode we're in
-            if (mode == LS_SERVO_MODE_RANDOM && current_pulse_width == target_pulse_width)
-            {
-#ifdef LSDEBUG_SERVO
-                ls_debug_printf("Servo reached target, choosing new random target...\n");
-#endif
-                // pause when target reached
-                vTaskDelay(pdMS_TO_TICKS(ls_settings_get_servo_random_pause_ms()));
-                uint16_t min = (uint16_t)ls_settings_get_servo_top();
-                uint16_t max = (uint16_t)ls_settings_get_servo_bottom();
-                target_pulse_width = esp_random() % (max - min + 1) + min;
-
-#ifdef LSDEBUG_SERVO
-                ls_debug_printf("New target: %d\n", target_pulse_width);
-#endif
-            }
-            else if (mode == LS_SERVO_MODE_SWEEP && current_pulse_width == target_pulse_width)
-            {
-                uint16_t top = (uint16_t)ls_settings_get_servo_top();
-                uint16_t bottom = (uint16_t)ls_settings_get_servo_bottom();
-                uint16_t mid = (top + bottom) / 2;
-#ifdef LSDEBUG_SERVO
-                ls_debug_printf("Servo sweep from top = %d to bottom = %d\n", top, bottom);
-#endif
-                // If the current pulse width is at the top, queue a LSEVT_SERVO_SWEEP_TOP event
-                if (current_pulse_width == top)
-                {
-                    ls_event event;
-                    event.type = LSEVT_SERVO_SWEEP_TOP;
-                    event.value = NULL;
-                    xQueueSendToBack(ls_event_queue, (void *)&event, 0);
-                }
-                // If the current pulse width is at the bottom, queue a LSEVT_SERVO_SWEEP_BOTTOM event
-                else if (current_pulse_width == bottom)
-                {
-                    ls_event event;
-                    event.type = LSEVT_SERVO_SWEEP_BOTTOM;
-                    event.value = NULL;
-                    xQueueSendToBack(ls_event_queue, (void *)&event, 0);
-                }
-                // Update the target pulse width, depending on its current position
-                // Most of the time, it will be at either end - but possibly not if we just entered sweep mode from another
-                // In that case, move towards whichever end is currently further away
-                target_pulse_width = current_pulse_width < mid ? bottom : top;
-                // pause when target reached
-#ifdef LSDEBUG_SERVO
-                ls_debug_printf("New servo target: %d after %dms pause\n", target_pulse_width, ls_settings_get_servo_sweep_pause_ms());
-#endif
-                vTaskDelay(pdMS_TO_TICKS(ls_settings_get_servo_sweep_pause_ms()));
-            }
-
-            // Calculate the updated current pulse width
-            current_pulse_width = (uint16_t)_constrain(
-                (BaseType_t)target_pulse_width,
-                (BaseType_t)current_pulse_width - ls_settings_get_servo_pulse_delta(),
-                (BaseType_t)current_pulse_width + ls_settings_get_servo_pulse_delta());
-
-            // Set the servo pulse width
-            _ls_servo_jump_to_pw(current_pulse_width);
-#ifdef LSDEBUG_SERVO
-            ls_debug_printf("Servo move to %d\n", current_pulse_width);
-#endif
-        }
     }
 }
\ No newline at end of file
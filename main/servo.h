@@ -25,7 +25,8 @@ enum ls_servo_event_types {
     LS_SERVO_JUMP_TO,       // Data: pulse_width
     LS_SERVO_MOVE_TO,       // Data: pulse_width
     LS_SERVO_MOVE_RANDOMLY, // Data: unused
-    LS_SERVO_SWEEP          // Data: unused
+    LS_SERVO_SWEEP,         // Data: unused
+    LS_SERVO_MOVE_TO_TIMED  // Data: pulse_width; duration_ms: how long the move should take
 };
 
 enum _ls_servo_motion_modes {
@@ -37,6 +38,8 @@ enum _ls_servo_motion_modes {
 struct ls_servo_event {
     enum ls_servo_event_types event_type;
     uint16_t data;
+    uint16_t duration_ms;
+    int64_t queued_us; // esp_timer_get_time() when sent; used to measure command-to-actuation latency
 };
 
 QueueHandle_t ls_servo_queue;
@@ -55,4 +58,17 @@ void ls_servo_moveto(uint32_t pulsewidth_us);
 
 void ls_servo_jumpto(uint32_t pulsewidth_us);
 
+void ls_servo_moveto_timed(uint32_t pulsewidth_us, uint32_t duration_ms);
+
+uint32_t ls_servo_move_duration_ms(uint32_t from_us, uint32_t to_us);
+
+// angle-space equivalents using the servo calibration table (millidegrees; see servocal.h)
+void ls_servo_moveto_mdeg(int32_t mdeg);
+void ls_servo_jumpto_mdeg(int32_t mdeg);
+void ls_servo_moveto_timed_mdeg(int32_t mdeg, uint32_t duration_ms);
+int32_t ls_servo_get_top_mdeg(void);
+int32_t ls_servo_get_bottom_mdeg(void);
+
+int64_t ls_servo_get_max_command_latency_us(void);
+
 void ls_servo_task(void* pvParameter);
\ No newline at end of file
@@ -0,0 +1,212 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "servocal.h"
+#include "debug.h"
+#include "util.h"
+
+// Piecewise-linear servo calibration. The slopes of each segment are precomputed in Q16
+// in both directions when the table is set, so converting either way is a short search
+// over at most LS_SERVOCAL_POINTS_MAX points and one multiply; no floating point.
+
+// caution: NVS keys and namespaces are restricted to 15 characters
+#define LS_SERVOCAL_NVS_NAMESPACE "ls_servocal"
+#define LS_SERVOCAL_NVS_KEY_POINTS "points"
+
+static ls_servocal_point_t _ls_servocal_points[LS_SERVOCAL_POINTS_MAX];
+static int _ls_servocal_count = 0;
+static bool _ls_servocal_mdeg_increasing = true;
+// slope of segment i (from point i to i+1) in millidegrees per microsecond and microseconds per millidegree
+static int32_t _ls_servocal_mdeg_per_us_q16[LS_SERVOCAL_POINTS_MAX - 1];
+static int32_t _ls_servocal_us_per_mdeg_q16[LS_SERVOCAL_POINTS_MAX - 1];
+
+// points captured so far toward a new table, in reference-mark order
+static ls_servocal_point_t _ls_servocal_captured[LS_SERVOCAL_CAPTURE_POINTS];
+static int _ls_servocal_captured_count = 0;
+
+/**
+ * @brief Replace the calibration table
+ *
+ * @param points sorted by increasing pulse width; angles strictly monotonic
+ * @param count 2..LS_SERVOCAL_POINTS_MAX
+ * @return true if the table was valid and is now in use
+ */
+bool ls_servocal_set_points(const ls_servocal_point_t *points, int count)
+{
+    if (count < 2 || count > LS_SERVOCAL_POINTS_MAX)
+    {
+        return false;
+    }
+    bool increasing = points[1].mdeg > points[0].mdeg;
+    for (int i = 0; i < count - 1; i++)
+    {
+        if (points[i + 1].us <= points[i].us ||
+            points[i + 1].mdeg == points[i].mdeg ||
+            (points[i + 1].mdeg > points[i].mdeg) != increasing)
+        {
+#ifdef LSDEBUG_SERVO
+            ls_debug_printf("Servo calibration rejected: point %d (%dus, %dmdeg) is not monotonic\n", i + 1, points[i + 1].us, points[i + 1].mdeg);
+#endif
+            return false;
+        }
+    }
+    memcpy(_ls_servocal_points, points, count * sizeof(ls_servocal_point_t));
+    _ls_servocal_count = count;
+    _ls_servocal_mdeg_increasing = increasing;
+    for (int i = 0; i < count - 1; i++)
+    {
+        int64_t delta_us = points[i + 1].us - points[i].us;
+        int64_t delta_mdeg = points[i + 1].mdeg - points[i].mdeg;
+        _ls_servocal_mdeg_per_us_q16[i] = (int32_t)((delta_mdeg << 16) / delta_us);
+        _ls_servocal_us_per_mdeg_q16[i] = (int32_t)((delta_us << 16) / delta_mdeg);
+    }
+    return true;
+}
+
+void ls_servocal_set_defaults(void)
+{
+    ls_servocal_point_t points[2] = {
+        {.us = LS_SERVO_US_MIN, .mdeg = (int32_t)(LS_SERVO_US_MIN - LS_SERVO_US_MID) * LS_SERVOCAL_DEFAULT_MDEG_PER_1000US / 1000},
+        {.us = LS_SERVO_US_MAX, .mdeg = (int32_t)(LS_SERVO_US_MAX - LS_SERVO_US_MID) * LS_SERVOCAL_DEFAULT_MDEG_PER_1000US / 1000},
+    };
+    ls_servocal_set_points(points, 2);
+}
+
+/**
+ * @brief Load the calibration table from NVS, falling back to the linear default.
+ * NVS must already be initialized (ls_settings_read() does this).
+ */
+void ls_servocal_init(void)
+{
+    ls_servocal_set_defaults();
+    nvs_handle_t handle;
+    if (ESP_OK != nvs_open(LS_SERVOCAL_NVS_NAMESPACE, NVS_READWRITE, &handle))
+    {
+        return;
+    }
+    ls_servocal_point_t points[LS_SERVOCAL_POINTS_MAX];
+    size_t length = sizeof(points);
+    esp_err_t err = nvs_get_blob(handle, LS_SERVOCAL_NVS_KEY_POINTS, points, &length);
+    if (ESP_OK == err && 0 == length % sizeof(ls_servocal_point_t))
+    {
+        bool loaded = ls_servocal_set_points(points, length / sizeof(ls_servocal_point_t));
+#ifdef LSDEBUG_SERVO
+        ls_debug_printf("Servo calibration: %s %d points from NVS\n", loaded ? "loaded" : "ignored invalid", (int)(length / sizeof(ls_servocal_point_t)));
+#else
+        (void)loaded;
+#endif
+    }
+    nvs_close(handle);
+}
+
+void ls_servocal_save(void)
+{
+    nvs_handle_t handle;
+    if (ESP_OK != nvs_open(LS_SERVOCAL_NVS_NAMESPACE, NVS_READWRITE, &handle))
+    {
+        printf("NVS open for servo calibration FAILED!\n");
+        return;
+    }
+    if (ESP_OK != nvs_set_blob(handle, LS_SERVOCAL_NVS_KEY_POINTS, _ls_servocal_points, _ls_servocal_count * sizeof(ls_servocal_point_t)) ||
+        ESP_OK != nvs_commit(handle))
+    {
+        printf("NVS save of servo calibration FAILED!\n");
+    }
+    nvs_close(handle);
+}
+
+void ls_servocal_capture_reset(void)
+{
+    _ls_servocal_captured_count = 0;
+}
+
+/**
+ * @brief Record the pulse width that points at the next reference mark. Once every mark has
+ * been captured, the new table replaces the current one and is saved, and capture starts over.
+ *
+ * @return marks captured so far (LS_SERVOCAL_CAPTURE_POINTS when the table was saved), or 0 if
+ * the completed table was rejected (e.g., marks aimed out of order)
+ */
+int ls_servocal_capture(uint16_t us)
+{
+    ls_servocal_point_t *point = &_ls_servocal_captured[_ls_servocal_captured_count];
+    point->us = us;
+    point->mdeg = LS_SERVOCAL_CAPTURE_FIRST_MDEG + _ls_servocal_captured_count * LS_SERVOCAL_CAPTURE_STEP_MDEG;
+    int count = ++_ls_servocal_captured_count;
+#ifdef LSDEBUG_SERVO
+    ls_debug_printf("Servo calibration: captured %dus for %dmdeg (%d of %d)\n", point->us, point->mdeg, count, LS_SERVOCAL_CAPTURE_POINTS);
+#endif
+    if (count < LS_SERVOCAL_CAPTURE_POINTS)
+    {
+        return count;
+    }
+    _ls_servocal_captured_count = 0;
+    // the table is ordered by pulse width; marks may have been aimed at in either direction
+    ls_servocal_point_t points[LS_SERVOCAL_CAPTURE_POINTS];
+    for (int i = 0; i < LS_SERVOCAL_CAPTURE_POINTS; i++)
+    {
+        int j = i;
+        for (; j > 0 && points[j - 1].us > _ls_servocal_captured[i].us; j--)
+        {
+            points[j] = points[j - 1];
+        }
+        points[j] = _ls_servocal_captured[i];
+    }
+    if (!ls_servocal_set_points(points, LS_SERVOCAL_CAPTURE_POINTS))
+    {
+        return 0;
+    }
+    ls_servocal_save();
+    return count;
+}
+
+int32_t ls_servocal_us_to_mdeg(uint32_t us)
+{
+    // extrapolate beyond the ends using the outermost segments
+    int i = 0;
+    while (i < _ls_servocal_count - 2 && us >= _ls_servocal_points[i + 1].us)
+    {
+        i++;
+    }
+    int64_t offset = (int64_t)us - _ls_servocal_points[i].us;
+    return _ls_servocal_points[i].mdeg + (int32_t)((offset * _ls_servocal_mdeg_per_us_q16[i] + (1 << 15)) >> 16);
+}
+
+uint32_t ls_servocal_mdeg_to_us(int32_t mdeg)
+{
+    int i = 0;
+    if (_ls_servocal_mdeg_increasing)
+    {
+        while (i < _ls_servocal_count - 2 && mdeg >= _ls_servocal_points[i + 1].mdeg)
+        {
+            i++;
+        }
+    }
+    else
+    {
+        while (i < _ls_servocal_count - 2 && mdeg <= _ls_servocal_points[i + 1].mdeg)
+        {
+            i++;
+        }
+    }
+    int64_t offset = (int64_t)mdeg - _ls_servocal_points[i].mdeg;
+    int32_t us = _ls_servocal_points[i].us + (int32_t)((offset * _ls_servocal_us_per_mdeg_q16[i] + (1 << 15)) >> 16);
+    return (uint32_t)_constrain(us, LS_SERVO_US_MIN, LS_SERVO_US_MAX);
+}
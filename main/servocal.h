@@ -0,0 +1,41 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+
+/**
+ * @brief One measured point of a servo's response: this pulse width gives this angle.
+ * Angles are in millidegrees; the sign convention is up to whoever calibrates, but
+ * angles must be strictly monotonic (increasing or decreasing) with pulse width.
+ */
+typedef struct ls_servocal_point_t {
+    uint16_t us;
+    int32_t mdeg;
+} ls_servocal_point_t;
+
+void ls_servocal_init(void);
+bool ls_servocal_set_points(const ls_servocal_point_t *points, int count);
+void ls_servocal_set_defaults(void);
+void ls_servocal_save(void);
+
+void ls_servocal_capture_reset(void);
+int ls_servocal_capture(uint16_t us);
+
+int32_t ls_servocal_us_to_mdeg(uint32_t us);
+uint32_t ls_servocal_mdeg_to_us(int32_t mdeg);
@@ -21,9 +21,10 @@
 #include "settings.h"
 #include "config.h"
 #include "util.h"
+#include "adccal.h"
 
 static BaseType_t _ls_settings_stepper_speed, _ls_settings_servo_top, _ls_settings_servo_bottom;
-static BaseType_t _ls_settings_stepper_random_max, _ls_settings_light_threshold_on, _ls_settings_light_threshold_off;
+static BaseType_t _ls_settings_stepper_random_max, _ls_settings_light_threshold_on_mv, _ls_settings_light_threshold_off_mv;
 static BaseType_t _ls_settings_servo_pulse_delta, _ls_settings_servo_random_pause_ms, _ls_settings_servo_sweep_pause_ms;
 static BaseType_t _ls_settings_tilt_threshold_detected, _ls_settings_tilt_threshold_ok;
 
@@ -34,8 +35,11 @@ static nvs_handle_t _ls_settings_nvs_handle;
 #define LS_SETTINGS_NVS_KEY_SERVO_TOP "servo_top"
 #define LS_SETTINGS_NVS_KEY_SERVO_BOTTOM "servo_bottom"
 #define LS_SETTINGS_NVS_KEY_SERVO_DELTA "servo_delta"
-#define LS_SETTINGS_NVS_KEY_LIGHTSENSE_ON "light_on"
-#define LS_SETTINGS_NVS_KEY_LIGHTSENSE_OFF "light_off"
+// light thresholds used to be saved as raw readings under these keys; they are converted once
+#define LS_SETTINGS_NVS_KEY_LIGHTSENSE_ON_RAW "light_on"
+#define LS_SETTINGS_NVS_KEY_LIGHTSENSE_OFF_RAW "light_off"
+#define LS_SETTINGS_NVS_KEY_LIGHTSENSE_ON "light_on_mv"
+#define LS_SETTINGS_NVS_KEY_LIGHTSENSE_OFF "light_off_mv"
 
 void ls_settings_set_defaults(void)
 {
@@ -44,15 +48,15 @@ void ls_settings_set_defaults(void)
     ls_settings_set_servo_bottom(LS_SERVO_US_MAX);
 
     ls_settings_set_stepper_random_max(LS_STEPPER_MOVEMENT_STEPS_MAX);
-    ls_settings_set_light_threshold_on(LS_LIGHTSENSE_DAY_THRESHOLD);
-    ls_settings_set_light_threshold_off(LS_LIGHTSENSE_NIGHT_THRESHOLD);
+    ls_settings_set_light_threshold_on_mv(LS_LIGHTSENSE_DAY_THRESHOLD_MV);
+    ls_settings_set_light_threshold_off_mv(LS_LIGHTSENSE_NIGHT_THRESHOLD_MV);
 
     ls_settings_set_servo_random_pause_ms(LS_SERVO_RANDOM_PAUSE_MS);
     ls_settings_set_servo_sweep_pause_ms(LS_SERVO_SWEEP_PAUSE_MS);
     ls_settings_set_servo_pulse_delta(LS_SERVO_DELTA_PER_TICK_DEFAULT);
 
-    ls_settings_set_tilt_threshold_mg_detected(LS_TILT_THRESHOLD_DETECTED_MG);
-    ls_settings_set_tilt_threshold_mg_ok(LS_TILT_THRESHOLD_OK_MG);
+    ls_settings_set_tilt_threshold_mdeg_detected(LS_TILT_THRESHOLD_DETECTED_MDEG);
+    ls_settings_set_tilt_threshold_mdeg_ok(LS_TILT_THRESHOLD_OK_MDEG);
 }
 
 void ls_settings_reset_defaults(void)
@@ -143,13 +147,22 @@ void ls_settings_read(void)
     {
         ls_settings_set_servo_pulse_delta(nvs_value);
     }
+    // ls_adccal_init() has already run, so raw thresholds from older firmware convert with this unit's calibration
     if (ESP_OK == _ls_settings_read_from_nvs(LS_SETTINGS_NVS_KEY_LIGHTSENSE_OFF, &nvs_value))
     {
-        ls_settings_set_light_threshold_off(nvs_value);
+        ls_settings_set_light_threshold_off_mv(nvs_value);
+    }
+    else if (ESP_OK == _ls_settings_read_from_nvs(LS_SETTINGS_NVS_KEY_LIGHTSENSE_OFF_RAW, &nvs_value))
+    {
+        ls_settings_set_light_threshold_off_mv(ls_adccal_raw_to_mv(_constrain(nvs_value, 0, 4095)));
     }
     if (ESP_OK == _ls_settings_read_from_nvs(LS_SETTINGS_NVS_KEY_LIGHTSENSE_ON, &nvs_value))
     {
-        ls_settings_set_light_threshold_on(nvs_value);
+        ls_settings_set_light_threshold_on_mv(nvs_value);
+    }
+    else if (ESP_OK == _ls_settings_read_from_nvs(LS_SETTINGS_NVS_KEY_LIGHTSENSE_ON_RAW, &nvs_value))
+    {
+        ls_settings_set_light_threshold_on_mv(ls_adccal_raw_to_mv(_constrain(nvs_value, 0, 4095)));
     }
     _ls_settings_close_nvs();
 }
@@ -221,11 +234,11 @@ void ls_settings_save(void)
 #endif
     }
     if (ESP_OK == nvs_set_i32(_ls_settings_nvs_handle, LS_SETTINGS_NVS_KEY_LIGHTSENSE_OFF,
-                              ls_settings_get_light_threshold_off()))
+                              ls_settings_get_light_threshold_off_mv()))
     {
         ;
 #ifdef LSDEBUG_SETTINGS
-        ls_debug_printf("Settings saved light threshold OFF=%d\n", ls_settings_get_light_threshold_off());
+        ls_debug_printf("Settings saved light threshold OFF=%dmV\n", ls_settings_get_light_threshold_off_mv());
 #endif
     }
     else
@@ -236,11 +249,11 @@ void ls_settings_save(void)
 #endif
     }
     if (ESP_OK == nvs_set_i32(_ls_settings_nvs_handle, LS_SETTINGS_NVS_KEY_LIGHTSENSE_ON,
-                              ls_settings_get_light_threshold_on()))
+                              ls_settings_get_light_threshold_on_mv()))
     {
         ;
 #ifdef LSDEBUG_SETTINGS
-        ls_debug_printf("Settings saved light threshold ON=%d\n", ls_settings_get_light_threshold_on());
+        ls_debug_printf("Settings saved light threshold ON=%dmV\n", ls_settings_get_light_threshold_on_mv());
 #endif
     }
     else
@@ -318,22 +331,22 @@ BaseType_t ls_settings_get_stepper_random_max(void)
     return _ls_settings_stepper_random_max;
 }
 
-void ls_settings_set_light_threshold_on(BaseType_t adc)
+void ls_settings_set_light_threshold_on_mv(BaseType_t mv)
 {
-    _ls_settings_light_threshold_on = _constrain(adc, 0, 4095);
+    _ls_settings_light_threshold_on_mv = _constrain(mv, 0, LS_LIGHTSENSE_THRESHOLD_MV_MAX);
 }
-BaseType_t ls_settings_get_light_threshold_on(void)
+BaseType_t ls_settings_get_light_threshold_on_mv(void)
 {
-    return _ls_settings_light_threshold_on;
+    return _ls_settings_light_threshold_on_mv;
 }
 
-void ls_settings_set_light_threshold_off(BaseType_t adc)
+void ls_settings_set_light_threshold_off_mv(BaseType_t mv)
 {
-    _ls_settings_light_threshold_off = _constrain(adc, 0, 4095);
+    _ls_settings_light_threshold_off_mv = _constrain(mv, 0, LS_LIGHTSENSE_THRESHOLD_MV_MAX);
 }
-BaseType_t ls_settings_get_light_threshold_off(void)
+BaseType_t ls_settings_get_light_threshold_off_mv(void)
 {
-    return _ls_settings_light_threshold_off;
+    return _ls_settings_light_threshold_off_mv;
 }
 
 void ls_settings_set_light_thresholds_from_0to10(int index)
@@ -348,10 +361,10 @@ void ls_settings_set_light_thresholds_from_0to10(int index)
 #ifdef LSDEBUG_SETTINGS
         ls_debug_printf("Setting lightsense thresholds from index value %d (range 0..10 inclusive).\n", index);
 #endif
-    // off will range from 0 to 2010; 5 => 505 (near default)
-    ls_settings_set_light_threshold_off(20 * (index * index) + (1 * index) + 0);
-    // off will range from 50 to 4070; 5 => 1060 (near default)
-    ls_settings_set_light_threshold_on(40 * (index * index) + (2 * index) + 50);
+    // off will range from 140 to 1750mV; 5 => 545 (the default)
+    ls_settings_set_light_threshold_off_mv(16 * (index * index) + (1 * index) + 140);
+    // on will range from 180 to 3300mV (constrained); 5 => 990 (near default)
+    ls_settings_set_light_threshold_on_mv(32 * (index * index) + (2 * index) + 180);
 }
 
 BaseType_t ls_settings_map_control_to_servo_pulse_delta(BaseType_t adc)
@@ -389,20 +402,20 @@ BaseType_t ls_settings_get_servo_sweep_pause_ms(void)
     return _ls_settings_servo_sweep_pause_ms;
 }
 
-void ls_settings_set_tilt_threshold_mg_detected(BaseType_t milli_gs)
+void ls_settings_set_tilt_threshold_mdeg_detected(BaseType_t millidegrees)
 {
-    _ls_settings_tilt_threshold_detected = milli_gs;
+    _ls_settings_tilt_threshold_detected = _constrain(millidegrees, 1000, 90000);
 }
-BaseType_t ls_settings_get_tilt_threshold_mg_detected(void)
+BaseType_t ls_settings_get_tilt_threshold_mdeg_detected(void)
 {
     return _ls_settings_tilt_threshold_detected;
 }
 
-void ls_settings_set_tilt_threshold_mg_ok(BaseType_t milli_gs)
+void ls_settings_set_tilt_threshold_mdeg_ok(BaseType_t millidegrees)
 {
-    _ls_settings_tilt_threshold_ok = milli_gs;
+    _ls_settings_tilt_threshold_ok = _constrain(millidegrees, 0, 90000);
 }
-BaseType_t ls_settings_get_tilt_threshold_mg_ok(void)
+BaseType_t ls_settings_get_tilt_threshold_mdeg_ok(void)
 {
     return _ls_settings_tilt_threshold_ok;
 }
\ No newline at end of file
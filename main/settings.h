@@ -56,11 +56,11 @@ BaseType_t ls_settings_get_servo_pulse_delta(void);
 void ls_settings_set_stepper_random_max(BaseType_t steps);
 BaseType_t ls_settings_get_stepper_random_max(void);
 
-void ls_settings_set_light_threshold_on(BaseType_t adc);
-BaseType_t ls_settings_get_light_threshold_on(void);
+void ls_settings_set_light_threshold_on_mv(BaseType_t mv);
+BaseType_t ls_settings_get_light_threshold_on_mv(void);
 
-void ls_settings_set_light_threshold_off(BaseType_t adc);
-BaseType_t ls_settings_get_light_threshold_off(void);
+void ls_settings_set_light_threshold_off_mv(BaseType_t mv);
+BaseType_t ls_settings_get_light_threshold_off_mv(void);
 
 /**
  * @brief Set thresholds to identifiable values with a logrithmic response
@@ -69,8 +69,14 @@ BaseType_t ls_settings_get_light_threshold_off(void);
  */
 void ls_settings_set_light_thresholds_from_0to10(int index);
 
-void ls_settings_set_tilt_threshold_mg_detected(BaseType_t milli_gs);
-BaseType_t ls_settings_get_tilt_threshold_mg_detected(void);
+/**
+ * @brief Tilt is detected beyond this angle from the calibrated installed orientation (see tiltcal.h)
+ */
+void ls_settings_set_tilt_threshold_mdeg_detected(BaseType_t millidegrees);
+BaseType_t ls_settings_get_tilt_threshold_mdeg_detected(void);
 
-void ls_settings_set_tilt_threshold_mg_ok(BaseType_t milli_gs);
-BaseType_t ls_settings_get_tilt_threshold_mg_ok(void);
\ No newline at end of file
+/**
+ * @brief ...and clears again once back within this angle
+ */
+void ls_settings_set_tilt_threshold_mdeg_ok(BaseType_t millidegrees);
+BaseType_t ls_settings_get_tilt_threshold_mdeg_ok(void);
\ No newline at end of file
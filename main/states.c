@@ -34,14 +34,20 @@
 #include "util.h"
 #include "controls.h"
 #include "coverage.h"
+#include "path.h"
+#include "eventstats.h"
+#include "scenario.h"
+#include "i2c.h"
+#include "servocal.h"
 
 extern SemaphoreHandle_t print_mux;
-extern QueueHandle_t ls_event_queue;
 
 static TaskHandle_t ls_coverage_task_handle;
 
 TimerHandle_t _ls_state_rehome_timer;
 
+enum ls_state_id ls_state_current = LS_STATE_POWERON, ls_state_previous = LS_STATE_COUNT;
+
 #define _ls_state_everything_off() \
     {                              \
         ls_servo_off();            \
@@ -52,10 +58,8 @@ TimerHandle_t _ls_state_rehome_timer;
 
 void _ls_state_rehome_timer_callback(TimerHandle_t xTimer)
 {
-    ls_event event;
-    event.type = LSEVT_REHOME_REQUIRED;
-    event.value = NULL;
-    if (xQueueSendToBack(ls_event_queue, (void *)&event, pdMS_TO_TICKS(5000)) != pdPASS)
+    ls_event event = ls_event_new(LSEVT_REHOME_REQUIRED);
+    if (ls_event_send(&event, pdMS_TO_TICKS(5000)) != pdPASS)
     {
 #ifdef LSDEBUG_STATES
         ls_debug_printf("WARNING: Could not enqueue LSEVT_REHOME_REQUIRED; will try to try again later\n");
@@ -74,159 +78,160 @@ void ls_state_init(void)
     );
 }
 
+// only touched by the state machine task (states call the setters from within their handlers)
+static bool _ls_state_deadline_set = false;
+static TickType_t _ls_state_deadline;
+
+void ls_state_set_deadline_ms(uint32_t ms)
+{
+    _ls_state_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(ms);
+    _ls_state_deadline_set = true;
+}
+
+void ls_state_clear_deadline(void)
+{
+    _ls_state_deadline_set = false;
+}
+
 /**
- * @brief Checks the event queue and dispatches to current state function
- *
- * @link https://controllerstech.com/freertos-tutorial-5-using-queue/
- *
- * @param pvParameter
+ * @brief Whether the buzzer and stepper have finished whatever a previous state started.
+ * States poll this with a short deadline instead of spinning in their handler.
  */
-void event_handler_state_machine(void *pvParameter)
+static bool _ls_state_is_settled(void)
 {
-    ls_State previous_state;
-    previous_state.func = NULL;
-    ls_event event;
-    ls_event state_entry_event, noop_event;
-    state_entry_event.type = LSEVT_STATE_ENTRY;
-    state_entry_event.value = NULL;
-    noop_event.type = LSEVT_NOOP;
-    noop_event.value = NULL;
-
-    // if the ls_state_current is set prior to beginning this task, start it up with an entry event
-    if (ls_state_current.func != NULL)
-    {
-        xQueueSendToFront(ls_event_queue, (void *)&state_entry_event, 0);
-    }
+    return !(ls_buzzer_in_use() || ls_stepper_is_moving());
+}
 
-    while (1)
+// how long the dispatcher may block waiting for an event
+static TickType_t _ls_state_ticks_until_deadline(void)
+{
+    if (!_ls_state_deadline_set)
     {
-        if (xQueueReceive(ls_event_queue, &event, pdMS_TO_TICKS(LS_EVENT_NOOP_TIMEOUT_MS)) != pdTRUE)
-        {
-            xQueueSendToFront(ls_event_queue, (void *)&noop_event, 0);
-        }
-        else
-        {
-#ifdef LSDEBUG_STATES
-            ls_debug_printf("Received event %d\n", event.type);
-#endif
-            if (ls_state_current.func != NULL) // we have a current state
-            {
-                ls_state_current = ls_state_current.func(event);
-                // send state entry events if the state changed
-                if (ls_state_current.func != previous_state.func)
-                {
-#ifdef LSDEBUG_STATES
-                    ls_debug_printf("Switching states; sending entry event\n");
-#endif
-                    xQueueSendToFront(ls_event_queue, (void *)&state_entry_event, 0);
-                }
-                previous_state.func = ls_state_current.func; // save current state as previous to next event
-            }
-            else
-            {
-#ifdef LSDEBUG_STATES
-                ls_debug_printf("Event lost; no state function to handle it\n");
-#endif
-                ; // do nothing; no state
-            }
-        }
-    } // while 1 -- task must not exit
+        return portMAX_DELAY;
+    }
+    TickType_t remaining = _ls_state_deadline - xTaskGetTickCount();
+    // a deadline in the past wraps around to a huge value
+    return remaining < portMAX_DELAY / 2 ? remaining : 0;
 }
 
 bool ls_state_home_to_magnet_status = false;
 int ls_magnet_homing_tries = 50;
 
-ls_State ls_state_poweron(ls_event event)
+/**
+ * @brief Power-on only decides where to go next, so it has an entry hook but no event handler
+ */
+static enum ls_state_id _ls_state_poweron_entry(void)
 {
 #ifdef LSDEBUG_STATES
-    ls_debug_printf("STATE_POWERON handling event\n");
+    ls_debug_printf("STATE_POWERON entry\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_prelaserwarn;
-    switch (event.type)
+    enum ls_state_id successor = LS_STATE_PRELASERWARN;
+    ls_tapemode_init();
+    switch (ls_tapemode())
     {
-    case LSEVT_STATE_ENTRY:
-        ls_tapemode_init();
-        switch (ls_tapemode())
-        {
-        case LS_TAPEMODE_IGNORE:
-            successor.func = ls_state_prelaserwarn;
+    case LS_TAPEMODE_IGNORE:
+        successor = LS_STATE_PRELASERWARN;
 #ifdef LSDEBUG_STATES
-            ls_debug_printf("State poweron ignoring tape => pre-laser warning\n");
+        ls_debug_printf("State poweron ignoring tape => pre-laser warning\n");
 #endif
-            break;
-        case LS_TAPEMODE_SELFTEST:
+        break;
+    case LS_TAPEMODE_SELFTEST:
 #ifdef LSDEBUG_STATES
-            ls_debug_printf("State poweron => selftest\n");
+        ls_debug_printf("State poweron => selftest\n");
 #endif
-            successor.func = ls_state_selftest;
-            break;
-        default:
+        successor = LS_STATE_SELFTEST;
+        break;
+    default:
 #ifdef LSDEBUG_STATES
-            ls_debug_printf("During poweron, ls_map_get_status()=> %d\n", ls_map_get_status());
+        ls_debug_printf("During poweron, ls_map_get_status()=> %d\n", ls_map_get_status());
 #endif
-            if (ls_map_get_status() == LS_MAP_STATUS_OK)
-            {
+        if (ls_map_get_status() == LS_MAP_STATUS_OK)
+        {
 #ifdef LSDEBUG_STATES
-                ls_debug_printf("State poweron (LS_MAP_STATUS_OK)=> pre-laser warning\n");
+            ls_debug_printf("State poweron (LS_MAP_STATUS_OK)=> pre-laser warning\n");
 #endif
-                successor.func = ls_state_prelaserwarn;
-            }
-            else
-            {
+            successor = LS_STATE_PRELASERWARN;
+        }
+        else
+        {
 #ifdef LSDEBUG_STATES
-                ls_debug_printf("State poweron => map_build_substate_home\n");
+            ls_debug_printf("State poweron => map_build_substate_home\n");
 #endif
-                ls_state_set_home_successor(ls_state_map_build);
-                successor.func = ls_state_home; // ls_state_map_build_substate_home;
-            }
+            ls_state_set_home_successor(LS_STATE_MAP_BUILD);
+            successor = LS_STATE_HOME;
+        }
 
-        } // switch tapemode
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
-        break;
-    default: // switch event.type
-        ;
-    }
+    } // switch tapemode
     return successor;
 }
 
+// prelaserwarn waits on timers rather than blocking the dispatcher so tilt events are still handled promptly
+static enum {
+    LS_PRELASERWARN_SETTLING,     // waiting for buzzer and stepper from the previous state to finish
+    LS_PRELASERWARN_QUIET_BEFORE, // 1sec quiet/still before warning
+    LS_PRELASERWARN_WARNING,      // buzzer and stepper warning in progress
+    LS_PRELASERWARN_QUIET_AFTER,  // 1sec quiet/still after warning
+} _ls_state_prelaserwarn_phase;
 static bool _ls_state_prelaserwarn_buzzer_complete;
 static bool _ls_state_prelaserwarn_movement_complete;
 static int _ls_state_prelaserwarn_rotation_count;
-static void *_ls_state_prelaserwarn_successor = NULL;
-void ls_state_set_prelaserwarn_successor(void *successor)
+static enum ls_state_id _ls_state_prelaserwarn_successor = LS_STATE_ACTIVE;
+void ls_state_set_prelaserwarn_successor(enum ls_state_id successor)
 {
     _ls_state_prelaserwarn_successor = successor;
 }
-ls_State ls_state_prelaserwarn(ls_event event)
+static enum ls_state_id _ls_state_prelaserwarn_entry(void)
+{
+    _ls_state_prelaserwarn_buzzer_complete = false;
+    _ls_state_prelaserwarn_movement_complete = false;
+    _ls_state_prelaserwarn_rotation_count = 0;
+    _ls_state_prelaserwarn_phase = LS_PRELASERWARN_SETTLING;
+    ls_state_set_deadline_ms(0);
+    return LS_STATE_PRELASERWARN;
+}
+static enum ls_state_id _ls_state_prelaserwarn(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_PRELASERWARN handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_prelaserwarn;
+    enum ls_state_id successor = LS_STATE_PRELASERWARN;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        _ls_state_prelaserwarn_buzzer_complete = false;
-        _ls_state_prelaserwarn_movement_complete = false;
-        _ls_state_prelaserwarn_rotation_count = 0;
-        while (ls_buzzer_in_use() || ls_stepper_is_moving())
+    case LSEVT_STATE_DEADLINE:
+        switch (_ls_state_prelaserwarn_phase)
         {
-            vTaskDelay(1);
+        case LS_PRELASERWARN_SETTLING:
+            if (_ls_state_is_settled())
+            {
+                _ls_state_prelaserwarn_phase = LS_PRELASERWARN_QUIET_BEFORE;
+                ls_state_set_deadline_ms(1000); // 1sec quiet/still before warning
+            }
+            else
+            {
+                ls_state_set_deadline_ms(LS_STATE_SETTLE_POLL_MS);
+            }
+            break;
+        case LS_PRELASERWARN_QUIET_BEFORE:
+            _ls_state_prelaserwarn_phase = LS_PRELASERWARN_WARNING;
+            ls_buzzer_effect(LS_BUZZER_PRE_LASER_WARNING);
+            ls_stepper_set_maximum_steps_per_second(LS_STEPPER_STEPS_PER_SECOND_WARNING);
+            ls_stepper_forward(LS_STEPPER_STEPS_PER_ROTATION / 2);
+            break;
+        case LS_PRELASERWARN_QUIET_AFTER:
+            successor = _ls_state_prelaserwarn_successor;
+            _ls_state_prelaserwarn_successor = LS_STATE_ACTIVE; // default
+            break;
+        default:;
         }
-        ls_event_empty_queue();
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 1sec quiet/still before warning
-        ls_buzzer_effect(LS_BUZZER_PRE_LASER_WARNING);
-        ls_stepper_set_maximum_steps_per_second(LS_STEPPER_STEPS_PER_SECOND_WARNING);
-        ls_stepper_forward(LS_STEPPER_STEPS_PER_ROTATION / 2);
         break;
     case LSEVT_BUZZER_WARNING_COMPLETE:
         _ls_state_prelaserwarn_buzzer_complete = true;
         break;
     case LSEVT_STEPPER_FINISHED_MOVE:
+        if (LS_PRELASERWARN_WARNING != _ls_state_prelaserwarn_phase)
+        {
+            break; // trailing move from the previous state
+        }
         _ls_state_prelaserwarn_rotation_count++;
         if (3 > _ls_state_prelaserwarn_rotation_count)
         {
@@ -241,62 +246,62 @@ ls_State ls_state_prelaserwarn(ls_event event)
             _ls_state_prelaserwarn_movement_complete = true;
         }
         break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
-        break;
     default:; // does not handle other events
     }
-    if (_ls_state_prelaserwarn_buzzer_complete && _ls_state_prelaserwarn_movement_complete)
+    if (LS_PRELASERWARN_WARNING == _ls_state_prelaserwarn_phase && _ls_state_prelaserwarn_buzzer_complete && _ls_state_prelaserwarn_movement_complete)
     {
-        if (NULL == _ls_state_prelaserwarn_successor)
-        {
-            _ls_state_prelaserwarn_successor = ls_state_active; // default
-        }
-        successor.func = _ls_state_prelaserwarn_successor;
-        _ls_state_prelaserwarn_successor = NULL;
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 1sec quiet/still after warning
+        _ls_state_prelaserwarn_phase = LS_PRELASERWARN_QUIET_AFTER;
+        ls_state_set_deadline_ms(1000); // 1sec quiet/still after warning
     }
     return successor;
 }
 
-ls_State ls_state_active(ls_event event)
+static enum ls_state_id _ls_state_active_entry(void)
 {
 #ifdef LSDEBUG_STATES
-    ls_debug_printf("STATE_ACTIVE handling event\n");
+    ls_debug_printf("Beginning active state\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_active;
-    switch (event.type)
+    ls_stepper_set_maximum_steps_per_second(ls_settings_get_stepper_speed());
+#ifdef LS_PATH_ACTIVE_PATTERN
+    // the path strategy drives the servo along with the stepper; regenerate in case the map or servo range changed
+    ls_path_generate(LS_PATH_ACTIVE_PATTERN);
+    ls_stepper_set_random_strategy(ls_stepper_random_strategy_path);
+    ls_stepper_random();
+#else
+    ls_stepper_random();
+    ls_servo_random();
+#endif
+    ls_coverage_task_handle = NULL;
+
+    if (ls_map_get_status() == LS_MAP_STATUS_OK)
     {
-    case LSEVT_STATE_ENTRY:
+        ls_laser_set_mode_mapped();
+        xTimerReset(_ls_state_rehome_timer, pdMS_TO_TICKS(5000));
+        xTaskCreate(&ls_coverage_task, "coverage_task", configMINIMAL_STACK_SIZE * 3, NULL, 2, &ls_coverage_task_handle); // cannot do before map is ready
+    }
+    else
+    {
+        ls_laser_set_mode_on();
+    }
+    return LS_STATE_ACTIVE;
+}
+static enum ls_state_id _ls_state_active(ls_event event)
+{
 #ifdef LSDEBUG_STATES
-        ls_debug_printf("Beginning active state\n");
+    ls_debug_printf("STATE_ACTIVE handling event\n");
 #endif
-        ls_stepper_set_maximum_steps_per_second(ls_settings_get_stepper_speed());
-        ls_stepper_random();
-        ls_servo_random();
-        ls_coverage_task_handle = NULL;
-
-        if (ls_map_get_status() == LS_MAP_STATUS_OK)
-        {
-            ls_laser_set_mode_mapped();
-            xTimerReset(_ls_state_rehome_timer, pdMS_TO_TICKS(5000));
-            xTaskCreate(&ls_coverage_task, "coverage_task", configMINIMAL_STACK_SIZE * 3, NULL, 2, &ls_coverage_task_handle); // cannot do before map is ready
-        }
-        else
-        {
-            ls_laser_set_mode_on();
-        }
-        break;
+    enum ls_state_id successor = LS_STATE_ACTIVE;
+    switch (event.type)
+    {
     case LSEVT_MAGNET_ENTER:
 #ifdef LSDEBUG_STATES
-        ls_debug_printf("Magnet Enter @ %d %s\n", (int32_t)event.value, ls_stepper_get_direction() ? "-->" : "<--");
+        ls_debug_printf("Magnet Enter @ %d %s\n", event.value.position, ls_stepper_get_direction() ? "-->" : "<--");
 #endif
         ls_buzzer_effect(LS_BUZZER_CLICK);
         break;
     case LSEVT_MAGNET_LEAVE:
 #ifdef LSDEBUG_STATES
-        ls_debug_printf("Magnet Leave @ %d %s\n", (int32_t)event.value, ls_stepper_get_direction() ? "-->" : "<--");
+        ls_debug_printf("Magnet Leave @ %d %s\n", event.value.position, ls_stepper_get_direction() ? "-->" : "<--");
 #endif
         ls_buzzer_effect(LS_BUZZER_CLICK);
         break;
@@ -319,13 +324,13 @@ ls_State ls_state_active(ls_event event)
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Rehoming from active state\n");
 #endif
-        successor.func = ls_state_home;
+        successor = LS_STATE_HOME;
         break;
     case LSEVT_LIGHT_NIGHT:
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Entering night/sleep state\n")
 #endif
-            successor.func = ls_state_sleep;
+            successor = LS_STATE_SLEEP;
         break;
     case LSEVT_CONTROLS_CONNECTED:
     case LSEVT_CONTROLS_SPEED:
@@ -334,63 +339,54 @@ ls_State ls_state_active(ls_event event)
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Entering settings control\n")
 #endif
-            successor.func = ls_state_settings;
+            successor = LS_STATE_SETTINGS;
         break;
     case LSEVT_CONTROLS_CONNECT_SECONDARY:
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Entering secondary settings control\n")
 #endif
-            successor.func = ls_state_secondary_settings;
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
+            successor = LS_STATE_SECONDARY_SETTINGS;
         break;
     default:;
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Unknown event %d\n", event.type);
 #endif
     }
-    // /exit behaviors:
-    if (successor.func != ls_state_active)
+    return successor;
+}
+static void _ls_state_active_exit(void)
+{
+    if (NULL != ls_coverage_task_handle)
     {
-        if (NULL != ls_coverage_task_handle)
-        {
-            vTaskDelete(ls_coverage_task_handle);
-            ls_coverage_task_handle = NULL; // probably not necessary now, but just in case
-        }
-        ls_stepper_stop();
-        ls_servo_off();
-        ls_laser_set_mode_off();
+        vTaskDelete(ls_coverage_task_handle);
+        ls_coverage_task_handle = NULL; // probably not necessary now, but just in case
     }
-    return successor;
+    ls_stepper_stop();
+    ls_servo_off();
+    ls_laser_set_mode_off();
 }
 
-static void *_ls_state_home_successor = NULL;
-void ls_state_set_home_successor(void *successor)
+static enum ls_state_id _ls_state_home_successor = LS_STATE_ACTIVE;
+void ls_state_set_home_successor(enum ls_state_id successor)
 {
     _ls_state_home_successor = successor;
 }
-ls_State ls_state_home(ls_event event)
+static enum ls_state_id _ls_state_home_entry(void)
+{
+    ls_substate_home_init();
+    return LS_STATE_HOME;
+}
+static enum ls_state_id _ls_state_home(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_HOME handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_home;
+    enum ls_state_id successor = LS_STATE_HOME;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        ls_substate_home_init();
-        ls_event_enqueue_noop();
-        break;
     case LSEVT_HOME_COMPLETED:
-        if (NULL == _ls_state_home_successor)
-        {
-            _ls_state_home_successor = ls_state_active;
-        }
-        successor.func = _ls_state_home_successor;
-        _ls_state_home_successor = ls_state_active;
-        ls_event_enqueue_noop();
+        successor = _ls_state_home_successor;
+        _ls_state_home_successor = LS_STATE_ACTIVE; // default
         break;
     case LSEVT_HOME_FAILED:
         ls_buzzer_effect(LS_BUZZER_PLAY_HOME_FAIL);
@@ -398,20 +394,12 @@ ls_State ls_state_home(ls_event event)
         {
         case LS_TAPEMODE_BLACK_SAFE:
         case LS_TAPEMODE_REFLECT_SAFE:
-            successor.func = ls_state_error_home;
+            successor = LS_STATE_ERROR_HOME;
             break;
         default:
-            if (NULL == _ls_state_home_successor)
-            {
-                _ls_state_home_successor = ls_state_active;
-            }
-            ls_state_set_prelaserwarn_successor(ls_state_active);
-            successor.func = ls_state_prelaserwarn;
+            ls_state_set_prelaserwarn_successor(LS_STATE_ACTIVE);
+            successor = LS_STATE_PRELASERWARN;
         }
-        ls_event_enqueue_noop();
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
         break;
     default:
         ls_substate_home_handle_event(event);
@@ -419,25 +407,44 @@ ls_State ls_state_home(ls_event event)
     return successor;
 }
 
-ls_State ls_state_selftest(ls_event event)
+static enum ls_state_id _ls_state_selftest_entry(void)
+{
+    // the self-test keeps its own event handler, which expects to see the entry event
+    selftest_event_handler(ls_event_new(LSEVT_STATE_ENTRY));
+    return LS_STATE_SELFTEST;
+}
+static enum ls_state_id _ls_state_selftest(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_SELFTEST handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_selftest;
+    enum ls_state_id successor = LS_STATE_SELFTEST;
     selftest_event_handler(event);
     return successor;
 }
 
 static int _ls_state_settings_servo_hold_count = 0;
-ls_State ls_state_settings(ls_event event)
+static enum ls_state_id _ls_state_settings_entry(void)
+{
+    // controls may already be gone by the time we get here (see #44 below)
+    if (LS_CONTROLS_STATUS_DISCONNECTED == ls_controls_get_current_status())
+    {
+        ls_stepper_stop();
+        return LS_STATE_ACTIVE;
+    }
+    ls_stepper_set_maximum_steps_per_second(ls_settings_get_stepper_speed());
+    ls_laser_set_mode((ls_map_get_status() == LS_MAP_STATUS_OK) ? LS_LASER_MAPPED : LS_LASER_ON);
+    ls_stepper_forward(LS_STEPPER_STEPS_PER_ROTATION * 5 / 4);
+    ls_servo_sweep();
+    ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
+    return LS_STATE_SETTINGS;
+}
+static enum ls_state_id _ls_state_settings(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_SETTINGS handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_settings;
+    enum ls_state_id successor = LS_STATE_SETTINGS;
     BaseType_t control_value;
 
     // somewhat awkward patch for #44 https://github.com/davidhbrown-uri/laser_scarecrow-ls22_esp32/issues/44
@@ -448,13 +455,6 @@ ls_State ls_state_settings(ls_event event)
 
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        ls_stepper_set_maximum_steps_per_second(ls_settings_get_stepper_speed());
-        ls_laser_set_mode((ls_map_get_status() == LS_MAP_STATUS_OK) ? LS_LASER_MAPPED : LS_LASER_ON);
-        ls_stepper_forward(LS_STEPPER_STEPS_PER_ROTATION * 5 / 4);
-        ls_servo_sweep();
-        ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
-        break;
     case LSEVT_STEPPER_FINISHED_MOVE:
         ls_stepper_forward(LS_STEPPER_STEPS_PER_ROTATION * 5 / 4);
         if (_ls_state_settings_servo_hold_count > 0)
@@ -474,45 +474,41 @@ ls_State ls_state_settings(ls_event event)
         ls_buzzer_effect(LS_BUZZER_PLAY_ROOT);
         break;
     case LSEVT_CONTROLS_SPEED:
-        control_value = *((BaseType_t *)event.value);
+        control_value = event.value.adc;
         ls_settings_set_stepper_speed(ls_settings_map_control_to_stepper_speed(control_value));
         ls_stepper_set_maximum_steps_per_second(ls_settings_get_stepper_speed());
         break;
     case LSEVT_CONTROLS_TOPANGLE:
-        control_value = *((BaseType_t *)event.value);
+        control_value = event.value.adc;
         ls_settings_set_servo_top(ls_settings_map_control_to_servo_top(control_value));
         ls_servo_jumpto(ls_settings_get_servo_top());
         _ls_state_settings_servo_hold_count = 3;
         break;
     case LSEVT_CONTROLS_BOTTOMANGLE:
-        control_value = *((BaseType_t *)event.value);
+        control_value = event.value.adc;
         ls_settings_set_servo_bottom(ls_settings_map_control_to_servo_bottom(control_value));
         ls_servo_jumpto(ls_settings_get_servo_bottom());
         _ls_state_settings_servo_hold_count = 3;
         break;
     case LSEVT_CONTROLS_DISCONNECTED:
         ls_stepper_stop();
-        successor.func = ls_state_active;
+        successor = LS_STATE_ACTIVE;
         break;
     case LSEVT_CONTROLS_CONNECT_SECONDARY:
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Entering secondary from primary settings control\n")
 #endif
-            successor.func = ls_state_secondary_settings;
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
+            successor = LS_STATE_SECONDARY_SETTINGS;
         break;
     default:;
     } // switch event type
-
-    if (ls_state_settings != successor.func)
-    {
-        ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_LEAVE);
-        ls_settings_save();
-    }
     return successor;
 }
+static void _ls_state_settings_exit(void)
+{
+    ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_LEAVE);
+    ls_settings_save();
+}
 
 static enum ls_buzzer_scale _ls_state_secondary_settings_lightsense_scale[] = {
     // 0..4 => switch at lower light levels
@@ -521,25 +517,32 @@ static enum ls_buzzer_scale _ls_state_secondary_settings_lightsense_scale[] = {
     // 6..10 => switch at higher levels
     LS_BUZZER_SCALE_Gx, LS_BUZZER_SCALE_A, LS_BUZZER_SCALE_Ax, LS_BUZZER_SCALE_B, LS_BUZZER_SCALE_CC};
 static int _ls_state_secondary_settings_servo_count = 0;
-ls_State ls_state_secondary_settings(ls_event event)
+// bottom angle slider aims the servo for calibration; a pulse width held still long enough is captured
+static bool _ls_state_secondary_settings_capture_pending = false;
+static uint16_t _ls_state_secondary_settings_capture_us;
+static enum ls_state_id _ls_state_secondary_settings_entry(void)
+{
+    ls_laser_set_mode_off();
+    ls_stepper_stop();
+    ls_stepper_sleep(); // why? loses homing
+    ls_servo_off();
+    ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
+    ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
+    _ls_state_secondary_settings_servo_count = 0;
+    _ls_state_secondary_settings_capture_pending = false;
+    ls_servocal_capture_reset();
+    ls_state_set_deadline_ms(LS_STATE_SECONDARY_SETTINGS_REMINDER_MS);
+    return LS_STATE_SECONDARY_SETTINGS;
+}
+static enum ls_state_id _ls_state_secondary_settings(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("CONTROLS_SECONDARY handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_secondary_settings;
+    enum ls_state_id successor = LS_STATE_SECONDARY_SETTINGS;
     BaseType_t control_value;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        ls_laser_set_mode_off();
-        ls_stepper_stop();
-        ls_stepper_sleep(); // why? loses homing
-        ls_servo_off();
-        ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
-        ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
-        _ls_state_secondary_settings_servo_count = 0;
-        break;
     case LSEVT_SERVO_SWEEP_TOP:
         ls_buzzer_effect(LS_BUZZER_PLAY_OCTAVE);
         _ls_state_secondary_settings_servo_count--;
@@ -557,7 +560,7 @@ ls_State ls_state_secondary_settings(ls_event event)
         }
         break;
     case LSEVT_CONTROLS_SPEED: // servo speed
-        control_value = *((BaseType_t *)event.value);
+        control_value = event.value.adc;
         ls_settings_set_servo_pulse_delta(ls_settings_map_control_to_servo_pulse_delta(control_value));
 #ifdef LSDEBUG_SETTINGS
         ls_debug_printf("Setting servo pulse delta to %d microseconds per tick.\n", ls_settings_map_control_to_servo_pulse_delta(control_value));
@@ -566,7 +569,7 @@ ls_State ls_state_secondary_settings(ls_event event)
         ls_servo_sweep();
         break;
     case LSEVT_CONTROLS_TOPANGLE: // light threshold
-        control_value = *((BaseType_t *)event.value);
+        control_value = event.value.adc;
         // map input to 0-10 setting range
         int index = _map(_constrain(control_value, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP),
                          LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, 0, 10);
@@ -580,42 +583,73 @@ ls_State ls_state_secondary_settings(ls_event event)
         ls_buzzer_note(_ls_state_secondary_settings_lightsense_scale[index], 3);
         ls_settings_set_light_thresholds_from_0to10(index);
         break;
-    case LSEVT_CONTROLS_BOTTOMANGLE:; // nothing assigned
+    case LSEVT_CONTROLS_BOTTOMANGLE: // turned all the way up: capture the installed orientation for tilt detection
+        if (event.value.adc >= LS_CONTROLS_READING_TOP)
+        {
+            _ls_state_secondary_settings_capture_pending = false;
+            ls_tilt_request_calibration();
+            ls_buzzer_effect(LS_BUZZER_PLAY_OCTAVE);
+            break;
+        }
+        // otherwise aim the servo at the next servo calibration mark
+        _ls_state_secondary_settings_capture_us = _map(_constrain(event.value.adc, LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP),
+                                                       LS_CONTROLS_READING_BOTTOM, LS_CONTROLS_READING_TOP, LS_SERVO_US_MIN, LS_SERVO_US_MAX);
+        _ls_state_secondary_settings_capture_pending = true;
+        _ls_state_secondary_settings_servo_count = 0;
+        ls_servo_moveto(_ls_state_secondary_settings_capture_us);
         break;
     case LSEVT_CONTROLS_DISCONNECTED:
         ls_servo_off();
-        successor.func = ls_state_wakeup; // because we turned laser off, must do wakeup and pre-laser warning
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
+        successor = LS_STATE_WAKEUP; // because we turned laser off, must do wakeup and pre-laser warning
         break;
-    case LSEVT_NOOP:
+    case LSEVT_STATE_DEADLINE:
+        if (_ls_state_secondary_settings_capture_pending)
+        {
+            // the servo has been held on a mark: root per point, octave once the table is saved
+            _ls_state_secondary_settings_capture_pending = false;
+            int captured = ls_servocal_capture(_ls_state_secondary_settings_capture_us);
+            if (0 == captured) // marks were not monotonic; capture starts over
+            {
+                ls_buzzer_effect(LS_BUZZER_PLAY_MAP_FAIL);
+            }
+            else
+            {
+                ls_buzzer_effect(captured < LS_SERVOCAL_CAPTURE_POINTS ? LS_BUZZER_PLAY_ROOT : LS_BUZZER_PLAY_OCTAVE);
+            }
+            break;
+        }
+        // remind whoever is there that we are still in secondary settings
         ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_ENTER);
     default:; // do nothing for this event
     }         // switch event type
-    if (ls_state_secondary_settings != successor.func)
-    {
-        ls_substate_home_require_rehome(); 
-        ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_LEAVE);
-        ls_settings_save();
-    }
+    // any activity postpones the reminder (or the capture, while the slider is still moving)
+    ls_state_set_deadline_ms(_ls_state_secondary_settings_capture_pending ? LS_SERVOCAL_CAPTURE_HOLD_MS : LS_STATE_SECONDARY_SETTINGS_REMINDER_MS);
     return successor;
 }
+static void _ls_state_secondary_settings_exit(void)
+{
+    ls_substate_home_require_rehome();
+    ls_buzzer_effect(LS_BUZZER_PLAY_SETTINGS_CONTROL_LEAVE);
+    ls_settings_save();
+}
 
-ls_State ls_state_sleep(ls_event event)
+static int _ls_state_sleep_snore_click = 0;
+
+static enum ls_state_id _ls_state_sleep_entry(void)
+{
+    ls_laser_set_mode_off();
+    ls_servo_off();
+    ls_stepper_forward(1);
+    return LS_STATE_SLEEP;
+}
+static enum ls_state_id _ls_state_sleep(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_SLEEP handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_sleep;
+    enum ls_state_id successor = LS_STATE_SLEEP;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        ls_laser_set_mode_off();
-        ls_servo_off();
-        ls_stepper_forward(1);
-        break;
     case LSEVT_STEPPER_FINISHED_MOVE:
         // the magnet sensor includes an LED which could pointlessly drain power during sleep
         if (ls_magnet_is_detected())
@@ -625,35 +659,32 @@ ls_State ls_state_sleep(ls_event event)
         else
         {
             ls_stepper_sleep();
-            ls_event_enqueue_noop();
+            _ls_state_sleep_snore_click = 0;
+            ls_state_set_deadline_ms(0); // snore right away
         }
         break;
     case LSEVT_LIGHT_DAY:
 #ifdef LSDEBUG_STATES
         ls_debug_printf("SLEEP received wake-up event\n");
 #endif
-        successor.func = ls_state_wakeup;
+        successor = LS_STATE_WAKEUP;
         break;
-    case LSEVT_NOOP: // snore (?)
-        for (int i = 0; i < 20; i++)
+    case LSEVT_STATE_DEADLINE: // snore (?) one click at a time: 20 speeding up, then 40 slowing down
+        ls_buzzer_effect(LS_BUZZER_CLICK);
+        if (_ls_state_sleep_snore_click < 20)
         {
-            ls_buzzer_effect(LS_BUZZER_CLICK);
-            vTaskDelay(5 - i / 5);
+            ls_state_set_deadline_ms((5 - _ls_state_sleep_snore_click / 5) * portTICK_PERIOD_MS);
         }
-        for (int i = 0; i < 40; i++)
+        else if (_ls_state_sleep_snore_click < 60)
         {
-            ls_buzzer_effect(LS_BUZZER_CLICK);
-            vTaskDelay(1 + i / 3);
+            ls_state_set_deadline_ms((1 + (_ls_state_sleep_snore_click - 20) / 3) * portTICK_PERIOD_MS);
         }
-        for (int i = 0; i < 40; i++)
+        _ls_state_sleep_snore_click++;
+        if (_ls_state_sleep_snore_click >= 60)
         {
-            if (ls_event_queue_has_messages())
-            {
-                break;
-            }
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            _ls_state_sleep_snore_click = 0;
+            ls_state_set_deadline_ms(LS_STATE_SLEEP_SNORE_INTERVAL_MS);
         }
-        ls_event_enqueue_noop_if_queue_empty();
         break;
     case LSEVT_CONTROLS_CONNECTED:
     case LSEVT_CONTROLS_SPEED:
@@ -662,62 +693,51 @@ ls_State ls_state_sleep(ls_event event)
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Entering settings control from sleep\n");
 #endif
-        ls_state_set_prelaserwarn_successor(ls_state_settings);
+        ls_state_set_prelaserwarn_successor(LS_STATE_SETTINGS);
         if (ls_map_get_status() == LS_MAP_STATUS_OK)
         {
-            ls_state_set_home_successor(ls_state_prelaserwarn);
-            successor.func = ls_state_home;
+            ls_state_set_home_successor(LS_STATE_PRELASERWARN);
+            successor = LS_STATE_HOME;
         }
         else
         {
-            successor.func = ls_state_prelaserwarn;
+            successor = LS_STATE_PRELASERWARN;
         }
         break;
     case LSEVT_CONTROLS_CONNECT_SECONDARY:
 #ifdef LSDEBUG_STATES
         ls_debug_printf("Entering secondary settings control from sleep\n")
 #endif
-            successor.func = ls_state_secondary_settings;
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
+            successor = LS_STATE_SECONDARY_SETTINGS;
         break;
     default:;
     }
     return successor;
 }
 
-ls_State ls_state_wakeup(ls_event event)
+static enum ls_state_id _ls_state_wakeup_entry(void)
+{
+    if (ls_map_get_status() != LS_MAP_STATUS_OK)
+    {
+        return LS_STATE_PRELASERWARN;
+    }
+    ls_substate_home_require_rehome();
+    ls_substate_home_init();
+    return LS_STATE_WAKEUP;
+}
+static enum ls_state_id _ls_state_wakeup(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_WAKEUP handling event\n");
 #endif
-    ls_State successor;
-    successor.func = ls_state_wakeup;
+    enum ls_state_id successor = LS_STATE_WAKEUP;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        if (ls_map_get_status() == LS_MAP_STATUS_OK)
-        {
-            ls_substate_home_require_rehome();
-            ls_substate_home_init();
-            ls_event_enqueue_noop();
-        }
-        else
-        {
-            successor.func = ls_state_prelaserwarn;
-        }
-        break;
     case LSEVT_HOME_COMPLETED:
-        successor.func = ls_state_prelaserwarn;
-        ls_event_enqueue_noop();
+        successor = LS_STATE_PRELASERWARN;
         break;
     case LSEVT_HOME_FAILED:
-        successor.func = ls_state_error_home;
-        ls_event_enqueue_noop();
-        break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
+        successor = LS_STATE_ERROR_HOME;
         break;
     default:
         ls_substate_home_handle_event(event);
@@ -726,42 +746,82 @@ ls_State ls_state_wakeup(ls_event event)
 }
 
 static int _ls_state_map_build_steps_remaining;
+static bool _ls_state_map_build_started;
+// the arm has stopped at a bin and its tape samples were requested
+static bool _ls_state_map_build_awaiting_samples;
 static int _ls_state_map_enable_count = 0, _ls_state_map_disable_count = 0, _ls_state_map_misread_count = 0;
 
-ls_State ls_state_map_build(ls_event event)
+/**
+ * @brief read the bin the arm stopped at and move on to the next
+ */
+static void _ls_state_map_build_read_bin(void)
+{
+    _ls_state_map_build_awaiting_samples = false;
+    _ls_state_map_build_read_and_set_map(&_ls_state_map_enable_count, &_ls_state_map_disable_count, &_ls_state_map_misread_count);
+#ifdef LSDEBUG_STATES
+    ls_debug_printf("continuing to next position...\n");
+#endif
+    ls_stepper_forward(LS_MAP_RESOLUTION);
+    _ls_state_map_build_steps_remaining--;
+}
+
+static enum ls_state_id _ls_state_map_build_entry(void)
+{
+    _ls_state_map_build_steps_remaining = LS_STEPPER_STEPS_PER_ROTATION / LS_MAP_RESOLUTION;
+    _ls_state_map_build_started = false;
+    _ls_state_map_build_awaiting_samples = false;
+    ls_tape_sensor_enable();
+    ls_state_set_deadline_ms(0);
+    return LS_STATE_MAP_BUILD;
+}
+static enum ls_state_id _ls_state_map_build(ls_event event)
 {
 #ifdef LSDEBUG_STATES
     ls_debug_printf("STATE_MAP_BUILD handling event %d with %d steps remaining\n", event.type, _ls_state_map_build_steps_remaining);
 #endif
-    ls_State successor;
-    successor.func = ls_state_map_build;
+    enum ls_state_id successor = LS_STATE_MAP_BUILD;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        _ls_state_map_build_steps_remaining = LS_STEPPER_STEPS_PER_ROTATION / LS_MAP_RESOLUTION;
-        ls_tape_sensor_enable();
-        while (ls_buzzer_in_use() || ls_stepper_is_moving())
+    case LSEVT_TAPE_SAMPLES_READY:
+        if (!_ls_state_map_build_awaiting_samples)
         {
-            // if we start moving while the buzzer is still indicating successfull homing,
-            // we get a bunch of pitches queued that play faster than the others
-            vTaskDelay(1);
+            break; // answered by the backstop already
         }
-        ls_event_empty_queue(); // in case of a trailing LSEVT_STEPPER_FINISHED_MOVE
+        ls_state_clear_deadline();
+        _ls_state_map_build_read_bin();
+        break;
+    case LSEVT_STATE_DEADLINE:
+        if (_ls_state_map_build_awaiting_samples)
+        {
+            // backstop: the samples never came, so read whatever the sensor has
+            _ls_state_map_build_read_bin();
+            break;
+        }
+        // if we start moving while the buzzer is still indicating successfull homing,
+        // we get a bunch of pitches queued that play faster than the others
+        if (!_ls_state_is_settled())
+        {
+            ls_state_set_deadline_ms(LS_STATE_SETTLE_POLL_MS);
+            break;
+        }
+        _ls_state_map_build_started = true;
         ls_stepper_set_maximum_steps_per_second(LS_STEPPER_STEPS_PER_SECOND_MAPPING);
         ls_stepper_forward(LS_MAP_RESOLUTION);
         break;
     case LSEVT_STEPPER_FINISHED_MOVE:
+        if (!_ls_state_map_build_started)
+        {
+            break; // trailing move from homing
+        }
 #ifdef LSDEBUG_STATES
         ls_debug_printf("case LSEVT_STEPPER_FINISHED_MOVE...\n");
 #endif
         if (_ls_state_map_build_steps_remaining > 0)
         {
-            _ls_state_map_build_read_and_set_map(&_ls_state_map_enable_count, &_ls_state_map_disable_count, &_ls_state_map_misread_count);
-#ifdef LSDEBUG_STATES
-            ls_debug_printf("continuing to next position...\n");
-#endif
-            ls_stepper_forward(LS_MAP_RESOLUTION);
-            _ls_state_map_build_steps_remaining--;
+            // the sensor stays on while mapping, so skip samples taken while the arm was still moving into this bin
+            _ls_state_map_build_awaiting_samples = true;
+            ls_state_set_deadline_ms(LS_TAPE_SAMPLES_TIMEOUT_MS);
+            ls_tape_sensor_request_samples(event.time_us);
         }
         else
         { // we're done building the map
@@ -789,7 +849,7 @@ ls_State ls_state_map_build(ls_event event)
 #ifdef LSDEBUG_MAP
             ls_debug_printf("\nMapping completed with %d enabled, %d disabled, and %d misreads\n", _ls_state_map_enable_count, _ls_state_map_disable_count, _ls_state_map_misread_count);
 #endif
-            successor.func = ls_state_prelaserwarn;
+            successor = LS_STATE_PRELASERWARN;
             if (0 == _ls_state_map_enable_count || 0 == _ls_state_map_disable_count)
             {
                 badmap = true;
@@ -813,7 +873,7 @@ ls_State ls_state_map_build(ls_event event)
                 {
                 case LS_TAPEMODE_BLACK_SAFE:
                 case LS_TAPEMODE_REFLECT_SAFE:
-                    successor.func = ls_state_error_map;
+                    successor = LS_STATE_ERROR_MAP;
                     break;
                 default:
                     if (0 == _ls_state_map_enable_count)
@@ -837,76 +897,108 @@ ls_State ls_state_map_build(ls_event event)
             ls_tape_sensor_disable();
         } // done building map
         break;
-    case LSEVT_TILT_DETECTED:
-        successor.func = ls_state_error_tilt;
-        break;
     default:; // nothing to do for event of this type
     }         // switch  on event
     return successor;
 }
 
-ls_State ls_state_error_home(ls_event event)
+static enum ls_state_id _ls_state_error_home_entry(void)
 {
     _ls_state_everything_off();
-    ls_State successor;
-    successor.func = ls_state_error_home;
+    ls_state_set_deadline_ms(LS_STATE_ERROR_ALERT_INTERVAL_MS);
+    return LS_STATE_ERROR_HOME;
+}
+static enum ls_state_id _ls_state_error_home(ls_event event)
+{
+    enum ls_state_id successor = LS_STATE_ERROR_HOME;
+    switch (event.type)
+    {
+    case LSEVT_STATE_DEADLINE:
 #ifdef LSDEBUG_HOMING
-    xSemaphoreTake(print_mux, portMAX_DELAY);
-    ls_debug_printf(">>>>HOMING FAILED<<<\n");
-    xSemaphoreGive(print_mux);
+        ls_debug_printf(">>>>HOMING FAILED<<<\n");
 #endif
-    vTaskDelay(pdMS_TO_TICKS(30000)); // 30 seconds between alerts
-    ls_buzzer_effect(LS_BUZZER_PLAY_HOME_FAIL);
-    ls_event_enqueue_noop();
+        ls_buzzer_effect(LS_BUZZER_PLAY_HOME_FAIL);
+        ls_state_set_deadline_ms(LS_STATE_ERROR_ALERT_INTERVAL_MS); // 30 seconds between alerts
+        break;
+    default:; // stays in error until power cycle
+    }
     return successor;
 }
 
-ls_State ls_state_error_map(ls_event event)
+static int _ls_state_error_map_tone = 0;
+
+static enum ls_state_id _ls_state_error_map_entry(void)
 {
     _ls_state_everything_off();
-    ls_State successor;
-    successor.func = ls_state_error_map;
+    _ls_state_error_map_tone = 0;
+    ls_state_set_deadline_ms(LS_STATE_ERROR_ALERT_INTERVAL_MS);
+    return LS_STATE_ERROR_MAP;
+}
+static enum ls_state_id _ls_state_error_map(ls_event event)
+{
+    enum ls_state_id successor = LS_STATE_ERROR_MAP;
+    if (LSEVT_STATE_DEADLINE != event.type)
+    {
+        return successor; // stays in error until power cycle
+    }
 #ifdef LSDEBUG_MAP
-    xSemaphoreTake(print_mux, portMAX_DELAY);
     ls_debug_printf(">>>>MAPPING FAILED<<<\n");
-    xSemaphoreGive(print_mux);
 #endif
-    vTaskDelay(pdMS_TO_TICKS(30000)); // 30 seconds between alerts
-    if (0 == _ls_state_map_enable_count)
-    {
-        ls_buzzer_effect(LS_BUZZER_PLAY_TAPE_DISABLE);
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 1 second between tones
-    }
-    if (0 == _ls_state_map_disable_count)
+    // play each applicable diagnostic tone on its own deadline, then the failure tone
+    while (_ls_state_error_map_tone < 3)
     {
-        ls_buzzer_effect(LS_BUZZER_PLAY_TAPE_ENABLE);
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 1 second between tones
-    }
-    if (ls_map_is_excessive_misreads(_ls_state_map_misread_count))
-    {
-        ls_buzzer_effect(LS_BUZZER_PLAY_TAPE_MISREAD);
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 1 second between tones
+        bool played = false;
+        switch (_ls_state_error_map_tone++)
+        {
+        case 0:
+            if (0 == _ls_state_map_enable_count)
+            {
+                ls_buzzer_effect(LS_BUZZER_PLAY_TAPE_DISABLE);
+                played = true;
+            }
+            break;
+        case 1:
+            if (0 == _ls_state_map_disable_count)
+            {
+                ls_buzzer_effect(LS_BUZZER_PLAY_TAPE_ENABLE);
+                played = true;
+            }
+            break;
+        default:
+            if (ls_map_is_excessive_misreads(_ls_state_map_misread_count))
+            {
+                ls_buzzer_effect(LS_BUZZER_PLAY_TAPE_MISREAD);
+                played = true;
+            }
+        }
+        if (played)
+        {
+            ls_state_set_deadline_ms(1000); // 1 second between tones
+            return successor;
+        }
     }
     ls_buzzer_effect(LS_BUZZER_PLAY_MAP_FAIL);
-    ls_event_enqueue_noop();
+    _ls_state_error_map_tone = 0;
+    ls_state_set_deadline_ms(LS_STATE_ERROR_ALERT_INTERVAL_MS); // 30 seconds between alerts
     return successor;
 }
 
-ls_State ls_state_error_tilt(ls_event event)
+static enum ls_state_id _ls_state_error_tilt_entry(void)
+{
+    _ls_state_everything_off();
+    ls_state_set_deadline_ms(0); // alert as soon as the queue is empty
+    return LS_STATE_ERROR_TILT;
+}
+static enum ls_state_id _ls_state_error_tilt(ls_event event)
 {
 #ifdef LSDEBUG_TILT
     xSemaphoreTake(print_mux, portMAX_DELAY);
     ls_debug_printf("ERROR_TILT\n");
     xSemaphoreGive(print_mux);
 #endif
-    ls_State successor;
-    successor.func = ls_state_error_tilt;
+    enum ls_state_id successor = LS_STATE_ERROR_TILT;
     switch (event.type)
     {
-    case LSEVT_STATE_ENTRY:
-        _ls_state_everything_off();
-        ls_event_enqueue_noop();
-        break;
     case LSEVT_TILT_OK:
         switch (ls_tapemode())
         {
@@ -919,45 +1011,190 @@ ls_State ls_state_error_tilt(ls_event event)
 #endif
             ls_buzzer_effect(LS_BUZZER_PLAY_TILT_FAIL);
             ls_buzzer_effect(LS_BUZZER_ALERT_1S);
-            ls_event_enqueue_noop();
+            ls_state_set_deadline_ms(0);
             break;
         default:
-            successor.func = ls_state_poweron;
+            successor = LS_STATE_POWERON;
         } // switch on tapemode if TILT_OK
         break;
-    default:
+    case LSEVT_STATE_DEADLINE:
         ls_buzzer_effect(LS_BUZZER_PLAY_TILT_FAIL);
-        // 30 seconds between alerts unless an event is pending
-        if (pdFALSE == xQueuePeek(ls_event_queue, &event, pdMS_TO_TICKS(30000)))
-        {
-            ls_event_enqueue_noop();
-        }
+        ls_state_set_deadline_ms(LS_STATE_ERROR_ALERT_INTERVAL_MS); // 30 seconds between alerts
+        break;
+    default:; // other events do not change anything while tilted
     }
     return successor;
 }
 
 /**
  * @brief If no accelerometer is found, play a warning tone then attempt to restart MCU
- *
- * @param event
- * @return ls_State
  */
-ls_State ls_state_error_noaccel(ls_event event)
+static enum ls_state_id _ls_state_error_noaccel_entry(void)
 {
-    ls_State successor;
-    successor.func = ls_state_error_noaccel;
-    // we're never really going to return
     ls_buzzer_effect(LS_BUZZER_PLAY_TILT_FAIL);
-    vTaskDelay(pdMS_TO_TICKS(500));
-    // if this is the first attempt just try to restart
-    if (esp_reset_reason() != ESP_RST_SW)
+    ls_state_set_deadline_ms(500);
+    return LS_STATE_ERROR_NOACCEL;
+}
+static enum ls_state_id _ls_state_error_noaccel(ls_event event)
+{
+    static bool warned = false;
+    enum ls_state_id successor = LS_STATE_ERROR_NOACCEL;
+    switch (event.type)
     {
-        esp_restart(); // software reset of the chip; starts execution again
+    case LSEVT_STATE_DEADLINE:
+        // if this is the first attempt just try to restart
+        if (warned || esp_reset_reason() != ESP_RST_SW)
+        {
+            esp_restart(); // software reset of the chip; starts execution again
+        }
+        // otherwise play the warning tone, too, and wait to try again
+        ls_buzzer_effect(LS_BUZZER_ALTERNATE_HIGH);
+        warned = true;
+        ls_state_set_deadline_ms(29000);
+        break;
+    default:;
     }
-    // otherwise play the warning tone, too, and wait to try again
-    ls_buzzer_effect(LS_BUZZER_ALTERNATE_HIGH);
-    vTaskDelay(pdMS_TO_TICKS(29000));
-    esp_restart(); // software reset of the chip; starts execution again
-    // will not be reached
     return successor;
+}
+
+/**
+ * @brief One row per state, indexed by enum ls_state_id.
+ *
+ * entry runs synchronously when the state is entered and may redirect to another state;
+ * exit runs when leaving for any other state. Either may be NULL, as may handler for
+ * states that never stay put (poweron). States with global set let the transitions in
+ * _ls_state_global_transitions take priority over their own handler.
+ */
+static const struct ls_state_table_entry
+{
+    const char *name;
+    enum ls_state_id (*handler)(ls_event);
+    enum ls_state_id (*entry)(void);
+    void (*exit)(void);
+    bool global;
+} _ls_state_table[LS_STATE_COUNT] = {
+    [LS_STATE_POWERON] = {"poweron", NULL, _ls_state_poweron_entry, NULL, true},
+    [LS_STATE_SELFTEST] = {"selftest", _ls_state_selftest, _ls_state_selftest_entry, NULL, false},
+    [LS_STATE_SETTINGS] = {"settings", _ls_state_settings, _ls_state_settings_entry, _ls_state_settings_exit, true},
+    [LS_STATE_SECONDARY_SETTINGS] = {"secondary_settings", _ls_state_secondary_settings, _ls_state_secondary_settings_entry, _ls_state_secondary_settings_exit, true},
+    [LS_STATE_SLEEP] = {"sleep", _ls_state_sleep, _ls_state_sleep_entry, NULL, true},
+    [LS_STATE_WAKEUP] = {"wakeup", _ls_state_wakeup, _ls_state_wakeup_entry, NULL, true},
+    [LS_STATE_PRELASERWARN] = {"prelaserwarn", _ls_state_prelaserwarn, _ls_state_prelaserwarn_entry, NULL, true},
+    [LS_STATE_ACTIVE] = {"active", _ls_state_active, _ls_state_active_entry, _ls_state_active_exit, true},
+    [LS_STATE_HOME] = {"home", _ls_state_home, _ls_state_home_entry, NULL, true},
+    [LS_STATE_MAP_BUILD] = {"map_build", _ls_state_map_build, _ls_state_map_build_entry, NULL, true},
+    [LS_STATE_ERROR_HOME] = {"error_home", _ls_state_error_home, _ls_state_error_home_entry, NULL, false},
+    [LS_STATE_ERROR_MAP] = {"error_map", _ls_state_error_map, _ls_state_error_map_entry, NULL, false},
+    [LS_STATE_ERROR_TILT] = {"error_tilt", _ls_state_error_tilt, _ls_state_error_tilt_entry, NULL, false},
+    [LS_STATE_ERROR_NOACCEL] = {"error_noaccel", _ls_state_error_noaccel, _ls_state_error_noaccel_entry, NULL, false},
+};
+
+/**
+ * @brief Events that mean the same thing in every state that accepts global transitions
+ */
+static const struct
+{
+    enum ls_event_t type;
+    enum ls_state_id successor;
+} _ls_state_global_transitions[] = {
+    {LSEVT_TILT_DETECTED, LS_STATE_ERROR_TILT},
+};
+
+const char *ls_state_name(enum ls_state_id state)
+{
+    return state < LS_STATE_COUNT ? _ls_state_table[state].name : "none";
+}
+
+/**
+ * @brief Run exit of the current state and entry of the next until some state stays put.
+ * Entry hooks may redirect; the hop limit keeps a bad table from looping forever.
+ */
+static void _ls_state_transition(enum ls_state_id successor)
+{
+    for (int hops = 0; successor != ls_state_current && hops < LS_STATE_COUNT; hops++)
+    {
+        if (ls_state_current < LS_STATE_COUNT && NULL != _ls_state_table[ls_state_current].exit)
+        {
+            _ls_state_table[ls_state_current].exit();
+        }
+#ifdef LSDEBUG_STATES
+        ls_debug_printf("State %s => %s\n", ls_state_name(ls_state_current), ls_state_name(successor));
+#endif
+        // deadlines belong to the state that set them
+        _ls_state_deadline_set = false;
+        ls_state_previous = ls_state_current;
+        ls_state_current = successor;
+#ifdef LS_SCENARIO_ENABLE
+        ls_scenario_record_transition(ls_state_previous, successor);
+#endif
+        if (NULL != _ls_state_table[successor].entry)
+        {
+            successor = _ls_state_table[successor].entry();
+        }
+    }
+}
+
+static enum ls_state_id _ls_state_dispatch(ls_event event)
+{
+    const struct ls_state_table_entry *state = &_ls_state_table[ls_state_current];
+    if (state->global)
+    {
+        for (int i = 0; i < sizeof(_ls_state_global_transitions) / sizeof(_ls_state_global_transitions[0]); i++)
+        {
+            if (_ls_state_global_transitions[i].type == event.type)
+            {
+                return _ls_state_global_transitions[i].successor;
+            }
+        }
+    }
+    return NULL == state->handler ? ls_state_current : state->handler(event);
+}
+
+/**
+ * @brief Checks the event queue and dispatches to current state function
+ *
+ * Blocks until an event arrives or the current state's deadline (if any) is due.
+ * Set ls_state_current to the initial state before starting this task.
+ *
+ * @link https://controllerstech.com/freertos-tutorial-5-using-queue/
+ *
+ * @param pvParameter
+ */
+void event_handler_state_machine(void *pvParameter)
+{
+    ls_event event;
+    enum ls_state_id initial = ls_state_current;
+
+    ls_state_current = LS_STATE_COUNT; // nothing to exit
+    _ls_state_transition(initial);
+
+    while (1)
+    {
+        if (ls_event_receive(&event, _ls_state_ticks_until_deadline()) != pdTRUE)
+        {
+            if (!_ls_state_deadline_set)
+            {
+                continue;
+            }
+            // deadline is due and nothing else is waiting
+            _ls_state_deadline_set = false;
+            event = ls_event_new(LSEVT_STATE_DEADLINE);
+        }
+#ifdef LSDEBUG_STATES
+        ls_debug_printf("Received event %d in state %s\n", event.type, ls_state_name(ls_state_current));
+#endif
+#if defined(LS_EVENTSTATS_ENABLE) || defined(LS_SCENARIO_ENABLE)
+        int64_t dispatched_us = esp_timer_get_time();
+#endif
+#ifdef LS_SCENARIO_ENABLE
+        enum ls_state_id dispatched_in = ls_state_current;
+#endif
+        _ls_state_transition(_ls_state_dispatch(event));
+#ifdef LS_EVENTSTATS_ENABLE
+        ls_eventstats_record(&event, dispatched_us, esp_timer_get_time());
+#endif
+#ifdef LS_SCENARIO_ENABLE
+        ls_scenario_record_dispatch(&event, dispatched_in, dispatched_us, esp_timer_get_time());
+#endif
+    } // while 1 -- task must not exit
 }
\ No newline at end of file
@@ -18,10 +18,24 @@
 #pragma once
 #include "events.h"
 
-// see http://c-faq.com/decl/recurfuncp.html
-// "Q: How can I declare a function that can return a pointer to a function of the same type? I'm building a state machine with one function for each state.... "
-typedef int (*ls_state_funcptr)(ls_event);	  /* generic function pointer */
-typedef ls_state_funcptr (*_ls_state_funcptr)(ls_event);  /* ptr to ls_state fcn taking event and returning g.f.p. */
+enum ls_state_id
+{
+    LS_STATE_POWERON,
+    LS_STATE_SELFTEST,
+    LS_STATE_SETTINGS,
+    LS_STATE_SECONDARY_SETTINGS,
+    LS_STATE_SLEEP,
+    LS_STATE_WAKEUP,
+    LS_STATE_PRELASERWARN,
+    LS_STATE_ACTIVE,
+    LS_STATE_HOME,
+    LS_STATE_MAP_BUILD,
+    LS_STATE_ERROR_HOME,
+    LS_STATE_ERROR_MAP,
+    LS_STATE_ERROR_TILT,
+    LS_STATE_ERROR_NOACCEL,
+    LS_STATE_COUNT, // number of states; also "no state" before the machine starts
+};
 
 void event_handler_state_machine(void *pvParameter);
 
@@ -31,46 +45,38 @@ void event_handler_state_machine(void *pvParameter);
  */
 void ls_state_init(void);
 
-typedef struct ls_State {
-    struct ls_State (*func)(ls_event);
-}ls_State;
-
-ls_State ls_state_current, ls_state_previous;
+/**
+ * @brief Set to the initial state before starting event_handler_state_machine; thereafter read-only outside states.c
+ */
+extern enum ls_state_id ls_state_current, ls_state_previous;
 
-ls_State ls_state_poweron(ls_event);
-ls_State ls_state_selftest(ls_event);
-ls_State ls_state_settings(ls_event);
-ls_State ls_state_secondary_settings(ls_event);
-ls_State ls_state_sleep(ls_event);
-ls_State ls_state_wakeup(ls_event);
+const char *ls_state_name(enum ls_state_id state);
 
-ls_State ls_state_prelaserwarn(ls_event);
+/**
+ * @brief Ask for an LSEVT_STATE_DEADLINE to be delivered to the current state after this long
+ * unless some other event arrives first (queued events are always handled before a due deadline).
+ * Setting a new deadline replaces any previous one; changing state clears it.
+ *
+ * @param ms 0 to be called back as soon as the queue is empty
+ */
+void ls_state_set_deadline_ms(uint32_t ms);
+void ls_state_clear_deadline(void);
 
 /**
- * @brief Default if not called is ls_state_active. 
+ * @brief Default if not called is LS_STATE_ACTIVE. 
  * 
  * typical use:
- *         ls_state_set_prelaserwarn_successor(&ls_state_settings);
- *         successor.func = ls_state_prelaserwarn;
+ *         ls_state_set_prelaserwarn_successor(LS_STATE_SETTINGS);
+ *         successor = LS_STATE_PRELASERWARN;
  * 
  */
-void ls_state_set_prelaserwarn_successor(void*);
-ls_State ls_state_active(ls_event);
+void ls_state_set_prelaserwarn_successor(enum ls_state_id successor);
 /**
- * @brief Default if not called is ls_state_active. 
+ * @brief Default if not called is LS_STATE_ACTIVE. 
  * 
  * typical use:
- *         ls_state_set_home_successor(&ls_state_map_build);
- *         successor.func = ls_state_home;
+ *         ls_state_set_home_successor(LS_STATE_MAP_BUILD);
+ *         successor = LS_STATE_HOME;
  * 
  */
-void ls_state_set_home_successor(void*);
-ls_State ls_state_home(ls_event);
-
-ls_State ls_state_map_build(ls_event);
-ls_State ls_state_map_build_substate_home(ls_event);
-
-ls_State ls_state_error_home(ls_event);
-ls_State ls_state_error_map(ls_event);
-ls_State ls_state_error_tilt(ls_event);
-ls_State ls_state_error_noaccel(ls_event);
+void ls_state_set_home_successor(enum ls_state_id successor);
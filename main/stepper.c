@@ -35,6 +35,7 @@
 #include "util.h"
 #include "settings.h"
 #include "math.h"
+#include "vibration.h"
 
 #define LS_STEPPER_TIMER_DIVIDER (20)
 // see https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/peripherals/timer.html
@@ -59,6 +60,8 @@ volatile static BaseType_t IRAM_ATTR _ls_stepperstep_phase = 0;
 
 enum ls_stepper_direction_t IRAM_ATTR ls_stepper_direction = LS_STEPPER_ACTION_FORWARD_STEPS;
 static bool _ls_stepper_enable_skipping = false;
+// set by a strategy that has timed its move (a path segment) so the speed it chose must hold throughout
+static bool _ls_stepper_move_is_timed = false;
 static int _ls_stepper_steps_per_second_max = LS_STEPPER_STEPS_PER_SECOND_DEFAULT;
 
 static int _ls_stepper_speed_when_skipping = LS_STEPPER_STEPS_PER_SECOND_MAX;
@@ -67,6 +70,13 @@ static int _ls_stepper_speed_current_rate = LS_STEPPER_STEPS_PER_SECOND_MIN;
 
 static uint8_t _ls_stepper_random_reverse_per255 = LS_STEPPER_MOVEMENT_REVERSE_PER255;
 
+// bookkeeping for reporting how much time the gap sprints save compared to crossing at sweep speed
+static ls_stepper_position_t _ls_stepper_gap_last_position = 0;
+static int32_t _ls_stepper_gap_rotation_steps = 0;
+static int64_t _ls_stepper_gap_actual_us = 0;
+static int64_t _ls_stepper_gap_baseline_us = 0;
+static int32_t _ls_stepper_gap_saved_ms_per_rotation = 0;
+
 // how many steps it will take to decelerate from full speed
 static int _ls_stepper_steps_to_decelerate(int current_rate)
 {
@@ -127,10 +137,8 @@ static bool IRAM_ATTR ls_stepper_step_isr_callback(void *args)
             ls_stepper_steps_taken++;
             if (ls_stepper_steps_remaining == 0)
             {
-                ls_event event;
-                event.type = LSEVT_STEPPER_FINISHED_MOVE;
-                event.value = 0;
-                xQueueSendToFrontFromISR(ls_event_queue, (void *)&event, NULL);
+                ls_event event = ls_event_new(LSEVT_STEPPER_FINISHED_MOVE);
+                ls_event_send_to_front_from_isr(&event, &high_task_awoken);
             }
         }
     }
@@ -167,12 +175,74 @@ void ls_stepper_init(void)
     ESP_ERROR_CHECK(timer_start(TIMER_GROUP_0, TIMER_0));
 }
 
+/**
+ * @brief Speed limit while crossing a disabled gap
+ *
+ * Sprint as fast as allowed, but no faster than would let us decelerate (at the usual rate)
+ * to exactly the sweep speed by the edge of the next span: v^2 = v_sweep^2 + 2ad. The distance
+ * we will cover before the next tick is subtracted because the limit is only revised once per tick.
+ *
+ * @param gap_steps steps until the laser is next enabled in the current direction
+ * @return int steps/second cap
+ */
+static int _ls_stepper_gap_sprint_cap(ls_stepper_position_t gap_steps)
+{
+    int32_t braking_steps = gap_steps - _ls_stepper_speed_current_rate * portTICK_PERIOD_MS / 1000;
+    if (braking_steps <= 0)
+    {
+        return _ls_stepper_speed_not_skipping;
+    }
+    uint32_t v_squared = (uint32_t)_ls_stepper_speed_not_skipping * _ls_stepper_speed_not_skipping +
+                         2UL * LS_STEPPER_MOVEMENT_STEPS_DELTA_PER_SECOND * braking_steps;
+    return _constrain(_isqrt(v_squared), _ls_stepper_speed_not_skipping, _ls_stepper_speed_when_skipping);
+}
+
+/**
+ * @brief Accumulate gap transit time (actual vs. at sweep speed) and latch the savings once per rotation
+ *
+ * @param in_gap whether the position at the start of this tick was in a disabled gap
+ */
+static void _ls_stepper_gap_account(bool in_gap)
+{
+    ls_stepper_position_t position = ls_stepper_position;
+    int32_t moved = position - _ls_stepper_gap_last_position;
+    _ls_stepper_gap_last_position = position;
+    if (moved > LS_STEPPER_STEPS_PER_ROTATION / 2)
+    {
+        moved -= LS_STEPPER_STEPS_PER_ROTATION;
+    }
+    if (moved < -LS_STEPPER_STEPS_PER_ROTATION / 2)
+    {
+        moved += LS_STEPPER_STEPS_PER_ROTATION;
+    }
+    moved = abs(moved);
+    if (in_gap && moved > 0)
+    {
+        _ls_stepper_gap_actual_us += portTICK_PERIOD_MS * 1000;
+        _ls_stepper_gap_baseline_us += (int64_t)moved * 1000000 / _ls_stepper_speed_not_skipping;
+    }
+    _ls_stepper_gap_rotation_steps += moved;
+    if (_ls_stepper_gap_rotation_steps >= LS_STEPPER_STEPS_PER_ROTATION)
+    {
+        _ls_stepper_gap_saved_ms_per_rotation = (int32_t)((_ls_stepper_gap_baseline_us - _ls_stepper_gap_actual_us) / 1000);
+#ifdef LSDEBUG_STEPPER
+        ls_debug_printf("Gap transits: %lldms at sweep speed; %lldms actual; saved %dms this rotation\n",
+                        _ls_stepper_gap_baseline_us / 1000, _ls_stepper_gap_actual_us / 1000, _ls_stepper_gap_saved_ms_per_rotation);
+#endif
+        _ls_stepper_gap_rotation_steps = 0;
+        _ls_stepper_gap_actual_us = 0;
+        _ls_stepper_gap_baseline_us = 0;
+    }
+}
+
 static void _ls_stepper_set_speed(void)
 {
-    // if doing random movements and outside a span, allow faster movement (skipping)
-    if (_ls_stepper_enable_skipping)
+    // if doing random movements and outside a span, sprint across the gap and arrive at the next span at sweep speed
+    if (_ls_stepper_enable_skipping && !_ls_stepper_move_is_timed)
     {
-        ls_stepper_set_maximum_steps_per_second(ls_map_is_enabled_at(ls_stepper_position) ? _ls_stepper_speed_not_skipping : _ls_stepper_speed_when_skipping);
+        ls_stepper_position_t gap_steps = ls_map_steps_to_enabled(ls_stepper_position, ls_stepper_direction);
+        ls_stepper_set_maximum_steps_per_second(gap_steps > 0 ? _ls_stepper_gap_sprint_cap(gap_steps) : _ls_stepper_speed_not_skipping);
+        _ls_stepper_gap_account(gap_steps > 0);
     }
     int steps_to_decelerate = _ls_stepper_steps_to_decelerate(_ls_stepper_speed_current_rate);
 
@@ -300,6 +370,7 @@ void ls_stepper_task(void *pvParameter)
             if (ls_stepper_steps_remaining <= 0)
             {
                 // invoke the current move strategy
+                _ls_stepper_move_is_timed = false;
                 (*_ls_stepper_random_strategy)(&ls_stepper_move);
                 ls_stepper_direction = ls_stepper_move.direction;
                 ls_stepper_steps_remaining = ls_stepper_move.steps;
@@ -375,6 +446,7 @@ void ls_stepper_random(void)
     if (_ls_stepper_enable_skipping)
     {
         _ls_stepper_speed_not_skipping = _ls_stepper_steps_per_second_max;
+        _ls_stepper_gap_last_position = ls_stepper_position;
     }
     ls_stepper_action_message message;
     message.action = LS_STEPPER_ACTION_RANDOM;
@@ -418,6 +490,11 @@ bool ls_stepper_is_stopped(void)
     return 0 == ls_stepper_steps_remaining;
 }
 
+int ls_stepper_get_steps_per_second(void)
+{
+    return ls_stepper_is_stopped() ? 0 : _ls_stepper_speed_current_rate;
+}
+
 BaseType_t ls_stepper_get_steps_taken(void)
 {
     return ls_stepper_steps_taken;
@@ -428,6 +505,27 @@ void ls_stepper_set_random_reverse_per255(uint8_t value)
     _ls_stepper_random_reverse_per255 = value;
 }
 
+/**
+ * @brief Set the speed for the move a random strategy is about to return (e.g., a path segment)
+ * and hold it for the whole move: no gap sprint, since the strategy has timed the move.
+ *
+ * @return the speed actually used after resonance avoidance and limits, so the caller can retime
+ */
+int ls_stepper_set_timed_steps_per_second(int steps_per_second)
+{
+#ifdef LS_VIBRATION_ENABLE
+    steps_per_second = ls_vibration_avoid_resonance(steps_per_second);
+#endif
+    ls_stepper_set_maximum_steps_per_second(steps_per_second);
+    _ls_stepper_move_is_timed = true;
+    return _ls_stepper_steps_per_second_max;
+}
+
+int32_t ls_stepper_get_gap_time_saved_ms_per_rotation(void)
+{
+    return _ls_stepper_gap_saved_ms_per_rotation;
+}
+
 #ifdef LSDEBUG_STEPPER
 void ls_stepper_debug_task(void *pvParameter)
 {
@@ -74,6 +74,10 @@ bool ls_stepper_is_stopped(void);
 enum ls_stepper_direction_t ls_stepper_get_direction();
 
 BaseType_t ls_stepper_get_steps_taken(void);
+/**
+ * @brief current step rate, or 0 while stopped
+ */
+int ls_stepper_get_steps_per_second(void);
 
 ls_stepper_position_t ls_stepper_get_position(void);
 void ls_stepper_set_home_position(void);
@@ -86,10 +90,12 @@ void ls_stepper_random(void);
 void ls_stepper_sleep(void);
 
 void ls_stepper_set_random_reverse_per255(uint8_t value);
+int32_t ls_stepper_get_gap_time_saved_ms_per_rotation(void);
 
 #define ls_stepper_off() ls_stepper_sleep()
 
 void ls_stepper_set_maximum_steps_per_second(int);
+int ls_stepper_set_timed_steps_per_second(int steps_per_second);
 
 #ifdef LSDEBUG_STEPPER
 void ls_stepper_debug_task(void *pvParameter);
@@ -23,8 +23,8 @@
 #include "buzzer.h"
 #include "magnet.h"
 #include "map.h"
+#include "states.h"
 
-extern QueueHandle_t ls_event_queue;
 extern SemaphoreHandle_t print_mux;
 
 /**
@@ -47,6 +47,7 @@ enum
 
 static int _ls_home_attempts = 0;
 static bool _ls_home_found_magnet = false;
+static bool _ls_home_found_stopped = false; // by one deadline while waiting for no steps
 
 static int _ls_home_homing_offsets[LS_HOME_HOMINGS_TO_AVERAGE];
 static int _ls_home_homing_index = 0;
@@ -66,7 +67,8 @@ void ls_substate_home_init()
     _ls_home_attempts = 0;
     _ls_home_homing_index = 0;
     _ls_substate_home_substate_phase = LS_HOME_SUBSTATE_WAIT_FOR_NO_STEPS;
-    ls_event_enqueue(LSEVT_SUBSTATE_ENTRY);
+    // called from a state's entry, so the deadline belongs to that state; it starts the stop check
+    ls_state_set_deadline_ms(0);
 }
 
 /**
@@ -112,16 +114,16 @@ static void _ls_substate_home_slow_to_magnet(ls_event event)
         break;
     case LSEVT_MAGNET_ENTER:
 #ifdef LSDEBUG_HOMING
-        ls_debug_printf("Slow step found magnet at offset %d.\n", (int)event.value);
+        ls_debug_printf("Slow step found magnet at offset %d.\n", event.value.position);
 #endif
         ls_stepper_stop();
         /* if offset exceeds threshold, we will need to reset home position (might already be doig that; it's okay to set true twice!)*/
-        if ((int)event.value > LS_HOME_OFFSET_THRESHOLD_TO_REHOME || -((int)event.value) > LS_HOME_OFFSET_THRESHOLD_TO_REHOME)
+        if (event.value.position > LS_HOME_OFFSET_THRESHOLD_TO_REHOME || -(event.value.position) > LS_HOME_OFFSET_THRESHOLD_TO_REHOME)
         {
             _ls_home_homing_required = true;
         }
         _ls_home_found_magnet = true;
-        _ls_substate_magnet_entry_offset = (int) event.value;
+        _ls_substate_magnet_entry_offset = event.value.position;
         break;
     case LSEVT_STEPPER_FINISHED_MOVE:
         if (_ls_home_found_magnet)
@@ -190,7 +192,7 @@ static void _ls_substate_home_rotate_to_magnet(ls_event event)
     case LSEVT_MAGNET_ENTER:
         _ls_home_found_magnet = true; // found magnet
         ls_stepper_stop();
-        _ls_substate_magnet_entry_offset = (ls_stepper_position_t)event.value;
+        _ls_substate_magnet_entry_offset = event.value.position;
 #ifdef LSDEBUG_HOMING
         ls_debug_printf("Found magnet in initial rotation(s).\n");
         if (ls_stepper_get_steps_taken() > ((5 * LS_STEPPER_STEPS_PER_ROTATION) / 4))
@@ -219,22 +221,27 @@ static void _ls_substate_home_rotate_to_magnet(ls_event event)
 }
 
 /**
- * This is a rather awkward method that can cause problems.
  * Use only on first entry to homing in case the stepper is already stopped
  * and there is not going to be any LSEVT_STEPPER_FINISHED_MOVE
- * (e.g., power-on or wake)
+ * (e.g., power-on or wake). Polls with a state deadline rather than blocking.
+ * The step ISR reports stopped as soon as the last step ends and only then queues
+ * LSEVT_STEPPER_FINISHED_MOVE (possibly on the other core), so one deadline finding
+ * the stepper stopped does not prove that event has been seen. A second deadline
+ * LS_STATE_SETTLE_POLL_MS later does: the ISR will have finished by then, and deadlines
+ * are only delivered to an empty queue, so any trailing finish event has been ignored here.
  */
-static void _ls_substate_home_wait_for_stop(void)
+static void _ls_substate_home_wait_for_stop(ls_event event)
 {
+    if (LSEVT_STATE_DEADLINE != event.type || ls_stepper_is_moving() || !_ls_home_found_stopped)
+    {
+        _ls_home_found_stopped = LSEVT_STATE_DEADLINE == event.type && !ls_stepper_is_moving();
 #ifdef LSDEBUG_HOMING
-    ls_debug_printf(ls_stepper_is_moving() ? "Waiting to stop...\n" : "Already stopped...\n");
+        ls_debug_printf(ls_stepper_is_moving() ? "Waiting to stop...\n" : "Checking stopped...\n");
 #endif
-    while (ls_stepper_is_moving())
-    {
-        vTaskDelay(1);
+        ls_state_set_deadline_ms(_ls_home_found_stopped || ls_stepper_is_moving() ? LS_STATE_SETTLE_POLL_MS : 0);
+        return;
     }
-    // a pending LSEVT_STEPPER_FINISHED_MOVE would confuse homing
-    ls_event_empty_queue();
+    _ls_home_found_stopped = false;
     _ls_substate_home_substate_phase = LS_HOME_SUBSTATE_ROTATE_TO_MAGNET;
     ls_event_enqueue(LSEVT_SUBSTATE_ENTRY);
 }
@@ -268,7 +275,7 @@ void ls_substate_home_handle_event(ls_event event)
     switch (_ls_substate_home_substate_phase)
     {
     case LS_HOME_SUBSTATE_WAIT_FOR_NO_STEPS:
-        _ls_substate_home_wait_for_stop();
+        _ls_substate_home_wait_for_stop(event);
         break;
     case LS_HOME_SUBSTATE_ROTATE_TO_MAGNET:
         _ls_substate_home_rotate_to_magnet(event);
@@ -22,46 +22,155 @@
 #include "driver/gpio.h"
 #include "esp_adc_cal.h"
 #include "buzzer.h"
+#include "adcstream.h"
+#include "adccal.h"
+#include "esp_timer.h"
+#include "events.h"
 
-extern SemaphoreHandle_t adc1_mux;
 static bool _ls_tape_sensor_enabled = false;
 
 bool ls_tape_sensor_is_enabled(void)
 {
     return _ls_tape_sensor_enabled;
 }
-uint32_t ls_tape_sensor_read(void)
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+#if LS_ADCSTREAM_PERIOD_US < LS_TAPE_DIFFERENTIAL_SETTLE_US
+#error "the emitter settles for one ADC stream period; LS_ADCSTREAM_PERIOD_US is too short"
+#endif
+#endif
+
+// the request from ls_tape_sensor_request_samples(), checked by the state machine task when
+// made and by the ADC stream's esp_timer callbacks as samples arrive; whoever finds it
+// satisfied first clears it and posts LSEVT_TAPE_SAMPLES_READY
+static bool _ls_tape_samples_requested = false;
+static int64_t _ls_tape_samples_since_us;
+static portMUX_TYPE _ls_tape_samples_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static bool _ls_tape_samples_subscribed = false;
+
+/**
+ * @brief whether every reflectance channel in use holds LS_ADCSTREAM_READ_AVERAGE samples taken at or after since_us
+ */
+static bool _ls_tape_samples_are_fresh(int64_t since_us)
+{
+    if (ls_adcstream_count_since(LS_ADCSTREAM_REFLECTANCE, since_us, LS_ADCSTREAM_READ_AVERAGE) < LS_ADCSTREAM_READ_AVERAGE)
+    {
+        return false;
+    }
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+    return ls_adcstream_count_since(LS_ADCSTREAM_REFLECTANCE_AMBIENT, since_us, LS_ADCSTREAM_READ_AVERAGE) >= LS_ADCSTREAM_READ_AVERAGE;
+#else
+    return true;
+#endif
+}
+
+static void _ls_tape_samples_check(void)
+{
+    taskENTER_CRITICAL(&_ls_tape_samples_spinlock);
+    bool requested = _ls_tape_samples_requested;
+    int64_t since_us = _ls_tape_samples_since_us;
+    taskEXIT_CRITICAL(&_ls_tape_samples_spinlock);
+    if (!requested || !_ls_tape_samples_are_fresh(since_us))
+    {
+        return;
+    }
+    taskENTER_CRITICAL(&_ls_tape_samples_spinlock);
+    // unless it was already answered, cancelled or replaced meanwhile
+    bool post = _ls_tape_samples_requested && since_us == _ls_tape_samples_since_us;
+    if (post)
+    {
+        _ls_tape_samples_requested = false;
+    }
+    taskEXIT_CRITICAL(&_ls_tape_samples_spinlock);
+    if (post)
+    {
+        ls_event event = ls_event_new(LSEVT_TAPE_SAMPLES_READY);
+        ls_event_send(&event, 0);
+    }
+}
+
+static void _ls_tape_sample_callback(enum ls_adcstream_channel_t channel, ls_adcstream_sample_t sample, void *arg)
+{
+    _ls_tape_samples_check();
+}
+
+void ls_tape_sensor_request_samples(int64_t since_us)
+{
+    if (!_ls_tape_samples_subscribed)
+    {
+        // subscriptions are permanent; if one cannot be had, the caller's timeout stands in
+        _ls_tape_samples_subscribed = true;
+        ls_adcstream_subscribe(LS_ADCSTREAM_REFLECTANCE, &_ls_tape_sample_callback, NULL);
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+        ls_adcstream_subscribe(LS_ADCSTREAM_REFLECTANCE_AMBIENT, &_ls_tape_sample_callback, NULL);
+#endif
+    }
+    taskENTER_CRITICAL(&_ls_tape_samples_spinlock);
+    _ls_tape_samples_requested = true;
+    _ls_tape_samples_since_us = since_us;
+    taskEXIT_CRITICAL(&_ls_tape_samples_spinlock);
+    // they may all be here already
+    _ls_tape_samples_check();
+}
+
+static void _ls_tape_sensor_acquire(ls_tape_reading_t *reading)
+{
+    reading->lit = ls_adcstream_read_average(LS_ADCSTREAM_REFLECTANCE, LS_ADCSTREAM_READ_AVERAGE);
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+    reading->ambient = ls_adcstream_read_average(LS_ADCSTREAM_REFLECTANCE_AMBIENT, LS_ADCSTREAM_READ_AVERAGE);
+#else
+    reading->ambient = LS_TAPE_DARK_RAW;
+#endif
+    int32_t reflectance = (int32_t)reading->lit + (LS_TAPE_DARK_RAW - (int32_t)reading->ambient);
+    reading->reflectance = reflectance < 0 ? 0 : (reflectance > LS_TAPE_DARK_RAW ? LS_TAPE_DARK_RAW : reflectance);
+}
+
+void ls_tape_sensor_read_differential(ls_tape_reading_t *reading)
 {
     bool was_disabled = ! ls_tape_sensor_is_enabled();
     if(was_disabled) 
     {
         ls_tape_sensor_enable();
+        // samples from before the sensor was powered mean nothing; give the sampler time for
+        // a full average on each channel (only tasks other than the state machine read this way)
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+        vTaskDelay(pdMS_TO_TICKS(2 * LS_ADCSTREAM_READ_AVERAGE * LS_ADCSTREAM_PERIOD_US / 1000) + 1);
+#else
+        vTaskDelay(pdMS_TO_TICKS(LS_ADCSTREAM_READ_AVERAGE * LS_ADCSTREAM_PERIOD_US / 1000) + 1);
+#endif
     }
-    xSemaphoreTake(adc1_mux, portMAX_DELAY);
-    adc1_config_width(ADC_WIDTH_BIT_12);
-    adc1_config_channel_atten(LSADC1_REFLECTANCESENSE, ADC_ATTEN_DB_11);
-    uint32_t adc_reading = 0;
-    for (int i = 0; i < 4; i++)
-    {
-        adc_reading += adc1_get_raw((adc1_channel_t)LSADC1_REFLECTANCESENSE);
-    }
-    adc_reading /= 4;
-    xSemaphoreGive(adc1_mux);
+    _ls_tape_sensor_acquire(reading);
     if(was_disabled)
     {
         ls_tape_sensor_disable();
     }
-    return (int) adc_reading;
+}
+
+uint32_t ls_tape_sensor_read(void)
+{
+    ls_tape_reading_t reading;
+    ls_tape_sensor_read_differential(&reading);
+    return reading.reflectance;
 }
 
 void ls_tape_sensor_enable(void)
 {
     gpio_set_level(LSGPIO_REFLECTANCEENABLE, 1);
     _ls_tape_sensor_enabled = true;
+    ls_adcstream_set_reflectance_sampling(true);
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+    ls_adcstream_set_emitter_modulation(true);
+#endif
 }
 
 void ls_tape_sensor_disable(void)
 {
+    taskENTER_CRITICAL(&_ls_tape_samples_spinlock);
+    _ls_tape_samples_requested = false;
+    taskEXIT_CRITICAL(&_ls_tape_samples_spinlock);
+#ifdef LS_TAPE_DIFFERENTIAL_ENABLE
+    ls_adcstream_set_emitter_modulation(false);
+#endif
+    ls_adcstream_set_reflectance_sampling(false);
     gpio_set_level(LSGPIO_REFLECTANCEENABLE, 0);
     _ls_tape_sensor_enabled = false;
 }
@@ -69,15 +178,15 @@ void ls_tape_sensor_disable(void)
 void ls_tape_sensor_selftest_task(void *pvParameter)
 {
     ls_tape_sensor_enable();
-    uint32_t last_tape_reading = ls_tape_sensor_read();
+    uint32_t last_tape_reading = ls_adccal_raw_to_mv(ls_tape_sensor_read());
     while (1)
     {
-        int tape_reading = ls_tape_sensor_read();
-        if(tape_reading < LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET && last_tape_reading >= LS_REFLECTANCE_ADC_MAX_WHITE_BUCKET)
+        int tape_reading = ls_adccal_raw_to_mv(ls_tape_sensor_read());
+        if(tape_reading < LS_REFLECTANCE_MV_MAX_WHITE_BUCKET && last_tape_reading >= LS_REFLECTANCE_MV_MAX_WHITE_BUCKET)
         {
             ls_buzzer_effect(LS_BUZZER_PLAY_ROOT);
         }
-        if(tape_reading > LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET && last_tape_reading <= LS_REFLECTANCE_ADC_MIN_BLACK_BUCKET)
+        if(tape_reading > LS_REFLECTANCE_MV_MIN_BLACK_BUCKET && last_tape_reading <= LS_REFLECTANCE_MV_MIN_BLACK_BUCKET)
         {
             ls_buzzer_effect(LS_BUZZER_PLAY_OCTAVE);
         }
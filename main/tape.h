@@ -21,6 +21,31 @@
 
 void ls_tape_sensor_enable(void);
 void ls_tape_sensor_disable(void);
+/**
+ * @brief reflectance reading in raw ADC counts; with LS_TAPE_DIFFERENTIAL_ENABLE, ambient
+ * light is rejected as in ls_tape_sensor_read_differential()
+ */
 uint32_t ls_tape_sensor_read(void);
+/**
+ * @brief ask for a LSEVT_TAPE_SAMPLES_READY event once a reading would average only samples
+ * taken at or after since_us (e.g., when the arm stopped moving); the sensor must be enabled.
+ * Never blocks: the ADC stream's sample callbacks post the event, possibly before this returns.
+ * A newer request replaces an older one, and disabling the sensor cancels it.
+ */
+void ls_tape_sensor_request_samples(int64_t since_us);
+
+typedef struct ls_tape_reading_t {
+    uint32_t lit;         // emitter on
+    uint32_t ambient;     // emitter off
+    uint32_t reflectance; // lit with the ambient light's contribution removed
+} ls_tape_reading_t;
+
+/**
+ * @brief read with the emitter on and off. More light pulls the sensor output down, so
+ * ambient light's contribution is how far the emitter-off reading falls below
+ * LS_TAPE_DARK_RAW; adding that back to the lit reading leaves the emitter's reflection.
+ * Without LS_TAPE_DIFFERENTIAL_ENABLE, ambient is reported as LS_TAPE_DARK_RAW.
+ */
+void ls_tape_sensor_read_differential(ls_tape_reading_t *reading);
 bool ls_tape_sensor_is_enabled(void);
 void ls_tape_sensor_selftest_task(void *pvParameter);
\ No newline at end of file
@@ -25,30 +25,32 @@
 #include <stdlib.h>
 #include "freertos/semphr.h"
 #include "esp_adc_cal.h"
+#include "adcstream.h"
+#include "adccal.h"
 
-extern SemaphoreHandle_t adc1_mux;
 extern SemaphoreHandle_t print_mux;
 static enum ls_tapemode_mode _ls_tapemode = LS_TAPEMODE_NOT_INITIALIZED;
 
 static enum ls_tapemode_mode ls_tapemode_from_adc(uint32_t adc_reading)
 {
-    if (adc_reading > LS_TAPEMODE_THRESHOLD_5)
+    uint32_t mv = ls_adccal_raw_to_mv(adc_reading);
+    if (mv > LS_TAPEMODE_THRESHOLD_MV_5)
     {
         return LS_TAPEMODE_REFLECT_SAFE;
     }
-    if (adc_reading > LS_TAPEMODE_THRESHOLD_4)
+    if (mv > LS_TAPEMODE_THRESHOLD_MV_4)
     {
         return LS_TAPEMODE_REFLECT;
     }
-    if (adc_reading > LS_TAPEMODE_THRESHOLD_3)
+    if (mv > LS_TAPEMODE_THRESHOLD_MV_3)
     {
         return LS_TAPEMODE_IGNORE;
     }
-    if (adc_reading > LS_TAPEMODE_THRESHOLD_2)
+    if (mv > LS_TAPEMODE_THRESHOLD_MV_2)
     {
         return LS_TAPEMODE_BLACK;
     }
-    if (adc_reading > LS_TAPEMODE_THRESHOLD_1)
+    if (mv > LS_TAPEMODE_THRESHOLD_MV_1)
     {
         return LS_TAPEMODE_BLACK_SAFE;
     }
@@ -67,17 +69,7 @@ enum ls_tapemode_mode ls_tapemode(void)
 
 enum ls_tapemode_mode ls_tapemode_current(void)
 {
-    xSemaphoreTake(adc1_mux, portMAX_DELAY);
-    adc1_config_width(ADC_WIDTH_BIT_12);
-    adc1_config_channel_atten(LSADC1_TAPESETTING, ADC_ATTEN_DB_11);
-    uint32_t adc_reading = 0;
-    for (int i = 0; i < 4; i++)
-    {
-        adc_reading += adc1_get_raw((adc1_channel_t)LSADC1_TAPESETTING);
-    }
-    adc_reading /= 4;
-    xSemaphoreGive(adc1_mux);
-    return ls_tapemode_from_adc(adc_reading);
+    return ls_tapemode_from_adc(ls_adcstream_read_average(LS_ADCSTREAM_TAPESETTING, LS_ADCSTREAM_READ_AVERAGE));
 }
 
 void ls_tapemode_selftest_task(void *pvParameter)
@@ -112,18 +104,9 @@ void ls_tapemode_debug_task(void *pvParameter)
 {
     while (1)
     {
-        xSemaphoreTake(adc1_mux, portMAX_DELAY);
-        adc1_config_width(ADC_WIDTH_BIT_12);
-        adc1_config_channel_atten(LSADC1_TAPESETTING, ADC_ATTEN_DB_11);
-        uint32_t adc_reading = 0;
-        for (int i = 0; i < 4; i++)
-        {
-            adc_reading += adc1_get_raw((adc1_channel_t)LSADC1_TAPESETTING);
-        }
-        adc_reading /= 4;
-        xSemaphoreGive(adc1_mux);
+        uint32_t adc_reading = ls_adcstream_read_average(LS_ADCSTREAM_TAPESETTING, LS_ADCSTREAM_READ_AVERAGE);
         xSemaphoreTake(print_mux, portMAX_DELAY);
-        printf("Tape mode %d (raw: %d)\n", (int)ls_tapemode_from_adc(adc_reading), adc_reading);
+        printf("Tape mode %d (raw: %d; %dmV)\n", (int)ls_tapemode_from_adc(adc_reading), adc_reading, ls_adccal_raw_to_mv(adc_reading));
         xSemaphoreGive(print_mux);
         vTaskDelay(pdMS_TO_TICKS(5000));
     }
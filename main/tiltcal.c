@@ -0,0 +1,159 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "tiltcal.h"
+#include "debug.h"
+#include "util.h"
+
+// Tilt is judged as the angle between the current orientation and the one captured where the
+// unit is installed, so a slightly off-level mounting no longer eats into the tilt threshold.
+// Angles come from a fixed-point atan2; no floating point per sample.
+
+// caution: NVS keys and namespaces are restricted to 15 characters
+#define LS_TILTCAL_NVS_NAMESPACE "ls_tiltcal"
+#define LS_TILTCAL_NVS_KEY_REFERENCE "reference"
+
+typedef struct ls_tiltcal_reference_t {
+    ls_tiltcal_orientation_t orientation;
+    int32_t tilt_mdeg; // from level
+} ls_tiltcal_reference_t;
+
+static ls_tiltcal_reference_t _ls_tiltcal_reference = {{0, 0}, 0};
+
+/**
+ * @brief atan2 in millidegrees, -180000..180000; within about 0.25 degree
+ */
+int32_t ls_tiltcal_atan2_mdeg(int32_t y, int32_t x)
+{
+    if (0 == x && 0 == y)
+    {
+        return 0;
+    }
+    int32_t ax = abs(x), ay = abs(y);
+    // ratio of the smaller to the larger magnitude in Q15, so 0..1
+    int64_t z = ((int64_t)(ax < ay ? ax : ay) << 15) / (ax < ay ? ay : ax);
+    // atan(z) ~ 45z + 15.64z(1 - z) degrees on 0..1
+    int32_t mdeg = (int32_t)((45000 * z + ((15640 * z * ((1 << 15) - z)) >> 15)) >> 15);
+    if (ay > ax)
+    {
+        mdeg = 90000 - mdeg;
+    }
+    if (x < 0)
+    {
+        mdeg = 180000 - mdeg;
+    }
+    return y < 0 ? -mdeg : mdeg;
+}
+
+void ls_tiltcal_orientation_from_mg(int32_t x_mg, int32_t y_mg, int32_t z_mg, ls_tiltcal_orientation_t *orientation)
+{
+    orientation->pitch_mdeg = ls_tiltcal_atan2_mdeg(x_mg, _isqrt((uint32_t)(y_mg * y_mg + z_mg * z_mg)));
+    orientation->roll_mdeg = ls_tiltcal_atan2_mdeg(y_mg, z_mg);
+}
+
+static int32_t _ls_tiltcal_wrap_mdeg(int32_t mdeg)
+{
+    while (mdeg > 180000)
+    {
+        mdeg -= 360000;
+    }
+    while (mdeg <= -180000)
+    {
+        mdeg += 360000;
+    }
+    return mdeg;
+}
+
+int32_t ls_tiltcal_deviation_mdeg(const ls_tiltcal_orientation_t *orientation)
+{
+    // combined in centidegrees so the sum of squares fits the integer square root
+    int32_t pitch_cdeg = (orientation->pitch_mdeg - _ls_tiltcal_reference.orientation.pitch_mdeg) / 10;
+    int32_t roll_cdeg = _ls_tiltcal_wrap_mdeg(orientation->roll_mdeg - _ls_tiltcal_reference.orientation.roll_mdeg) / 10;
+    return _isqrt((uint32_t)(pitch_cdeg * pitch_cdeg + roll_cdeg * roll_cdeg)) * 10;
+}
+
+bool ls_tiltcal_set_reference_mg(int32_t x_mg, int32_t y_mg, int32_t z_mg)
+{
+    int32_t tilt_mdeg = ls_tiltcal_atan2_mdeg(_isqrt((uint32_t)(x_mg * x_mg + y_mg * y_mg)), z_mg);
+    if (tilt_mdeg > LS_TILT_CALIBRATION_MAX_MDEG)
+    {
+        printf("Tilt calibration rejected: %d millidegrees from level\n", tilt_mdeg);
+        return false;
+    }
+    ls_tiltcal_orientation_from_mg(x_mg, y_mg, z_mg, &_ls_tiltcal_reference.orientation);
+    _ls_tiltcal_reference.tilt_mdeg = tilt_mdeg;
+    printf("Tilt reference: pitch %d, roll %d, %d from level (millidegrees)\n",
+           _ls_tiltcal_reference.orientation.pitch_mdeg, _ls_tiltcal_reference.orientation.roll_mdeg, tilt_mdeg);
+    return true;
+}
+
+void ls_tiltcal_clear_reference(void)
+{
+    _ls_tiltcal_reference.orientation.pitch_mdeg = 0;
+    _ls_tiltcal_reference.orientation.roll_mdeg = 0;
+    _ls_tiltcal_reference.tilt_mdeg = 0;
+}
+
+int32_t ls_tiltcal_get_reference_tilt_mdeg(void)
+{
+    return _ls_tiltcal_reference.tilt_mdeg;
+}
+
+/**
+ * @brief Load the reference orientation from NVS, falling back to level.
+ * NVS must already be initialized (ls_settings_read() does this).
+ */
+void ls_tiltcal_init(void)
+{
+    ls_tiltcal_clear_reference();
+    nvs_handle_t handle;
+    if (ESP_OK != nvs_open(LS_TILTCAL_NVS_NAMESPACE, NVS_READWRITE, &handle))
+    {
+        return;
+    }
+    ls_tiltcal_reference_t reference;
+    size_t length = sizeof(reference);
+    if (ESP_OK == nvs_get_blob(handle, LS_TILTCAL_NVS_KEY_REFERENCE, &reference, &length) && sizeof(reference) == length &&
+        reference.tilt_mdeg >= 0 && reference.tilt_mdeg <= LS_TILT_CALIBRATION_MAX_MDEG)
+    {
+        _ls_tiltcal_reference = reference;
+#ifdef LSDEBUG_TILT
+        ls_debug_printf("Tilt reference loaded: %d millidegrees from level\n", reference.tilt_mdeg);
+#endif
+    }
+    nvs_close(handle);
+}
+
+void ls_tiltcal_save(void)
+{
+    nvs_handle_t handle;
+    if (ESP_OK != nvs_open(LS_TILTCAL_NVS_NAMESPACE, NVS_READWRITE, &handle))
+    {
+        printf("NVS open for tilt calibration FAILED!\n");
+        return;
+    }
+    if (ESP_OK != nvs_set_blob(handle, LS_TILTCAL_NVS_KEY_REFERENCE, &_ls_tiltcal_reference, sizeof(_ls_tiltcal_reference)) ||
+        ESP_OK != nvs_commit(handle))
+    {
+        printf("NVS save of tilt calibration FAILED!\n");
+    }
+    nvs_close(handle);
+}
@@ -0,0 +1,52 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+
+/**
+ * @brief Orientation of the board in millidegrees. Pitch tips the X axis toward gravity;
+ * roll turns about X. A level board reads 0, 0.
+ */
+typedef struct ls_tiltcal_orientation_t {
+    int32_t pitch_mdeg;
+    int32_t roll_mdeg;
+} ls_tiltcal_orientation_t;
+
+void ls_tiltcal_init(void);
+void ls_tiltcal_save(void);
+
+int32_t ls_tiltcal_atan2_mdeg(int32_t y, int32_t x);
+void ls_tiltcal_orientation_from_mg(int32_t x_mg, int32_t y_mg, int32_t z_mg, ls_tiltcal_orientation_t *orientation);
+
+/**
+ * @brief Use an averaged reading taken in the installed position as the reference
+ *
+ * @return false (and no change) if the board is more than LS_TILT_CALIBRATION_MAX_MDEG from level
+ */
+bool ls_tiltcal_set_reference_mg(int32_t x_mg, int32_t y_mg, int32_t z_mg);
+void ls_tiltcal_clear_reference(void);
+/**
+ * @brief how far the reference orientation is from level
+ */
+int32_t ls_tiltcal_get_reference_tilt_mdeg(void);
+
+/**
+ * @brief angular deviation of this orientation from the reference
+ */
+int32_t ls_tiltcal_deviation_mdeg(const ls_tiltcal_orientation_t *orientation);
@@ -15,6 +15,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <stdint.h>
 #include "util.h"
 
 // https://github.com/arduino/ArduinoCore-API/issues/51#issuecomment-69873889
@@ -55,4 +56,129 @@ BaseType_t _difference_exceeds_threshold(BaseType_t previous, BaseType_t current
 uint16_t _make_log_response(uint16_t value, uint8_t bits)
 {
     return (uint16_t) (((uint32_t) value * (uint32_t) value) >> bits);
+}
+/**
+ * @brief Integer square root (floor) by the bitwise method; avoids pulling in floating point
+ * for speed-profile calculations done every tick.
+ */
+uint32_t _isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/**
+ * @brief How long a move of distance takes with a trapezoidal velocity profile that starts
+ * and ends at rest (triangular if the distance is too short to reach speed).
+ *
+ * @param distance in any unit (steps, microseconds of pulse width...)
+ * @param speed maximum speed in units per second
+ * @param acceleration in units per second per second
+ * @return uint32_t milliseconds
+ */
+uint32_t _trapezoid_duration_ms(uint32_t distance, uint32_t speed, uint32_t acceleration)
+{
+    if (0 == distance || 0 == speed || 0 == acceleration)
+    {
+        return 0;
+    }
+    if ((uint64_t)speed * speed >= (uint64_t)distance * acceleration)
+    {
+        // never reaches speed: t = 2 * sqrt(d / a)
+        return 2 * _isqrt((uint32_t)((uint64_t)distance * 1000000 / acceleration));
+    }
+    return (uint32_t)((uint64_t)distance * 1000 / speed + (uint64_t)speed * 1000 / acceleration);
+}
+
+/**
+ * @brief Inverse of _trapezoid_duration_ms: the top speed that makes a move of distance take duration_ms.
+ * Solves d/v + v/a = t for the smaller root; if the move cannot be done that quickly, returns the
+ * peak speed of the fastest (triangular) profile.
+ *
+ * @return uint32_t units per second
+ */
+uint32_t _trapezoid_speed_for_duration(uint32_t distance, uint32_t duration_ms, uint32_t acceleration)
+{
+    // with h = a*t/2, v = h - sqrt(h^2 - a*d), computed as a*d / (h + sqrt(h^2 - a*d)) to avoid cancellation
+    uint64_t half_at = (uint64_t)acceleration * duration_ms / 2000;
+    uint64_t ad = (uint64_t)acceleration * distance;
+    if (ad > UINT32_MAX)
+    {
+        ad = UINT32_MAX;
+    }
+    if (half_at * half_at <= ad)
+    {
+        return _isqrt((uint32_t)ad);
+    }
+    uint64_t discriminant = half_at * half_at - ad;
+    int shift = 0;
+    while (discriminant > UINT32_MAX)
+    {
+        discriminant >>= 2;
+        shift++;
+    }
+    uint64_t root = (uint64_t)_isqrt((uint32_t)discriminant) << shift;
+    return (uint32_t)(ad / (half_at + root));
+}
+
+// sin of 0..1/4 turn in 64 steps, in thousandths
+static const int16_t _sin_permil_table[65] = {
+    0, 25, 49, 74, 98, 122, 147, 171, 195, 219, 243, 267, 290,
+    314, 337, 360, 383, 405, 428, 450, 471, 493, 514, 535, 556, 576,
+    596, 615, 634, 653, 672, 690, 707, 724, 741, 757, 773, 788, 803,
+    818, 831, 845, 858, 870, 882, 893, 904, 914, 924, 933, 942, 950,
+    957, 964, 970, 976, 981, 985, 989, 992, 995, 997, 999, 1000, 1000,
+};
+
+/**
+ * @brief Table sine with linear interpolation (error well under 1 permil); avoids floating point
+ *
+ * @param angle in _ANGLE_TURN units per turn; any value, wraps
+ * @return int32_t -1000..1000
+ */
+int32_t _sin_permil(int32_t angle)
+{
+    angle &= _ANGLE_TURN - 1;
+    int32_t sign = 1;
+    if (angle >= _ANGLE_TURN / 2)
+    {
+        angle -= _ANGLE_TURN / 2;
+        sign = -1;
+    }
+    if (angle > _ANGLE_TURN / 4)
+    {
+        angle = _ANGLE_TURN / 2 - angle;
+    }
+    // _ANGLE_TURN / 4 = 256 angle units across 64 table steps
+    int index = angle >> 2;
+    int fraction = angle & 3;
+    int32_t value = _sin_permil_table[index];
+    if (fraction)
+    {
+        value += ((_sin_permil_table[index + 1] - value) * fraction + 2) >> 2;
+    }
+    return sign * value;
+}
+
+int32_t _cos_permil(int32_t angle)
+{
+    return _sin_permil(angle + _ANGLE_TURN / 4);
 }
\ No newline at end of file
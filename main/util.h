@@ -22,3 +22,10 @@ BaseType_t _map(BaseType_t x, BaseType_t in_min, BaseType_t in_max, BaseType_t o
 BaseType_t _constrain(BaseType_t x, BaseType_t min, BaseType_t max);
 BaseType_t _difference_exceeds_threshold(BaseType_t previous, BaseType_t current, BaseType_t threshold);
 uint16_t _make_log_response(uint16_t value, uint8_t bits);
+uint32_t _isqrt(uint32_t value);
+uint32_t _trapezoid_duration_ms(uint32_t distance, uint32_t speed, uint32_t acceleration);
+uint32_t _trapezoid_speed_for_duration(uint32_t distance, uint32_t duration_ms, uint32_t acceleration);
+// angles for _sin_permil/_cos_permil; must be a power of two
+#define _ANGLE_TURN 1024
+int32_t _sin_permil(int32_t angle);
+int32_t _cos_permil(int32_t angle);
@@ -0,0 +1,255 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "vibration.h"
+#ifdef LS_VIBRATION_ENABLE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "i2c.h"
+#include "stepper.h"
+#include "util.h"
+#include "debug.h"
+
+// Goertzel coefficients (2cos w) carry this many fraction bits
+#define _LS_VIBRATION_COEFFICIENT_BITS 14
+// each block moves a band's estimate 1/8 of the way to what it measured
+#define _LS_VIBRATION_BAND_SHIFT 3
+// the wear estimate moves 1/64 of the way per block
+#define _LS_VIBRATION_WEAR_SHIFT 6
+#define _LS_VIBRATION_FIFO_BATCH_MAX 32
+#define _LS_VIBRATION_TONES 3
+#define _LS_VIBRATION_SPEED_RANGE (LS_STEPPER_STEPS_PER_SECOND_MAX - LS_STEPPER_STEPS_PER_SECOND_MIN + 1)
+
+static ls_accel_mg_t _ls_vibration_block[LS_VIBRATION_BLOCK_SAMPLES];
+static int16_t _ls_vibration_ac[3][LS_VIBRATION_BLOCK_SAMPLES];
+static size_t _ls_vibration_block_count = 0;
+static int _ls_vibration_block_rate = 0;
+// per speed band, step-tone amplitude in mg << _LS_VIBRATION_BAND_SHIFT; negative until measured
+static int32_t _ls_vibration_band_tone[LS_VIBRATION_BANDS];
+// mg << _LS_VIBRATION_WEAR_SHIFT; negative until measured
+static int32_t _ls_vibration_wear_rms = -1;
+static bool _ls_vibration_wear_reported = false;
+static uint32_t _ls_vibration_stall_count = 0;
+
+static int _ls_vibration_band(int steps_per_second)
+{
+    return _constrain((steps_per_second - LS_STEPPER_STEPS_PER_SECOND_MIN) * LS_VIBRATION_BANDS / _LS_VIBRATION_SPEED_RANGE,
+                      0, LS_VIBRATION_BANDS - 1);
+}
+
+static int _ls_vibration_band_center(int band)
+{
+    return LS_STEPPER_STEPS_PER_SECOND_MIN + (2 * band + 1) * _LS_VIBRATION_SPEED_RANGE / (2 * LS_VIBRATION_BANDS);
+}
+
+static bool _ls_vibration_band_is_resonant(int band)
+{
+    return _ls_vibration_band_tone[band] >= (LS_VIBRATION_RESONANCE_MG << _LS_VIBRATION_BAND_SHIFT);
+}
+
+/**
+ * @brief power of one DC-free axis at the frequency whose 2cos w is coefficient
+ */
+static int64_t _ls_vibration_goertzel(const int16_t *ac, int32_t coefficient)
+{
+    int64_t s1 = 0, s2 = 0;
+    for (int i = 0; i < LS_VIBRATION_BLOCK_SAMPLES; i++)
+    {
+        int64_t s0 = ac[i] + ((coefficient * s1) >> _LS_VIBRATION_COEFFICIENT_BITS) - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return s1 * s1 + s2 * s2 - (((coefficient * s1) >> _LS_VIBRATION_COEFFICIENT_BITS) * s2);
+}
+
+static void _ls_vibration_analyse_block(int steps_per_second)
+{
+    // remove gravity and any other DC so it cannot leak into the low bins
+    int64_t sum_squares = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int32_t sum = 0;
+        for (int i = 0; i < LS_VIBRATION_BLOCK_SAMPLES; i++)
+        {
+            const ls_accel_mg_t *sample = &_ls_vibration_block[i];
+            sum += 0 == axis ? sample->x : 1 == axis ? sample->y : sample->z;
+        }
+        int16_t mean = sum / LS_VIBRATION_BLOCK_SAMPLES;
+        for (int i = 0; i < LS_VIBRATION_BLOCK_SAMPLES; i++)
+        {
+            const ls_accel_mg_t *sample = &_ls_vibration_block[i];
+            int16_t ac = (0 == axis ? sample->x : 1 == axis ? sample->y : sample->z) - mean;
+            _ls_vibration_ac[axis][i] = ac;
+            sum_squares += (int32_t)ac * ac;
+        }
+    }
+    uint32_t rms_mg = _isqrt((uint32_t)(sum_squares / LS_VIBRATION_BLOCK_SAMPLES));
+
+    // electrical cycle (4 full steps), full step, and its second harmonic
+    static const int divisors[_LS_VIBRATION_TONES] = {LS_STEPPER_MICROSTEPS_PER_STEP * 4, LS_STEPPER_MICROSTEPS_PER_STEP, LS_STEPPER_MICROSTEPS_PER_STEP / 2};
+    int64_t tone_power = 0;
+    for (int t = 0; t < _LS_VIBRATION_TONES; t++)
+    {
+        int hz_x1000 = steps_per_second * 1000 / divisors[t];
+        if (hz_x1000 >= LS_VIBRATION_ODR_HZ * 1000 / 2)
+        {
+            continue; // above Nyquist
+        }
+        int32_t coefficient = (int32_t)lroundf(2.0f * cosf(2.0f * (float)M_PI * hz_x1000 / (LS_VIBRATION_ODR_HZ * 1000.0f)) *
+                                               (1 << _LS_VIBRATION_COEFFICIENT_BITS));
+        for (int axis = 0; axis < 3; axis++)
+        {
+            tone_power += _ls_vibration_goertzel(_ls_vibration_ac[axis], coefficient);
+        }
+    }
+    // a sinusoid of amplitude A in the bin has power (N A / 2)^2
+    int64_t tone_squared = tone_power * 4 / ((int64_t)LS_VIBRATION_BLOCK_SAMPLES * LS_VIBRATION_BLOCK_SAMPLES);
+    uint32_t tone_mg = _isqrt(tone_squared > UINT32_MAX ? UINT32_MAX : (uint32_t)tone_squared);
+
+    int band = _ls_vibration_band(steps_per_second);
+    if (_ls_vibration_band_tone[band] < 0)
+    {
+        _ls_vibration_band_tone[band] = tone_mg << _LS_VIBRATION_BAND_SHIFT;
+    }
+    else
+    {
+        _ls_vibration_band_tone[band] += (int32_t)tone_mg - (_ls_vibration_band_tone[band] >> _LS_VIBRATION_BAND_SHIFT);
+    }
+
+    if (rms_mg >= LS_VIBRATION_STALL_RMS_MG && tone_mg < LS_VIBRATION_STALL_TONE_MG)
+    {
+        _ls_vibration_stall_count++;
+#ifdef LSDEBUG_VIBRATION
+        ls_debug_printf("Vibration: likely stall at %d steps/s (rms %u mg, tone %u mg)\n", steps_per_second, rms_mg, tone_mg);
+#endif
+    }
+
+    if (_ls_vibration_wear_rms < 0)
+    {
+        _ls_vibration_wear_rms = rms_mg << _LS_VIBRATION_WEAR_SHIFT;
+    }
+    else
+    {
+        _ls_vibration_wear_rms += (int32_t)rms_mg - (_ls_vibration_wear_rms >> _LS_VIBRATION_WEAR_SHIFT);
+    }
+    if (!_ls_vibration_wear_reported && ls_vibration_get_wear_rms_mg() >= LS_VIBRATION_WEAR_RMS_MG)
+    {
+        printf("Vibration while moving has risen to %u mg; check the bearings.\n", ls_vibration_get_wear_rms_mg());
+        _ls_vibration_wear_reported = true;
+    }
+#ifdef LSDEBUG_VIBRATION
+    ls_debug_printf("Vibration at %d steps/s: rms %u mg, tone %u mg, band %d estimate %d mg%s\n", steps_per_second, rms_mg, tone_mg,
+                    band, _ls_vibration_band_tone[band] >> _LS_VIBRATION_BAND_SHIFT, _ls_vibration_band_is_resonant(band) ? " (resonant)" : "");
+#endif
+}
+
+static void _ls_vibration_add_sample(const ls_accel_mg_t *sample, int steps_per_second)
+{
+    // only blocks recorded at one steady step rate are meaningful
+    if (0 == _ls_vibration_block_count || abs(steps_per_second - _ls_vibration_block_rate) > LS_VIBRATION_RATE_TOLERANCE)
+    {
+        _ls_vibration_block_count = 0;
+        _ls_vibration_block_rate = steps_per_second;
+    }
+    _ls_vibration_block[_ls_vibration_block_count++] = *sample;
+    if (LS_VIBRATION_BLOCK_SAMPLES == _ls_vibration_block_count)
+    {
+        if (_ls_vibration_block_rate > 0)
+        {
+            _ls_vibration_analyse_block(_ls_vibration_block_rate);
+        }
+        _ls_vibration_block_count = 0;
+    }
+}
+
+void ls_vibration_task(void *pvParameter)
+{
+    static ls_accel_mg_t batch[_LS_VIBRATION_FIFO_BATCH_MAX];
+    for (int band = 0; band < LS_VIBRATION_BANDS; band++)
+    {
+        _ls_vibration_band_tone[band] = -1;
+    }
+    const ls_accel_driver_t *driver = ls_i2c_accelerometer_driver();
+    if (NULL == driver || NULL == driver->configure_fifo || ESP_OK != driver->configure_fifo(LS_VIBRATION_ODR_HZ))
+    {
+        printf("Vibration analysis needs an accelerometer with a FIFO; not running.\n");
+        vTaskDelete(NULL);
+        return;
+    }
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1)
+    {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(LS_VIBRATION_BATCH_MS));
+        size_t count = 0;
+        if (ESP_OK != driver->read_fifo(batch, _LS_VIBRATION_FIFO_BATCH_MAX, &count))
+        {
+            continue;
+        }
+        int steps_per_second = ls_stepper_get_steps_per_second();
+        for (size_t i = 0; i < count; i++)
+        {
+            _ls_vibration_add_sample(&batch[i], steps_per_second);
+        }
+    }
+}
+
+uint16_t ls_vibration_get_tone_mg(int steps_per_second)
+{
+    int32_t tone = _ls_vibration_band_tone[_ls_vibration_band(steps_per_second)];
+    return tone < 0 ? 0 : tone >> _LS_VIBRATION_BAND_SHIFT;
+}
+
+bool ls_vibration_is_resonant(int steps_per_second)
+{
+    return _ls_vibration_band_is_resonant(_ls_vibration_band(steps_per_second));
+}
+
+int ls_vibration_avoid_resonance(int steps_per_second)
+{
+    int band = _ls_vibration_band(steps_per_second);
+    if (!_ls_vibration_band_is_resonant(band))
+    {
+        return steps_per_second;
+    }
+    for (int distance = 1; distance < LS_VIBRATION_BANDS; distance++)
+    {
+        if (band - distance >= 0 && !_ls_vibration_band_is_resonant(band - distance))
+        {
+            return _ls_vibration_band_center(band - distance);
+        }
+        if (band + distance < LS_VIBRATION_BANDS && !_ls_vibration_band_is_resonant(band + distance))
+        {
+            return _ls_vibration_band_center(band + distance);
+        }
+    }
+    return steps_per_second;
+}
+
+uint32_t ls_vibration_get_stall_count(void)
+{
+    return _ls_vibration_stall_count;
+}
+
+uint16_t ls_vibration_get_wear_rms_mg(void)
+{
+    return _ls_vibration_wear_rms < 0 ? 0 : _ls_vibration_wear_rms >> _LS_VIBRATION_WEAR_SHIFT;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+    Control software for URI Laser Scarecrow, 2022 Model
+    Copyright (C) 2022-2023 David H. Brown
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "config.h"
+
+/**
+ * Mechanical health from the accelerometer: streams its FIFO, measures the vibration at the
+ * stepper's electrical, full-step and double full-step frequencies with fixed-point Goertzel
+ * filters, and keeps a resonance estimate per speed band. Everything compiles away unless
+ * LS_VIBRATION_ENABLE is defined in config.h.
+ */
+#ifdef LS_VIBRATION_ENABLE
+#include "freertos/FreeRTOS.h"
+
+void ls_vibration_task(void *pvParameter);
+
+/**
+ * @brief filtered step-tone amplitude measured around this step rate
+ *
+ * @return milli-g, or 0 if the band has not been measured yet
+ */
+uint16_t ls_vibration_get_tone_mg(int steps_per_second);
+bool ls_vibration_is_resonant(int steps_per_second);
+/**
+ * @brief the nearest step rate (preferring slower) whose band is not known to resonate
+ *
+ * @return steps_per_second itself if its band is fine or no alternative is
+ */
+int ls_vibration_avoid_resonance(int steps_per_second);
+
+/**
+ * @brief blocks that showed broadband vibration without the step tone, as a skipping motor does
+ */
+uint32_t ls_vibration_get_stall_count(void);
+/**
+ * @brief long-term vibration while moving; rises as bearings wear
+ */
+uint16_t ls_vibration_get_wear_rms_mg(void);
+
+#endif